@@ -3,6 +3,8 @@
 // C stdlib
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>   // snprintf (str_is_int)
+#include <string.h>  // memcmp (str_is_int), memcpy (murmur64)
 
 // C++ stdlib
 #include <string>
@@ -30,6 +32,37 @@ inline uint64_t string_hash(const uint8_t *data, size_t len){
     return base;
 }
 
+// MurmurHash64A, for sketches that need 64 well-mixed bits where string_hash only has 32
+inline uint64_t murmur64(const uint8_t *data, size_t len, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t k;
+        memcpy(&k, data + i, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    switch (len & 7) {
+    case 7: h ^= (uint64_t)data[i + 6] << 48; [[fallthrough]];
+    case 6: h ^= (uint64_t)data[i + 5] << 40; [[fallthrough]];
+    case 5: h ^= (uint64_t)data[i + 4] << 32; [[fallthrough]];
+    case 4: h ^= (uint64_t)data[i + 3] << 24; [[fallthrough]];
+    case 3: h ^= (uint64_t)data[i + 2] << 16; [[fallthrough]];
+    case 2: h ^= (uint64_t)data[i + 1] << 8; [[fallthrough]];
+    case 1: h ^= (uint64_t)data[i]; h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
 // Convert string to double
 inline bool str2dbl(const std::string &s, double &out) {
     char *endp = NULL;
@@ -42,4 +75,28 @@ inline bool str2int(const std::string &s, int64_t &out) {
     char *endp = NULL;
     out = strtoll(s.c_str(), &endp, 10);
     return endp == s.c_str() + s.size();
-}
\ No newline at end of file
+}
+
+// Strict integer: the string must print back byte for byte (no sign, spaces or zeros added, no overflow)
+inline bool str_is_int(const std::string &s, int64_t &out) {
+    char buf[32];
+    if (s.empty() || s.size() >= sizeof(buf) || !str2int(s, out)) { return false; }
+    int len = snprintf(buf, sizeof(buf), "%lld", (long long)out);
+    return (size_t)len == s.size() && memcmp(buf, s.data(), s.size()) == 0;
+}
+
+/**
+ * Byte range [start, end] of a string of `len` bytes, negative indexes count from the end.
+ * Returns false if the range is empty.
+ */
+inline bool byte_range(int64_t start, int64_t end, size_t len, size_t *from, size_t *to) {
+    int64_t n = (int64_t)len;
+    if (start < 0) { start += n; }
+    if (end < 0) { end += n; }
+    if (start < 0) { start = 0; }
+    if (end >= n) { end = n - 1; }
+    if (n == 0 || end < 0 || start > end) { return false; }
+    *from = (size_t)start;
+    *to = (size_t)end + 1;
+    return true;
+}
@@ -22,5 +22,65 @@ const uint64_t k_idle_timeout_ms = 15 * 1000; // 15 seconds
 const uint64_t k_read_timeout_ms = 10 * 1000; // 10 seconds
 const uint64_t k_write_timeout_ms = 10 * 1000; // 10 seconds
 
+// With I/O threads, a poll() round is split across them once each gets this many ready connections
+const size_t k_io_thread_min_conns = 2;
+
 // Constant for the maximum work in a single timer loop
-const size_t k_max_works = 2000;
\ No newline at end of file
+const size_t k_max_works = 2000;
+
+// Sorted sets larger than this are indexed by the B+-tree instead of the AVL tree
+// (0 puts every set on the B+-tree, SIZE_MAX keeps every set on the AVL tree)
+const size_t k_zset_btree_threshold = 4096;
+
+// Sorted sets stay in the packed encoding while they have at most this many members,
+// each with a name of at most this many bytes
+const size_t k_zset_pack_max_len = 64;
+const size_t k_zset_pack_max_name = 64;
+
+// Set algebra over at least this many input members is split across the thread pool
+const size_t k_zset_merge_parallel_min = 1 << 16;
+
+// Hashes stay in the packed encoding while they have at most this many fields,
+// each field and value of at most this many bytes
+const size_t k_hash_pack_max_len = 64;
+const size_t k_hash_pack_max_value = 64;
+
+// Bytes of item data in one quicklist chunk (larger items get a chunk of their own)
+const size_t k_qlist_chunk_size = 4096 - 64;
+
+// Sets of integers are kept sorted as a chain of intsets of at most this many members each,
+// which keeps the tail shifted by one insert within 128 KB (8-byte members)
+const uint32_t k_set_intset_chunk_len = 1 << 14;
+
+// Largest string SETBIT grows a bitmap to (offsets up to 2^32 bits)
+const size_t k_bitmap_max_bytes = 512u << 20;
+
+// Largest string APPEND/SETRANGE grow a value to
+const size_t k_str_max_bytes = 512u << 20;
+
+// HyperLogLogs keep their non-zero registers sparse up to this many (4 bytes each, 12 KB dense)
+const size_t k_hll_sparse_max_len = 768;
+
+// Bloom filters created by BF.ADD/BF.MADD without BF.RESERVE
+const double k_bloom_default_error = 0.01;
+const uint64_t k_bloom_default_capacity = 100;
+const uint64_t k_bloom_max_capacity = 1ull << 30;
+// Largest total size of a filter's layers, BF.RESERVE and growth past it are refused
+const size_t k_bloom_max_bytes = 1u << 30;
+
+// Top-k sketches created by TOPK.ADD without TOPK.RESERVE; rows are k * k_topk_width_per_k counters wide
+const uint32_t k_topk_default_k = 10;
+const uint32_t k_topk_width_per_k = 8;
+const uint32_t k_topk_default_depth = 4;
+const double k_topk_default_decay = 0.9;
+const uint64_t k_topk_max_k = 1u << 16;
+const uint64_t k_topk_max_counters = 1ull << 24;   // width * depth, 8 bytes each
+
+// Nesting limit of a JSON document, keeps parsing and serializing within a bounded stack
+const uint32_t k_json_max_depth = 128;
+
+// Bytes of a stream block; XTRIM frees whole blocks, a larger entry gets a block of its own
+const size_t k_stream_block_size = 4096 - 64;
+
+// Bytes of compressed samples in a time series chunk, retention drops whole chunks
+const size_t k_ts_chunk_size = 4096 - 64;
@@ -53,4 +53,11 @@ static uint64_t get_monotonic_msec() {
 // Get the current time in milliseconds
 uint64_t get_current_time_ms() {
     return get_monotonic_msec();
+}
+
+// Get the wall-clock time in milliseconds since the Unix epoch (may jump, unlike the above)
+uint64_t get_wall_time_ms() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_REALTIME, &tv);
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_nsec / 1000 / 1000;
 }
\ No newline at end of file
@@ -8,4 +8,5 @@ void msg(const char *msg);
 void msg_error(const char *msg);
 [[noreturn]] void die(const char *msg);
 void fd_set_nb(int fd);
-uint64_t get_current_time_ms();
\ No newline at end of file
+uint64_t get_current_time_ms();
+uint64_t get_wall_time_ms();    // Unix time, for IDs that leave the server
\ No newline at end of file
@@ -1,6 +1,7 @@
 // C stdlib
 #include <stdio.h>   // fprintf
 #include <stdint.h>
+#include <assert.h>  // assert
 
 // local
 #include "sys_server.h"
@@ -10,6 +11,7 @@
 #include "../storage/commands.h" // server_data, Entry
 #include "../net/netio.h"      // Connection, handle_destroy
 #include "../storage/heap.h"   // heap_delete
+#include "../net/blocking.h"   // block_process_timeouts
 
 static bool hnode_same(HNode *node, HNode *key) {
     return node == key;
@@ -31,6 +33,21 @@ int32_t next_timer_ms() {
         next_ms = server_data.heap[0].val;
     }
 
+    // Earliest member deadline of any sorted set
+    if (!server_data.zset_heap.empty() && server_data.zset_heap[0].val < next_ms) {
+        next_ms = server_data.zset_heap[0].val;
+    }
+
+    // Oldest chunk to drop from a time series
+    if (!server_data.ts_heap.empty() && server_data.ts_heap[0].val < next_ms) {
+        next_ms = server_data.ts_heap[0].val;
+    }
+
+    // Timeouts of connections parked by BZPOPMIN/BZPOPMAX
+    if (!server_data.block_heap.empty() && server_data.block_heap[0].val < next_ms) {
+        next_ms = server_data.block_heap[0].val;
+    }
+
     // If there is no next expiration time, return -1
     if (next_ms == (uint64_t)-1) { return -1; }
 
@@ -58,6 +75,9 @@ void process_timers() {
         handle_destroy(conn); // close the connection
     }
 
+    // Blocked command timeouts
+    block_process_timeouts(now_ms);
+
     // Key TTL timers (min-heap by expiration)
     size_t num_works = 0;
     while (!server_data.heap.empty() && server_data.heap[0].val <= now_ms) {
@@ -85,4 +105,27 @@ void process_timers() {
         entry_del(entry);
         if (++num_works >= k_max_works) { break; } // Don't stall the server if too many entries need to be deleted at once
     }
+
+    // Sorted set member deadlines, earliest set first, sharing the same work budget
+    while (num_works < k_max_works && !server_data.zset_heap.empty() && server_data.zset_heap[0].val <= now_ms) {
+        ZSet *zset = container_of(server_data.zset_heap[0].ref, ZSet, expiry_idx);
+        num_works += zset_expire(zset, now_ms, k_max_works - num_works);
+        if (zset_len(zset) > 0) { continue; }
+
+        // A set emptied by expiry goes away like an expired key
+        Entry *entry = container_of(zset, Entry, zset);
+        HNode *node = hm_delete(&server_data.db, &entry->node, &hnode_same);
+        assert(node == &entry->node);
+        entry_del(entry);
+    }
+
+    // Time series retention, whole chunks at a time; an emptied series keeps its key.
+    // Samples are in Unix time, a series the wall clock has not caught up with is rescheduled.
+    uint64_t wall_ms = get_wall_time_ms();
+    while (num_works < k_max_works && !server_data.ts_heap.empty() && server_data.ts_heap[0].val <= now_ms) {
+        TimeSeries *ts = container_of(server_data.ts_heap[0].ref, TimeSeries, expiry_idx);
+        size_t dropped = ts_expire(ts, wall_ms, k_max_works - num_works);
+        if (dropped == 0) { break; }
+        num_works += dropped;
+    }
 }
\ No newline at end of file
@@ -1,23 +1,128 @@
 #include <assert.h>
+#include <errno.h>          // errno
+#include <unistd.h>         // read, write, close
+#include <sys/eventfd.h>    // eventfd
 #include "thread_pool.h"
 
 
+// Worker index of the calling thread in `tls_pool`, -1 outside of it
+static thread_local TheadPool *tls_pool = NULL;
+static thread_local int64_t tls_worker = -1;
+
+/** ------------------------------------------------------------
+ *    Work-stealing deque (Chase-Lev, after Le et al. 2013, with the fences folded into
+ *    the seq_cst accesses so sanitizers can follow them)
+ * ------------------------------------------------------------
+ */
+
+static bool deque_push(WorkDeque *dq, Work *w) {
+    int64_t b = dq->bottom.load(std::memory_order_relaxed);
+    int64_t t = dq->top.load(std::memory_order_acquire);
+    if (b - t >= (int64_t)k_work_deque_cap) { return false; }
+    dq->ring[(size_t)b & (k_work_deque_cap - 1)].store(w, std::memory_order_relaxed);
+    dq->bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+// Owner only, newest first
+static Work *deque_pop(WorkDeque *dq) {
+    int64_t b = dq->bottom.load(std::memory_order_relaxed) - 1;
+    dq->bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = dq->top.load(std::memory_order_seq_cst);
+    if (t > b) {
+        // empty
+        dq->bottom.store(b + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+    Work *w = dq->ring[(size_t)b & (k_work_deque_cap - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // the last one, race the thieves for it
+        if (!dq->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) { w = NULL; }
+        dq->bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return w;
+}
+
+// Any thread, oldest first; NULL when empty or when another thread won the race
+static Work *deque_steal(WorkDeque *dq) {
+    int64_t t = dq->top.load(std::memory_order_seq_cst);
+    int64_t b = dq->bottom.load(std::memory_order_seq_cst);
+    if (t >= b) { return NULL; }
+    Work *w = dq->ring[(size_t)t & (k_work_deque_cap - 1)].load(std::memory_order_relaxed);
+    if (!dq->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) { return NULL; }
+    return w;
+}
+
+/** ------------------------------------------------------------
+ *    Workers
+ * ------------------------------------------------------------
+ */
+
+static WorkDeque *pool_deque(TheadPool *tp, size_t group, uint8_t prio) {
+    return tp->deques[group * WORK_PRIO_COUNT + prio];
+}
+
+// Run the work, then hand it to the event loop or free it
+static void work_run(TheadPool *tp, Work *w) {
+    w->f(w->arg);
+    if (w->done) {
+        Work *head = tp->done_head.load(std::memory_order_relaxed);
+        do { w->next_done = head; }
+        while (!tp->done_head.compare_exchange_weak(head, w, std::memory_order_release, std::memory_order_relaxed));
+        // The stack was empty, so the event loop may be asleep
+        if (!head) {
+            uint64_t one = 1;
+            ssize_t rv = write(tp->event_fd, &one, sizeof(one));
+            (void)rv;   // the counter only saturates, nothing to do on failure
+        }
+    }
+    else if (w->owned) { delete w; }
+}
+
+// Highest priority work for worker `self`: its own deque, the submit deque, then the others
+static Work *pool_take(TheadPool *tp, size_t self) {
+    size_t nthreads = tp->threads.size();
+    for (uint8_t prio = 0; prio < WORK_PRIO_COUNT; ++prio) {
+        Work *w = deque_pop(pool_deque(tp, self, prio));
+        if (!w) { w = deque_steal(pool_deque(tp, nthreads, prio)); }
+        for (size_t i = 1; !w && i < nthreads; ++i) { w = deque_steal(pool_deque(tp, (self + i) % nthreads, prio)); }
+        if (w) {
+            tp->queued.fetch_sub(1, std::memory_order_relaxed);
+            return w;
+        }
+    }
+    return NULL;
+}
+
+struct WorkerArg {
+    TheadPool *tp = NULL;
+    size_t self = 0;
+};
+
 static void *worker(void *arg) {
-    TheadPool *tp = (TheadPool *)arg;
+    WorkerArg wa = *(WorkerArg *)arg;
+    delete (WorkerArg *)arg;
+    TheadPool *tp = wa.tp;
+    tls_pool = tp;
+    tls_worker = (int64_t)wa.self;
+
     while (true) {
+        Work *w = pool_take(tp, wa.self);
+        if (w) {
+            work_run(tp, w);
+            continue;
+        }
+
+        // A steal can lose a race while work is still queued, only sleep when there is none
         pthread_mutex_lock(&tp->mu);
-        // wait for the condition: a non-empty queue
-        while (tp->queue.empty()) {
+        tp->sleeping.fetch_add(1);
+        while (tp->queued.load() <= 0 && !tp->stopping.load()) {
             pthread_cond_wait(&tp->not_empty, &tp->mu);
         }
-
-        // got the job
-        Work w = tp->queue.front();
-        tp->queue.pop_front();
+        tp->sleeping.fetch_sub(1);
+        bool quit = tp->stopping.load() && tp->queued.load() <= 0;
         pthread_mutex_unlock(&tp->mu);
-
-        // do the work
-        w.f(w.arg);
+        if (quit) { break; }
     }
     return NULL;
 }
@@ -27,19 +132,134 @@ void thread_pool_init(TheadPool *tp, size_t num_threads) {
 
     int rv = pthread_mutex_init(&tp->mu, NULL);
     assert(rv == 0);
+    rv = pthread_mutex_init(&tp->submit_mu, NULL);
+    assert(rv == 0);
     rv = pthread_cond_init(&tp->not_empty, NULL);
     assert(rv == 0);
+    tp->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(tp->event_fd >= 0);
+
+    tp->deques.resize((num_threads + 1) * WORK_PRIO_COUNT);
+    for (WorkDeque *&dq : tp->deques) { dq = new WorkDeque(); }
 
     tp->threads.resize(num_threads);
     for (size_t i = 0; i < num_threads; ++i) {
-        int rv = pthread_create(&tp->threads[i], NULL, &worker, tp);
+        WorkerArg *wa = new WorkerArg();
+        wa->tp = tp;
+        wa->self = i;
+        int rv = pthread_create(&tp->threads[i], NULL, &worker, wa);
         assert(rv == 0);
     }
 }
 
-void thread_pool_queue(TheadPool *tp, void (*f)(void *), void *arg) {
+void thread_pool_submit(TheadPool *tp, Work *work) {
+    assert(work->prio < WORK_PRIO_COUNT && !tp->stopping.load());
+
+    // A worker pushes to its own deque, everyone else to the shared one
+    bool pushed = false;
+    if (tls_pool == tp) {
+        pushed = deque_push(pool_deque(tp, (size_t)tls_worker, work->prio), work);
+    }
+    else {
+        pthread_mutex_lock(&tp->submit_mu);
+        pushed = deque_push(pool_deque(tp, tp->threads.size(), work->prio), work);
+        pthread_mutex_unlock(&tp->submit_mu);
+    }
+    if (!pushed) {
+        // Full: run it here, which also slows the submitter down
+        work_run(tp, work);
+        return;
+    }
+
+    tp->queued.fetch_add(1);
+    if (tp->sleeping.load() > 0) {
+        pthread_mutex_lock(&tp->mu);
+        pthread_cond_signal(&tp->not_empty);
+        pthread_mutex_unlock(&tp->mu);
+    }
+}
+
+void thread_pool_queue(TheadPool *tp, void (*f)(void *), void *arg, uint8_t prio) {
+    Work *w = new Work();
+    w->f = f;
+    w->arg = arg;
+    w->prio = prio;
+    w->owned = true;
+    thread_pool_submit(tp, w);
+}
+
+size_t thread_pool_complete(TheadPool *tp) {
+    // Reset the eventfd before taking the stack, a push after this signals again
+    uint64_t count = 0;
+    while (read(tp->event_fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+
+    Work *list = tp->done_head.exchange(NULL, std::memory_order_acquire);
+    // The stack is newest first, run the callbacks in completion order
+    Work *ordered = NULL;
+    while (list) {
+        Work *next = list->next_done;
+        list->next_done = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    size_t n = 0;
+    while (ordered) {
+        Work *w = ordered;
+        ordered = w->next_done;
+        bool owned = w->owned;
+        w->done(w->arg);
+        if (owned) { delete w; }
+        n++;
+    }
+    return n;
+}
+
+void thread_pool_stop(TheadPool *tp) {
     pthread_mutex_lock(&tp->mu);
-    tp->queue.push_back(Work {f, arg});
-    pthread_cond_signal(&tp->not_empty);
+    tp->stopping.store(true);
+    pthread_cond_broadcast(&tp->not_empty);
     pthread_mutex_unlock(&tp->mu);
-}
\ No newline at end of file
+
+    // Workers leave once nothing is queued
+    for (pthread_t &thread : tp->threads) {
+        int rv = pthread_join(thread, NULL);
+        assert(rv == 0);
+    }
+    tp->threads.clear();
+    thread_pool_complete(tp);
+
+    for (WorkDeque *dq : tp->deques) { delete dq; }
+    tp->deques.clear();
+    close(tp->event_fd);
+    tp->event_fd = -1;
+    pthread_mutex_destroy(&tp->mu);
+    pthread_mutex_destroy(&tp->submit_mu);
+    pthread_cond_destroy(&tp->not_empty);
+}
+
+void latch_init(Latch *latch, size_t count) {
+    latch->pending = count;
+    int rv = pthread_mutex_init(&latch->mu, NULL);
+    assert(rv == 0);
+    rv = pthread_cond_init(&latch->done, NULL);
+    assert(rv == 0);
+}
+
+void latch_count_down(Latch *latch) {
+    pthread_mutex_lock(&latch->mu);
+    assert(latch->pending > 0);
+    if (--latch->pending == 0) { pthread_cond_broadcast(&latch->done); }
+    pthread_mutex_unlock(&latch->mu);
+}
+
+void latch_wait(Latch *latch) {
+    pthread_mutex_lock(&latch->mu);
+    while (latch->pending > 0) {
+        pthread_cond_wait(&latch->done, &latch->mu);
+    }
+    pthread_mutex_unlock(&latch->mu);
+
+    pthread_mutex_destroy(&latch->mu);
+    pthread_cond_destroy(&latch->done);
+}
@@ -1,22 +1,80 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <atomic>
 #include <vector>
-#include <deque>
 
+// Priorities of queued work, workers drain higher ones first
+enum WorkPrio : uint8_t {
+    WORK_PRIO_HIGH   = 0,   // someone is waiting on it, e.g. a parallel merge
+    WORK_PRIO_NORMAL = 1,
+    WORK_PRIO_LOW    = 2,   // background cleanup, e.g. freeing large values
+    WORK_PRIO_COUNT  = 3,
+};
+
+// Slots of one work deque, a full deque makes the submitter run the work itself
+const size_t k_work_deque_cap = 1024;
 
+/**
+ * A unit of work. `f(arg)` runs on a worker; if `done` is set, `done(arg)` then runs on the
+ * event loop thread from `thread_pool_complete`, which is how results are handed back.
+ * Submitted work belongs to the caller until `done` runs (work from `thread_pool_queue` is
+ * owned by the pool and freed after it ran).
+ */
 struct Work {
     void (*f)(void *) = NULL;
     void *arg = NULL;
+    void (*done)(void *) = NULL;
+    uint8_t prio = WORK_PRIO_NORMAL;
+    bool owned = false;         // allocated by thread_pool_queue
+    Work *next_done = NULL;     // link in the completion stack
 };
 
+/**
+ * Chase-Lev work-stealing deque of fixed capacity: the owner pushes and pops at the bottom
+ * without locks, other threads steal from the top with a CAS.
+ */
+struct WorkDeque {
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Work *> ring[k_work_deque_cap];
+};
+
+/**
+ * Work-stealing pool. Each worker owns a deque per priority for work it submits itself; work
+ * from other threads (the event loop) goes to the shared submit deques, whose pushes are
+ * serialized by `submit_mu`. An idle worker takes the highest priority it finds: its own
+ * deque, then the submit deque, then the other workers' deques. Finished work with a `done`
+ * callback is pushed on a lock-free stack and `event_fd` is signalled for the event loop.
+ */
 struct TheadPool {
     std::vector<pthread_t> threads;
-    std::deque<Work> queue;
-    pthread_mutex_t mu;
+    std::vector<WorkDeque *> deques;    // (threads + 1) * WORK_PRIO_COUNT, the last group is the submit deques
+    pthread_mutex_t submit_mu;
+    std::atomic<int64_t> queued{0};     // work in the deques, workers sleep when it is 0
+    std::atomic<uint32_t> sleeping{0};
+    std::atomic<bool> stopping{false};
+    pthread_mutex_t mu;                 // parks idle workers
     pthread_cond_t not_empty;
+    std::atomic<Work *> done_head{NULL};
+    int event_fd = -1;                  // readable when finished work waits for thread_pool_complete
+};
+
+// Countdown latch, lets the caller wait for a batch of queued work
+struct Latch {
+    size_t pending = 0;
+    pthread_mutex_t mu;
+    pthread_cond_t done;
 };
 
 void thread_pool_init(TheadPool *tp, size_t num_threads);
-void thread_pool_queue(TheadPool *tp, void (*f)(void *), void *arg);
\ No newline at end of file
+void thread_pool_queue(TheadPool *tp, void (*f)(void *), void *arg, uint8_t prio = WORK_PRIO_NORMAL);
+void thread_pool_submit(TheadPool *tp, Work *work);
+size_t thread_pool_complete(TheadPool *tp);     // runs the `done` callbacks of finished work
+void thread_pool_stop(TheadPool *tp);           // finishes the queued work and joins the workers
+
+void latch_init(Latch *latch, size_t count);
+void latch_count_down(Latch *latch);
+void latch_wait(Latch *latch);      // blocks until the count reaches zero, then releases the latch
@@ -0,0 +1,168 @@
+// C stdlib
+#include <assert.h>      // assert
+#include <math.h>        // isfinite
+#include <stdint.h>      // INT64_MAX, UINT64_MAX
+
+// local
+#include "blocking.h"
+#include "netio.h"               // Connection, response_begin, response_end
+#include "serialize.h"           // out_err, out_nil
+#include "../core/common.h"      // container_of, string_hash, str2dbl
+#include "../core/sys.h"         // get_current_time_ms
+#include "../storage/commands.h" // server_data
+#include "../storage/heap.h"     // heap_upsert, heap_delete
+#include "../storage/sorted_set.h" // zset_pop_reply
+
+// A key with parked connections, entries of `server_data.blocked_keys`
+struct BlockedKey {
+    HNode node;
+    std::string key;
+    DList waiters;      // BlockWaiter FIFO
+};
+
+static bool bkey_equals(HNode *node, HNode *key) {
+    BlockedKey *bkey = container_of(node, BlockedKey, node);
+    LookupKey *lkey = container_of(key, LookupKey, node);
+    return bkey->key == lkey->key;
+}
+
+static bool hnode_same(HNode *node, HNode *key) {
+    return node == key;
+}
+
+// Find the waiter list of a key, optionally creating it
+static BlockedKey *bkey_lookup(const std::string &key, bool create) {
+    LookupKey lkey;
+    lkey.key = key;
+    lkey.node.hash_code = string_hash((uint8_t *)key.data(), key.size());
+
+    HNode *node = hm_lookup(&server_data.blocked_keys, &lkey.node, &bkey_equals);
+    if (node) { return container_of(node, BlockedKey, node); }
+    if (!create) { return NULL; }
+
+    BlockedKey *bkey = new BlockedKey();
+    bkey->key = key;
+    bkey->node.hash_code = lkey.node.hash_code;
+    dlist_init(&bkey->waiters);
+    hm_insert(&server_data.blocked_keys, &bkey->node);
+    return bkey;
+}
+
+// The reply is queued, switch the connection to writing
+static void block_wake(Connection *conn) {
+    conn->want_read = false;
+    conn->want_write = true;
+}
+
+/**
+ * Command: BZPOPMIN|BZPOPMAX <key> [<key> ...] <timeout seconds>
+ * Pop from the first key holding members, otherwise wait for one; a timeout of 0 waits forever.
+ */
+bool block_run_request(Connection *conn, std::vector<std::string> &cmd, Buffer &resp) {
+    bool max = cmd[0] == "bzpopmax";
+    double timeout_s = 0;
+    if (!str2dbl(cmd.back(), timeout_s) || !isfinite(timeout_s) || timeout_s < 0) {
+        out_err(resp, ERR_BAD_ARG, "expect timeout");
+        return false;
+    }
+
+    // Serve right away if any key has members
+    for (size_t i = 1; i + 1 < cmd.size(); ++i) {
+        int rv = zset_pop_reply(cmd[i], max, resp);
+        if (rv < 0) { out_err(resp, ERR_BAD_TYP, "expect zset"); }
+        if (rv != 0) { return false; }
+    }
+
+    // Park on every key
+    conn->blocked = true;
+    conn->block_max = max;
+    for (size_t i = 1; i + 1 < cmd.size(); ++i) {
+        BlockWaiter *waiter = new BlockWaiter();
+        waiter->conn = conn;
+        waiter->bkey = bkey_lookup(cmd[i], true);
+        dlist_insert_before(&waiter->bkey->waiters, &waiter->node);
+        conn->block_waiters.push_back(waiter);
+    }
+    // A deadline past the clock's range waits forever, like 0
+    uint64_t now_ms = get_current_time_ms();
+    double timeout_ms = timeout_s * 1000;
+    if (timeout_s > 0 && timeout_ms < (double)INT64_MAX && (uint64_t)timeout_ms < UINT64_MAX - now_ms) {
+        HeapItem item = { now_ms + (uint64_t)timeout_ms, &conn->block_heap_idx };
+        heap_upsert(server_data.block_heap, conn->block_heap_idx, item);
+    }
+
+    // A parked connection is not idle, it leaves the idle timer until released
+    dlist_detach(&conn->idle_node);
+    dlist_init(&conn->idle_node);
+    return true;
+}
+
+void block_signal_key(const std::string &key) {
+    if (hm_size(&server_data.blocked_keys) == 0) { return; }    // nobody is waiting, the common case
+    if (bkey_lookup(key, false)) { server_data.ready_keys.push_back(key); }
+}
+
+void block_serve_ready() {
+    while (!server_data.ready_keys.empty()) {
+        std::string key;
+        key.swap(server_data.ready_keys.back());
+        server_data.ready_keys.pop_back();
+
+        // The key's list is freed with its last waiter, which ends the loop
+        while (BlockedKey *bkey = bkey_lookup(key, false)) {
+            Connection *conn = container_of(bkey->waiters.next, BlockWaiter, node)->conn;
+
+            size_t header = 0;
+            response_begin(conn->outgoing, &header);
+            if (zset_pop_reply(key, conn->block_max, conn->outgoing) <= 0) {
+                conn->outgoing.resize(header);  // drained, or no longer a zset
+                break;
+            }
+            response_end(conn->outgoing, header);
+
+            block_release(conn);
+            block_wake(conn);
+        }
+    }
+}
+
+void block_release(Connection *conn) {
+    if (!conn->blocked) { return; }
+
+    for (BlockWaiter *waiter : conn->block_waiters) {
+        BlockedKey *bkey = waiter->bkey;
+        dlist_detach(&waiter->node);
+        if (dlist_empty(&bkey->waiters)) {
+            HNode *node = hm_delete(&server_data.blocked_keys, &bkey->node, &hnode_same);
+            assert(node == &bkey->node);
+            delete bkey;
+        }
+        delete waiter;
+    }
+    conn->block_waiters.clear();
+
+    if (conn->block_heap_idx != (size_t)-1) {
+        heap_delete(server_data.block_heap, conn->block_heap_idx);
+        conn->block_heap_idx = (size_t)-1;
+    }
+    conn->blocked = false;
+
+    // Back on the idle timer
+    conn->last_activity_ms = get_current_time_ms();
+    dlist_detach(&conn->idle_node);
+    dlist_insert_before(&server_data.idle_conn_list, &conn->idle_node);
+}
+
+void block_process_timeouts(uint64_t now_ms) {
+    while (!server_data.block_heap.empty() && server_data.block_heap[0].val <= now_ms) {
+        Connection *conn = container_of(server_data.block_heap[0].ref, Connection, block_heap_idx);
+
+        size_t header = 0;
+        response_begin(conn->outgoing, &header);
+        out_nil(conn->outgoing);
+        response_end(conn->outgoing, header);
+
+        block_release(conn);
+        block_wake(conn);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// C stdlib
+#include <stdint.h> // uint64_t
+
+// C++ stdlib
+#include <string>   // std::string (keys)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "../core/buffer_io.h"  // Buffer
+#include "../storage/list.h"    // DList
+
+struct Connection;
+struct BlockedKey;
+
+/**
+ * One parked connection waiting on one key. The key keeps its waiters in a FIFO,
+ * so the connection that blocked first is served first.
+ */
+struct BlockWaiter {
+    DList node;                 // link in the key's waiter list
+    Connection *conn = NULL;
+    BlockedKey *bkey = NULL;
+};
+
+// BZPOPMIN/BZPOPMAX: replies into `resp` right away, or parks `conn` and returns true
+bool block_run_request(Connection *conn, std::vector<std::string> &cmd, Buffer &resp);
+
+// A write may have made `key` poppable, its waiters are served by block_serve_ready()
+void block_signal_key(const std::string &key);
+
+// Hand members of the signalled keys to their waiters, oldest first
+void block_serve_ready();
+
+// Unlink a parked connection from its keys and the timeout heap
+void block_release(Connection *conn);
+
+// Reply nil to parked connections whose timeout has passed
+void block_process_timeouts(uint64_t now_ms);
@@ -17,9 +17,10 @@
 #include "../core/sys.h"        // msg_error
 #include "../core/buffer_io.h"  // Buffer, append_buffer, consume_buffer
 #include "../net/serialize.h"   // out_err, append_buffer_u32
+#include "blocking.h"           // block_run_request, block_serve_ready, block_release
 
 // Begin the response
-static void response_begin(Buffer &out, size_t *header) {
+void response_begin(Buffer &out, size_t *header) {
     *header = out.size();       // messege header position
     append_buffer_u32(out, 0);     // reserve space
 }
@@ -30,7 +31,7 @@ static size_t response_size(Buffer &out, size_t header) {
 }
 
 // End the response
-static void response_end(Buffer &out, size_t header) {
+void response_end(Buffer &out, size_t header) {
     size_t msg_size = response_size(out, header);
     if (msg_size > k_max_msg) {
         out.resize(header + 4);
@@ -42,52 +43,152 @@ static void response_end(Buffer &out, size_t header) {
     memcpy(&out[header], &len, 4);
 }
 
+// Requests parsed ahead by an I/O thread that have not run yet
+static bool has_parsed(Connection *conn) {
+    return conn->parsed_next < conn->parsed.size();
+}
+
 // Process one request when there is enough data
 bool handle_one_request(Connection *conn) {
-    // try to parse the protocol: message header
-    if (conn->incoming.size() < 4) { return false; } // we don't even know the size of the message
+    // A parked connection keeps its pipelined requests until it is released
+    if (conn->blocked) { return false; }
 
-    uint32_t frame_len = 0;
-    memcpy(&frame_len, conn->incoming.data(), 4);
-    if (frame_len > k_max_msg) {
-        msg_error("too long");
-        conn->want_close = true;
-        return false;
+    std::vector<std::string> cmd;
+    if (has_parsed(conn)) {
+        // already split and parsed by an I/O thread
+        cmd.swap(conn->parsed[conn->parsed_next++]);
+        if (!has_parsed(conn)) {
+            conn->parsed.clear();
+            conn->parsed_next = 0;
+        }
     }
-    
-    // Get the message payload
-    if (4 + frame_len > conn->incoming.size()) { return false; } // size of the payload is incorrect
-    const uint8_t *request = conn->incoming.data() + 4;
+    else {
+        // try to parse the protocol: message header
+        if (conn->incoming.size() < 4) { return false; } // we don't even know the size of the message
 
-    // Parse the request and apply application logic
-    std::vector<std::string> cmd;
-    if (parse_request(request, frame_len, cmd) < 0) {
-        // Malformed request: respond with an error instead of closing the connection
-        size_t header = 0;
-        response_begin(conn->outgoing, &header);
-        out_err(conn->outgoing, ERR_BAD_ARG, "malformed request");
-        response_end(conn->outgoing, header);
+        uint32_t frame_len = 0;
+        memcpy(&frame_len, conn->incoming.data(), 4);
+        if (frame_len > k_max_msg) {
+            msg_error("too long");
+            conn->want_close = true;
+            return false;
+        }
+
+        // Get the message payload
+        if (4 + frame_len > conn->incoming.size()) { return false; } // size of the payload is incorrect
+        const uint8_t *request = conn->incoming.data() + 4;
+
+        // Parse the request, the arguments are copied out so the frame can go right away
+        int32_t rv = parse_request(request, frame_len, cmd);
         consume_buffer(conn->incoming, 4 + frame_len);
-        return true;
+        if (rv < 0) {
+            // Malformed request: respond with an error instead of closing the connection
+            size_t header = 0;
+            response_begin(conn->outgoing, &header);
+            out_err(conn->outgoing, ERR_BAD_ARG, "malformed request");
+            response_end(conn->outgoing, header);
+            return true;
+        }
     }
 
     // Begin the response
     size_t header = 0;
     response_begin(conn->outgoing, &header);
 
-    // Run the request
-    run_request(cmd, conn->outgoing);
+    // Run the request, blocking commands need the connection and may park it without a reply
+    bool parked = false;
+    if (cmd.size() >= 3 && (cmd[0] == "bzpopmin" || cmd[0] == "bzpopmax")) {
+        parked = block_run_request(conn, cmd, conn->outgoing);
+    }
+    else {
+        run_request(cmd, conn->outgoing);
+    }
 
     // End the response
-    response_end(conn->outgoing, header);
+    if (parked) { conn->outgoing.resize(header); }
+    else { response_end(conn->outgoing, header); }
+
+    // The request may have fed keys that parked connections wait on
+    block_serve_ready();
+    return !parked;
+}
+
+// Run every complete request in the incoming buffer, then switch to writing if there are replies
+static void run_requests(Connection *conn) {
+    // parse the request and generate response, in a while loop as there may be multiple requests in the buffer
+    while (handle_one_request(conn)) {}
+
+    // update the readiness flag
+    if (!conn->outgoing.empty()) { // if there is outgoing data, we want to write
+        conn->want_read = false;
+        conn->want_write = true;
+    }
+}
+
+// Run the requests, then start sending the replies
+static void handle_requests(Connection *conn) {
+    run_requests(conn);
 
-    // Consume the incoming data
-    consume_buffer(conn->incoming, 4 + frame_len);
+    // The socket is likely ready to write in a request-response protocol,
+    // try to write it without waiting for the next iteration.
+    if (conn->want_write) { return handle_write(conn); }
+}
+
+/**
+ * Socket side of reading: append what the socket has to `incoming`, false if nothing was read.
+ * Touches nothing but the connection, so I/O threads may call it.
+ */
+static bool conn_read(Connection *conn) {
+    // read the request [4b header + payload]
+    uint8_t buf[64 * 1024]; // 64KB buffer
+    ssize_t rv = read(conn->socket_fd, buf, sizeof(buf));
+    if (rv < 0) {
+        if (errno == EAGAIN) { return false; } // actually not ready
+
+        // handle IO errors
+        msg_error("read() error");
+        conn->want_close = true;
+        return false; // want to close the connection
+    }
+
+    // Handle EOF, closing as we are done with the connection
+    if (rv == 0) {
+        if (conn->incoming.empty() && !has_parsed(conn)) { msg("[server] client closed connection"); }
+        else { msg("unexpected EOF"); }
+        conn->want_close = true;
+        return false;
+    }
+
+    // append the incoming data to the buffer
+    append_buffer(conn->incoming, buf, (size_t)rv);
     return true;
 }
 
-// Application callback when the socket is writable
-void handle_write(Connection *conn) {
+/**
+ * Split the complete frames off `incoming` and parse them into `parsed`. Stops at the first
+ * frame that is partial, too long or malformed; handle_one_request deals with that one.
+ * Touches nothing but the connection, so I/O threads may call it.
+ */
+static void parse_ahead(Connection *conn) {
+    size_t pos = 0;
+    while (conn->incoming.size() - pos >= 4) {
+        uint32_t frame_len = 0;
+        memcpy(&frame_len, &conn->incoming[pos], 4);
+        if (frame_len > k_max_msg || pos + 4 + frame_len > conn->incoming.size()) { break; }
+
+        std::vector<std::string> cmd;
+        if (parse_request(&conn->incoming[pos + 4], frame_len, cmd) < 0) { break; }
+        conn->parsed.push_back(std::move(cmd));
+        pos += 4 + frame_len;
+    }
+    consume_buffer(conn->incoming, pos);
+}
+
+/**
+ * Socket side of writing: send as much of `outgoing` as the socket takes.
+ * Touches nothing but the connection, so I/O threads may call it.
+ */
+static void conn_write(Connection *conn) {
     assert(!conn->outgoing.empty()); // check if there is any outgoing data
 
     // write the response to the socket, outgoing[0] is the pointer to the buffer
@@ -102,14 +203,26 @@ void handle_write(Connection *conn) {
 
     // remove the written data from the outgoing buffer
     consume_buffer(conn->outgoing, (size_t)rv);
+}
 
+// Everything was sent: go back to reading, and run what waited behind a blocking command
+static void write_done(Connection *conn) {
     // update the readiness flag
     if (conn->outgoing.size() == 0) { // if there is no outgoing data, we want to read
         conn->want_read = true;
         conn->want_write = false;
+
+        // Requests pipelined behind a blocking command are still waiting in the buffer
+        if (!conn->incoming.empty() || has_parsed(conn)) { handle_requests(conn); }
     }
 }
 
+// Application callback when the socket is writable
+void handle_write(Connection *conn) {
+    conn_write(conn);
+    if (!conn->want_close) { write_done(conn); }
+}
+
 /**
  * Application callback when the socket is readable
  * Read the request and parse it
@@ -117,45 +230,87 @@ void handle_write(Connection *conn) {
  * Write the response to the socket
 */
 void handle_read(Connection *conn) {
-    // read the request [4b header + payload]
-    uint8_t buf[64 * 1024]; // 64KB buffer
-    ssize_t rv = read(conn->socket_fd, buf, sizeof(buf));
-    if (rv < 0) {
-        if (errno == EAGAIN) { return; } // actually not ready
+    if (conn_read(conn)) { handle_requests(conn); }
+}
 
-        // handle IO errors
-        msg_error("read() error");
-        conn->want_close = true;
-        return; // want to close the connection
+/** ------------------------------------------------------------
+ *    Threaded I/O
+ * ------------------------------------------------------------
+ */
+
+// One slice of the ready connections, read or written by one thread
+struct IoTask {
+    Connection *const *conns = NULL;
+    size_t n = 0;
+    bool write = false;
+    Latch *latch = NULL;
+};
+
+static void io_task_run(IoTask *task) {
+    for (size_t i = 0; i < task->n; ++i) {
+        Connection *conn = task->conns[i];
+        if (task->write) { conn_write(conn); }
+        else if (conn_read(conn)) { parse_ahead(conn); }
     }
+}
 
-    // Handle EOF, closing as we are done with the connection
-    if (rv == 0) {
-        if (conn->incoming.empty()) { msg("[server] client closed connection"); }
-        else { msg("unexpected EOF"); }
-        conn->want_close = true;
-        return;
+// Thread pool entry point
+static void io_worker(void *arg) {
+    IoTask *task = (IoTask *)arg;
+    io_task_run(task);
+    latch_count_down(task->latch);
+}
+
+// Read or write every connection, split into contiguous slices, the caller takes the first one
+static void io_parallel(TheadPool *io_pool, std::vector<Connection *> &conns, bool write) {
+    if (conns.empty()) { return; }
+
+    size_t parts = 1;
+    size_t threads = io_pool->threads.size() + 1;
+    if (conns.size() >= k_io_thread_min_conns * threads) { parts = threads; }
+
+    std::vector<IoTask> tasks(parts);
+    Latch latch;
+    latch_init(&latch, parts - 1);
+    for (size_t p = 0; p < parts; ++p) {
+        size_t begin = conns.size() * p / parts;
+        size_t end = conns.size() * (p + 1) / parts;
+        tasks[p].conns = conns.data() + begin;
+        tasks[p].n = end - begin;
+        tasks[p].write = write;
+        tasks[p].latch = &latch;
     }
-    
-    // append the incoming data to the buffer
-    append_buffer(conn->incoming, buf, (size_t)rv);
 
-    // parse the request and generate response, in a while loop as there may be multiple requests in the buffer
-    while (handle_one_request(conn)) {}
+    for (size_t p = 1; p < parts; ++p) { thread_pool_queue(io_pool, &io_worker, &tasks[p], WORK_PRIO_HIGH); }
+    io_task_run(&tasks[0]);
+    latch_wait(&latch);
+}
 
-    // update the readiness flag
-    if (!conn->outgoing.empty()) { // if there is outgoing data, we want to write
-        conn->want_read = false;
-        conn->want_write = true;
+/**
+ * One round of poll() results with I/O threads. Reading and parsing, then writing, are spread
+ * over the I/O threads, each connection handled by a single thread in each phase; the requests
+ * run on this thread in between, connection by connection, so the data needs no locks and the
+ * replies keep the request order.
+ */
+void handle_io_batch(TheadPool *io_pool, std::vector<Connection *> &reads, std::vector<Connection *> &writes) {
+    io_parallel(io_pool, reads, false);
+
+    // The commands, serially; a connection with replies joins the writers
+    for (Connection *conn : reads) {
+        if (conn->want_close) { continue; }
+        run_requests(conn);
+        if (conn->want_write) { writes.push_back(conn); }
+    }
 
-        // The socket is likely ready to write in a request-response protocol,
-        // try to write it without waiting for the next iteration.
-        return handle_write(conn);
+    io_parallel(io_pool, writes, true);
+    for (Connection *conn : writes) {
+        if (!conn->want_close) { write_done(conn); }
     }
 }
 
 // Close the socket and remove the connection from the map and the idle list
 void handle_destroy(Connection *conn) {
+    block_release(conn);
     (void)close(conn->socket_fd);
     server_data.fd2conn[conn->socket_fd] = NULL;
     dlist_detach(&conn->idle_node);
@@ -13,7 +13,9 @@
 
 // local
 #include "../storage/list.h" // DList
+#include "../core/buffer_io.h" // Buffer
 #include "../core/sys.h" // get_current_time_ms
+#include "../core/thread_pool.h" // TheadPool
 
 struct Connection {
     int socket_fd = -1; // listening/accepted socket fd, by default set to -1
@@ -27,18 +29,36 @@ struct Connection {
     std::vector<uint8_t> incoming; // data to be parsed by the application
     std::vector<uint8_t> outgoing; // responses generated by the application
 
+    // requests parsed ahead by an I/O thread, run in order before anything left in `incoming`
+    std::vector<std::vector<std::string>> parsed;
+    size_t parsed_next = 0;
+
     // timer to track the last activity of the connection
     uint64_t last_activity_ms = 0;
     DList idle_node; // node to store the connection in the idle list
+
+    // parked by BZPOPMIN/BZPOPMAX, requests are not processed until released
+    bool blocked = false;
+    bool block_max = false;                         // pop the highest score once woken
+    std::vector<struct BlockWaiter *> block_waiters; // one per key it waits on
+    size_t block_heap_idx = (size_t)-1;             // index in the block timeout heap
 };
 
 struct Response; // from protocol.h
 
+// Response framing: reserve the length header, then fill it in once the body is written
+void response_begin(Buffer &out, size_t *header);
+void response_end(Buffer &out, size_t header);
+
 bool handle_one_request(Connection *conn);
 void handle_read(Connection *conn);
 void handle_write(Connection *conn);
 void handle_destroy(Connection *conn);
 
+// Threaded I/O: `reads` are read and parsed on `io_pool`, their requests run here in order,
+// then their replies and the pending ones of `writes` are written on `io_pool`
+void handle_io_batch(TheadPool *io_pool, std::vector<Connection *> &reads, std::vector<Connection *> &writes);
+
 // Client-side netio helpers
 /**
  * Read exactly n bytes from the file descriptor
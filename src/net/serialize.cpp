@@ -1,4 +1,5 @@
 // C stdlib
+#include <assert.h>  // assert
 #include <stdint.h>  // int32_t
 #include <stddef.h>  // size_t
 #include <string.h>  // memcpy
@@ -51,4 +52,14 @@ void out_arr(Buffer &out, uint32_t n) {
 void out_map(Buffer &out, uint32_t n) {
     append_buffer_u8(out, TAG_MAP);
     append_buffer_u32(out, n);
+}
+
+size_t out_begin_arr(Buffer &out) {
+    out_arr(out, 0);    // filled in by out_end_arr
+    return out.size() - 4;
+}
+
+void out_end_arr(Buffer &out, size_t ctx, uint32_t n) {
+    assert(out[ctx - 1] == TAG_ARR);
+    memcpy(&out[ctx], &n, 4);
 }
\ No newline at end of file
@@ -37,4 +37,9 @@ void out_int(Buffer &out, int64_t val);
 void out_dbl(Buffer &out, double val);
 void out_bool(Buffer &out, bool val);
 void out_arr(Buffer &out, uint32_t n);
-void out_map(Buffer &out, uint32_t n);
\ No newline at end of file
+void out_map(Buffer &out, uint32_t n);
+
+// Array whose length is only known once its elements are out: begin returns the position of
+// the header, end patches the length in
+size_t out_begin_arr(Buffer &out);
+void out_end_arr(Buffer &out, size_t ctx, uint32_t n);
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <errno.h>       // errno
 #include <stdint.h>      // uint8_t, uint32_t
 #include <stdio.h>       // printf
+#include <stdlib.h>      // strtoul
 #include <string.h>      // memcpy
 
 // POSIX / system (socket API, inet helpers, read/write, poll)
@@ -13,6 +14,7 @@
 #include <netinet/in.h>  // sockaddr_in
 #include <sys/socket.h>  // socket, bind, listen, accept, setsockopt
 #include <poll.h>        // poll, struct pollfd
+#include <signal.h>      // sigaction, SIGINT, SIGTERM
 
 // C++ stdlib
 #include <vector>        // std::vector
@@ -22,7 +24,43 @@
 #include "core/sys_server.h" // next_timer_ms, process_timers
 #include "net/netio.h" // Connection, handle_read, handle_write
 #include "storage/commands.h" // server_data
-#include "core/thread_pool.h" // thread_pool_init
+#include "core/thread_pool.h" // thread_pool_init, thread_pool_complete, thread_pool_stop
+
+
+// Set by SIGINT/SIGTERM, the event loop exits and shuts down in order
+static volatile sig_atomic_t g_stop = 0;
+// The thread pool's eventfd, the handler signals it so a signal between the flag check and
+// poll() still wakes the loop
+static volatile sig_atomic_t g_wake_fd = -1;
+
+static void handle_stop_signal(int) {
+    g_stop = 1;
+    int saved_errno = errno;
+    uint64_t one = 1;
+    if (g_wake_fd >= 0) {
+        ssize_t rv = write(g_wake_fd, &one, sizeof(one)); // async-signal-safe
+        (void)rv;
+    }
+    errno = saved_errno;
+}
+
+// Readers and writers for threaded I/O, set with --io-threads N (N counts the main thread)
+static TheadPool g_io_pool;
+static size_t g_io_threads = 1;
+
+// Parse the command line, false on anything unknown
+static bool parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--io-threads") && i + 1 < argc) {
+            char *end = NULL;
+            unsigned long n = strtoul(argv[++i], &end, 10);
+            if (*end || n < 1 || n > 64) { return false; }
+            g_io_threads = (size_t)n;
+        }
+        else { return false; }
+    }
+    return true;
+}
 
 
 // Handle the client connection
@@ -75,16 +113,38 @@ static int32_t handle_accept(int listen_fd) {
  * - Handles readable and writable events for each client socket.
  * - Cleans up connections on error or when marked for closure.
  * 
- * This function runs an infinite event loop and only exits on fatal error.
+ * With `--io-threads N`, N - 1 extra threads help read, parse and write the ready sockets while
+ * the commands still run one at a time on the main thread.
+ * 
+ * The event loop runs until SIGINT/SIGTERM, then the thread pool finishes its queued work and
+ * the connections are closed.
  * 
  * Return 0 on successful execution.
 */
-int main() {
+int main(int argc, char **argv) {
+    if (!parse_args(argc, argv)) {
+        fprintf(stderr, "usage: %s [--io-threads N]\n", argv[0]);
+        return 1;
+    }
 
     // initialize the connection timeout list
     dlist_init(&server_data.idle_conn_list);
-    // initialize thread pool for heavy deletes
+    // initialize thread pool for heavy deletes and parallel merges
     thread_pool_init(&server_data.thread_pool, 4);
+    // and the I/O threads, the main thread is one of them
+    if (g_io_threads > 1) {
+        thread_pool_init(&g_io_pool, g_io_threads - 1);
+        fprintf(stderr, "[server] %zu I/O threads\n", g_io_threads);
+    }
+
+    // stop on SIGINT/SIGTERM; the handler also signals the polled eventfd, so a signal that
+    // lands after the `while (!g_stop)` check still ends the next poll() instead of being lost
+    g_wake_fd = server_data.thread_pool.event_fd;
+    struct sigaction sa = {};
+    sa.sa_handler = &handle_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
     // the listening socket
     int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -115,14 +175,19 @@ int main() {
 
     // the event loop
     std::vector<struct pollfd> poll_args;
-    while (true) {
+    std::vector<Connection *> io_reads, io_writes;
+    while (!g_stop) {
         // prepare the arguments for the poll()
         poll_args.clear();
 
         // put the listening socket into the poll_args in the first position
-    struct pollfd pfd = {listen_fd, POLLIN, 0};
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
         poll_args.push_back(pfd);
 
+        // then the thread pool's eventfd, readable when finished work has results to hand back
+        struct pollfd done_pfd = {server_data.thread_pool.event_fd, POLLIN, 0};
+        poll_args.push_back(done_pfd);
+
         // the rest are the connection sockets
         for (Connection *conn : server_data.fd2conn) {
             if (!conn) { continue; }
@@ -148,27 +213,63 @@ int main() {
             handle_accept(listen_fd);
         }
 
+        // run the completion callbacks of the offloaded work on this thread
+        if (poll_args[1].revents) {
+            thread_pool_complete(&server_data.thread_pool);
+        }
+
         // handle the client connections sockets
-        for (size_t i = 1; i < poll_args.size(); i++) { // skipping the first, as we put it there
+        io_reads.clear();
+        io_writes.clear();
+        for (size_t i = 2; i < poll_args.size(); i++) { // skipping the listening socket and the eventfd
             uint32_t ready = poll_args[i].revents;
             if (ready == 0) { continue; }
 
             // get the connection from the server_data map
             Connection *conn = server_data.fd2conn[poll_args[i].fd];
             
-            // Update the Idle timer and the list
-            conn->last_activity_ms = get_current_time_ms();
-            dlist_detach(&conn->idle_node);
-            dlist_insert_before(&server_data.idle_conn_list, &conn->idle_node);
-            
+            // Update the Idle timer and the list, parked connections are off the idle timer
+            if (!conn->blocked) {
+                conn->last_activity_ms = get_current_time_ms();
+                dlist_detach(&conn->idle_node);
+                dlist_insert_before(&server_data.idle_conn_list, &conn->idle_node);
+            }
+
+            // With I/O threads the sockets are handled together below
+            if (g_io_threads > 1) {
+                if ((ready & POLLIN) && conn->want_read)  { io_reads.push_back(conn); }
+                if ((ready & POLLOUT) && conn->want_write) { io_writes.push_back(conn); }
+                continue;
+            }
+
             // Handle the read, write, and error events
             if ((ready & POLLIN) && conn->want_read)  { handle_read(conn); }
             if ((ready & POLLOUT) && conn->want_write) { handle_write(conn); }
             if ((ready & POLLERR) || conn->want_close) { handle_destroy(conn); }
         }
+
+        if (g_io_threads > 1) {
+            handle_io_batch(&g_io_pool, io_reads, io_writes);
+            for (size_t i = 2; i < poll_args.size(); i++) {
+                uint32_t ready = poll_args[i].revents;
+                if (ready == 0) { continue; }
+                Connection *conn = server_data.fd2conn[poll_args[i].fd];
+                if ((ready & POLLERR) || conn->want_close) { handle_destroy(conn); }
+            }
+        }
         // for each connection socket
         process_timers();
     }
     // for event loop
+
+    // orderly shutdown: finish the offloaded work, then drop the connections
+    msg("[server] shutting down");
+    g_wake_fd = -1; // the eventfd is closed below
+    thread_pool_stop(&server_data.thread_pool);
+    if (g_io_threads > 1) { thread_pool_stop(&g_io_pool); }
+    for (Connection *conn : server_data.fd2conn) {
+        if (conn) { handle_destroy(conn); }
+    }
+    close(listen_fd);
     return 0;
 }
\ No newline at end of file
@@ -207,6 +207,43 @@ AVLNode *avl_offset(AVLNode *node, int32_t offset) {
     return node;
 }
 
+/**
+ * Rank of the node in sorted order (0-based), O(log N).
+ * Everything in the left subtree is smaller; walking up, each time we come
+ * from a right child the parent and its left subtree are smaller as well.
+ */
+int64_t avl_rank(AVLNode *node) {
+    if (node == NULL) { return -1; }
+
+    int64_t rank = avl_cnt(node->left);
+    for (AVLNode *parent = node->parent; parent; node = parent, parent = parent->parent) {
+        if (parent->right == node) { rank += avl_cnt(parent->left) + 1; }
+    }
+    return rank;
+}
+
+/**
+ * Build a perfectly balanced tree from nodes already in sorted order, O(N).
+ * The middle node of each range becomes the subtree root, so sibling heights
+ * differ by at most 1 and no rotations are needed.
+ */
+static AVLNode *avl_build_range(AVLNode **nodes, size_t lo, size_t hi, AVLNode *parent) {
+    if (lo >= hi) { return NULL; }
+
+    size_t mid = lo + (hi - lo) / 2;
+    AVLNode *node = nodes[mid];
+    node->parent = parent;
+    node->left = avl_build_range(nodes, lo, mid, node);
+    node->right = avl_build_range(nodes, mid + 1, hi, node);
+    avl_update_stats(node);
+    return node;
+}
+
+// Returns the root of the tree built from `n` sorted nodes
+AVLNode *avl_build(AVLNode **nodes, size_t n) {
+    return avl_build_range(nodes, 0, n, NULL);
+}
+
 // Insert a node into the AVL tree
 void avl_search_and_insert(AVLNode **root, AVLNode *new_node, bool (*less)(AVLNode *, AVLNode *)) {
     // Find the correct position to insert the new node
@@ -0,0 +1,197 @@
+// C stdlib
+#include <string.h>  // memcpy, memset
+#include <strings.h> // strcasecmp
+
+// C++ stdlib
+#include <string>    // std::string (values)
+#include <vector>    // std::vector (command args)
+
+// local
+#include "bitmap.h"
+#include "commands.h"            // Entry, TYPE_STR, entry_lookup, entry_insert, entry_str, entry_raw_str, entry_touch
+#include "../core/common.h"      // str2int, byte_range
+#include "../core/constants.h"   // k_bitmap_max_bytes
+#include "../net/serialize.h"    // out_*, ERR_*
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// String entry of a key; `*wrong_type` is set if the key holds another type
+static Entry *expect_str(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_STR;
+    return *wrong_type ? NULL : ent;
+}
+
+// Bit offset argument, within the largest bitmap
+static bool parse_offset(const std::string &arg, uint64_t *offset) {
+    int64_t val = 0;
+    if (!str2int(arg, val) || val < 0 || (uint64_t)val >= (uint64_t)k_bitmap_max_bytes * 8) { return false; }
+    *offset = (uint64_t)val;
+    return true;
+}
+
+/**
+ * Command: SETBIT <key> <offset> <0|1>
+ * Set or clear one bit, the string grows with zero bytes as needed. Replies with the old bit.
+ */
+void bcmd_setbit(std::vector<std::string> &cmd, Buffer &resp) {
+    uint64_t offset = 0;
+    if (!parse_offset(cmd[2], &offset)) { return out_err(resp, ERR_BAD_ARG, "bit offset is not an integer or out of range"); }
+    if (cmd[3] != "0" && cmd[3] != "1") { return out_err(resp, ERR_BAD_ARG, "bit is not an integer or out of range"); }
+
+    Entry *ent = entry_lookup(cmd[1]);
+    if (!ent) { ent = entry_insert(cmd[1], TYPE_STR); }
+    if (ent->type != TYPE_STR) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+
+    std::string &bytes = entry_raw_str(ent);
+    size_t byte = (size_t)(offset >> 3);
+    uint8_t mask = (uint8_t)(0x80 >> (offset & 7));
+    if (byte >= bytes.size()) { bytes.resize(byte + 1, '\0'); }
+
+    uint8_t &cell = (uint8_t &)bytes[byte];
+    int64_t old = (cell & mask) != 0;
+    if (cmd[3] == "1") { cell |= mask; }
+    else { cell &= (uint8_t)~mask; }
+    return out_int(resp, old);
+}
+
+/**
+ * Command: GETBIT <key> <offset>
+ * One bit of a string, 0 past its end.
+ */
+void bcmd_getbit(std::vector<std::string> &cmd, Buffer &resp) {
+    uint64_t offset = 0;
+    if (!parse_offset(cmd[2], &offset)) { return out_err(resp, ERR_BAD_ARG, "bit offset is not an integer or out of range"); }
+
+    bool wrong_type = false;
+    Entry *ent = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if (!ent) { return out_int(resp, 0); }
+
+    char buf[k_num_buf];
+    size_t len = 0;
+    const uint8_t *data = (const uint8_t *)entry_str(ent, buf, &len);
+    size_t byte = (size_t)(offset >> 3);
+    return out_int(resp, byte < len && (data[byte] & (0x80 >> (offset & 7))) != 0);
+}
+
+/**
+ * Command: BITCOUNT <key> [<start> <end>]
+ * Number of set bits, optionally in a byte range.
+ */
+void bcmd_count(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t start = 0, end = -1;
+    if (cmd.size() == 4 && (!str2int(cmd[2], start) || !str2int(cmd[3], end))) {
+        return out_err(resp, ERR_BAD_ARG, "expect int");
+    }
+
+    bool wrong_type = false;
+    Entry *ent = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if (!ent) { return out_int(resp, 0); }
+
+    char buf[k_num_buf];
+    size_t len = 0, from = 0, to = 0;
+    const uint8_t *data = (const uint8_t *)entry_str(ent, buf, &len);
+    if (!byte_range(start, end, len, &from, &to)) { return out_int(resp, 0); }
+    return out_int(resp, (int64_t)bitmap_count(data + from, to - from));
+}
+
+/**
+ * Command: BITPOS <key> <bit> [<start> [<end>]]
+ * Position of the first bit set to `bit`, optionally searching a byte range, -1 if none.
+ * Without an end the string counts as followed by zero bits, so a clear bit is always found.
+ */
+void bcmd_pos(std::vector<std::string> &cmd, Buffer &resp) {
+    if (cmd[2] != "0" && cmd[2] != "1") { return out_err(resp, ERR_BAD_ARG, "the bit argument must be 1 or 0"); }
+    bool bit = cmd[2] == "1";
+    int64_t start = 0, end = -1;
+    if (cmd.size() >= 4 && !str2int(cmd[3], start)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+    if (cmd.size() == 5 && !str2int(cmd[4], end)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+    bool open_end = cmd.size() < 5;
+
+    bool wrong_type = false;
+    Entry *ent = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if (!ent) { return out_int(resp, bit ? -1 : 0); }
+
+    char buf[k_num_buf];
+    size_t len = 0, from = 0, to = 0;
+    const uint8_t *data = (const uint8_t *)entry_str(ent, buf, &len);
+    if (!byte_range(start, end, len, &from, &to)) { return out_int(resp, -1); }
+
+    int64_t pos = bitmap_pos(data + from, to - from, bit);
+    if (pos >= 0) { return out_int(resp, (int64_t)from * 8 + pos); }
+    return out_int(resp, !bit && open_end ? (int64_t)to * 8 : -1);
+}
+
+/**
+ * Command: BITOP <AND|OR|XOR|NOT> <dst> <key> [<key> ...]
+ * Combine bitmaps into `dst`, shorter or missing inputs count as zero bytes; NOT takes one key.
+ * Replies with the length of the result; an empty result deletes `dst`.
+ */
+void bcmd_op(std::vector<std::string> &cmd, Buffer &resp) {
+    const char *name = cmd[1].c_str();
+    BitOp op = BITOP_AND;
+    if (strcasecmp(name, "and") == 0) { op = BITOP_AND; }
+    else if (strcasecmp(name, "or") == 0) { op = BITOP_OR; }
+    else if (strcasecmp(name, "xor") == 0) { op = BITOP_XOR; }
+    else if (strcasecmp(name, "not") == 0) { op = BITOP_NOT; }
+    else { return out_err(resp, ERR_BAD_ARG, "unknown bit operation"); }
+    if (op == BITOP_NOT && cmd.size() != 4) { return out_err(resp, ERR_BAD_ARG, "BITOP NOT takes a single source key"); }
+
+    // Bytes of every source, printed numbers live in `nums`
+    size_t nsrc = cmd.size() - 3;
+    std::vector<std::string> nums(nsrc);
+    std::vector<const uint8_t *> srcs(nsrc, NULL);
+    std::vector<size_t> lens(nsrc, 0);
+    size_t max_len = 0;
+    for (size_t i = 0; i < nsrc; ++i) {
+        bool wrong_type = false;
+        Entry *ent = expect_str(cmd[3 + i], &wrong_type);
+        if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+        if (!ent) { continue; }
+        if (ent->str_enc == STR_ENC_RAW) {
+            srcs[i] = (const uint8_t *)ent->value.data();
+            lens[i] = ent->value.size();
+        }
+        else {
+            char buf[k_num_buf];
+            size_t len = 0;
+            const char *text = entry_str(ent, buf, &len);
+            nums[i].assign(text, len);
+            srcs[i] = (const uint8_t *)nums[i].data();
+            lens[i] = len;
+        }
+        if (lens[i] > max_len) { max_len = lens[i]; }
+    }
+
+    // The first source seeds the result, the others are folded in; AND clears past a short input
+    std::string result(max_len, '\0');
+    uint8_t *dst = (uint8_t *)&result[0];
+    if (op == BITOP_NOT) {
+        bitmap_op(BITOP_NOT, dst, srcs[0], lens[0]);
+    }
+    else {
+        if (lens[0]) { memcpy(dst, srcs[0], lens[0]); }
+        for (size_t i = 1; i < nsrc; ++i) {
+            bitmap_op(op, dst, srcs[i], lens[i]);
+            if (op == BITOP_AND) { memset(dst + lens[i], 0, max_len - lens[i]); }
+        }
+    }
+
+    Entry *ent = entry_lookup(cmd[2]);
+    if (ent && (ent->type != TYPE_STR || max_len == 0)) {
+        entry_erase(ent);   // a value of another type is replaced as a whole
+        ent = NULL;
+    }
+    if (max_len == 0) { return out_int(resp, 0); }
+    if (!ent) { ent = entry_insert(cmd[2], TYPE_STR); }
+    ent->str_enc = STR_ENC_RAW;
+    ent->value.swap(result);
+    entry_touch(ent);
+    return out_int(resp, (int64_t)max_len);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint64_t, int64_t
+
+// C++ stdlib
+#include <string>   // std::string (command args)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "bitmap_kernels.h"     // BitOp, bitmap_count, bitmap_op, bitmap_pos
+#include "../core/buffer_io.h"  // Buffer
+
+// Bitmap command handlers (operate on top-level HMap `db`)
+void bcmd_setbit(std::vector<std::string> &cmd, Buffer &resp);
+void bcmd_getbit(std::vector<std::string> &cmd, Buffer &resp);
+void bcmd_count(std::vector<std::string> &cmd, Buffer &resp);
+void bcmd_op(std::vector<std::string> &cmd, Buffer &resp);
+void bcmd_pos(std::vector<std::string> &cmd, Buffer &resp);
@@ -0,0 +1,216 @@
+// C stdlib
+#include <string.h>  // memcpy
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>  // AVX2 intrinsics (compiled per function with target attributes)
+#define BITMAP_X86 1
+#endif
+
+// local
+#include "bitmap_kernels.h"
+
+/** ------------------------------------------------------------
+ *    Portable kernels
+ * ------------------------------------------------------------
+ */
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store64(uint8_t *p, uint64_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+// Population count without the popcnt instruction
+static inline uint64_t popcount_swar(uint64_t v) {
+    v = v - ((v >> 1) & 0x5555555555555555ull);
+    v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (v * 0x0101010101010101ull) >> 56;
+}
+
+static uint64_t count_scalar(const uint8_t *data, size_t len) {
+    uint64_t total = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) { total += popcount_swar(load64(data + i)); }
+    for (; i < len; ++i) { total += popcount_swar(data[i]); }
+    return total;
+}
+
+template <BitOp OP>
+static void op_scalar_t(uint8_t *dst, const uint8_t *src, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a = load64(dst + i), b = load64(src + i);
+        switch (OP) {
+        case BITOP_AND: store64(dst + i, a & b); break;
+        case BITOP_OR:  store64(dst + i, a | b); break;
+        case BITOP_XOR: store64(dst + i, a ^ b); break;
+        case BITOP_NOT: store64(dst + i, ~b); break;
+        }
+    }
+    for (; i < len; ++i) {
+        switch (OP) {
+        case BITOP_AND: dst[i] &= src[i]; break;
+        case BITOP_OR:  dst[i] |= src[i]; break;
+        case BITOP_XOR: dst[i] ^= src[i]; break;
+        case BITOP_NOT: dst[i] = (uint8_t)~src[i]; break;
+        }
+    }
+}
+
+static void op_scalar(BitOp op, uint8_t *dst, const uint8_t *src, size_t len) {
+    switch (op) {
+    case BITOP_AND: return op_scalar_t<BITOP_AND>(dst, src, len);
+    case BITOP_OR:  return op_scalar_t<BITOP_OR>(dst, src, len);
+    case BITOP_XOR: return op_scalar_t<BITOP_XOR>(dst, src, len);
+    case BITOP_NOT: return op_scalar_t<BITOP_NOT>(dst, src, len);
+    }
+}
+
+// First bit equal to `bit` in data[from, len), byte by byte
+static int64_t pos_bytes(const uint8_t *data, size_t from, size_t len, bool bit) {
+    uint8_t skip = bit ? 0x00 : 0xff;
+    for (size_t i = from; i < len; ++i) {
+        if (data[i] != skip) {
+            unsigned byte = bit ? data[i] : (uint8_t)~data[i];
+            return (int64_t)i * 8 + __builtin_clz(byte) - 24;    // bit 0 is the high bit
+        }
+    }
+    return -1;
+}
+
+static int64_t pos_scalar(const uint8_t *data, size_t len, bool bit) {
+    uint64_t skip = bit ? 0 : ~0ull;
+    size_t i = 0;
+    while (i + 8 <= len && load64(data + i) == skip) { i += 8; }
+    return pos_bytes(data, i, len, bit);
+}
+
+/** ------------------------------------------------------------
+ *    x86 kernels
+ * ------------------------------------------------------------
+ */
+
+#ifdef BITMAP_X86
+
+// Four independent sums keep several popcnt in flight
+__attribute__((target("popcnt")))
+static uint64_t count_popcnt(const uint8_t *data, size_t len) {
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        c0 += __builtin_popcountll(load64(data + i));
+        c1 += __builtin_popcountll(load64(data + i + 8));
+        c2 += __builtin_popcountll(load64(data + i + 16));
+        c3 += __builtin_popcountll(load64(data + i + 24));
+    }
+    for (; i + 8 <= len; i += 8) { c0 += __builtin_popcountll(load64(data + i)); }
+    for (; i < len; ++i) { c0 += __builtin_popcount(data[i]); }
+    return c0 + c1 + c2 + c3;
+}
+
+/**
+ * Nibble lookup: the bit count of each half byte comes from a 16-entry table in a register,
+ * the byte counts of a 32-byte block are summed into four 64-bit lanes with vpsadbw.
+ */
+__attribute__((target("avx2")))
+static uint64_t count_avx2(const uint8_t *data, size_t len) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i acc = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i lo = _mm256_and_si256(v, low);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+        __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(table, lo), _mm256_shuffle_epi8(table, hi));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + count_scalar(data + i, len - i);
+}
+
+template <BitOp OP>
+__attribute__((target("avx2")))
+static void op_avx2_t(uint8_t *dst, const uint8_t *src, size_t len) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+        switch (OP) {
+        case BITOP_AND: a = _mm256_and_si256(a, b); break;
+        case BITOP_OR:  a = _mm256_or_si256(a, b); break;
+        case BITOP_XOR: a = _mm256_xor_si256(a, b); break;
+        case BITOP_NOT: a = _mm256_xor_si256(b, ones); break;
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+    }
+    op_scalar_t<OP>(dst + i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void op_avx2(BitOp op, uint8_t *dst, const uint8_t *src, size_t len) {
+    switch (op) {
+    case BITOP_AND: return op_avx2_t<BITOP_AND>(dst, src, len);
+    case BITOP_OR:  return op_avx2_t<BITOP_OR>(dst, src, len);
+    case BITOP_XOR: return op_avx2_t<BITOP_XOR>(dst, src, len);
+    case BITOP_NOT: return op_avx2_t<BITOP_NOT>(dst, src, len);
+    }
+}
+
+// Skip 32-byte blocks made only of the other bit value
+__attribute__((target("avx2")))
+static int64_t pos_avx2(const uint8_t *data, size_t len, bool bit) {
+    const __m256i skip = bit ? _mm256_setzero_si256() : _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, skip)) != -1) { break; }
+    }
+    return pos_bytes(data, i, len, bit);
+}
+
+#endif // BITMAP_X86
+
+/** ------------------------------------------------------------
+ *    Dispatch
+ * ------------------------------------------------------------
+ */
+
+std::vector<BitKernels> bitmap_kernel_sets() {
+    std::vector<BitKernels> sets;
+#ifdef BITMAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { sets.push_back({ "avx2", &count_avx2, &op_avx2, &pos_avx2 }); }
+    if (__builtin_cpu_supports("popcnt")) { sets.push_back({ "popcnt", &count_popcnt, &op_scalar, &pos_scalar }); }
+#endif
+    sets.push_back({ "scalar", &count_scalar, &op_scalar, &pos_scalar });
+    return sets;
+}
+
+static const BitKernels g_kernels = bitmap_kernel_sets()[0];
+
+uint64_t bitmap_count(const uint8_t *data, size_t len) {
+    return g_kernels.count(data, len);
+}
+
+void bitmap_op(BitOp op, uint8_t *dst, const uint8_t *src, size_t len) {
+    g_kernels.op(op, dst, src, len);
+}
+
+int64_t bitmap_pos(const uint8_t *data, size_t len, bool bit) {
+    return g_kernels.pos(data, len, bit);
+}
+
+const char *bitmap_kernels() {
+    return g_kernels.name;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint64_t, int64_t
+
+// C++ stdlib
+#include <vector>   // std::vector (bitmap_kernel_sets)
+
+/**
+ * Bitmaps are plain string values, bit 0 being the most significant bit of the first byte.
+ * The kernels below have an AVX2, a popcnt and a portable version; the best one the CPU
+ * supports is picked once at startup.
+ */
+enum BitOp : uint8_t {
+    BITOP_AND = 0,
+    BITOP_OR  = 1,
+    BITOP_XOR = 2,
+    BITOP_NOT = 3,
+};
+
+// Number of set bits
+uint64_t bitmap_count(const uint8_t *data, size_t len);
+
+// dst = dst <op> src over `len` bytes (BITOP_NOT: dst = ~src)
+void bitmap_op(BitOp op, uint8_t *dst, const uint8_t *src, size_t len);
+
+// Index of the first bit equal to `bit`, -1 if there is none
+int64_t bitmap_pos(const uint8_t *data, size_t len, bool bit);
+
+// Name of the kernels in use: "avx2", "popcnt" or "scalar"
+const char *bitmap_kernels();
+
+// One build of the kernels
+struct BitKernels {
+    const char *name;
+    uint64_t (*count)(const uint8_t *, size_t);
+    void (*op)(BitOp, uint8_t *, const uint8_t *, size_t);
+    int64_t (*pos)(const uint8_t *, size_t, bool);
+};
+
+// Every build this CPU runs, best first ("scalar" is always last); the first one is in use
+std::vector<BitKernels> bitmap_kernel_sets();
@@ -0,0 +1,306 @@
+// C stdlib
+#include <stdlib.h>  // aligned_alloc, free
+#include <string.h>  // memset
+#include <math.h>    // log, exp, pow, ceil, lround
+
+// C++ stdlib
+#include <vector>    // std::vector (layers)
+
+// local
+#include "bloom.h"
+#include "commands.h"            // Entry, TYPE_BLOOM, entry_lookup, entry_insert
+#include "../core/common.h"      // murmur64, str2dbl, str2int
+#include "../core/constants.h"   // k_bloom_default_*, k_bloom_max_bytes
+#include "../net/serialize.h"    // out_*, ERR_*
+
+// Each new layer holds this many times more items, at this fraction of the previous error rate
+const uint64_t k_bloom_growth = 2;
+const double   k_bloom_tightening = 0.5;
+
+// Words of one block
+const uint32_t k_bloom_block_words = k_bloom_block_bits / 64;
+
+/** ------------------------------------------------------------
+ *    Hashing
+ * ------------------------------------------------------------
+ */
+
+// splitmix64 finalizer
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * Positions of an item: two independently seeded 64-bit hashes, one picks the block (h1) and
+ * the other seeds the bits inside the block (h2). Both come from the item itself, so the
+ * positions are not limited by the 32 bits of string_hash.
+ */
+struct BloomHash {
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+};
+
+static BloomHash bloom_hash(const char *item, size_t len) {
+    BloomHash hash;
+    hash.h1 = murmur64((const uint8_t *)item, len, 0x5bd1e9955bd1e995ull);
+    hash.h2 = murmur64((const uint8_t *)item, len, 0x27d4eb2f165667c5ull);
+    return hash;
+}
+
+// Block of a layer, by multiply-shift instead of a modulo (k_bloom_max_capacity keeps nblocks < 2^32)
+static uint64_t layer_block(const BloomLayer *layer, const BloomHash &hash) {
+    return ((hash.h1 >> 32) * layer->nblocks) >> 32;
+}
+
+/**
+ * The k bits of an item inside its block, 9 bits of position each, taken from the stream
+ * h2 + i * golden for i = 0, 1, ... run through the mixer. Plain double hashing
+ * (h1 + i * h2 mod 512) reuses too few distinct patterns in a block this small and tripled
+ * the false positives at low error rates.
+ */
+static void block_mask(const BloomHash &hash, uint32_t k, uint64_t *mask) {
+    memset(mask, 0, k_bloom_block_words * sizeof(uint64_t));
+    uint64_t seed = hash.h2, bits = 0;
+    int left = 0;
+    for (uint32_t i = 0; i < k; ++i) {
+        if (left < 9) {
+            seed += 0x9e3779b97f4a7c15ull;
+            bits = mix64(seed);
+            left = 64;
+        }
+        uint32_t bit = (uint32_t)(bits % k_bloom_block_bits);
+        bits >>= 9;
+        left -= 9;
+        mask[bit / 64] |= 1ull << (bit % 64);
+    }
+}
+
+/** ------------------------------------------------------------
+ *    Layers
+ * ------------------------------------------------------------
+ */
+
+/**
+ * False positive rate of a blocked filter: the items per block follow a Poisson law around
+ * the mean load, and a block holding j items answers yes with the classic (1 - e^(-kj/B))^k.
+ */
+static double blocked_error(double bits_per_item, uint32_t k) {
+    double load = k_bloom_block_bits / bits_per_item;
+    double prob = exp(-load), rate = 0;
+    for (uint32_t j = 0; j < 4 * load + 64; ++j) {
+        if (j > 0) { prob *= load / j; }
+        rate += prob * pow(1 - exp(-(double)k * j / k_bloom_block_bits), k);
+    }
+    return rate;
+}
+
+static size_t layer_bytes(const BloomLayer *layer) {
+    return layer->nblocks * (k_bloom_block_bits / 8);
+}
+
+/**
+ * Size a layer for `capacity` items at `error_rate`: start from the classic -ln(p) / ln(2)^2
+ * bits per item and k = bits * ln(2), then add bits until the uneven load of the blocks
+ * is paid for. Returns false, allocating nothing, if it would take over `max_bytes`.
+ */
+static bool layer_new(BloomLayer *layer, uint64_t capacity, double error_rate, size_t max_bytes) {
+    const double ln2 = log(2.0);
+    double bits_per_item = -log(error_rate) / (ln2 * ln2);
+    uint32_t k = (uint32_t)lround(bits_per_item * ln2);
+    if (k < 1) { k = 1; }
+    while (blocked_error(bits_per_item, k) > error_rate) { bits_per_item *= 1.05; }
+
+    // in floating point first, the block count of an absurd request does not fit an integer
+    double nblocks = ceil((double)capacity * bits_per_item / k_bloom_block_bits);
+    if (nblocks < 1) { nblocks = 1; }
+    if (nblocks * (k_bloom_block_bits / 8) > (double)max_bytes) { return false; }
+
+    layer->capacity = capacity;
+    layer->count = 0;
+    layer->k = k;
+    layer->nblocks = (uint64_t)nblocks;
+    size_t bytes = layer_bytes(layer);
+    layer->bits = (uint64_t *)aligned_alloc(64, bytes);
+    if (!layer->bits) { return false; }
+    memset(layer->bits, 0, bytes);
+    return true;
+}
+
+static bool layer_test(const BloomLayer *layer, const BloomHash &hash, const uint64_t *mask) {
+    const uint64_t *block = layer->bits + layer_block(layer, hash) * k_bloom_block_words;
+    uint64_t missing = 0;
+    for (uint32_t w = 0; w < k_bloom_block_words; ++w) { missing |= mask[w] & ~block[w]; }
+    return missing == 0;
+}
+
+static void layer_set(BloomLayer *layer, const BloomHash &hash, const uint64_t *mask) {
+    uint64_t *block = layer->bits + layer_block(layer, hash) * k_bloom_block_words;
+    for (uint32_t w = 0; w < k_bloom_block_words; ++w) { block[w] |= mask[w]; }
+}
+
+/** ------------------------------------------------------------
+ *    Bloom API
+ * ------------------------------------------------------------
+ */
+
+// The first layer gets half the budget so the whole series stays under `error_rate`
+bool bloom_init(Bloom *bloom, double error_rate, uint64_t capacity) {
+    bloom->error_rate = error_rate;
+    BloomLayer layer;
+    if (!layer_new(&layer, capacity, error_rate * (1 - k_bloom_tightening), k_bloom_max_bytes)) { return false; }
+    bloom->layers.push_back(layer);
+    return true;
+}
+
+bool bloom_exists(Bloom *bloom, const char *item, size_t len) {
+    BloomHash hash = bloom_hash(item, len);
+    uint64_t mask[k_bloom_block_words];
+    uint32_t mask_k = 0;
+    for (const BloomLayer &layer : bloom->layers) {
+        if (layer.k != mask_k) {
+            block_mask(hash, layer.k, mask);
+            mask_k = layer.k;
+        }
+        if (layer_test(&layer, hash, mask)) { return true; }
+    }
+    return false;
+}
+
+int bloom_add(Bloom *bloom, const char *item, size_t len) {
+    if (bloom_exists(bloom, item, len)) { return 0; }
+
+    BloomLayer *last = &bloom->layers.back();
+    if (last->count >= last->capacity) {
+        double error_rate = bloom->error_rate * (1 - k_bloom_tightening);
+        for (size_t i = 0; i < bloom->layers.size(); ++i) { error_rate *= k_bloom_tightening; }
+
+        // The next layer must fit in what is left of the filter's budget
+        size_t used = 0;
+        for (const BloomLayer &layer : bloom->layers) { used += layer_bytes(&layer); }
+        BloomLayer layer;
+        if (used >= k_bloom_max_bytes || !layer_new(&layer, last->capacity * k_bloom_growth, error_rate, k_bloom_max_bytes - used)) {
+            return -1;
+        }
+        bloom->layers.push_back(layer);
+        last = &bloom->layers.back();
+    }
+
+    BloomHash hash = bloom_hash(item, len);
+    uint64_t mask[k_bloom_block_words];
+    block_mask(hash, last->k, mask);
+    layer_set(last, hash, mask);
+    last->count++;
+    bloom->count++;
+    return 1;
+}
+
+void bloom_clear(Bloom *bloom) {
+    for (BloomLayer &layer : bloom->layers) { free(layer.bits); }
+    bloom->layers.clear();
+    bloom->count = 0;
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// Filter of a key; `*wrong_type` is set if the key holds another type
+static Bloom *expect_bloom(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_BLOOM;
+    return ent && !*wrong_type ? ent->bloom : NULL;
+}
+
+// Filter of a key for a write, created with the default sizing; NULL if of another type
+static Bloom *expect_bloom_create(std::string &key) {
+    Entry *ent = entry_lookup(key);
+    if (!ent) {
+        ent = entry_insert(key, TYPE_BLOOM);
+        bloom_init(ent->bloom, k_bloom_default_error, k_bloom_default_capacity);
+    }
+    return ent->type == TYPE_BLOOM ? ent->bloom : NULL;
+}
+
+/**
+ * Command: BF.RESERVE <key> <error_rate> <capacity>
+ * Create an empty filter sized for `capacity` items at the given false positive rate.
+ */
+void bfcmd_reserve(std::vector<std::string> &cmd, Buffer &resp) {
+    double error_rate = 0;
+    int64_t capacity = 0;
+    if (!str2dbl(cmd[2], error_rate) || !(error_rate > 0 && error_rate < 1)) {
+        return out_err(resp, ERR_BAD_ARG, "error rate should be between 0 and 1");
+    }
+    if (!str2int(cmd[3], capacity) || capacity < 1 || (uint64_t)capacity > k_bloom_max_capacity) {
+        return out_err(resp, ERR_BAD_ARG, "capacity out of range");
+    }
+    if (entry_lookup(cmd[1])) { return out_err(resp, ERR_BAD_ARG, "item exists"); }
+
+    Entry *ent = entry_insert(cmd[1], TYPE_BLOOM);
+    if (!bloom_init(ent->bloom, error_rate, (uint64_t)capacity)) {
+        entry_erase(ent);
+        return out_err(resp, ERR_BAD_ARG, "filter too large");
+    }
+    return out_nil(resp);
+}
+
+/**
+ * Command: BF.ADD <key> <item>
+ * Add an item, replies 1 if it was surely absent and 0 if it may have been there already.
+ */
+void bfcmd_add(std::vector<std::string> &cmd, Buffer &resp) {
+    Bloom *bloom = expect_bloom_create(cmd[1]);
+    if (!bloom) { return out_err(resp, ERR_BAD_TYP, "expect bloom filter"); }
+    int rv = bloom_add(bloom, cmd[2].data(), cmd[2].size());
+    if (rv < 0) { return out_err(resp, ERR_BAD_ARG, "filter is full"); }
+    return out_int(resp, rv);
+}
+
+/**
+ * Command: BF.MADD <key> <item> [<item> ...]
+ * BF.ADD for each item, replies with an array of 1/0.
+ */
+void bfcmd_madd(std::vector<std::string> &cmd, Buffer &resp) {
+    Bloom *bloom = expect_bloom_create(cmd[1]);
+    if (!bloom) { return out_err(resp, ERR_BAD_TYP, "expect bloom filter"); }
+
+    // an item that finds the filter full gets an error in its place
+    out_arr(resp, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i) {
+        int rv = bloom_add(bloom, cmd[i].data(), cmd[i].size());
+        if (rv < 0) { out_err(resp, ERR_BAD_ARG, "filter is full"); }
+        else { out_int(resp, rv); }
+    }
+}
+
+/**
+ * Command: BF.EXISTS <key> <item>
+ * 0 if the item was never added, 1 if it probably was.
+ */
+void bfcmd_exists(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Bloom *bloom = expect_bloom(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect bloom filter"); }
+    return out_int(resp, bloom && bloom_exists(bloom, cmd[2].data(), cmd[2].size()));
+}
+
+/**
+ * Command: BF.MEXISTS <key> <item> [<item> ...]
+ * BF.EXISTS for each item, replies with an array of 1/0.
+ */
+void bfcmd_mexists(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Bloom *bloom = expect_bloom(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect bloom filter"); }
+
+    out_arr(resp, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i) {
+        out_int(resp, bloom && bloom_exists(bloom, cmd[i].data(), cmd[i].size()));
+    }
+}
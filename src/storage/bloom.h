@@ -0,0 +1,49 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t, uint32_t
+
+// C++ stdlib
+#include <string>   // std::string (command args)
+#include <vector>   // std::vector (layers, command args)
+
+// local
+#include "../core/buffer_io.h"  // Buffer
+
+// Bits of one Bloom block: a cache line
+const uint32_t k_bloom_block_bits = 512;
+
+/**
+ * One fixed-size blocked Bloom filter. An item picks one 64-byte block and sets its `k` bits
+ * inside it, so a lookup reads a single cache line.
+ */
+struct BloomLayer {
+    uint64_t *bits = NULL;      // nblocks * 8 words, 64-byte aligned
+    uint64_t  nblocks = 0;
+    uint64_t  capacity = 0;     // items before the next layer is started
+    uint64_t  count = 0;        // items added
+    uint32_t  k = 0;            // bits per item
+};
+
+/**
+ * Scalable Bloom filter: when the newest layer is full another one twice as large with half
+ * the error rate is added, so the overall rate stays under the requested one.
+ */
+struct Bloom {
+    double   error_rate = 0;    // requested false positive rate
+    uint64_t count = 0;         // items added over all layers
+    std::vector<BloomLayer> layers;
+};
+
+bool bloom_init(Bloom *bloom, double error_rate, uint64_t capacity);   // false if over k_bloom_max_bytes
+int  bloom_add(Bloom *bloom, const char *item, size_t len);     // 1 added, 0 may be present, -1 full
+bool bloom_exists(Bloom *bloom, const char *item, size_t len);
+void bloom_clear(Bloom *bloom);
+
+// Bloom filter command handlers (operate on top-level HMap `db`)
+void bfcmd_reserve(std::vector<std::string> &cmd, Buffer &resp);
+void bfcmd_add(std::vector<std::string> &cmd, Buffer &resp);
+void bfcmd_exists(std::vector<std::string> &cmd, Buffer &resp);
+void bfcmd_madd(std::vector<std::string> &cmd, Buffer &resp);
+void bfcmd_mexists(std::vector<std::string> &cmd, Buffer &resp);
@@ -0,0 +1,530 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <string.h>  // memcpy, memmove
+
+// C++ stdlib
+#include <vector>    // std::vector (bt_build)
+
+// local
+#include "btree.h"
+#include "../core/common.h" // container_of
+
+/** Layout of a 3-level tree (k_btree_order = 4 for the picture):
+ *
+ *                        [ min:1 cnt:6 | min:9 cnt:5 ]                       inner
+ *                         /                       \
+ *         [ 1 cnt:3 | 5 cnt:3 ]            [ 9 cnt:2 | 12 cnt:3 ]             inner
+ *          /            \                   /            \
+ *      [1 2 3] <-> [5 6 8] <-------> [9 11] <-----> [12 14 15]                leaves
+ *
+ * Every inner slot stores the exact minimum of its child, so routing a key is a binary
+ * search over one array, and the counts turn rank/select into one root-to-leaf descent.
+ */
+
+static BLeaf *as_leaf(BNode *node) { return container_of(node, BLeaf, hdr); }
+static BInner *as_inner(BNode *node) { return container_of(node, BInner, hdr); }
+
+static BLeaf *leaf_new() {
+    return new BLeaf;   // no value-initialisation, the arrays are filled as entries arrive
+}
+
+static BInner *inner_new() {
+    BInner *inner = new BInner;
+    inner->hdr.leaf = false;
+    return inner;
+}
+
+static void bnode_del(BNode *node) {
+    if (node->leaf) { delete as_leaf(node); }
+    else { delete as_inner(node); }
+}
+
+// (score, item) < (key_score, key)
+static bool entry_less(BTree *tree, double score, void *item, double key_score, const void *key) {
+    if (score != key_score) { return score < key_score; }
+    return tree->cmp(item, key) < 0;
+}
+
+// (key_score, key) < (score, item)
+static bool key_less(BTree *tree, double key_score, const void *key, double score, void *item) {
+    if (score != key_score) { return key_score < score; }
+    return tree->cmp(item, key) > 0;
+}
+
+// Minimum key and number of entries of a subtree
+static double bnode_min_score(BNode *node) {
+    return node->leaf ? as_leaf(node)->score[0] : as_inner(node)->score[0];
+}
+
+static void *bnode_min_item(BNode *node) {
+    return node->leaf ? as_leaf(node)->item[0] : as_inner(node)->item[0];
+}
+
+static uint64_t bnode_count(BNode *node) {
+    if (node->leaf) { return node->n; }
+
+    uint64_t cnt = 0;
+    BInner *inner = as_inner(node);
+    for (uint32_t i = 0; i < node->n; ++i) { cnt += inner->cnt[i]; }
+    return cnt;
+}
+
+// First slot whose entry is >= key
+static uint32_t leaf_lower_bound(BTree *tree, BLeaf *leaf, double score, const void *key) {
+    uint32_t lo = 0, hi = leaf->hdr.n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (entry_less(tree, leaf->score[mid], leaf->item[mid], score, key)) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+// First slot whose score is not below the bound
+static uint32_t leaf_score_bound(BLeaf *leaf, double score, bool inclusive) {
+    uint32_t lo = 0, hi = leaf->hdr.n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        bool below = inclusive ? leaf->score[mid] <= score : leaf->score[mid] < score;
+        if (below) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+// The last child whose minimum is <= key, child 0 catches everything smaller
+static uint32_t inner_route(BTree *tree, BInner *inner, double score, const void *key) {
+    uint32_t lo = 1, hi = inner->hdr.n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (key_less(tree, score, key, inner->score[mid], inner->item[mid])) { hi = mid; }
+        else { lo = mid + 1; }
+    }
+    return lo - 1;
+}
+
+// The last child whose minimum score is below the bound
+static uint32_t inner_route_score(BInner *inner, double score, bool inclusive) {
+    uint32_t lo = 1, hi = inner->hdr.n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        bool below = inclusive ? inner->score[mid] <= score : inner->score[mid] < score;
+        if (below) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo - 1;
+}
+
+static void leaf_insert_at(BLeaf *leaf, uint32_t pos, double score, void *item) {
+    assert(leaf->hdr.n < k_btree_order);
+    uint32_t tail = leaf->hdr.n - pos;
+    memmove(&leaf->score[pos + 1], &leaf->score[pos], tail * sizeof(double));
+    memmove(&leaf->item[pos + 1], &leaf->item[pos], tail * sizeof(void *));
+    leaf->score[pos] = score;
+    leaf->item[pos] = item;
+    leaf->hdr.n++;
+}
+
+static void leaf_remove_at(BLeaf *leaf, uint32_t pos) {
+    uint32_t tail = leaf->hdr.n - pos - 1;
+    memmove(&leaf->score[pos], &leaf->score[pos + 1], tail * sizeof(double));
+    memmove(&leaf->item[pos], &leaf->item[pos + 1], tail * sizeof(void *));
+    leaf->hdr.n--;
+}
+
+// Re-read the minimum of child i after its first entry changed
+static void inner_refresh_min(BInner *inner, uint32_t i) {
+    inner->score[i] = bnode_min_score(inner->child[i]);
+    inner->item[i] = bnode_min_item(inner->child[i]);
+}
+
+static void inner_insert_at(BInner *inner, uint32_t pos, BNode *child, uint64_t cnt) {
+    assert(inner->hdr.n < k_btree_order);
+    uint32_t tail = inner->hdr.n - pos;
+    memmove(&inner->score[pos + 1], &inner->score[pos], tail * sizeof(double));
+    memmove(&inner->item[pos + 1], &inner->item[pos], tail * sizeof(void *));
+    memmove(&inner->cnt[pos + 1], &inner->cnt[pos], tail * sizeof(uint64_t));
+    memmove(&inner->child[pos + 1], &inner->child[pos], tail * sizeof(BNode *));
+    inner->child[pos] = child;
+    inner->cnt[pos] = cnt;
+    inner->hdr.n++;
+    inner_refresh_min(inner, pos);
+}
+
+static void inner_remove_at(BInner *inner, uint32_t pos) {
+    uint32_t tail = inner->hdr.n - pos - 1;
+    memmove(&inner->score[pos], &inner->score[pos + 1], tail * sizeof(double));
+    memmove(&inner->item[pos], &inner->item[pos + 1], tail * sizeof(void *));
+    memmove(&inner->cnt[pos], &inner->cnt[pos + 1], tail * sizeof(uint64_t));
+    memmove(&inner->child[pos], &inner->child[pos + 1], tail * sizeof(BNode *));
+    inner->hdr.n--;
+}
+
+// Insert into a leaf, returns the new right sibling if the leaf had to split
+static BNode *leaf_insert(BTree *tree, BLeaf *leaf, double score, const void *key, void *item) {
+    uint32_t pos = leaf_lower_bound(tree, leaf, score, key);
+
+    BLeaf *right = NULL;
+    if (leaf->hdr.n == k_btree_order) {
+        // Move the upper half into a new leaf chained after this one
+        const uint32_t half = k_btree_order / 2;
+        right = leaf_new();
+        right->hdr.n = k_btree_order - half;
+        memcpy(right->score, &leaf->score[half], right->hdr.n * sizeof(double));
+        memcpy(right->item, &leaf->item[half], right->hdr.n * sizeof(void *));
+        leaf->hdr.n = half;
+
+        right->prev = leaf;
+        right->next = leaf->next;
+        if (leaf->next) { leaf->next->prev = right; }
+        leaf->next = right;
+
+        // The new entry goes to the half that covers its position
+        if (pos > half) {
+            leaf = right;
+            pos -= half;
+        }
+    }
+
+    leaf_insert_at(leaf, pos, score, item);
+    return right ? &right->hdr : NULL;
+}
+
+// Insert into a subtree, returns the new right sibling if the node had to split
+static BNode *node_insert(BTree *tree, BNode *node, double score, const void *key, void *item) {
+    if (node->leaf) { return leaf_insert(tree, as_leaf(node), score, key, item); }
+
+    BInner *inner = as_inner(node);
+    uint32_t i = inner_route(tree, inner, score, key);
+    BNode *split = node_insert(tree, inner->child[i], score, key, item);
+    inner->cnt[i]++;
+    inner_refresh_min(inner, i);
+    if (!split) { return NULL; }
+
+    // The child split in two: part of its entries now live in `split`
+    uint64_t split_cnt = bnode_count(split);
+    inner->cnt[i] -= split_cnt;
+
+    BInner *right = NULL;
+    uint32_t pos = i + 1;
+    if (inner->hdr.n == k_btree_order) {
+        const uint32_t half = k_btree_order / 2;
+        right = inner_new();
+        right->hdr.n = k_btree_order - half;
+        memcpy(right->score, &inner->score[half], right->hdr.n * sizeof(double));
+        memcpy(right->item, &inner->item[half], right->hdr.n * sizeof(void *));
+        memcpy(right->cnt, &inner->cnt[half], right->hdr.n * sizeof(uint64_t));
+        memcpy(right->child, &inner->child[half], right->hdr.n * sizeof(BNode *));
+        inner->hdr.n = half;
+
+        if (pos > half) {
+            inner = right;
+            pos -= half;
+        }
+    }
+
+    inner_insert_at(inner, pos, split, split_cnt);
+    return right ? &right->hdr : NULL;
+}
+
+// Merge or rebalance child i with a neighbour after it dropped below half full
+static void inner_fix_underflow(BInner *inner, uint32_t i) {
+    if (inner->hdr.n < 2) { return; }   // the root with a single child, collapsed by the caller
+
+    uint32_t l = i > 0 ? i - 1 : i;
+    uint32_t r = l + 1;
+    BNode *lhs = inner->child[l];
+    BNode *rhs = inner->child[r];
+
+    if (lhs->n + rhs->n <= k_btree_order) {
+        // Merge: append the right node to the left one and drop it
+        if (lhs->leaf) {
+            BLeaf *ll = as_leaf(lhs), *rl = as_leaf(rhs);
+            memcpy(&ll->score[lhs->n], rl->score, rhs->n * sizeof(double));
+            memcpy(&ll->item[lhs->n], rl->item, rhs->n * sizeof(void *));
+            ll->next = rl->next;
+            if (rl->next) { rl->next->prev = ll; }
+        }
+        else {
+            BInner *li = as_inner(lhs), *ri = as_inner(rhs);
+            memcpy(&li->score[lhs->n], ri->score, rhs->n * sizeof(double));
+            memcpy(&li->item[lhs->n], ri->item, rhs->n * sizeof(void *));
+            memcpy(&li->cnt[lhs->n], ri->cnt, rhs->n * sizeof(uint64_t));
+            memcpy(&li->child[lhs->n], ri->child, rhs->n * sizeof(BNode *));
+        }
+        lhs->n += rhs->n;
+        inner->cnt[l] += inner->cnt[r];
+        inner_remove_at(inner, r);
+        bnode_del(rhs);
+    }
+    else if (lhs->n < rhs->n) {
+        // Borrow the first entry of the right node
+        uint64_t moved = 1;
+        if (lhs->leaf) {
+            BLeaf *ll = as_leaf(lhs), *rl = as_leaf(rhs);
+            leaf_insert_at(ll, lhs->n, rl->score[0], rl->item[0]);
+            leaf_remove_at(rl, 0);
+        }
+        else {
+            BInner *li = as_inner(lhs), *ri = as_inner(rhs);
+            moved = ri->cnt[0];
+            inner_insert_at(li, lhs->n, ri->child[0], moved);
+            inner_remove_at(ri, 0);
+        }
+        inner->cnt[l] += moved;
+        inner->cnt[r] -= moved;
+        inner_refresh_min(inner, r);
+    }
+    else {
+        // Borrow the last entry of the left node
+        uint64_t moved = 1;
+        if (lhs->leaf) {
+            BLeaf *ll = as_leaf(lhs), *rl = as_leaf(rhs);
+            leaf_insert_at(rl, 0, ll->score[lhs->n - 1], ll->item[lhs->n - 1]);
+            lhs->n--;
+        }
+        else {
+            BInner *li = as_inner(lhs), *ri = as_inner(rhs);
+            moved = li->cnt[lhs->n - 1];
+            inner_insert_at(ri, 0, li->child[lhs->n - 1], moved);
+            lhs->n--;
+        }
+        inner->cnt[l] -= moved;
+        inner->cnt[r] += moved;
+        inner_refresh_min(inner, r);
+    }
+    inner_refresh_min(inner, l);
+}
+
+// Remove the exact (score, key) entry from a subtree, returns its item or NULL
+static void *node_delete(BTree *tree, BNode *node, double score, const void *key) {
+    if (node->leaf) {
+        BLeaf *leaf = as_leaf(node);
+        uint32_t pos = leaf_lower_bound(tree, leaf, score, key);
+        if (pos == node->n || leaf->score[pos] != score || tree->cmp(leaf->item[pos], key) != 0) { return NULL; }
+
+        void *item = leaf->item[pos];
+        leaf_remove_at(leaf, pos);
+        return item;
+    }
+
+    BInner *inner = as_inner(node);
+    uint32_t i = inner_route(tree, inner, score, key);
+    void *item = node_delete(tree, inner->child[i], score, key);
+    if (!item) { return NULL; }
+
+    inner->cnt[i]--;
+    BNode *child = inner->child[i];
+    if (child->n > 0) { inner_refresh_min(inner, i); }
+    if (child->n < k_btree_order / 2) { inner_fix_underflow(inner, i); }
+    return item;
+}
+
+// Initialize an empty tree
+void bt_init(BTree *tree, BTreeCmp cmp) {
+    tree->root = NULL;
+    tree->size = 0;
+    tree->cmp = cmp;
+}
+
+// Insert an entry, the caller guarantees (score, key) is not present yet
+void bt_insert(BTree *tree, double score, const void *key, void *item) {
+    if (!tree->root) {
+        BLeaf *leaf = leaf_new();
+        leaf_insert_at(leaf, 0, score, item);
+        tree->root = &leaf->hdr;
+        tree->size = 1;
+        return;
+    }
+
+    // Grow a new root when the old one splits
+    BNode *split = node_insert(tree, tree->root, score, key, item);
+    if (split) {
+        BInner *root = inner_new();
+        inner_insert_at(root, 0, tree->root, bnode_count(tree->root));
+        inner_insert_at(root, 1, split, bnode_count(split));
+        tree->root = &root->hdr;
+    }
+    tree->size++;
+}
+
+// Delete the entry matching (score, key), returns its item or NULL if not found
+void *bt_delete(BTree *tree, double score, const void *key) {
+    if (!tree->root) { return NULL; }
+
+    void *item = node_delete(tree, tree->root, score, key);
+    if (!item) { return NULL; }
+    tree->size--;
+
+    // Shrink from the top: drop single-child roots and an empty root leaf
+    while (!tree->root->leaf && tree->root->n == 1) {
+        BInner *old = as_inner(tree->root);
+        tree->root = old->child[0];
+        delete old;
+    }
+    if (tree->root->leaf && tree->root->n == 0) {
+        delete as_leaf(tree->root);
+        tree->root = NULL;
+    }
+    return item;
+}
+
+/**
+ * Bulk-load `n` entries already sorted by (score, item) into an empty tree in O(N).
+ * Nodes are filled to 3/4 so that the first inserts after a build do not split everything.
+ */
+void bt_build(BTree *tree, const double *scores, void *const *items, size_t n) {
+    assert(tree->root == NULL);
+    if (n == 0) { return; }
+
+    const size_t fill = k_btree_order * 3 / 4;
+
+    // Leaves: spread the entries evenly, chained left to right
+    std::vector<BNode *> level;
+    size_t groups = (n + fill - 1) / fill;
+    BLeaf *prev = NULL;
+    for (size_t g = 0, start = 0; g < groups; ++g) {
+        size_t take = n / groups + (g < n % groups ? 1 : 0);
+        BLeaf *leaf = leaf_new();
+        leaf->hdr.n = (uint32_t)take;
+        memcpy(leaf->score, &scores[start], take * sizeof(double));
+        memcpy(leaf->item, &items[start], take * sizeof(void *));
+        leaf->prev = prev;
+        if (prev) { prev->next = leaf; }
+        prev = leaf;
+        level.push_back(&leaf->hdr);
+        start += take;
+    }
+
+    // Inner levels until a single root remains
+    while (level.size() > 1) {
+        std::vector<BNode *> parents;
+        groups = (level.size() + fill - 1) / fill;
+        for (size_t g = 0, start = 0; g < groups; ++g) {
+            size_t take = level.size() / groups + (g < level.size() % groups ? 1 : 0);
+            BInner *inner = inner_new();
+            for (size_t j = 0; j < take; ++j) {
+                BNode *child = level[start + j];
+                inner_insert_at(inner, inner->hdr.n, child, bnode_count(child));
+            }
+            parents.push_back(&inner->hdr);
+            start += take;
+        }
+        level.swap(parents);
+    }
+
+    tree->root = level[0];
+    tree->size = n;
+}
+
+// Recursively free the nodes, `del` (optional) is called on every item
+static void node_dispose(BNode *node, void (*del)(void *item)) {
+    if (node->leaf) {
+        BLeaf *leaf = as_leaf(node);
+        for (uint32_t i = 0; del && i < node->n; ++i) { del(leaf->item[i]); }
+    }
+    else {
+        BInner *inner = as_inner(node);
+        for (uint32_t i = 0; i < node->n; ++i) { node_dispose(inner->child[i], del); }
+    }
+    bnode_del(node);
+}
+
+// Destroy all nodes and reset the tree
+void bt_clear(BTree *tree, void (*del)(void *item)) {
+    if (tree->root) { node_dispose(tree->root, del); }
+    tree->root = NULL;
+    tree->size = 0;
+}
+
+// Number of entries strictly less than (score, key)
+uint64_t bt_rank(BTree *tree, double score, const void *key) {
+    uint64_t rank = 0;
+    BNode *node = tree->root;
+    if (!node) { return 0; }
+
+    while (!node->leaf) {
+        BInner *inner = as_inner(node);
+        uint32_t i = inner_route(tree, inner, score, key);
+        for (uint32_t j = 0; j < i; ++j) { rank += inner->cnt[j]; }
+        node = inner->child[i];
+    }
+    return rank + leaf_lower_bound(tree, as_leaf(node), score, key);
+}
+
+// Number of entries whose score is below `score` (or at most `score` when inclusive)
+uint64_t bt_count_below(BTree *tree, double score, bool inclusive) {
+    uint64_t count = 0;
+    BNode *node = tree->root;
+    if (!node) { return 0; }
+
+    while (!node->leaf) {
+        BInner *inner = as_inner(node);
+        uint32_t i = inner_route_score(inner, score, inclusive);
+        for (uint32_t j = 0; j < i; ++j) { count += inner->cnt[j]; }
+        node = inner->child[i];
+    }
+    return count + leaf_score_bound(as_leaf(node), score, inclusive);
+}
+
+// Position the cursor on the first entry >= (score, key)
+bool bt_seek_greater_equal(BTree *tree, double score, const void *key, BIter *iter) {
+    iter->leaf = NULL;
+    BNode *node = tree->root;
+    if (!node) { return false; }
+
+    while (!node->leaf) {
+        BInner *inner = as_inner(node);
+        node = inner->child[inner_route(tree, inner, score, key)];
+    }
+
+    // Every entry of the routed leaf may be smaller, then the answer starts the next leaf
+    BLeaf *leaf = as_leaf(node);
+    uint32_t pos = leaf_lower_bound(tree, leaf, score, key);
+    if (pos == node->n) {
+        leaf = leaf->next;
+        pos = 0;
+    }
+    iter->leaf = leaf;
+    iter->slot = pos;
+    return leaf != NULL;
+}
+
+// Position the cursor on the entry with the given 0-based rank
+bool bt_seek_rank(BTree *tree, uint64_t rank, BIter *iter) {
+    iter->leaf = NULL;
+    if (!tree->root || rank >= tree->size) { return false; }
+
+    BNode *node = tree->root;
+    while (!node->leaf) {
+        BInner *inner = as_inner(node);
+        uint32_t i = 0;
+        while (i + 1 < node->n && rank >= inner->cnt[i]) { rank -= inner->cnt[i++]; }
+        node = inner->child[i];
+    }
+    iter->leaf = as_leaf(node);
+    iter->slot = (uint32_t)rank;
+    return true;
+}
+
+// Step to the next entry in sorted order
+bool bt_iter_next(BIter *iter) {
+    if (!iter->leaf) { return false; }
+    if (++iter->slot == iter->leaf->hdr.n) {
+        iter->leaf = iter->leaf->next;
+        iter->slot = 0;
+    }
+    return iter->leaf != NULL;
+}
+
+// Step to the previous entry in sorted order
+bool bt_iter_prev(BIter *iter) {
+    if (!iter->leaf) { return false; }
+    if (iter->slot == 0) {
+        iter->leaf = iter->leaf->prev;
+        iter->slot = iter->leaf ? iter->leaf->hdr.n - 1 : 0;
+        return iter->leaf != NULL;
+    }
+    iter->slot--;
+    return true;
+}
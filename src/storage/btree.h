@@ -0,0 +1,80 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // NULL, size_t
+#include <stdint.h> // uint32_t, uint64_t
+
+/**
+ * Order-statistic B+-tree keyed by (score, item).
+ *
+ * Entries live in wide leaves as parallel `score[]` / `item[]` arrays, so a range scan
+ * reads contiguous memory and only touches an item when the caller needs it.
+ * Inner nodes keep, for every child, its exact minimum key and its entry count,
+ * which gives O(log N) seek, rank and select with a handful of cache lines per level.
+ */
+
+// Maximum number of entries in a leaf, and of children in an inner node
+const uint32_t k_btree_order = 64;
+
+// Common header, `leaf` tells which of BLeaf / BInner it is embedded in
+struct BNode {
+    bool     leaf = true;
+    uint32_t n = 0;         // entries (leaf) or children (inner) in use
+};
+
+// Leaves hold the sorted entries and are chained for range scans
+struct BLeaf {
+    BNode  hdr;
+    BLeaf *prev = NULL;
+    BLeaf *next = NULL;
+    double score[k_btree_order];
+    void  *item[k_btree_order];
+};
+
+// Inner nodes hold the minimum key and the number of entries under every child
+struct BInner {
+    BNode    hdr;
+    double   score[k_btree_order];   // min score of each child
+    void    *item[k_btree_order];    // min item of each child
+    uint64_t cnt[k_btree_order];     // number of entries under each child
+    BNode   *child[k_btree_order];
+};
+
+/**
+ * Tie-breaker for entries with equal scores, returns <0, 0, >0 like memcmp.
+ * `key` is whatever the caller passes alongside the score (it identifies an item).
+ */
+typedef int (*BTreeCmp)(void *item, const void *key);
+
+struct BTree {
+    BNode   *root = NULL;
+    uint64_t size = 0;      // number of entries
+    BTreeCmp cmp = NULL;
+};
+
+// Position of an entry, invalidated by any modification of the tree
+struct BIter {
+    BLeaf   *leaf = NULL;   // NULL once the cursor runs off either end
+    uint32_t slot = 0;
+};
+
+inline bool   bt_iter_valid(const BIter *iter) { return iter->leaf != NULL; }
+inline double bt_iter_score(const BIter *iter) { return iter->leaf->score[iter->slot]; }
+inline void  *bt_iter_item(const BIter *iter) { return iter->leaf->item[iter->slot]; }
+
+// functions
+void     bt_init(BTree *tree, BTreeCmp cmp);
+void     bt_insert(BTree *tree, double score, const void *key, void *item);
+void    *bt_delete(BTree *tree, double score, const void *key);
+void     bt_build(BTree *tree, const double *scores, void *const *items, size_t n);
+void     bt_clear(BTree *tree, void (*del)(void *item));
+
+// Order statistics
+uint64_t bt_rank(BTree *tree, double score, const void *key);
+uint64_t bt_count_below(BTree *tree, double score, bool inclusive);
+
+// Cursors
+bool bt_seek_greater_equal(BTree *tree, double score, const void *key, BIter *iter);
+bool bt_seek_rank(BTree *tree, uint64_t rank, BIter *iter);
+bool bt_iter_next(BIter *iter);
+bool bt_iter_prev(BIter *iter);
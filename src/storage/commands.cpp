@@ -1,7 +1,10 @@
 // C stdlib
-#include <assert.h>      // assert (get_key)
+#include <assert.h>      // assert (entry_erase)
 #include <stdlib.h>      // strtod, strtoll
-#include <math.h>        // isnan
+#include <stdio.h>       // snprintf
+#include <string.h>      // memcmp, memcpy
+#include <strings.h>     // strcasecmp (SET/GETEX options)
+#include <math.h>        // isnan, isinf
 
 // C++ stdlib
 #include <string>        // std::string (Entry keys/values)
@@ -9,12 +12,14 @@
 
 // local
 #include "commands.h"           // Entry/LookupKey, run_request
-#include "../core/constants.h" // k_max_msg
+#include "../core/constants.h" // tunables
 #include "../net/serialize.h"   // out_str, out_nil, out_err, out_int
 #include "../core/buffer_io.h"  // Buffer
-#include "../core/common.h"     // container_of, string_hash
+#include "../core/common.h"     // container_of, string_hash, byte_range
 #include "heap.h"               // heap ops
-#include "../core/sys.h"        // get_current_time_ms
+#include "bitmap.h"             // bcmd_* (bitmap commands on string values)
+#include "geo.h"                // geocmd_* (geo commands on zsets)
+#include "../core/sys.h"        // get_current_time_ms, get_wall_time_ms
 #include "../core/thread_pool.h" // thread_pool_queue
 
 // Define the single global server state instance
@@ -49,6 +54,42 @@ void entry_set_ttl(Entry *entry, int64_t ttl_ms) {
 // Synchronous deleter (no heap unlink here)
 static void entry_del_sync(Entry *entry) {
     if (entry->type == TYPE_ZSET) { zset_clear(&entry->zset); }
+    if (entry->type == TYPE_HASH) {
+        hash_clear(entry->hash);
+        delete entry->hash;
+    }
+    if (entry->type == TYPE_LIST) {
+        qlist_clear(entry->list);
+        delete entry->list;
+    }
+    if (entry->type == TYPE_SET) {
+        set_clear(entry->set);
+        delete entry->set;
+    }
+    if (entry->type == TYPE_HLL) {
+        hll_clear(entry->hll);
+        delete entry->hll;
+    }
+    if (entry->type == TYPE_BLOOM) {
+        bloom_clear(entry->bloom);
+        delete entry->bloom;
+    }
+    if (entry->type == TYPE_STREAM) {
+        stream_clear(entry->stream);
+        delete entry->stream;
+    }
+    if (entry->type == TYPE_TS) {
+        ts_clear(entry->ts);
+        delete entry->ts;
+    }
+    if (entry->type == TYPE_TOPK) {
+        topk_clear(entry->topk);
+        delete entry->topk;
+    }
+    if (entry->type == TYPE_JSON) {
+        json_clear(entry->json);
+        delete entry->json;
+    }
     delete entry;
 }
 
@@ -59,37 +100,203 @@ static void entry_del_worker(void *arg) {
 void entry_del(Entry *entry) {
     // Unlink from TTL heap first to avoid double-touching it in async path
     entry_set_ttl(entry, -1);
-    // For large zsets, free asynchronously
-    size_t sz = (entry->type == TYPE_ZSET) ? hm_size(&entry->zset.hmap) : 0;
+    // Same for the member deadlines of a zset
+    if (entry->type == TYPE_ZSET) { zset_expiry_release(&entry->zset); }
+    if (entry->type == TYPE_TS) { ts_expiry_release(entry->ts); }
+    // For large containers, free asynchronously
+    size_t sz = 0;
+    if (entry->type == TYPE_ZSET) { sz = zset_len(&entry->zset); }
+    if (entry->type == TYPE_HASH) { sz = hash_len(entry->hash); }
+    if (entry->type == TYPE_LIST) { sz = qlist_len(entry->list); }
+    if (entry->type == TYPE_SET) { sz = set_len(entry->set); }
+    if (entry->type == TYPE_STREAM) { sz = entry->stream->len; }
+    if (entry->type == TYPE_TS) { sz = entry->ts->nchunks; }
+    if (entry->type == TYPE_JSON) { sz = entry->json->nodes; }
     const size_t k_large_container_size = 1000;
     if (sz > k_large_container_size) {
-        thread_pool_queue(&server_data.thread_pool, &entry_del_worker, entry);
+        thread_pool_queue(&server_data.thread_pool, &entry_del_worker, entry, WORK_PRIO_LOW);
     } else {
         entry_del_sync(entry);
     }
 }
 
-// Set the value of the key from the hash table
+Entry *entry_lookup(std::string &key) {
+    // Swap the key in and out instead of copying it
+    LookupKey lkey;
+    lkey.key.swap(key);
+    lkey.node.hash_code = string_hash((uint8_t *)lkey.key.data(), lkey.key.size());
+    HNode *node = hm_lookup(&server_data.db, &lkey.node, &entry_equals);
+    key.swap(lkey.key);
+    return node ? container_of(node, Entry, node) : NULL;
+}
+
+Entry *entry_insert(std::string &key, uint32_t type) {
+    Entry *entry = entry_new(type);
+    entry->key.swap(key);
+    entry->node.hash_code = string_hash((uint8_t *)entry->key.data(), entry->key.size());
+    hm_insert(&server_data.db, &entry->node);
+    return entry;
+}
+
+static bool hnode_same(HNode *node, HNode *key) {
+    return node == key;
+}
+
+void entry_erase(Entry *entry) {
+    HNode *node = hm_delete(&server_data.db, &entry->node, &hnode_same);
+    assert(node == &entry->node);
+    entry_del(entry);
+}
+
+// Shortest text that parses back to the same double
+static size_t dbl_format(double val, char *buf) {
+    int len = 0;
+    for (int prec = 15; prec <= 17; ++prec) {
+        len = snprintf(buf, k_num_buf, "%.*g", prec, val);
+        if (strtod(buf, NULL) == val) { break; }
+    }
+    return (size_t)len;
+}
+
+const char *entry_str(const Entry *entry, char *buf, size_t *len) {
+    switch (entry->str_enc) {
+    case STR_ENC_INT:
+        *len = (size_t)snprintf(buf, k_num_buf, "%lld", (long long)entry->int_val);
+        return buf;
+    case STR_ENC_DBL:
+        *len = dbl_format(entry->dbl_val, buf);
+        return buf;
+    default:
+        *len = entry->value.size();
+        return entry->value.data();
+    }
+}
+
+std::string &entry_raw_str(Entry *entry) {
+    if (entry->str_enc != STR_ENC_RAW) {
+        char buf[k_num_buf];
+        size_t len = 0;
+        const char *text = entry_str(entry, buf, &len);
+        entry->value.assign(text, len);
+        entry->str_enc = STR_ENC_RAW;
+    }
+    entry_touch(entry);
+    return entry->value;
+}
+
+// Store a string value, integers are kept inline instead of as bytes
+static void entry_set_str(Entry *entry, std::string &val) {
+    entry_touch(entry);
+    int64_t num = 0;
+    if (str_is_int(val, num)) {
+        entry->str_enc = STR_ENC_INT;
+        entry->int_val = num;
+        std::string().swap(entry->value);   // release the bytes as well
+    }
+    else {
+        entry->str_enc = STR_ENC_RAW;
+        entry->value.swap(val);
+    }
+}
+
+// Options of SET
+enum {
+    SET_NX      = 1 << 0,   // only set a missing key
+    SET_XX      = 1 << 1,   // only set an existing key
+    SET_GET     = 1 << 2,   // reply with the old value
+    SET_KEEPTTL = 1 << 3,   // keep the TTL of an existing key
+};
+
+/**
+ * Expiry option of SET/GETEX at cmd[*pos]: EX <s>, PX <ms>, EXAT <unix s> or PXAT <unix ms>.
+ * Returns 0 if cmd[*pos] is not one, 1 with the TTL from now in `*ttl_ms` (0 for a time
+ * already past), -1 for a bad value. `*pos` is left on the value.
+ */
+static int parse_expiry(std::vector<std::string> &cmd, size_t *pos, int64_t *ttl_ms) {
+    const char *opt = cmd[*pos].c_str();
+    bool ex = strcasecmp(opt, "ex") == 0, px = strcasecmp(opt, "px") == 0;
+    bool exat = strcasecmp(opt, "exat") == 0, pxat = strcasecmp(opt, "pxat") == 0;
+    if (!ex && !px && !exat && !pxat) { return 0; }
+
+    int64_t val = 0;
+    if (*pos + 1 >= cmd.size() || !str2int(cmd[++*pos], val) || val <= 0) { return -1; }
+    if ((ex || exat) && __builtin_mul_overflow(val, (int64_t)1000, &val)) { return -1; }
+    if (ex || px) {
+        *ttl_ms = val;
+        return 1;
+    }
+    int64_t now_ms = (int64_t)get_wall_time_ms();
+    *ttl_ms = val > now_ms ? val - now_ms : 0;
+    return 1;
+}
+
+/**
+ * Command: SET <key> <value> [NX|XX] [GET] [EX <s>|PX <ms>|EXAT <unix s>|PXAT <unix ms>|KEEPTTL]
+ * Store a string, replacing a value of another type, in a single lookup. The TTL is cleared
+ * unless an expiry or KEEPTTL is given. Replies nil; with NX/XX 1 if the value was written and
+ * 0 if not; with GET the old value (nil if missing) whether or not it was written.
+ */
 void set_key(std::vector<std::string> &cmd, Buffer &resp){
+    uint32_t flags = 0;
+    int64_t ttl_ms = -1;
+    bool has_ttl = false;
+    for (size_t i = 3; i < cmd.size(); ++i) {
+        int expiry = parse_expiry(cmd, &i, &ttl_ms);
+        if (expiry < 0) { return out_err(resp, ERR_BAD_ARG, "invalid expire time"); }
+        if (expiry > 0 && has_ttl) { return out_err(resp, ERR_BAD_ARG, "syntax error"); }
+        if (expiry > 0) { has_ttl = true; continue; }
+
+        const char *opt = cmd[i].c_str();
+        if (strcasecmp(opt, "nx") == 0) { flags |= SET_NX; }
+        else if (strcasecmp(opt, "xx") == 0) { flags |= SET_XX; }
+        else if (strcasecmp(opt, "get") == 0) { flags |= SET_GET; }
+        else if (strcasecmp(opt, "keepttl") == 0) { flags |= SET_KEEPTTL; }
+        else { return out_err(resp, ERR_BAD_ARG, "syntax error"); }
+    }
+    if (((flags & SET_NX) && (flags & SET_XX)) || ((flags & SET_KEEPTTL) && has_ttl)) {
+        return out_err(resp, ERR_BAD_ARG, "syntax error");
+    }
+
     // A dummy 'Entry' just for the lookup
-    Entry key;
+    LookupKey key;
     key.key.swap(cmd[1]);
     key.node.hash_code = string_hash((uint8_t*) key.key.data(), key.key.size());
 
     // Hashtable Lookup
     HNode *node = hm_lookup(&server_data.db, &key.node, &entry_equals);
-    if(node) {
-        // Key already exists, update the value
-        container_of(node, Entry, node)->value.swap(cmd[2]);
+    Entry *entry = node ? container_of(node, Entry, node) : NULL;
+    if (entry && entry->type != TYPE_STR && (flags & SET_GET)) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+
+    // The old value goes out before it is overwritten
+    if (flags & SET_GET) {
+        char buf[k_num_buf];
+        size_t len = 0;
+        const char *val = entry ? entry_str(entry, buf, &len) : NULL;
+        if (val) { out_str(resp, val, len); }
+        else { out_nil(resp); }
     }
-    else {
-        // Key does not exist, create a new entry
-        Entry *key_entry = new Entry();
-        key_entry->key.swap(key.key);
-        key_entry->value.swap(cmd[2]);
-        key_entry->node.hash_code = key.node.hash_code;
-        hm_insert(&server_data.db, &key_entry->node);
+
+    bool write = !((flags & SET_NX) && entry) && !((flags & SET_XX) && !entry);
+    if (write) {
+        if (entry && entry->type != TYPE_STR) {
+            // A value of another type is replaced as a whole
+            entry_erase(entry);
+            entry = NULL;
+        }
+        if (!entry) {
+            // Key does not exist, create a new entry
+            entry = entry_new(TYPE_STR);
+            entry->key.swap(key.key);
+            entry->node.hash_code = key.node.hash_code;
+            hm_insert(&server_data.db, &entry->node);
+        }
+        entry_set_str(entry, cmd[2]);
+        if (has_ttl) { entry_set_ttl(entry, ttl_ms); }
+        else if (!(flags & SET_KEEPTTL)) { entry_set_ttl(entry, -1); }
     }
+
+    if (flags & SET_GET) { return; }
+    if (flags & (SET_NX | SET_XX)) { return out_int(resp, write ? 1 : 0); }
     return out_nil(resp);
 }
 
@@ -106,10 +313,369 @@ void get_key(std::vector<std::string> &cmd, Buffer &resp){
         return out_nil(resp);
     }
     
-    // Copy the values
-    const std:: string &val = container_of(node, Entry, node)->value;      // Returns the value of the HNode
-    assert(val.size() <= k_max_msg);
-    return out_str(resp, val.data(), val.size());
+    Entry *entry = container_of(node, Entry, node);
+    if (entry->type != TYPE_STR) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+
+    // Copy the values, encoded numbers are printed back on the fly
+    char buf[k_num_buf];
+    size_t len = 0;
+    const char *val = entry_str(entry, buf, &len);
+    return out_str(resp, val, len);     // oversized values are turned into ERR_TOO_BIG by the connection
+}
+
+/**
+ * Command: GETEX <key> [EX <s>|PX <ms>|EXAT <unix s>|PXAT <unix ms>|PERSIST]
+ * GET that also sets or clears the TTL, nil for a missing key.
+ */
+void getex_key(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t ttl_ms = -1;
+    bool has_ttl = false;
+    if (cmd.size() > 2) {
+        size_t pos = 2;
+        int expiry = parse_expiry(cmd, &pos, &ttl_ms);
+        if (expiry < 0) { return out_err(resp, ERR_BAD_ARG, "invalid expire time"); }
+        bool persist = expiry == 0 && strcasecmp(cmd[2].c_str(), "persist") == 0;
+        if ((expiry == 0 && !persist) || pos + 1 != cmd.size()) { return out_err(resp, ERR_BAD_ARG, "syntax error"); }
+        has_ttl = true;     // PERSIST leaves ttl_ms at -1
+    }
+
+    Entry *entry = entry_lookup(cmd[1]);
+    if (!entry) { return out_nil(resp); }
+    if (entry->type != TYPE_STR) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+
+    char buf[k_num_buf];
+    size_t len = 0;
+    const char *val = entry_str(entry, buf, &len);
+    out_str(resp, val, len);
+    if (has_ttl) { entry_set_ttl(entry, ttl_ms); }
+}
+
+/**
+ * Command: GETDEL <key>
+ * GET and delete the key, nil for a missing key.
+ */
+void getdel_key(std::vector<std::string> &cmd, Buffer &resp) {
+    Entry *entry = entry_lookup(cmd[1]);
+    if (!entry) { return out_nil(resp); }
+    if (entry->type != TYPE_STR) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+
+    char buf[k_num_buf];
+    size_t len = 0;
+    const char *val = entry_str(entry, buf, &len);
+    out_str(resp, val, len);
+    entry_erase(entry);
+}
+
+// Find a string entry for INCR*, creating it as integer 0 when missing; NULL if of another type
+static Entry *expect_counter(std::string &s) {
+    LookupKey key;
+    key.key.swap(s);
+    key.node.hash_code = string_hash((uint8_t *)key.key.data(), key.key.size());
+
+    HNode *node = hm_lookup(&server_data.db, &key.node, &entry_equals);
+    if (node) {
+        Entry *entry = container_of(node, Entry, node);
+        return entry->type == TYPE_STR ? entry : NULL;
+    }
+
+    Entry *entry = entry_new(TYPE_STR);
+    entry->key.swap(key.key);
+    entry->node.hash_code = key.node.hash_code;
+    entry->str_enc = STR_ENC_INT;
+    entry->int_val = 0;
+    hm_insert(&server_data.db, &entry->node);
+    return entry;
+}
+
+/**
+ * Command: INCR|DECR <key>, INCRBY|DECRBY <key> <delta>
+ * Add to the integer value of a key, a missing key counts as 0. Replies with the new value.
+ */
+void incr_key(std::vector<std::string> &cmd, Buffer &resp) {
+    bool decr = cmd[0] == "decr" || cmd[0] == "decrby";
+    int64_t delta = 1;
+    if (cmd.size() == 3 && !str2int(cmd[2], delta)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+    if (decr && __builtin_sub_overflow((int64_t)0, delta, &delta)) {
+        return out_err(resp, ERR_BAD_ARG, "increment or decrement would overflow");
+    }
+
+    Entry *entry = expect_counter(cmd[1]);
+    if (!entry) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+
+    // Current value as an integer
+    int64_t val = 0;
+    switch (entry->str_enc) {
+    case STR_ENC_INT:
+        val = entry->int_val;
+        break;
+    case STR_ENC_DBL:   // a whole INCRBYFLOAT result reads back as an integer
+        val = (int64_t)entry->dbl_val;
+        if ((double)val != entry->dbl_val || fabs(entry->dbl_val) >= 0x1p63) {
+            return out_err(resp, ERR_BAD_ARG, "value is not an integer");
+        }
+        break;
+    default:
+        if (!str_is_int(entry->value, val)) { return out_err(resp, ERR_BAD_ARG, "value is not an integer"); }
+        break;
+    }
+
+    if (__builtin_add_overflow(val, delta, &val)) {
+        return out_err(resp, ERR_BAD_ARG, "increment or decrement would overflow");
+    }
+    if (entry->str_enc == STR_ENC_RAW) { std::string().swap(entry->value); }   // the bytes are not needed anymore
+    entry->str_enc = STR_ENC_INT;
+    entry->int_val = val;
+    entry_touch(entry);
+    return out_int(resp, val);
+}
+
+/**
+ * Command: INCRBYFLOAT <key> <delta>
+ * Add to the numeric value of a key, a missing key counts as 0. Replies with the new value as text.
+ */
+void incr_float_key(std::vector<std::string> &cmd, Buffer &resp) {
+    double delta = 0;
+    if (!str2dbl(cmd[2], delta) || isinf(delta)) { return out_err(resp, ERR_BAD_ARG, "expect float"); }
+
+    Entry *entry = expect_counter(cmd[1]);
+    if (!entry) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+
+    double val = 0;
+    switch (entry->str_enc) {
+    case STR_ENC_INT:
+        val = (double)entry->int_val;
+        break;
+    case STR_ENC_DBL:
+        val = entry->dbl_val;
+        break;
+    default:
+        if (entry->value.empty() || !str2dbl(entry->value, val) || isinf(val)) {
+            return out_err(resp, ERR_BAD_ARG, "value is not a valid float");
+        }
+        break;
+    }
+
+    val += delta;
+    if (isnan(val) || isinf(val)) { return out_err(resp, ERR_BAD_ARG, "increment would produce NaN or Infinity"); }
+    if (entry->str_enc == STR_ENC_RAW) { std::string().swap(entry->value); }
+    entry->str_enc = STR_ENC_DBL;
+    entry->dbl_val = val;
+    entry_touch(entry);
+
+    char buf[k_num_buf];
+    size_t len = 0;
+    const char *text = entry_str(entry, buf, &len);
+    return out_str(resp, text, len);
+}
+
+// String entry of a key; `*wrong_type` is set if the key holds another type
+static Entry *expect_str(std::string &key, bool *wrong_type) {
+    Entry *entry = entry_lookup(key);
+    *wrong_type = entry && entry->type != TYPE_STR;
+    return *wrong_type ? NULL : entry;
+}
+
+/**
+ * Command: APPEND <key> <value>
+ * Append to a string in place, a missing key starts empty. Replies with the new length.
+ * The bytes grow geometrically, so appending N bytes in pieces costs O(N) overall.
+ */
+void append_key(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Entry *entry = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if (!entry) {
+        int64_t len = (int64_t)cmd[2].size();
+        entry = entry_insert(cmd[1], TYPE_STR);
+        entry_set_str(entry, cmd[2]);     // takes the bytes
+        return out_int(resp, len);
+    }
+
+    std::string &bytes = entry_raw_str(entry);
+    if (bytes.size() + cmd[2].size() > k_str_max_bytes) { return out_err(resp, ERR_BAD_ARG, "string exceeds maximum allowed size"); }
+    bytes.append(cmd[2]);
+    return out_int(resp, (int64_t)bytes.size());
+}
+
+/**
+ * Command: GETRANGE <key> <start> <end>
+ * Bytes [start, end] of a string, negative indexes count from the end. Empty past the end or
+ * for a missing key.
+ */
+void getrange_key(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t start = 0, end = 0;
+    if (!str2int(cmd[2], start) || !str2int(cmd[3], end)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+
+    bool wrong_type = false;
+    Entry *entry = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if (!entry) { return out_str(resp, "", 0); }
+
+    char buf[k_num_buf];
+    size_t len = 0, from = 0, to = 0;
+    const char *val = entry_str(entry, buf, &len);
+    if (!byte_range(start, end, len, &from, &to)) { return out_str(resp, "", 0); }
+    return out_str(resp, val + from, to - from);
+}
+
+/**
+ * Command: SETRANGE <key> <offset> <value>
+ * Overwrite the bytes of a string from `offset`, padding with zero bytes past its end.
+ * Replies with the new length; an empty value leaves a missing key missing.
+ */
+void setrange_key(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t offset = 0;
+    if (!str2int(cmd[2], offset) || offset < 0) { return out_err(resp, ERR_BAD_ARG, "offset is out of range"); }
+    const std::string &val = cmd[3];
+    if ((uint64_t)offset + val.size() > k_str_max_bytes) { return out_err(resp, ERR_BAD_ARG, "string exceeds maximum allowed size"); }
+
+    bool wrong_type = false;
+    Entry *entry = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if (val.empty()) {
+        char buf[k_num_buf];
+        size_t len = 0;
+        if (entry) { entry_str(entry, buf, &len); }
+        return out_int(resp, (int64_t)len);
+    }
+    if (!entry) { entry = entry_insert(cmd[1], TYPE_STR); }
+
+    std::string &bytes = entry_raw_str(entry);
+    size_t end = (size_t)offset + val.size();
+    if (bytes.size() < end) { bytes.resize(end, '\0'); }
+    memcpy(&bytes[(size_t)offset], val.data(), val.size());
+    return out_int(resp, (int64_t)bytes.size());
+}
+
+/**
+ * Command: STRLEN <key>
+ * Length of a string, 0 for a missing key.
+ */
+void strlen_key(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Entry *entry = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+
+    char buf[k_num_buf];
+    size_t len = 0;
+    if (entry) { entry_str(entry, buf, &len); }
+    return out_int(resp, (int64_t)len);
+}
+
+/**
+ * Command: GETS <key>
+ * Value and version of a string as a 2-element array, nil for a missing key. The version
+ * changes with every write of the value and is passed back to CAS/CAD.
+ */
+void gets_key(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Entry *entry = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if (!entry) { return out_nil(resp); }
+
+    char buf[k_num_buf];
+    size_t len = 0;
+    const char *val = entry_str(entry, buf, &len);
+    out_arr(resp, 2);
+    out_str(resp, val, len);
+    out_int(resp, (int64_t)entry->version);
+}
+
+// Parse the version argument of CAS/CAD, versions are positive and 0 stands for a missing key
+static bool parse_version(const std::string &arg, uint64_t *version) {
+    int64_t val = 0;
+    if (!str2int(arg, val) || val < 0) { return false; }
+    *version = (uint64_t)val;
+    return true;
+}
+
+/**
+ * Command: CAS <key> <version> <value>
+ * Write the value only if the string still has `version` (0 to create a missing key), keeping
+ * its TTL. Replies with the new version, or 0 if the key changed since it was read.
+ */
+void cas_key(std::vector<std::string> &cmd, Buffer &resp) {
+    uint64_t version = 0;
+    if (!parse_version(cmd[2], &version)) { return out_err(resp, ERR_BAD_ARG, "expect version"); }
+
+    bool wrong_type = false;
+    Entry *entry = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if ((entry ? entry->version : 0) != version) { return out_int(resp, 0); }
+
+    if (!entry) { entry = entry_insert(cmd[1], TYPE_STR); }
+    entry_set_str(entry, cmd[3]);
+    return out_int(resp, (int64_t)entry->version);
+}
+
+/**
+ * Command: CAD <key> <version>
+ * Delete the string only if it still has `version`. Replies 1 if deleted, 0 otherwise.
+ */
+void cad_key(std::vector<std::string> &cmd, Buffer &resp) {
+    uint64_t version = 0;
+    if (!parse_version(cmd[2], &version)) { return out_err(resp, ERR_BAD_ARG, "expect version"); }
+
+    bool wrong_type = false;
+    Entry *entry = expect_str(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect string"); }
+    if (!entry || entry->version != version) { return out_int(resp, 0); }
+
+    entry_erase(entry);
+    return out_int(resp, 1);
+}
+
+/**
+ * Command: RATELIMIT <key> <burst> <rate> <period ms> [quantity]
+ * GCRA limiter allowing `rate` requests per period and up to `burst` at once. The key holds
+ * the theoretical arrival time (TAT) in monotonic microseconds as an inline integer, and its
+ * TTL ends when the limiter is back to full, so idle limiters clean themselves up.
+ * Replies with [allowed 1|0, remaining, retry after ms], retry after is -1 when allowed or when
+ * `quantity` exceeds the burst and can never be.
+ */
+void ratelimit_key(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t burst = 0, rate = 0, period = 0, quantity = 1;
+    if (!str2int(cmd[2], burst) || !str2int(cmd[3], rate) || !str2int(cmd[4], period)
+        || (cmd.size() == 6 && !str2int(cmd[5], quantity))) {
+        return out_err(resp, ERR_BAD_ARG, "expect int");
+    }
+    if (burst < 1 || rate < 1 || period < 1 || quantity < 0) { return out_err(resp, ERR_BAD_ARG, "expect positive values"); }
+
+    // Emission interval and tolerance in microseconds
+    int64_t interval = 0, tolerance = 0, cost = 0;
+    if (__builtin_mul_overflow(period, (int64_t)1000, &interval)
+        || (interval /= rate) == 0
+        || __builtin_mul_overflow(interval, burst, &tolerance)
+        || __builtin_mul_overflow(interval, quantity, &cost)) {
+        return out_err(resp, ERR_BAD_ARG, "rate limit out of range");
+    }
+
+    bool wrong_type = false;
+    Entry *entry = expect_str(cmd[1], &wrong_type);
+    if (wrong_type || (entry && entry->str_enc != STR_ENC_INT)) { return out_err(resp, ERR_BAD_TYP, "expect rate limit"); }
+
+    int64_t now = (int64_t)get_current_time_ms() * 1000;
+    int64_t tat = entry && entry->int_val > now ? entry->int_val : now;
+    int64_t new_tat = tat + cost;
+    int64_t allow_at = new_tat - tolerance;
+
+    out_arr(resp, 3);
+    if (now < allow_at) {
+        // Denied, the stored TAT is left alone
+        out_int(resp, 0);
+        out_int(resp, (tolerance - (tat - now)) / interval);
+        return out_int(resp, cost > tolerance ? -1 : (allow_at - now + 999) / 1000);
+    }
+
+    if (!entry) { entry = entry_insert(cmd[1], TYPE_STR); }
+    entry->str_enc = STR_ENC_INT;
+    entry->int_val = new_tat;
+    entry_touch(entry);
+    entry_set_ttl(entry, (new_tat - now + 999) / 1000);
+
+    out_int(resp, 1);
+    out_int(resp, (tolerance - (new_tat - now)) / interval);
+    return out_int(resp, -1);
 }
 
 // Delete the value of the key from the hash table
@@ -167,12 +733,46 @@ void get_ttl_ms(std::vector<std::string> &cmd, Buffer &out) {
     return out_int(out, expires_at > now_ms ? (expires_at - now_ms) : 0);
 }
 
+/**
+ * Command: PEXPIREAT <key> <unix ms>
+ * Expire the key at a Unix time, a time already past expires it at once. 1 if the key exists.
+ */
+void set_expire_at_ms(std::vector<std::string> &cmd, Buffer &out) {
+    int64_t at_ms = 0;
+    if (!str2int(cmd[2], at_ms)) { return out_err(out, ERR_BAD_ARG, "expect int"); }
+
+    Entry *entry = entry_lookup(cmd[1]);
+    if (!entry) { return out_int(out, 0); }
+    int64_t now_ms = (int64_t)get_wall_time_ms();
+    entry_set_ttl(entry, at_ms > now_ms ? at_ms - now_ms : 0);
+    return out_int(out, 1);
+}
+
+/**
+ * Command: PEXPIRETIME <key>
+ * Unix time in ms the key expires at, -1 without a TTL, -2 if missing. Deadlines are kept on
+ * the monotonic clock and converted back with the current wall time.
+ */
+void get_expire_time_ms(std::vector<std::string> &cmd, Buffer &out) {
+    Entry *entry = entry_lookup(cmd[1]);
+    if (!entry) { return out_int(out, -2); }
+    if (entry->heap_idx == (size_t)-1) { return out_int(out, -1); }
+
+    uint64_t expires_at = server_data.heap[entry->heap_idx].val;
+    uint64_t now_ms = get_current_time_ms(), wall_ms = get_wall_time_ms();
+    uint64_t left = expires_at > now_ms ? expires_at - now_ms : 0;
+    return out_int(out, (int64_t)(wall_ms + left));
+}
+
 // Callback function for the keys command
 static bool cb_keys(HNode *node, void *arg) {
     Buffer &resp = *(Buffer *)arg;
     const Entry *entry = container_of(node, Entry, node);
+    char buf[k_num_buf];
+    size_t len = 0;
+    const char *val = entry_str(entry, buf, &len);
     // Emit one array element as a nested array: key : value
-    std::string kV_pair = entry->key + " : " + entry->value;
+    std::string kV_pair = entry->key + " : " + std::string(val, len);
     out_str(resp, kV_pair.data(), kV_pair.size());
     return true;
 }
@@ -198,10 +798,17 @@ void run_request(std::vector<std::string> &cmd, Buffer &resp) {
     }
 
     // set request
-    else if (cmd.size() == 3 && cmd[0] == "set") {
+    // set <key> <value> [nx|xx] [get] [ex <s>|px <ms>|exat <unix s>|pxat <unix ms>|keepttl]
+    //                                  → stores a string, nil (1/0 with nx|xx, old value with get)   e.g. set lock:a tok nx px 30000
+    else if (cmd.size() >= 3 && cmd[0] == "set") {
         return set_key(cmd, resp);
     }
 
+    // getex <key> [ex <s>|px <ms>|exat <unix s>|pxat <unix ms>|persist] → value, updates the ttl   e.g. getex session:1 px 60000
+    // getdel <key>                                                       → value, deletes the key    e.g. getdel token:9
+    else if ((cmd.size() == 2 || cmd.size() == 3 || cmd.size() == 4) && cmd[0] == "getex") { return getex_key(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "getdel") { return getdel_key(cmd, resp); }
+
     // del request
     else if (cmd.size() == 2 && cmd[0] == "del") {
         return del_key(cmd, resp);
@@ -212,22 +819,208 @@ void run_request(std::vector<std::string> &cmd, Buffer &resp) {
         return all_keys(cmd, resp);
     }
 
+    // counters
+    // incr <key> / decr <key>                → adds ±1 to an integer value   e.g. incr visits
+    // incrby <key> <n> / decrby <key> <n>    → adds ±n                      e.g. incrby visits 10
+    // incrbyfloat <key> <f>                  → adds a float                 e.g. incrbyfloat price 0.5
+    else if (cmd.size() == 2 && (cmd[0] == "incr" || cmd[0] == "decr")) { return incr_key(cmd, resp); }
+    else if (cmd.size() == 3 && (cmd[0] == "incrby" || cmd[0] == "decrby")) { return incr_key(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "incrbyfloat") { return incr_float_key(cmd, resp); }
+
+    // partial strings
+    // append <key> <value>                 → appends in place, prints the new length   e.g. append log:1 "line\n"
+    // getrange <key> <start> <end>         → bytes [start, end], negatives from the end  e.g. getrange blob 0 63
+    // setrange <key> <offset> <value>      → overwrites from offset, prints the length   e.g. setrange blob 16 abc
+    // strlen <key>                         → length of the value                         e.g. strlen blob
+    else if (cmd.size() == 3 && cmd[0] == "append") { return append_key(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "getrange") { return getrange_key(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "setrange") { return setrange_key(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "strlen") { return strlen_key(cmd, resp); }
+
+    // versioned writes (optimistic concurrency)
+    // gets <key>                     → [value, version] or nil    e.g. gets cfg:feature
+    // cas <key> <version> <value>    → new version, 0 if changed  e.g. cas cfg:feature 41 on
+    // cad <key> <version>            → 1 if deleted, 0 if changed e.g. cad lock:a 42
+    else if (cmd.size() == 2 && cmd[0] == "gets") { return gets_key(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "cas") { return cas_key(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "cad") { return cad_key(cmd, resp); }
+
+    // rate limiting (GCRA)
+    // ratelimit <key> <burst> <rate> <period ms> [quantity] → [allowed, remaining, retry after ms]   e.g. ratelimit rl:user:7 20 100 60000
+    else if ((cmd.size() == 5 || cmd.size() == 6) && cmd[0] == "ratelimit") { return ratelimit_key(cmd, resp); }
+
+    // bitmaps (on string values)
+    // setbit <key> <offset> <0|1>          → sets a bit, prints the old one     e.g. setbit dau:1018 4242 1
+    // getbit <key> <offset>                → 0 or 1                             e.g. getbit dau:1018 4242
+    // bitcount <key> [<start> <end>]       → set bits, optionally in a byte range   e.g. bitcount dau:1018
+    // bitop <and|or|xor|not> <dst> <key>...  → combines bitmaps, prints the length  e.g. bitop and both dau:1017 dau:1018
+    // bitpos <key> <0|1> [<start> [<end>]] → first bit with that value          e.g. bitpos dau:1018 1
+    else if (cmd.size() == 4 && cmd[0] == "setbit") { return bcmd_setbit(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "getbit") { return bcmd_getbit(cmd, resp); }
+    else if ((cmd.size() == 2 || cmd.size() == 4) && cmd[0] == "bitcount") { return bcmd_count(cmd, resp); }
+    else if (cmd.size() >= 4 && cmd[0] == "bitop") { return bcmd_op(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd.size() <= 5 && cmd[0] == "bitpos") { return bcmd_pos(cmd, resp); }
+
+    // hash requests
+    // hset <key> <field> <value> ...  → sets fields, prints the number added   e.g. hset user:1 name ann age 31
+    // hget <key> <field>              → value or nil                           e.g. hget user:1 name
+    // hmget <key> <field> ...         → array of values or nil                 e.g. hmget user:1 name age
+    // hdel <key> <field> ...          → number of fields removed               e.g. hdel user:1 age
+    // hgetall <key>                   → [field, value, ...]                    e.g. hgetall user:1
+    // hincrby <key> <field> <n>       → adds n to an integer field             e.g. hincrby user:1 age 1
+    else if (cmd.size() >= 4 && cmd.size() % 2 == 0 && cmd[0] == "hset") { return hcmd_set(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "hget") { return hcmd_get(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd[0] == "hmget") { return hcmd_mget(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd[0] == "hdel") { return hcmd_del(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "hgetall") { return hcmd_getall(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "hincrby") { return hcmd_incrby(cmd, resp); }
+
+    // list requests
+    // lpush/rpush <key> <item> ...     → pushes at the head/tail, prints the length   e.g. rpush log a b c
+    // lpop/rpop <key> [count]          → pops from the head/tail                      e.g. lpop log
+    // llen <key>                       → number of items                              e.g. llen log
+    // lrange <key> <start> <stop>      → items by index                               e.g. lrange log 0 -1
+    // ltrim <key> <start> <stop>       → keeps only the items in the range            e.g. ltrim log -100 -1
+    else if (cmd.size() >= 3 && (cmd[0] == "lpush" || cmd[0] == "rpush")) { return lcmd_push(cmd, resp); }
+    else if ((cmd.size() == 2 || cmd.size() == 3) && (cmd[0] == "lpop" || cmd[0] == "rpop")) { return lcmd_pop(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "llen") { return lcmd_len(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "lrange") { return lcmd_range(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "ltrim") { return lcmd_trim(cmd, resp); }
+
+    // set requests
+    // sadd <key> <member> ...          → adds members, prints the number added     e.g. sadd tag:red 1 5 9
+    // srem <key> <member> ...          → number of members removed                 e.g. srem tag:red 5
+    // sismember <key> <member>         → 1 or 0                                    e.g. sismember tag:red 9
+    // scard <key>                      → number of members                         e.g. scard tag:red
+    // smembers <key>                   → every member                              e.g. smembers tag:red
+    // sinter <key> ...                 → members in all the sets                   e.g. sinter tag:red tag:big
+    // sunion <key> ...                 → members in any of the sets                e.g. sunion tag:red tag:big
+    else if (cmd.size() >= 3 && cmd[0] == "sadd") { return scmd_add(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd[0] == "srem") { return scmd_rem(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "sismember") { return scmd_ismember(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "scard") { return scmd_card(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "smembers") { return scmd_members(cmd, resp); }
+    else if (cmd.size() >= 2 && cmd[0] == "sinter") { return scmd_inter(cmd, resp); }
+    else if (cmd.size() >= 2 && cmd[0] == "sunion") { return scmd_union(cmd, resp); }
+
+    // hyperloglog requests
+    // pfadd <key> <element> ...       → adds elements, prints 1 if the estimate changed   e.g. pfadd visitors:1018 u42 u7
+    // pfcount <key> ...               → estimated distinct elements of the union          e.g. pfcount visitors:1018
+    // pfmerge <dst> <src> ...         → stores the union in dst                           e.g. pfmerge visitors:week visitors:1018
+    else if (cmd.size() >= 2 && cmd[0] == "pfadd") { return pfcmd_add(cmd, resp); }
+    else if (cmd.size() >= 2 && cmd[0] == "pfcount") { return pfcmd_count(cmd, resp); }
+    else if (cmd.size() >= 2 && cmd[0] == "pfmerge") { return pfcmd_merge(cmd, resp); }
+
+    // bloom filter requests
+    // bf.reserve <key> <error_rate> <capacity>  → creates an empty filter        e.g. bf.reserve seen 0.001 1000000
+    // bf.add <key> <item>                       → 1 if new, 0 if maybe present   e.g. bf.add seen user:42
+    // bf.madd <key> <item> ...                  → array of bf.add results        e.g. bf.madd seen user:1 user:2
+    // bf.exists <key> <item>                    → 0 if surely absent, else 1     e.g. bf.exists seen user:42
+    // bf.mexists <key> <item> ...               → array of bf.exists results     e.g. bf.mexists seen user:1 user:3
+    else if (cmd.size() == 4 && cmd[0] == "bf.reserve") { return bfcmd_reserve(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "bf.add") { return bfcmd_add(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd[0] == "bf.madd") { return bfcmd_madd(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "bf.exists") { return bfcmd_exists(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd[0] == "bf.mexists") { return bfcmd_mexists(cmd, resp); }
+
+    // top-k requests
+    // topk.reserve <key> <k> [<width> <depth> <decay>] → creates an empty sketch             e.g. topk.reserve hot:urls 50
+    // topk.add <key> <item> ...                        → array of expelled items or nil     e.g. topk.add hot:urls /a /b
+    // topk.query <key> <item> ...                      → array of 1 if in the top-k, else 0 e.g. topk.query hot:urls /a
+    // topk.list <key> [withcount]                      → items, most frequent first         e.g. topk.list hot:urls withcount
+    else if ((cmd.size() == 3 || cmd.size() == 6) && cmd[0] == "topk.reserve") { return topkcmd_reserve(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd[0] == "topk.add") { return topkcmd_add(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd[0] == "topk.query") { return topkcmd_query(cmd, resp); }
+    else if ((cmd.size() == 2 || cmd.size() == 3) && cmd[0] == "topk.list") { return topkcmd_list(cmd, resp); }
+
+    // json requests
+    // json.set <key> <path> <json> [nx|xx]  → sets the value at a path, nil (1/0 with nx|xx)   e.g. json.set user:1 $.address.city '"Oslo"'
+    // json.get <key> [path]                 → the subtree as JSON text or nil                  e.g. json.get user:1 $.address
+    // json.numincrby <key> <path> <n>       → adds to a number, prints the result              e.g. json.numincrby user:1 $.visits 1
+    else if ((cmd.size() == 4 || cmd.size() == 5) && cmd[0] == "json.set") { return jsoncmd_set(cmd, resp); }
+    else if ((cmd.size() == 2 || cmd.size() == 3) && cmd[0] == "json.get") { return jsoncmd_get(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "json.numincrby") { return jsoncmd_numincrby(cmd, resp); }
+
+    // stream requests
+    // xadd <key> [maxlen [=|~] <n>] <id|*> <field> <value> ... → appends an entry, prints its id   e.g. xadd clicks * page /home
+    // xrange <key> <start> <end> [count <n>]     → entries oldest first, ids or - +         e.g. xrange clicks - + count 10
+    // xrevrange <key> <end> <start> [count <n>]  → entries newest first                     e.g. xrevrange clicks + (1700000000000-0
+    // xtrim <key> maxlen [=|~] <n>               → keeps the newest n, prints how many went e.g. xtrim clicks maxlen ~ 1000
+    // xlen <key>                                 → number of entries                         e.g. xlen clicks
+    else if (cmd.size() >= 5 && cmd[0] == "xadd") { return xcmd_add(cmd, resp); }
+    else if ((cmd.size() == 4 || cmd.size() == 6) && cmd[0] == "xrange") { return xcmd_range(cmd, resp); }
+    else if ((cmd.size() == 4 || cmd.size() == 6) && cmd[0] == "xrevrange") { return xcmd_range(cmd, resp); }
+    else if ((cmd.size() == 4 || cmd.size() == 5) && cmd[0] == "xtrim") { return xcmd_trim(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "xlen") { return xcmd_len(cmd, resp); }
+
+    // time series requests
+    // ts.add <key> <timestamp|*> <value> [retention <ms>]  → appends a sample, prints its timestamp   e.g. ts.add cpu:1 * 0.42
+    // ts.range <key> <from|-> <to|+> [aggregation avg|min|max|sum|count <bucket_ms>]
+    //                                → [timestamp, value] pairs, or one per bucket       e.g. ts.range cpu:1 - + aggregation avg 60000
+    // ts.info <key>                  → [samples, chunks, bytes, retention]                e.g. ts.info cpu:1
+    else if ((cmd.size() == 4 || cmd.size() == 6) && cmd[0] == "ts.add") { return tscmd_add(cmd, resp); }
+    else if ((cmd.size() == 4 || cmd.size() == 7) && cmd[0] == "ts.range") { return tscmd_range(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "ts.info") { return tscmd_info(cmd, resp); }
+
+    // geo requests (members of a zset scored by geohash)
+    // geoadd <key> <lon> <lat> <member> ...   → adds members, prints the number added   e.g. geoadd shops 13.361389 38.115556 palermo
+    // geopos <key> <member> ...               → [lon, lat] of each member or nil       e.g. geopos shops palermo
+    // geodist <key> <m1> <m2> [m|km|mi|ft]    → distance between two members            e.g. geodist shops palermo catania km
+    // geosearch <key> frommember <m> | fromlonlat <lon> <lat> byradius <r> <unit> | bybox <w> <h> <unit>
+    //           [asc|desc] [count <n>] [withdist] [withcoord]  → members in the shape   e.g. geosearch shops fromlonlat 15 37 byradius 200 km
+    else if (cmd.size() >= 5 && cmd[0] == "geoadd") { return geocmd_add(cmd, resp); }
+    else if (cmd.size() >= 3 && cmd[0] == "geopos") { return geocmd_pos(cmd, resp); }
+    else if ((cmd.size() == 4 || cmd.size() == 5) && cmd[0] == "geodist") { return geocmd_dist(cmd, resp); }
+    else if (cmd.size() >= 6 && cmd[0] == "geosearch") { return geocmd_search(cmd, resp); }
+
     // zset requests
-    // zadd <key> <score> <member>     → adds/updates a member   e.g. zadd players 100 alice
+    // zadd <key> [nx|xx] [gt|lt] [incr] <score> <member> ... → adds/updates members   e.g. zadd players 100 alice 90 bob
     // zscore <key> <member>           → gets member’s score     e.g. zscore players alice
     // zrem <key> <member>             → removes a member        e.g. zrem players alice
     // zquery <key> <min> <max> <off> <limit> → range query     e.g. zquery players 0 200 0 3
-    else if (cmd.size() == 4 && cmd[0] == "zadd") { return zcmd_add(cmd, resp); }
+    else if (cmd.size() >= 4 && cmd[0] == "zadd") { return zcmd_add(cmd, resp); }
     else if (cmd.size() == 3 && cmd[0] == "zrem") { return zcmd_remove(cmd, resp); }
     else if (cmd.size() == 3 && cmd[0] == "zscore") { return zcmd_score(cmd, resp); }
     else if (cmd.size() == 6 && cmd[0] == "zquery") { return zcmd_query(cmd, resp); }
 
+    // zrank <key> <member>            → 0-based rank           e.g. zrank players alice
+    // zcount <key> <min> <max>        → members in score range e.g. zcount players 100 (200
+    // zrange <key> <start> <stop>     → members by rank index  e.g. zrange players 0 -1
+    else if (cmd.size() == 3 && cmd[0] == "zrank") { return zcmd_rank(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "zrevrank") { return zcmd_revrank(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "zcount") { return zcmd_count(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "zrange") { return zcmd_range(cmd, resp); }
+    else if (cmd.size() == 4 && cmd[0] == "zrevrange") { return zcmd_revrange(cmd, resp); }
+
+    // zunionstore <dst> <numkeys> <key> ... [weights <w> ...] [aggregate sum|min|max]   e.g. zunionstore all 2 week1 week2
+    // zinterstore <dst> <numkeys> <key> ... [weights <w> ...] [aggregate sum|min|max]   e.g. zinterstore both 2 week1 week2 aggregate max
+    // zdiffstore <dst> <numkeys> <key> ...  → members only in the first key             e.g. zdiffstore gone 2 week1 week2
+    else if (cmd.size() >= 4 && cmd[0] == "zunionstore") { return zcmd_unionstore(cmd, resp); }
+    else if (cmd.size() >= 4 && cmd[0] == "zinterstore") { return zcmd_interstore(cmd, resp); }
+    else if (cmd.size() >= 4 && cmd[0] == "zdiffstore") { return zcmd_diffstore(cmd, resp); }
+
+    // zpopmin <key> [count] → removes the lowest-scored members   e.g. zpopmin jobs 10
+    // zpopmax <key> [count] → removes the highest-scored members  e.g. zpopmax jobs
+    // (bzpopmin/bzpopmax <key> ... <timeout> need the connection and are run by handle_one_request)
+    else if ((cmd.size() == 2 || cmd.size() == 3) && cmd[0] == "zpopmin") { return zcmd_popmin(cmd, resp); }
+    else if ((cmd.size() == 2 || cmd.size() == 3) && cmd[0] == "zpopmax") { return zcmd_popmax(cmd, resp); }
+
+    // zpexpire <key> <member> <ttl> → expires a member after ttl ms   e.g. zpexpire recent alice 60000
+    // zpttl <key> <member>          → ms left before a member expires e.g. zpttl recent alice
+    else if (cmd.size() == 4 && cmd[0] == "zpexpire") { return zcmd_pexpire(cmd, resp); }
+    else if (cmd.size() == 3 && cmd[0] == "zpttl") { return zcmd_pttl(cmd, resp); }
+
     // ttl requests
     // pttl <key> → gets the ttl of the key   e.g. pttl players
     // pexpire <key> <ttl> → sets the ttl of the key   e.g. pexpire players 1000
     else if (cmd.size() == 2 && cmd[0] == "pttl") { return get_ttl_ms(cmd, resp); }
     else if (cmd.size() == 3 && cmd[0] == "pexpire") { return set_ttl_ms(cmd, resp); }
 
+    // pexpireat <key> <unix ms> → expires the key at a Unix time   e.g. pexpireat players 1893456000000
+    // pexpiretime <key>         → Unix ms of the expiry, -1 or -2  e.g. pexpiretime players
+    else if (cmd.size() == 3 && cmd[0] == "pexpireat") { return set_expire_at_ms(cmd, resp); }
+    else if (cmd.size() == 2 && cmd[0] == "pexpiretime") { return get_expire_time_ms(cmd, resp); }
+
     // unknown request
     else {
         // Error in executing command
@@ -9,6 +9,15 @@
 #include "hashtable.h" // HNode, HMap, hm_*
 #include "../core/buffer_io.h" // Buffer
 #include "sorted_set.h" // ZSet, ZNode, zset_*
+#include "hash.h" // Hash, hash_*
+#include "quicklist.h" // QList, qlist_*
+#include "set.h" // Set, set_*
+#include "hyperloglog.h" // Hll, hll_*
+#include "bloom.h" // Bloom, bloom_*
+#include "stream.h" // Stream, stream_*
+#include "timeseries.h" // TimeSeries, ts_*
+#include "topk.h" // TopK, topk_*
+#include "json.h" // Json, json_*
 #include "heap.h" // HeapItem, heap_* operations
 #include "list.h" // DList
 #include "../core/thread_pool.h" // TheadPool
@@ -23,6 +32,12 @@ struct ServerData {
     DList idle_conn_list; // list to store the timers for idle connections
     std::vector<HeapItem> heap; // heap to store the ttl values of the keys
     TheadPool thread_pool; // worker pool for heavy destructors
+    HMap blocked_keys; // keys with connections parked by BZPOPMIN/BZPOPMAX
+    std::vector<HeapItem> block_heap; // timeouts of the parked connections
+    std::vector<std::string> ready_keys; // keys written since the parked connections were last served
+    std::vector<HeapItem> zset_heap; // sorted sets with member deadlines, by their earliest deadline
+    std::vector<HeapItem> ts_heap; // time series with a retention, by when their oldest chunk expires
+    uint64_t version = 0; // last version stamped on a string write, never reused
 };
 
 // Global instance of the server data
@@ -34,6 +49,22 @@ enum ValueType : uint8_t {
     TYPE_INIT  = 0,
     TYPE_STR   = 1,    // string
     TYPE_ZSET  = 2,    // sorted set
+    TYPE_HASH  = 3,    // field/value map
+    TYPE_LIST  = 4,    // list of items
+    TYPE_SET   = 5,    // unordered set of members
+    TYPE_HLL   = 6,    // HyperLogLog cardinality sketch
+    TYPE_BLOOM = 7,    // scalable Bloom filter
+    TYPE_STREAM = 8,   // append-only log of field/value entries
+    TYPE_TS    = 9,    // compressed time series
+    TYPE_TOPK  = 10,   // top-k heavy hitters sketch
+    TYPE_JSON  = 11,   // parsed JSON document
+};
+
+// Encoding of a TYPE_STR value, numbers that print back identically are kept inline
+enum StrEncoding : uint8_t {
+    STR_ENC_RAW = 0,    // bytes in `value`
+    STR_ENC_INT = 1,    // int64 in `int_val`
+    STR_ENC_DBL = 2,    // double in `dbl_val`, left by INCRBYFLOAT
 };
 
 // KV pair storage for the server
@@ -42,30 +73,99 @@ struct Entry {
     std::string key;        // key of the entry
 
     size_t heap_idx = (size_t)-1; // index of the item in the heap, this is for the ttl
+    uint64_t version = 0; // stamped by entry_touch on every write of a string value, for GETS/CAS
     uint32_t type = TYPE_INIT; // type of the value
+    uint8_t str_enc = STR_ENC_RAW; // encoding of a TYPE_STR value
 
     // One of the following
     std::string value;      // value of the entry
+    union {
+        int64_t int_val = 0;
+        double  dbl_val;
+    };
     ZSet zset;
+    union {                 // types held by pointer, allocated by entry_new
+        Hash  *hash = NULL;
+        QList *list;
+        Set   *set;
+        Hll   *hll;
+        Bloom *bloom;
+        Stream *stream;
+        TimeSeries *ts;
+        TopK  *topk;
+        Json  *json;
+    };
 };
 
 inline static Entry *entry_new(uint32_t type = TYPE_INIT) {
     Entry *entry = new Entry();
     entry->type = type;
+    if (type == TYPE_HASH) { entry->hash = new Hash(); }
+    if (type == TYPE_LIST) {
+        entry->list = new QList();
+        qlist_init(entry->list);
+    }
+    if (type == TYPE_SET) { entry->set = new Set(); }
+    if (type == TYPE_HLL) { entry->hll = new Hll(); }
+    if (type == TYPE_BLOOM) { entry->bloom = new Bloom(); }
+    if (type == TYPE_STREAM) {
+        entry->stream = new Stream();
+        stream_init(entry->stream);
+    }
+    if (type == TYPE_TS) { entry->ts = new TimeSeries(); }
+    if (type == TYPE_TOPK) { entry->topk = new TopK(); }
+    if (type == TYPE_JSON) { entry->json = new Json(); }
     return entry;
 }
 
+// Entry of a key, NULL if missing (`key` is borrowed for the lookup and left unchanged)
+Entry *entry_lookup(std::string &key);
+
+// Add a new entry of the given type under `key`, which is moved into the entry
+Entry *entry_insert(std::string &key, uint32_t type);
+
+// Remove an entry from the db and free it
+void entry_erase(Entry *entry);
+
+// Buffer size for printing an encoded number
+const size_t k_num_buf = 32;
+
+// Text of a string value, encoded numbers are printed into `buf` (k_num_buf bytes)
+const char *entry_str(const Entry *entry, char *buf, size_t *len);
+
+// Bytes of a string value for in-place edits, an inline number is turned back into text.
+// Stamps a new version, the caller is about to change the bytes.
+std::string &entry_raw_str(Entry *entry);
+
 // the error was that the ttl_ms was unsigned, but it should be signed, as we are using -1 to remove the ttl
 void entry_set_ttl(Entry *entry, int64_t ttl);
 
+// Stamp a string entry with a fresh version as its value changes. Versions come from one
+// server-wide counter, so a key that is deleted and set again never repeats an old version.
+inline static void entry_touch(Entry *entry) {
+    entry->version = ++server_data.version;
+}
+
 // Heavy delete (may offload to thread pool)
 void entry_del(Entry *entry);
 
 // Request handlers
 void set_key(std::vector<std::string> &cmd, Buffer &resp); // set the value of the key
 void get_key(std::vector<std::string> &cmd, Buffer &resp); // get the value of the key
+void getex_key(std::vector<std::string> &cmd, Buffer &resp); // GETEX
+void getdel_key(std::vector<std::string> &cmd, Buffer &resp); // GETDEL
 void del_key(std::vector<std::string> &cmd, Buffer &resp); // delete the value of the key
 void all_keys(std::vector<std::string> &, Buffer &resp); // get all the keys
+void incr_key(std::vector<std::string> &cmd, Buffer &resp); // INCR/DECR/INCRBY/DECRBY
+void incr_float_key(std::vector<std::string> &cmd, Buffer &resp); // INCRBYFLOAT
+void append_key(std::vector<std::string> &cmd, Buffer &resp); // APPEND
+void getrange_key(std::vector<std::string> &cmd, Buffer &resp); // GETRANGE
+void setrange_key(std::vector<std::string> &cmd, Buffer &resp); // SETRANGE
+void strlen_key(std::vector<std::string> &cmd, Buffer &resp); // STRLEN
+void gets_key(std::vector<std::string> &cmd, Buffer &resp); // GETS
+void cas_key(std::vector<std::string> &cmd, Buffer &resp); // CAS
+void cad_key(std::vector<std::string> &cmd, Buffer &resp); // CAD
+void ratelimit_key(std::vector<std::string> &cmd, Buffer &resp); // RATELIMIT (GCRA)
 
 // Run one request
 void run_request(std::vector<std::string> &cmd, Buffer &resp);
@@ -0,0 +1,430 @@
+// C stdlib
+#include <math.h>    // sin, cos, asin, sqrt, floor
+#include <strings.h> // strcasecmp
+
+// C++ stdlib
+#include <algorithm> // std::sort, std::partial_sort
+#include <vector>    // std::vector (cells, hits)
+
+// local
+#include "geo.h"
+#include "commands.h"            // Entry, TYPE_ZSET, entry_lookup, entry_insert
+#include "sorted_set.h"          // ZSet, ZIter, zset_*
+#include "../core/common.h"      // str2dbl, str2int
+#include "../core/sys.h"         // get_current_time_ms
+#include "../net/blocking.h"     // block_signal_key
+#include "../net/serialize.h"    // out_*, ERR_*
+
+// Earth radius of the haversine distance, in meters
+const double k_earth_radius = 6372797.560856;
+
+/** ------------------------------------------------------------
+ *    Geohash
+ * ------------------------------------------------------------
+ */
+
+static double deg_rad(double deg) { return deg * M_PI / 180; }
+static double rad_deg(double rad) { return rad * 180 / M_PI; }
+
+// Spread the low 32 bits of `v` over the even bits of the result
+static uint64_t bits_spread(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+    x = (x | (x << 8))  & 0x00ff00ff00ff00ffull;
+    x = (x | (x << 4))  & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x << 2))  & 0x3333333333333333ull;
+    x = (x | (x << 1))  & 0x5555555555555555ull;
+    return x;
+}
+
+// Inverse of bits_spread: gather the even bits
+static uint32_t bits_squash(uint64_t x) {
+    x &= 0x5555555555555555ull;
+    x = (x | (x >> 1))  & 0x3333333333333333ull;
+    x = (x | (x >> 2))  & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x >> 4))  & 0x00ff00ff00ff00ffull;
+    x = (x | (x >> 8))  & 0x0000ffff0000ffffull;
+    x = (x | (x >> 16)) & 0x00000000ffffffffull;
+    return (uint32_t)x;
+}
+
+// Cell of a coordinate along one axis, at `step` bits
+static uint32_t axis_cell(double v, double lo, double hi, uint32_t step) {
+    double cells = (double)(1ull << step);
+    double pos = floor((v - lo) / (hi - lo) * cells);
+    if (pos < 0) { return 0; }
+    if (pos >= cells) { return (uint32_t)(cells - 1); }
+    return (uint32_t)pos;
+}
+
+// Longitude bits take the odd positions, so the first bit of the hash splits east from west
+static uint64_t cell_hash(uint32_t lon_cell, uint32_t lat_cell) {
+    return bits_spread(lat_cell) | (bits_spread(lon_cell) << 1);
+}
+
+uint64_t geo_encode(double lon, double lat) {
+    return cell_hash(axis_cell(lon, k_geo_lon_min, k_geo_lon_max, k_geo_step_max),
+                     axis_cell(lat, k_geo_lat_min, k_geo_lat_max, k_geo_step_max));
+}
+
+void geo_decode(uint64_t hash, double *lon, double *lat) {
+    double cells = (double)(1ull << k_geo_step_max);
+    *lon = k_geo_lon_min + (bits_squash(hash >> 1) + 0.5) / cells * (k_geo_lon_max - k_geo_lon_min);
+    *lat = k_geo_lat_min + (bits_squash(hash) + 0.5) / cells * (k_geo_lat_max - k_geo_lat_min);
+}
+
+// Great-circle distance by the haversine formula
+double geo_distance(double lon1, double lat1, double lon2, double lat2) {
+    double u = sin(deg_rad(lat2 - lat1) / 2), v = sin(deg_rad(lon2 - lon1) / 2);
+    double a = u * u + cos(deg_rad(lat1)) * cos(deg_rad(lat2)) * v * v;
+    return 2 * k_earth_radius * asin(sqrt(a < 1 ? a : 1));
+}
+
+/** ------------------------------------------------------------
+ *    Covering cells
+ * ------------------------------------------------------------
+ */
+
+// Scores [lo, hi) of the members inside one cell
+struct GeoRange {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+};
+
+/**
+ * Cells covering a lon/lat box. The step is the finest whose cells are still as large as the
+ * box, plus one, so the box touches at most 3x3 cells; each cell is a contiguous score range.
+ */
+static void cover_box(double lon_lo, double lon_hi, double lat_lo, double lat_hi, std::vector<GeoRange> &out) {
+    uint32_t step = k_geo_step_max;
+    while (step > 0) {
+        double cells = (double)(1ull << step);
+        bool fits = (k_geo_lon_max - k_geo_lon_min) / cells >= lon_hi - lon_lo
+            && (k_geo_lat_max - k_geo_lat_min) / cells >= lat_hi - lat_lo;
+        if (fits) { break; }
+        step--;
+    }
+    if (step < k_geo_step_max) { step++; }
+
+    uint32_t x0 = axis_cell(lon_lo, k_geo_lon_min, k_geo_lon_max, step);
+    uint32_t x1 = axis_cell(lon_hi, k_geo_lon_min, k_geo_lon_max, step);
+    uint32_t y0 = axis_cell(lat_lo, k_geo_lat_min, k_geo_lat_max, step);
+    uint32_t y1 = axis_cell(lat_hi, k_geo_lat_min, k_geo_lat_max, step);
+    uint32_t shift = 2 * (k_geo_step_max - step);
+    for (uint32_t x = x0; x <= x1; ++x) {
+        for (uint32_t y = y0; y <= y1; ++y) {
+            GeoRange range;
+            range.lo = cell_hash(x, y) << shift;
+            range.hi = (cell_hash(x, y) + 1) << shift;
+            out.push_back(range);
+        }
+    }
+}
+
+// Sort the ranges and join the ones that touch, neighbouring cells are often adjacent in Z-order
+static void ranges_merge(std::vector<GeoRange> &ranges) {
+    std::sort(ranges.begin(), ranges.end(), [](const GeoRange &a, const GeoRange &b) { return a.lo < b.lo; });
+    size_t n = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (n > 0 && ranges[i].lo <= ranges[n - 1].hi) {
+            if (ranges[i].hi > ranges[n - 1].hi) { ranges[n - 1].hi = ranges[i].hi; }
+        }
+        else { ranges[n++] = ranges[i]; }
+    }
+    ranges.resize(n);
+}
+
+// Search shape, sizes in meters
+struct GeoShape {
+    double lon = 0;
+    double lat = 0;
+    bool   box = false;
+    double radius = 0;
+    double width = 0;
+    double height = 0;
+};
+
+/**
+ * Score ranges holding every point of the shape: its lon/lat bounding box, split in two when
+ * it crosses the antimeridian. The longitude span is taken at the box edge nearest a pole,
+ * where a meter is the most degrees.
+ */
+static void shape_ranges(const GeoShape &shape, std::vector<GeoRange> &ranges) {
+    double half_h = shape.box ? shape.height / 2 : shape.radius;
+    double half_w = shape.box ? shape.width / 2 : shape.radius;
+    double dlat = rad_deg(half_h / k_earth_radius);
+    double lat_lo = shape.lat - dlat, lat_hi = shape.lat + dlat;
+
+    double dlon = 180;
+    double polar = fabs(lat_lo) > fabs(lat_hi) ? fabs(lat_lo) : fabs(lat_hi);
+    if (polar < 90) {
+        double c = cos(deg_rad(polar));
+        if (c > 0 && half_w / (k_earth_radius * c) < M_PI) { dlon = rad_deg(half_w / (k_earth_radius * c)); }
+    }
+    if (lat_lo < k_geo_lat_min) { lat_lo = k_geo_lat_min; }
+    if (lat_hi > k_geo_lat_max) { lat_hi = k_geo_lat_max; }
+
+    double lon_lo = shape.lon - dlon, lon_hi = shape.lon + dlon;
+    if (dlon >= 180) {
+        cover_box(k_geo_lon_min, k_geo_lon_max, lat_lo, lat_hi, ranges);
+    }
+    else if (lon_lo < k_geo_lon_min) {
+        cover_box(lon_lo + 360, k_geo_lon_max, lat_lo, lat_hi, ranges);
+        cover_box(k_geo_lon_min, lon_hi, lat_lo, lat_hi, ranges);
+    }
+    else if (lon_hi > k_geo_lon_max) {
+        cover_box(lon_lo, k_geo_lon_max, lat_lo, lat_hi, ranges);
+        cover_box(k_geo_lon_min, lon_hi - 360, lat_lo, lat_hi, ranges);
+    }
+    else {
+        cover_box(lon_lo, lon_hi, lat_lo, lat_hi, ranges);
+    }
+    ranges_merge(ranges);
+}
+
+// Exact test of a point, `*dist` is its distance to the center
+static bool shape_contains(const GeoShape &shape, double lon, double lat, double *dist) {
+    *dist = geo_distance(shape.lon, shape.lat, lon, lat);
+    if (!shape.box) { return *dist <= shape.radius; }
+    double dy = k_earth_radius * deg_rad(fabs(lat - shape.lat));
+    double dx = geo_distance(shape.lon, lat, lon, lat);
+    return dy <= shape.height / 2 && dx <= shape.width / 2;
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// Reads never see a member past its deadline, the due ones are removed first
+static void geo_expire_due(ZSet *zset) {
+    if (zset->expiry_idx != (size_t)-1) { zset_expire(zset, get_current_time_ms(), (size_t)-1); }
+}
+
+// Zset of a key; `*wrong_type` is set if the key holds another type
+static ZSet *expect_geo(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_ZSET;
+    if (!ent || *wrong_type) { return NULL; }
+    geo_expire_due(&ent->zset);
+    return &ent->zset;
+}
+
+static bool parse_lonlat(const std::string &lon_s, const std::string &lat_s, double *lon, double *lat) {
+    return str2dbl(lon_s, *lon) && str2dbl(lat_s, *lat)
+        && *lon >= k_geo_lon_min && *lon <= k_geo_lon_max
+        && *lat >= k_geo_lat_min && *lat <= k_geo_lat_max;
+}
+
+// Meters per unit, 0 for an unknown unit
+static double parse_unit(const std::string &unit) {
+    const char *s = unit.c_str();
+    if (strcasecmp(s, "m") == 0) { return 1; }
+    if (strcasecmp(s, "km") == 0) { return 1000; }
+    if (strcasecmp(s, "mi") == 0) { return 1609.34; }
+    if (strcasecmp(s, "ft") == 0) { return 0.3048; }
+    return 0;
+}
+
+// Position of a member, false if it is missing
+static bool member_pos(ZSet *zset, const std::string &name, double *lon, double *lat) {
+    double score = 0;
+    if (!zset || !zset_score(zset, name.data(), name.size(), &score)) { return false; }
+    geo_decode((uint64_t)score, lon, lat);
+    return true;
+}
+
+/**
+ * Command: GEOADD <key> <lon> <lat> <member> [<lon> <lat> <member> ...]
+ * Store members at the 52-bit geohash of their position, replies with the number added.
+ */
+void geocmd_add(std::vector<std::string> &cmd, Buffer &resp) {
+    if ((cmd.size() - 2) % 3 != 0) { return out_err(resp, ERR_BAD_ARG, "expect lon lat member triples"); }
+
+    // Check every position before touching the set
+    std::vector<uint64_t> hashes;
+    for (size_t i = 2; i < cmd.size(); i += 3) {
+        double lon = 0, lat = 0;
+        if (!parse_lonlat(cmd[i], cmd[i + 1], &lon, &lat)) {
+            return out_err(resp, ERR_BAD_ARG, "invalid longitude,latitude pair");
+        }
+        hashes.push_back(geo_encode(lon, lat));
+    }
+
+    Entry *ent = entry_lookup(cmd[1]);
+    if (ent && ent->type != TYPE_ZSET) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+    if (!ent) { ent = entry_insert(cmd[1], TYPE_ZSET); }
+    geo_expire_due(&ent->zset);     // an expired member is re-added as new
+
+    int64_t added = 0;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        const std::string &name = cmd[4 + 3 * i];
+        added += zset_insert(&ent->zset, name.data(), name.size(), (double)hashes[i]);
+    }
+    block_signal_key(ent->key);     // wake BZPOPMIN waiters
+    return out_int(resp, added);
+}
+
+/**
+ * Command: GEOPOS <key> <member> [<member> ...]
+ * Position of each member as [lon, lat], nil if missing.
+ */
+void geocmd_pos(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    ZSet *zset = expect_geo(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+
+    out_arr(resp, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i) {
+        double lon = 0, lat = 0;
+        if (!member_pos(zset, cmd[i], &lon, &lat)) {
+            out_nil(resp);
+            continue;
+        }
+        out_arr(resp, 2);
+        out_dbl(resp, lon);
+        out_dbl(resp, lat);
+    }
+}
+
+/**
+ * Command: GEODIST <key> <member1> <member2> [m|km|mi|ft]
+ * Distance between two members, nil if either is missing.
+ */
+void geocmd_dist(std::vector<std::string> &cmd, Buffer &resp) {
+    double unit = cmd.size() == 5 ? parse_unit(cmd[4]) : 1;
+    if (unit == 0) { return out_err(resp, ERR_BAD_ARG, "unsupported unit, use m, km, mi or ft"); }
+
+    bool wrong_type = false;
+    ZSet *zset = expect_geo(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+
+    double lon1 = 0, lat1 = 0, lon2 = 0, lat2 = 0;
+    if (!member_pos(zset, cmd[2], &lon1, &lat1) || !member_pos(zset, cmd[3], &lon2, &lat2)) { return out_nil(resp); }
+    return out_dbl(resp, geo_distance(lon1, lat1, lon2, lat2) / unit);
+}
+
+// A member found by GEOSEARCH, the name points into the zset
+struct GeoHit {
+    const char *name = NULL;
+    size_t len = 0;
+    double dist = 0;
+    double lon = 0;
+    double lat = 0;
+};
+
+/**
+ * Command: GEOSEARCH <key> FROMMEMBER <member> | FROMLONLAT <lon> <lat>
+ *          BYRADIUS <radius> <unit> | BYBOX <width> <height> <unit>
+ *          [ASC|DESC] [COUNT <n>] [WITHDIST] [WITHCOORD]
+ * Members inside the circle or box, nearest first unless DESC. Each covering geohash cell is
+ * one score-range seek, so the cost is O(log n) per cell plus the members near the shape.
+ */
+void geocmd_search(std::vector<std::string> &cmd, Buffer &resp) {
+    GeoShape shape;
+    const std::string *from_member = NULL;
+    bool has_center = false, has_shape = false, desc = false, with_dist = false, with_coord = false;
+    double unit = 1;
+    int64_t count = -1;
+
+    for (size_t i = 2; i < cmd.size(); ++i) {
+        const char *opt = cmd[i].c_str();
+        size_t left = cmd.size() - i - 1;
+        if (strcasecmp(opt, "frommember") == 0 && left >= 1 && !has_center) {
+            from_member = &cmd[++i];
+            has_center = true;
+        }
+        else if (strcasecmp(opt, "fromlonlat") == 0 && left >= 2 && !has_center) {
+            if (!parse_lonlat(cmd[i + 1], cmd[i + 2], &shape.lon, &shape.lat)) {
+                return out_err(resp, ERR_BAD_ARG, "invalid longitude,latitude pair");
+            }
+            i += 2;
+            has_center = true;
+        }
+        else if (strcasecmp(opt, "byradius") == 0 && left >= 2 && !has_shape) {
+            unit = parse_unit(cmd[i + 2]);
+            if (!str2dbl(cmd[i + 1], shape.radius) || !(shape.radius >= 0) || unit == 0) {
+                return out_err(resp, ERR_BAD_ARG, "bad radius");
+            }
+            i += 2;
+            has_shape = true;
+        }
+        else if (strcasecmp(opt, "bybox") == 0 && left >= 3 && !has_shape) {
+            unit = parse_unit(cmd[i + 3]);
+            if (!str2dbl(cmd[i + 1], shape.width) || !str2dbl(cmd[i + 2], shape.height)
+                || !(shape.width >= 0) || !(shape.height >= 0) || unit == 0) {
+                return out_err(resp, ERR_BAD_ARG, "bad box");
+            }
+            shape.box = true;
+            i += 3;
+            has_shape = true;
+        }
+        else if (strcasecmp(opt, "asc") == 0) { desc = false; }
+        else if (strcasecmp(opt, "desc") == 0) { desc = true; }
+        else if (strcasecmp(opt, "count") == 0 && left >= 1) {
+            if (!str2int(cmd[++i], count) || count < 1) { return out_err(resp, ERR_BAD_ARG, "COUNT must be > 0"); }
+        }
+        else if (strcasecmp(opt, "withdist") == 0) { with_dist = true; }
+        else if (strcasecmp(opt, "withcoord") == 0) { with_coord = true; }
+        else { return out_err(resp, ERR_BAD_ARG, "syntax error"); }
+    }
+    if (!has_center || !has_shape) {
+        return out_err(resp, ERR_BAD_ARG, "expect FROMMEMBER or FROMLONLAT, and BYRADIUS or BYBOX");
+    }
+    shape.radius *= unit;
+    shape.width *= unit;
+    shape.height *= unit;
+
+    bool wrong_type = false;
+    ZSet *zset = expect_geo(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+    if (from_member && !member_pos(zset, *from_member, &shape.lon, &shape.lat)) {
+        return out_err(resp, ERR_BAD_ARG, "could not decode requested zset member");
+    }
+
+    // Seek each covering range and keep the members really inside the shape
+    std::vector<GeoHit> hits;
+    if (zset) {
+        std::vector<GeoRange> ranges;
+        shape_ranges(shape, ranges);
+        for (const GeoRange &range : ranges) {
+            ZIter iter;
+            zset_seek_greater_equal(zset, &iter, (double)range.lo, "", 0);
+            for (; iter.valid && iter.score < (double)range.hi; zset_iter_offset(zset, &iter, +1)) {
+                GeoHit hit;
+                geo_decode((uint64_t)iter.score, &hit.lon, &hit.lat);
+                if (!shape_contains(shape, hit.lon, hit.lat, &hit.dist)) { continue; }
+                hit.name = iter.name;
+                hit.len = iter.len;
+                hits.push_back(hit);
+            }
+        }
+    }
+
+    auto order = [desc](const GeoHit &a, const GeoHit &b) { return desc ? a.dist > b.dist : a.dist < b.dist; };
+    size_t n = hits.size();
+    if (count >= 0 && (uint64_t)count < n) {
+        n = (size_t)count;
+        std::partial_sort(hits.begin(), hits.begin() + n, hits.end(), order);
+    }
+    else {
+        std::sort(hits.begin(), hits.end(), order);
+    }
+
+    out_arr(resp, (uint32_t)n);
+    for (size_t i = 0; i < n; ++i) {
+        const GeoHit &hit = hits[i];
+        if (!with_dist && !with_coord) {
+            out_str(resp, hit.name, hit.len);
+            continue;
+        }
+        out_arr(resp, 1 + with_dist + with_coord);
+        out_str(resp, hit.name, hit.len);
+        if (with_dist) { out_dbl(resp, hit.dist / unit); }
+        if (with_coord) {
+            out_arr(resp, 2);
+            out_dbl(resp, hit.lon);
+            out_dbl(resp, hit.lat);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// C stdlib
+#include <stdint.h> // uint64_t
+
+// C++ stdlib
+#include <string>   // std::string (command args)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "../core/buffer_io.h"  // Buffer
+
+// Bits per coordinate of a geohash, interleaved into a 52-bit score that a double holds exactly
+const uint32_t k_geo_step_max = 26;
+
+// Coordinates that can be indexed, the latitude range of Web Mercator
+const double k_geo_lon_min = -180;
+const double k_geo_lon_max = 180;
+const double k_geo_lat_min = -85.05112878;
+const double k_geo_lat_max = 85.05112878;
+
+uint64_t geo_encode(double lon, double lat);
+void     geo_decode(uint64_t hash, double *lon, double *lat);     // center of the cell
+double   geo_distance(double lon1, double lat1, double lon2, double lat2);  // meters
+
+// Geo command handlers (operate on zsets in the top-level HMap `db`)
+void geocmd_add(std::vector<std::string> &cmd, Buffer &resp);
+void geocmd_pos(std::vector<std::string> &cmd, Buffer &resp);
+void geocmd_dist(std::vector<std::string> &cmd, Buffer &resp);
+void geocmd_search(std::vector<std::string> &cmd, Buffer &resp);
@@ -0,0 +1,409 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <stdlib.h>  // malloc, realloc, free
+#include <string.h>  // memcmp, memcpy, memmove
+#include <stdio.h>   // snprintf
+
+// C++ stdlib
+#include <vector>    // std::vector (hash_clear)
+
+// local
+#include "hash.h"
+#include "commands.h"            // Entry, TYPE_HASH, entry_lookup, entry_insert, entry_erase
+#include "../core/common.h"      // container_of, string_hash, str2int, str_is_int
+#include "../core/constants.h"   // k_hash_pack_max_*
+#include "../net/serialize.h"    // out_*, ERR_*
+
+/** ------------------------------------------------------------
+ *    Packed encoding
+ * ------------------------------------------------------------
+ */
+
+// Bytes of the record header: field length and value length
+const size_t k_hrec_header = 2 * sizeof(uint32_t);
+
+// Records start right after the pack header
+static uint8_t *hp_data(HPack *pack) {
+    return (uint8_t *)(pack + 1);
+}
+
+// Decode the record at `pos`, returns the position of the next record
+static uint32_t hp_record(HPack *pack, uint32_t pos, const char **field, uint32_t *flen,
+                          const char **val, uint32_t *vlen) {
+    uint8_t *rec = hp_data(pack) + pos;
+    memcpy(flen, rec, 4);
+    memcpy(vlen, rec + 4, 4);
+    *field = (const char *)rec + k_hrec_header;
+    *val = *field + *flen;
+    return pos + (uint32_t)k_hrec_header + *flen + *vlen;
+}
+
+// Offset of the record holding `field`, -1 if absent
+static int64_t hp_find(HPack *pack, const char *field, size_t flen) {
+    if (!pack) { return -1; }
+    for (uint32_t pos = 0; pos < pack->bytes; ) {
+        const char *f = NULL, *v = NULL;
+        uint32_t fl = 0, vl = 0;
+        uint32_t next = hp_record(pack, pos, &f, &fl, &v, &vl);
+        if (fl == flen && memcmp(f, field, flen) == 0) { return pos; }
+        pos = next;
+    }
+    return -1;
+}
+
+// Resize the records area so the record at `pos` spans `new_size` bytes instead of `old_size`
+static HPack *hp_resize_record(HPack *pack, uint32_t pos, size_t old_size, size_t new_size) {
+    uint32_t bytes = pack ? pack->bytes : 0;
+    uint32_t tail = bytes - pos - (uint32_t)old_size;    // records after this one
+    uint32_t new_bytes = bytes - (uint32_t)old_size + (uint32_t)new_size;
+
+    // Shrinking moves the tail before the realloc, growing after it
+    if (new_size < old_size) {
+        memmove(hp_data(pack) + pos + new_size, hp_data(pack) + pos + old_size, tail);
+    }
+    HPack *resized = (HPack *)realloc(pack, sizeof(HPack) + new_bytes);
+    assert(resized);    // not a good idea in real projects
+    if (!pack) { resized->n = 0; }
+    if (new_size > old_size) {
+        memmove(hp_data(resized) + pos + new_size, hp_data(resized) + pos + old_size, tail);
+    }
+    resized->bytes = new_bytes;
+    return resized;
+}
+
+// Write a record at `pos`, the space is already reserved
+static void hp_write(HPack *pack, uint32_t pos, const char *field, size_t flen, const char *val, size_t vlen) {
+    uint8_t *rec = hp_data(pack) + pos;
+    uint32_t fl = (uint32_t)flen, vl = (uint32_t)vlen;
+    memcpy(rec, &fl, 4);
+    memcpy(rec + 4, &vl, 4);
+    if (flen) { memcpy(rec + k_hrec_header, field, flen); }
+    if (vlen) { memcpy(rec + k_hrec_header + flen, val, vlen); }
+}
+
+/** ------------------------------------------------------------
+ *    Hash table encoding
+ * ------------------------------------------------------------
+ */
+
+// Helper structure for the field lookup
+struct HFieldKey {
+    HNode node;
+    const char *field = NULL;
+    size_t flen = 0;
+};
+
+static bool hfield_equals(HNode *node, HNode *key) {
+    HField *hf = container_of(node, HField, node);
+    HFieldKey *hkey = container_of(key, HFieldKey, node);
+    return hf->field.size() == hkey->flen && memcmp(hf->field.data(), hkey->field, hkey->flen) == 0;
+}
+
+static HField *hfield_lookup(Hash *hash, const char *field, size_t flen) {
+    HFieldKey key;
+    key.node.hash_code = string_hash((uint8_t *)field, flen);
+    key.field = field;
+    key.flen = flen;
+    HNode *node = hm_lookup(&hash->fields, &key.node, &hfield_equals);
+    return node ? container_of(node, HField, node) : NULL;
+}
+
+static void hfield_insert(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen) {
+    HField *hf = new HField();
+    hf->field.assign(field, flen);
+    hf->value.assign(val, vlen);
+    hf->node.hash_code = string_hash((uint8_t *)field, flen);
+    hm_insert(&hash->fields, &hf->node);
+}
+
+// Move a packed hash that outgrew the packed limits to the hash table
+static void hash_unpack(Hash *hash) {
+    assert(hash->encoding == HASH_ENC_PACKED);
+    HPack *pack = hash->pack;
+    if (pack) {
+        hm_reserve(&hash->fields, pack->n + 1);
+        for (uint32_t pos = 0; pos < pack->bytes; ) {
+            const char *f = NULL, *v = NULL;
+            uint32_t fl = 0, vl = 0;
+            pos = hp_record(pack, pos, &f, &fl, &v, &vl);
+            hfield_insert(hash, f, fl, v, vl);
+        }
+    }
+    free(pack);
+    hash->pack = NULL;
+    hash->encoding = HASH_ENC_HMAP;
+}
+
+/** ------------------------------------------------------------
+ *    Hash API
+ * ------------------------------------------------------------
+ */
+
+size_t hash_len(Hash *hash) {
+    if (hash->encoding == HASH_ENC_PACKED) { return hash->pack ? hash->pack->n : 0; }
+    return hm_size(&hash->fields);
+}
+
+// Value of a field, valid until the hash changes; returns false if the field is absent
+bool hash_get(Hash *hash, const char *field, size_t flen, const char **val, size_t *vlen) {
+    if (hash->encoding == HASH_ENC_PACKED) {
+        int64_t pos = hp_find(hash->pack, field, flen);
+        if (pos < 0) { return false; }
+        const char *f = NULL;
+        uint32_t fl = 0, vl = 0;
+        hp_record(hash->pack, (uint32_t)pos, &f, &fl, val, &vl);
+        *vlen = vl;
+        return true;
+    }
+
+    HField *hf = hfield_lookup(hash, field, flen);
+    if (!hf) { return false; }
+    *val = hf->value.data();
+    *vlen = hf->value.size();
+    return true;
+}
+
+// Set a field, returns true if it is new
+bool hash_set(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen) {
+    if (hash->encoding == HASH_ENC_PACKED) {
+        int64_t pos = hp_find(hash->pack, field, flen);
+        bool fits = flen <= k_hash_pack_max_value && vlen <= k_hash_pack_max_value
+            && (pos >= 0 || hash_len(hash) + 1 <= k_hash_pack_max_len);
+        if (fits) {
+            size_t old_size = 0;
+            if (pos >= 0) {
+                const char *f = NULL, *v = NULL;
+                uint32_t fl = 0, vl = 0;
+                old_size = hp_record(hash->pack, (uint32_t)pos, &f, &fl, &v, &vl) - (uint32_t)pos;
+            }
+            else {
+                pos = hash->pack ? hash->pack->bytes : 0;   // new fields are appended
+            }
+
+            hash->pack = hp_resize_record(hash->pack, (uint32_t)pos, old_size, k_hrec_header + flen + vlen);
+            hp_write(hash->pack, (uint32_t)pos, field, flen, val, vlen);
+            if (old_size == 0) { hash->pack->n++; }
+            return old_size == 0;
+        }
+        hash_unpack(hash);
+    }
+
+    HField *hf = hfield_lookup(hash, field, flen);
+    if (hf) {
+        hf->value.assign(val, vlen);
+        return false;
+    }
+    hfield_insert(hash, field, flen, val, vlen);
+    return true;
+}
+
+// Remove a field, returns false if it was absent
+bool hash_del(Hash *hash, const char *field, size_t flen) {
+    if (hash->encoding == HASH_ENC_PACKED) {
+        int64_t pos = hp_find(hash->pack, field, flen);
+        if (pos < 0) { return false; }
+
+        const char *f = NULL, *v = NULL;
+        uint32_t fl = 0, vl = 0;
+        size_t size = hp_record(hash->pack, (uint32_t)pos, &f, &fl, &v, &vl) - (uint32_t)pos;
+        if (hash->pack->n == 1) {
+            free(hash->pack);
+            hash->pack = NULL;
+            return true;
+        }
+        hash->pack = hp_resize_record(hash->pack, (uint32_t)pos, size, 0);
+        hash->pack->n--;
+        return true;
+    }
+
+    HFieldKey key;
+    key.node.hash_code = string_hash((uint8_t *)field, flen);
+    key.field = field;
+    key.flen = flen;
+    HNode *node = hm_delete(&hash->fields, &key.node, &hfield_equals);
+    if (node) { delete container_of(node, HField, node); }
+    return node != NULL;
+}
+
+// hm_foreach callback: gather the fields of the hash table
+static bool hfield_collect(HNode *node, void *arg) {
+    ((std::vector<HField *> *)arg)->push_back(container_of(node, HField, node));
+    return true;
+}
+
+// Free every field, the hash is empty and packed afterwards
+void hash_clear(Hash *hash) {
+    free(hash->pack);
+    hash->pack = NULL;
+
+    // The chains are walked before the nodes go away
+    std::vector<HField *> fields;
+    fields.reserve(hm_size(&hash->fields));
+    hm_foreach(&hash->fields, &hfield_collect, &fields);
+    hm_clear(&hash->fields);
+    for (HField *hf : fields) { delete hf; }
+    hash->encoding = HASH_ENC_PACKED;
+}
+
+// Adapter from hm_foreach to the field/value callback
+struct HashVisit {
+    bool (*f)(const char *, size_t, const char *, size_t, void *) = NULL;
+    void *arg = NULL;
+};
+
+static bool hfield_visit(HNode *node, void *arg) {
+    HashVisit *visit = (HashVisit *)arg;
+    HField *hf = container_of(node, HField, node);
+    return visit->f(hf->field.data(), hf->field.size(), hf->value.data(), hf->value.size(), visit->arg);
+}
+
+void hash_foreach(Hash *hash, bool (*f)(const char *, size_t, const char *, size_t, void *), void *arg) {
+    if (hash->encoding == HASH_ENC_PACKED) {
+        for (uint32_t pos = 0; hash->pack && pos < hash->pack->bytes; ) {
+            const char *field = NULL, *val = NULL;
+            uint32_t flen = 0, vlen = 0;
+            pos = hp_record(hash->pack, pos, &field, &flen, &val, &vlen);
+            if (!f(field, flen, val, vlen, arg)) { return; }
+        }
+        return;
+    }
+
+    HashVisit visit;
+    visit.f = f;
+    visit.arg = arg;
+    hm_foreach(&hash->fields, &hfield_visit, &visit);
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// Hash of a key; `*wrong_type` is set if the key holds another type
+static Hash *expect_hash(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_HASH;
+    return ent && !*wrong_type ? ent->hash : NULL;
+}
+
+// Hash of a key for a write, created when missing; NULL if the key holds another type
+static Hash *expect_hash_create(std::string &key) {
+    Entry *ent = entry_lookup(key);
+    if (!ent) { ent = entry_insert(key, TYPE_HASH); }
+    return ent->type == TYPE_HASH ? ent->hash : NULL;
+}
+
+/**
+ * Command: HSET <key> <field> <value> [<field> <value> ...]
+ * Set fields of a hash, replies with the number of new fields.
+ */
+void hcmd_set(std::vector<std::string> &cmd, Buffer &resp) {
+    Hash *hash = expect_hash_create(cmd[1]);
+    if (!hash) { return out_err(resp, ERR_BAD_TYP, "expect hash"); }
+
+    int64_t added = 0;
+    for (size_t i = 2; i + 1 < cmd.size(); i += 2) {
+        added += hash_set(hash, cmd[i].data(), cmd[i].size(), cmd[i + 1].data(), cmd[i + 1].size());
+    }
+    return out_int(resp, added);
+}
+
+/**
+ * Command: HGET <key> <field>
+ * Value of a field, or nil.
+ */
+void hcmd_get(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Hash *hash = expect_hash(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect hash"); }
+
+    const char *val = NULL;
+    size_t vlen = 0;
+    if (!hash || !hash_get(hash, cmd[2].data(), cmd[2].size(), &val, &vlen)) { return out_nil(resp); }
+    return out_str(resp, val, vlen);
+}
+
+/**
+ * Command: HMGET <key> <field> [<field> ...]
+ * Values of the fields in order, nil for the absent ones.
+ */
+void hcmd_mget(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Hash *hash = expect_hash(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect hash"); }
+
+    out_arr(resp, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i) {
+        const char *val = NULL;
+        size_t vlen = 0;
+        if (hash && hash_get(hash, cmd[i].data(), cmd[i].size(), &val, &vlen)) { out_str(resp, val, vlen); }
+        else { out_nil(resp); }
+    }
+}
+
+/**
+ * Command: HDEL <key> <field> [<field> ...]
+ * Remove fields, replies with the number removed. The key goes with its last field.
+ */
+void hcmd_del(std::vector<std::string> &cmd, Buffer &resp) {
+    Entry *ent = entry_lookup(cmd[1]);
+    if (!ent) { return out_int(resp, 0); }
+    if (ent->type != TYPE_HASH) { return out_err(resp, ERR_BAD_TYP, "expect hash"); }
+
+    int64_t removed = 0;
+    for (size_t i = 2; i < cmd.size(); ++i) {
+        removed += hash_del(ent->hash, cmd[i].data(), cmd[i].size());
+    }
+    if (hash_len(ent->hash) == 0) { entry_erase(ent); }
+    return out_int(resp, removed);
+}
+
+// hash_foreach callback: emit a field/value pair
+static bool hfield_out(const char *field, size_t flen, const char *val, size_t vlen, void *arg) {
+    Buffer &resp = *(Buffer *)arg;
+    out_str(resp, field, flen);
+    out_str(resp, val, vlen);
+    return true;
+}
+
+/**
+ * Command: HGETALL <key>
+ * Every field of a hash as [field, value, ...].
+ */
+void hcmd_getall(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Hash *hash = expect_hash(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect hash"); }
+    if (!hash) { return out_arr(resp, 0); }
+
+    out_arr(resp, (uint32_t)(hash_len(hash) * 2));
+    hash_foreach(hash, &hfield_out, &resp);
+}
+
+/**
+ * Command: HINCRBY <key> <field> <delta>
+ * Add to the integer value of a field, a missing field counts as 0. Replies with the new value.
+ */
+void hcmd_incrby(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t delta = 0;
+    if (!str2int(cmd[3], delta)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+
+    Hash *hash = expect_hash_create(cmd[1]);
+    if (!hash) { return out_err(resp, ERR_BAD_TYP, "expect hash"); }
+
+    const std::string &field = cmd[2];
+    const char *val = NULL;
+    size_t vlen = 0;
+    int64_t num = 0;
+    if (hash_get(hash, field.data(), field.size(), &val, &vlen) && !str_is_int(std::string(val, vlen), num)) {
+        return out_err(resp, ERR_BAD_ARG, "hash value is not an integer");
+    }
+    if (__builtin_add_overflow(num, delta, &num)) {
+        return out_err(resp, ERR_BAD_ARG, "increment or decrement would overflow");
+    }
+
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%lld", (long long)num);
+    hash_set(hash, field.data(), field.size(), buf, (size_t)len);
+    return out_int(resp, num);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint32_t
+
+// C++ stdlib
+#include <string>   // std::string (fields and values of large hashes)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "hashtable.h"          // HMap, HNode
+#include "../core/buffer_io.h"  // Buffer
+
+// Representation of a hash, small hashes are packed and move to the hash table as they grow
+enum HashEncoding : uint8_t {
+    HASH_ENC_PACKED = 0,    // field/value records in one allocation
+    HASH_ENC_HMAP   = 1,    // hash table of HField nodes
+};
+
+/**
+ * Packed encoding of a small hash: a header followed by `n` records in insertion order
+ *
+ *      +-----+-------+------+------+-------+-------+------+-----
+ *      |  n  | bytes | flen | vlen | field | value | flen | ...
+ *      +-----+-------+------+------+-------+-------+------+-----
+ *
+ * `bytes` is the size of the records after the header. Lookups scan the records.
+ */
+struct HPack {
+    uint32_t n = 0;         // number of fields
+    uint32_t bytes = 0;     // total bytes of the records
+};
+
+// One field of a large hash
+struct HField {
+    HNode node;
+    std::string field;
+    std::string value;
+};
+
+struct Hash {
+    uint8_t encoding = HASH_ENC_PACKED;
+    HPack  *pack = NULL;    // fields of a packed hash, NULL when empty
+    HMap    fields;         // fields of a large hash
+};
+
+size_t hash_len(Hash *hash);
+bool   hash_get(Hash *hash, const char *field, size_t flen, const char **val, size_t *vlen);
+bool   hash_set(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen);
+bool   hash_del(Hash *hash, const char *field, size_t flen);
+void   hash_clear(Hash *hash);
+
+// Visit each field/value pair until the callback returns false, the hash must not change meanwhile
+void hash_foreach(Hash *hash, bool (*f)(const char *, size_t, const char *, size_t, void *), void *arg);
+
+// Hash command handlers (operate on top-level HMap `db`)
+void hcmd_set(std::vector<std::string> &cmd, Buffer &resp);
+void hcmd_get(std::vector<std::string> &cmd, Buffer &resp);
+void hcmd_mget(std::vector<std::string> &cmd, Buffer &resp);
+void hcmd_del(std::vector<std::string> &cmd, Buffer &resp);
+void hcmd_getall(std::vector<std::string> &cmd, Buffer &resp);
+void hcmd_incrby(std::vector<std::string> &cmd, Buffer &resp);
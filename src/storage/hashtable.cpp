@@ -65,7 +65,7 @@ static bool h_foreach(HTable *ht, bool (*f) (HNode *, void *), void *args) {
 static void hm_trigger_rehash(HMap *hmap) {
     assert(hmap->older.tab == NULL);
     hmap->older = hmap->newer;                                 // (newer, older) <- (new_table, newer)
-    h_init(&hmap->newer, (hmap->newer.size + 1) * 2); // Double the size of the newer table
+    h_init(&hmap->newer, (hmap->newer.mask + 1) * 2); // Double the number of slots of the newer table
     hmap->migration_pos = 0;
 }
 
@@ -143,6 +143,18 @@ void hm_clear(HMap *hmap) {
     *hmap = HMap{};
 }
 
+// Pre-size an empty map for `n` keys, so a bulk load never triggers a rehash
+void hm_reserve(HMap *hmap, size_t n) {
+    if (hm_size(hmap) != 0) { return; }     // a populated map grows by progressive rehashing instead
+
+    size_t slots = 4;
+    while (slots * k_max_load_factor <= n) { slots *= 2; }
+    if (slots <= hmap->newer.mask + 1) { return; }   // already large enough
+
+    hm_clear(hmap);
+    h_init(&hmap->newer, slots);
+}
+
 // Get the size of the hash table via hashmap
 size_t hm_size(HMap *hmap) {
     return hmap->newer.size + hmap->older.size;
@@ -38,5 +38,6 @@ HNode *hm_lookup(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
  void   hm_insert(HMap *hmap, HNode *node);
 HNode *hm_delete(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
 void   hm_clear(HMap *hmap);
+void   hm_reserve(HMap *hmap, size_t n);
 size_t hm_size(HMap *hmap);
 void hm_foreach(HMap *hmap, bool (*f)(HNode *, void *), void *args); // invoke the callback on each node until it returns false
\ No newline at end of file
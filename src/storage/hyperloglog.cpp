@@ -0,0 +1,301 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <stdlib.h>  // calloc, free
+#include <string.h>  // memcpy
+#include <math.h>    // sqrt, llround, log
+
+// C++ stdlib
+#include <algorithm> // std::lower_bound
+#include <vector>    // std::vector (register scratch)
+
+// local
+#include "hyperloglog.h"
+#include "commands.h"            // Entry, TYPE_HLL, entry_lookup, entry_insert
+#include "../core/common.h"      // murmur64
+#include "../core/constants.h"   // k_hll_sparse_max_len
+#include "../net/serialize.h"    // out_*, ERR_*
+
+// Bits of the hash left after the register index; register values are 1..q+1
+const uint32_t k_hll_q = 64 - k_hll_bits;
+
+/** ------------------------------------------------------------
+ *    Hashing
+ * ------------------------------------------------------------
+ */
+
+// Register of an element and the value it proposes: 1 + trailing zeros of the other bits
+static void hll_position(const char *elem, size_t len, uint32_t *index, uint8_t *val) {
+    uint64_t h = murmur64((const uint8_t *)elem, len, 0xadc83b19ull);
+    *index = (uint32_t)(h & (k_hll_registers - 1));
+    h >>= k_hll_bits;
+    h |= 1ull << k_hll_q;   // stop bit, caps the value at q + 1
+    *val = (uint8_t)(__builtin_ctzll(h) + 1);
+}
+
+/** ------------------------------------------------------------
+ *    Registers
+ * ------------------------------------------------------------
+ */
+
+// A 6-bit register may straddle two bytes
+static uint8_t dense_get(const uint8_t *dense, uint32_t i) {
+    size_t bit = (size_t)i * 6, byte = bit >> 3;
+    unsigned shift = bit & 7;
+    unsigned lo = dense[byte];
+    unsigned hi = shift > 2 ? dense[byte + 1] : 0;
+    return (uint8_t)(((lo >> shift) | (hi << (8 - shift))) & 63);
+}
+
+static void dense_set(uint8_t *dense, uint32_t i, uint8_t val) {
+    size_t bit = (size_t)i * 6, byte = bit >> 3;
+    unsigned shift = bit & 7;
+    dense[byte] = (uint8_t)((dense[byte] & ~(63u << shift)) | ((unsigned)val << shift));
+    if (shift > 2) {
+        dense[byte + 1] = (uint8_t)((dense[byte + 1] & ~(63u >> (8 - shift))) | (val >> (8 - shift)));
+    }
+}
+
+// One register per byte; every 3 packed bytes hold 4 registers
+static void dense_unpack(const uint8_t *dense, uint8_t *regs) {
+    for (uint32_t g = 0; g < k_hll_registers / 4; ++g) {
+        const uint8_t *b = dense + g * 3;
+        regs[g * 4 + 0] = b[0] & 63;
+        regs[g * 4 + 1] = (uint8_t)(((b[0] >> 6) | (b[1] << 2)) & 63);
+        regs[g * 4 + 2] = (uint8_t)(((b[1] >> 4) | (b[2] << 4)) & 63);
+        regs[g * 4 + 3] = b[2] >> 2;
+    }
+}
+
+static void dense_pack(const uint8_t *regs, uint8_t *dense) {
+    for (uint32_t g = 0; g < k_hll_registers / 4; ++g) {
+        const uint8_t *r = regs + g * 4;
+        dense[g * 3 + 0] = (uint8_t)(r[0] | (r[1] << 6));
+        dense[g * 3 + 1] = (uint8_t)((r[1] >> 2) | (r[2] << 4));
+        dense[g * 3 + 2] = (uint8_t)((r[2] >> 4) | (r[3] << 2));
+    }
+}
+
+// Sparse word of a register
+static inline uint32_t sparse_index(uint32_t word) { return word >> 8; }
+static inline uint8_t  sparse_val(uint32_t word) { return (uint8_t)(word & 0xff); }
+
+static void hll_to_dense(Hll *hll) {
+    assert(hll->encoding == HLL_ENC_SPARSE);
+    hll->dense = (uint8_t *)calloc(1, k_hll_dense_bytes);
+    assert(hll->dense); // not a good idea in real projects
+    for (uint32_t word : hll->sparse) { dense_set(hll->dense, sparse_index(word), sparse_val(word)); }
+    std::vector<uint32_t>().swap(hll->sparse);  // release the words as well
+    hll->encoding = HLL_ENC_DENSE;
+}
+
+// Raise one register to `val`, returns true if it changed
+static bool hll_raise(Hll *hll, uint32_t index, uint8_t val) {
+    if (hll->encoding == HLL_ENC_DENSE) {
+        if (dense_get(hll->dense, index) >= val) { return false; }
+        dense_set(hll->dense, index, val);
+        return true;
+    }
+
+    auto it = std::lower_bound(hll->sparse.begin(), hll->sparse.end(), index << 8);
+    if (it != hll->sparse.end() && sparse_index(*it) == index) {
+        if (sparse_val(*it) >= val) { return false; }
+        *it = index << 8 | val;
+        return true;
+    }
+    hll->sparse.insert(it, index << 8 | val);
+    if (hll->sparse.size() > k_hll_sparse_max_len) { hll_to_dense(hll); }
+    return true;
+}
+
+bool hll_add(Hll *hll, const char *elem, size_t len) {
+    uint32_t index = 0;
+    uint8_t val = 0;
+    hll_position(elem, len, &index, &val);
+    bool changed = hll_raise(hll, index, val);
+    if (changed) { hll->cached = -1; }
+    return changed;
+}
+
+void hll_clear(Hll *hll) {
+    free(hll->dense);
+    hll->dense = NULL;
+    std::vector<uint32_t>().swap(hll->sparse);
+    hll->encoding = HLL_ENC_SPARSE;
+    hll->cached = -1;
+}
+
+/**
+ * regs = max(regs, registers of `hll`), one register per byte. Dense registers are unpacked
+ * then merged 16 at a time with vector max.
+ */
+static void hll_max_into(Hll *hll, uint8_t *regs, uint8_t *scratch) {
+    if (hll->encoding == HLL_ENC_SPARSE) {
+        for (uint32_t word : hll->sparse) {
+            uint32_t i = sparse_index(word);
+            if (sparse_val(word) > regs[i]) { regs[i] = sparse_val(word); }
+        }
+        return;
+    }
+
+    typedef uint8_t V __attribute__((vector_size(16)));
+    dense_unpack(hll->dense, scratch);
+    for (uint32_t i = 0; i < k_hll_registers; i += sizeof(V)) {
+        V a, b;
+        memcpy(&a, regs + i, sizeof(V));
+        memcpy(&b, scratch + i, sizeof(V));
+        a = a > b ? a : b;
+        memcpy(regs + i, &a, sizeof(V));
+    }
+}
+
+/** ------------------------------------------------------------
+ *    Estimator
+ * ------------------------------------------------------------
+ */
+
+// Ertl's improved estimator ("New cardinality estimation algorithms for HyperLogLog sketches"),
+// exact for small counts without a linear counting switch-over
+static double hll_sigma(double x) {
+    if (x == 1.0) { return INFINITY; }
+    double y = 1.0, z = x, prev = 0;
+    do {
+        x *= x;
+        prev = z;
+        z += x * y;
+        y += y;
+    } while (z != prev);
+    return z;
+}
+
+static double hll_tau(double x) {
+    if (x == 0.0 || x == 1.0) { return 0.0; }
+    double y = 1.0, z = 1 - x, prev = 0;
+    do {
+        x = sqrt(x);
+        prev = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (z != prev);
+    return z / 3;
+}
+
+// Cardinality from the number of registers holding each value
+static int64_t hll_estimate(const uint32_t *hist) {
+    const double m = k_hll_registers;
+    double z = m * hll_tau((m - hist[k_hll_q + 1]) / m);
+    for (uint32_t k = k_hll_q; k >= 1; --k) {
+        z += hist[k];
+        z *= 0.5;
+    }
+    z += m * hll_sigma(hist[0] / m);
+    return llround(0.5 / log(2) * m * m / z);
+}
+
+static int64_t regs_estimate(const uint8_t *regs) {
+    uint32_t hist[k_hll_q + 2] = {};
+    for (uint32_t i = 0; i < k_hll_registers; ++i) { hist[regs[i]]++; }
+    return hll_estimate(hist);
+}
+
+int64_t hll_count(Hll *hll) {
+    if (hll->cached >= 0) { return hll->cached; }
+
+    if (hll->encoding == HLL_ENC_DENSE) {
+        std::vector<uint8_t> regs(k_hll_registers);
+        dense_unpack(hll->dense, regs.data());
+        hll->cached = regs_estimate(regs.data());
+    }
+    else {
+        uint32_t hist[k_hll_q + 2] = {};
+        hist[0] = k_hll_registers - (uint32_t)hll->sparse.size();
+        for (uint32_t word : hll->sparse) { hist[sparse_val(word)]++; }
+        hll->cached = hll_estimate(hist);
+    }
+    return hll->cached;
+}
+
+// Replace the registers of `hll`, sparse if few enough are set
+static void hll_assign(Hll *hll, const uint8_t *regs) {
+    uint32_t nonzero = 0;
+    for (uint32_t i = 0; i < k_hll_registers; ++i) { nonzero += regs[i] != 0; }
+
+    hll_clear(hll);
+    if (nonzero <= k_hll_sparse_max_len) {
+        hll->sparse.reserve(nonzero);
+        for (uint32_t i = 0; i < k_hll_registers; ++i) {
+            if (regs[i]) { hll->sparse.push_back(i << 8 | regs[i]); }
+        }
+        return;
+    }
+    hll->dense = (uint8_t *)malloc(k_hll_dense_bytes);
+    assert(hll->dense); // not a good idea in real projects
+    dense_pack(regs, hll->dense);
+    hll->encoding = HLL_ENC_DENSE;
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// HLL of a key; `*wrong_type` is set if the key holds another type
+static Hll *expect_hll(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_HLL;
+    return ent && !*wrong_type ? ent->hll : NULL;
+}
+
+/**
+ * Command: PFADD <key> [<element> ...]
+ * Add elements, replies 1 if the estimate may have changed (or the key was created), else 0.
+ */
+void pfcmd_add(std::vector<std::string> &cmd, Buffer &resp) {
+    Entry *ent = entry_lookup(cmd[1]);
+    bool created = !ent;
+    if (!ent) { ent = entry_insert(cmd[1], TYPE_HLL); }
+    if (ent->type != TYPE_HLL) { return out_err(resp, ERR_BAD_TYP, "expect hyperloglog"); }
+
+    bool changed = created;
+    for (size_t i = 2; i < cmd.size(); ++i) { changed |= hll_add(ent->hll, cmd[i].data(), cmd[i].size()); }
+    return out_int(resp, changed);
+}
+
+/**
+ * Command: PFCOUNT <key> [<key> ...]
+ * Estimated number of distinct elements added to the union of the keys. A single key keeps
+ * its estimate until the next change.
+ */
+void pfcmd_count(std::vector<std::string> &cmd, Buffer &resp) {
+    std::vector<Hll *> hlls;
+    for (size_t i = 1; i < cmd.size(); ++i) {
+        bool wrong_type = false;
+        Hll *hll = expect_hll(cmd[i], &wrong_type);
+        if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect hyperloglog"); }
+        if (hll) { hlls.push_back(hll); }
+    }
+    if (hlls.empty()) { return out_int(resp, 0); }
+    if (cmd.size() == 2) { return out_int(resp, hll_count(hlls[0])); }
+
+    std::vector<uint8_t> regs(k_hll_registers, 0), scratch(k_hll_registers);
+    for (Hll *hll : hlls) { hll_max_into(hll, regs.data(), scratch.data()); }
+    return out_int(resp, regs_estimate(regs.data()));
+}
+
+/**
+ * Command: PFMERGE <dst> [<src> ...]
+ * Store the union of `dst` and the sources in `dst`.
+ */
+void pfcmd_merge(std::vector<std::string> &cmd, Buffer &resp) {
+    std::vector<uint8_t> regs(k_hll_registers, 0), scratch(k_hll_registers);
+    for (size_t i = 1; i < cmd.size(); ++i) {
+        bool wrong_type = false;
+        Hll *hll = expect_hll(cmd[i], &wrong_type);
+        if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect hyperloglog"); }
+        if (hll) { hll_max_into(hll, regs.data(), scratch.data()); }
+    }
+
+    Entry *ent = entry_lookup(cmd[1]);
+    if (!ent) { ent = entry_insert(cmd[1], TYPE_HLL); }
+    hll_assign(ent->hll, regs.data());
+    return out_nil(resp);
+}
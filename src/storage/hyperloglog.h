@@ -0,0 +1,39 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint32_t, int64_t
+
+// C++ stdlib
+#include <string>   // std::string (command args)
+#include <vector>   // std::vector (sparse registers, command args)
+
+// local
+#include "../core/buffer_io.h"  // Buffer
+
+// 2^14 registers of 6 bits: 12 KB dense, standard error 1.04 / sqrt(2^14) = 0.81%
+const uint32_t k_hll_bits = 14;
+const uint32_t k_hll_registers = 1u << k_hll_bits;
+const size_t   k_hll_dense_bytes = k_hll_registers * 6 / 8;
+
+// Representation of a HyperLogLog, sparse until it holds too many non-zero registers
+enum HllEncoding : uint8_t {
+    HLL_ENC_SPARSE = 0,     // sorted (index << 8 | value) words of the non-zero registers
+    HLL_ENC_DENSE  = 1,     // every register, 6 bits each, packed little-endian
+};
+
+struct Hll {
+    uint8_t  encoding = HLL_ENC_SPARSE;
+    std::vector<uint32_t> sparse;   // registers of a sparse HLL
+    uint8_t *dense = NULL;          // k_hll_dense_bytes of a dense HLL
+    int64_t  cached = -1;           // last cardinality, -1 once a register changes
+};
+
+bool    hll_add(Hll *hll, const char *elem, size_t len);    // true if a register changed
+int64_t hll_count(Hll *hll);
+void    hll_clear(Hll *hll);
+
+// HyperLogLog command handlers (operate on top-level HMap `db`)
+void pfcmd_add(std::vector<std::string> &cmd, Buffer &resp);
+void pfcmd_count(std::vector<std::string> &cmd, Buffer &resp);
+void pfcmd_merge(std::vector<std::string> &cmd, Buffer &resp);
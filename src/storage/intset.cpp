@@ -0,0 +1,515 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <stdlib.h>  // malloc, realloc, free
+#include <string.h>  // memcpy, memmove
+
+// C++ stdlib
+#include <algorithm>    // std::lower_bound, std::upper_bound, std::inplace_merge (chains)
+#include <type_traits>  // std::is_same (intersection dispatch)
+
+// local
+#include "intset.h"
+#include "../core/constants.h"  // k_set_intset_chunk_len
+
+// A set this many times smaller than the other is galloped through it instead of merged
+const size_t k_gallop_ratio = 32;
+
+// Members start right after the header
+static void *is_data(const IntSet *set) {
+    return (void *)(set + 1);
+}
+
+static size_t is_size(uint32_t n, uint32_t width) {
+    return sizeof(IntSet) + (size_t)n * width;
+}
+
+// Make room for `n` members of `width` bytes, doubling the capacity (NULL allocates a new set)
+static IntSet *is_reserve(IntSet *set, uint32_t n, uint32_t width) {
+    uint32_t cap = set ? set->cap : 0;
+    if (set && n <= cap && width <= set->width) { return set; }
+    if (n > cap) { cap = n > 2 * cap ? n : 2 * cap; }
+
+    IntSet *grown = (IntSet *)realloc(set, is_size(cap, width));
+    assert(grown);  // not a good idea in real projects
+    if (!set) {
+        grown->n = 0;
+        grown->width = width;
+    }
+    grown->cap = cap;
+    return grown;
+}
+
+// Narrowest width holding a value
+static uint32_t is_width_for(int64_t val) {
+    if (val >= INT16_MIN && val <= INT16_MAX) { return 2; }
+    if (val >= INT32_MIN && val <= INT32_MAX) { return 4; }
+    return 8;
+}
+
+// Read or write member i as if the set had the given width
+static int64_t is_load(const IntSet *set, uint32_t width, uint32_t i) {
+    switch (width) {
+    case 2:  return ((int16_t *)is_data(set))[i];
+    case 4:  return ((int32_t *)is_data(set))[i];
+    default: return ((int64_t *)is_data(set))[i];
+    }
+}
+
+static void is_store(IntSet *set, uint32_t width, uint32_t i, int64_t val) {
+    switch (width) {
+    case 2:  ((int16_t *)is_data(set))[i] = (int16_t)val; break;
+    case 4:  ((int32_t *)is_data(set))[i] = (int32_t)val; break;
+    default: ((int64_t *)is_data(set))[i] = val; break;
+    }
+}
+
+int64_t intset_get(const IntSet *set, uint32_t i) {
+    return is_load(set, set->width, i);
+}
+
+size_t intset_alloc_size(const IntSet *set) {
+    return set ? is_size(set->cap, set->width) : 0;
+}
+
+// Binary search, `pos` is where the value is or would be inserted
+bool intset_find(const IntSet *set, int64_t val, uint32_t *pos) {
+    uint32_t lo = 0, hi = intset_len(set);
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (intset_get(set, mid) < val) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    *pos = lo;
+    return lo < intset_len(set) && intset_get(set, lo) == val;
+}
+
+/**
+ * Re-encode every member at a larger width. The new value does not fit the old width,
+ * so it goes before all members (negative) or after them.
+ */
+static IntSet *is_upgrade_insert(IntSet *set, int64_t val, uint32_t width) {
+    uint32_t n = set->n, old = set->width;
+    IntSet *grown = is_reserve(set, n + 1, width);
+
+    // Back to front, as the wider members overlap the narrower ones
+    uint32_t shift = val < 0 ? 1 : 0;
+    for (uint32_t i = n; i-- > 0; ) { is_store(grown, width, i + shift, is_load(grown, old, i)); }
+    is_store(grown, width, val < 0 ? 0 : n, val);
+
+    grown->width = width;
+    grown->n = n + 1;
+    return grown;
+}
+
+IntSet *intset_insert(IntSet *set, int64_t val, bool *added) {
+    uint32_t width = is_width_for(val);
+    *added = true;
+    if (!set) {
+        set = is_reserve(NULL, 1, width);
+        set->n = 1;
+        is_store(set, width, 0, val);
+        return set;
+    }
+    if (width > set->width) { return is_upgrade_insert(set, val, width); }
+
+    uint32_t pos = 0;
+    if (intset_find(set, val, &pos)) {
+        *added = false;
+        return set;
+    }
+
+    IntSet *grown = is_reserve(set, set->n + 1, set->width);
+    char *data = (char *)is_data(grown);
+    memmove(data + (size_t)(pos + 1) * grown->width, data + (size_t)pos * grown->width,
+            (size_t)(grown->n - pos) * grown->width);
+    is_store(grown, grown->width, pos, val);
+    grown->n++;
+    return grown;
+}
+
+// Remove a value, returns NULL once the set is empty
+IntSet *intset_remove(IntSet *set, int64_t val, bool *removed) {
+    uint32_t pos = 0;
+    *removed = intset_find(set, val, &pos);
+    if (!*removed) { return set; }
+    if (set->n == 1) {
+        free(set);
+        return NULL;
+    }
+
+    char *data = (char *)is_data(set);
+    memmove(data + (size_t)pos * set->width, data + (size_t)(pos + 1) * set->width,
+            (size_t)(set->n - pos - 1) * set->width);
+    set->n--;
+
+    // Halve the capacity once a quarter is used, so the next inserts do not grow it right back
+    if (set->n > 8 && set->n < set->cap / 4) {
+        IntSet *shrunk = (IntSet *)realloc(set, is_size(set->cap / 2, set->width));
+        if (shrunk) {
+            set = shrunk;
+            set->cap /= 2;
+        }
+    }
+    return set;
+}
+
+/**
+ * Merge sorted new values into the set in one pass: reserve room for them, widen the
+ * members if needed, then fill from the back so every member moves at most once.
+ */
+IntSet *intset_add_sorted(IntSet *set, const int64_t *vals, size_t n) {
+    if (n == 0) { return set; }
+    uint32_t fresh = (uint32_t)n;
+
+    // Sorted, so the extremes decide the width
+    uint32_t width = set ? set->width : 2;
+    if (is_width_for(vals[0]) > width) { width = is_width_for(vals[0]); }
+    if (is_width_for(vals[n - 1]) > width) { width = is_width_for(vals[n - 1]); }
+
+    uint32_t old_n = intset_len(set), old_width = set ? set->width : width;
+    set = is_reserve(set, old_n + fresh, width);
+
+    // Widening in place is safe back to front, and the merge below goes back to front too
+    uint32_t out = old_n + fresh;
+    uint32_t i = old_n;
+    size_t j = n;
+    while (j > 0) {
+        int64_t val = vals[j - 1];
+        int64_t cur = i > 0 ? is_load(set, old_width, i - 1) : 0;
+        if (i > 0 && cur > val) {
+            is_store(set, width, --out, cur);
+            i--;
+        }
+        else {
+            is_store(set, width, --out, val);
+            j--;
+        }
+    }
+    // The members below the smallest new value only move if they were widened
+    if (width != old_width) {
+        while (i > 0) {
+            i--;
+            is_store(set, width, --out, is_load(set, old_width, i));
+        }
+    }
+    assert(out == i);
+
+    set->width = width;
+    set->n = old_n + fresh;
+    return set;
+}
+
+/** ------------------------------------------------------------
+ *    Intersection kernels
+ * ------------------------------------------------------------
+ */
+
+// Plain merge of two sorted arrays
+template <typename TA, typename TB>
+static void isect_merge(const TA *a, size_t na, const TB *b, size_t nb, std::vector<int64_t> &out) {
+    size_t i = 0, j = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) { i++; }
+        else if (b[j] < a[i]) { j++; }
+        else {
+            out.push_back(a[i]);
+            i++;
+            j++;
+        }
+    }
+}
+
+/**
+ * Look each member of the small array up in the large one: double the step until it passes
+ * the member, then binary search the last step. O(small * log(large / small)).
+ */
+template <typename TA, typename TB>
+static void isect_gallop(const TA *a, size_t na, const TB *b, size_t nb, std::vector<int64_t> &out) {
+    size_t j = 0;
+    for (size_t i = 0; i < na && j < nb; ++i) {
+        int64_t val = a[i];
+        size_t step = 1;
+        while (j + step < nb && b[j + step] < val) { step *= 2; }
+
+        size_t lo = j + step / 2, hi = j + step < nb ? j + step + 1 : nb;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (b[mid] < val) { lo = mid + 1; }
+            else { hi = mid; }
+        }
+        j = lo;
+        if (j < nb && b[j] == val) { out.push_back(val); j++; }
+    }
+}
+
+/**
+ * Block merge with 16-byte vectors: every lane of a block of `a` is compared with every lane
+ * of a block of `b` by rotating `b` through all lane positions, then the block with the
+ * smaller maximum advances. Members are distinct, so no value matches twice.
+ */
+template <typename T>
+static void isect_vector(const T *a, size_t na, const T *b, size_t nb, std::vector<int64_t> &out) {
+    typedef T V __attribute__((vector_size(16)));
+    const size_t lanes = 16 / sizeof(T);
+
+    V rotate;
+    for (size_t l = 0; l < lanes; ++l) { rotate[l] = (T)((l + 1) % lanes); }
+
+    size_t i = 0, j = 0;
+    while (i + lanes <= na && j + lanes <= nb) {
+        V va, vb;
+        memcpy(&va, a + i, sizeof(V));
+        memcpy(&vb, b + j, sizeof(V));
+
+        V hit = va == vb;
+        for (size_t r = 1; r < lanes; ++r) {
+            vb = __builtin_shuffle(vb, rotate);
+            hit |= va == vb;
+        }
+        for (size_t l = 0; l < lanes; ++l) {
+            if (hit[l]) { out.push_back(va[l]); }
+        }
+
+        T amax = a[i + lanes - 1], bmax = b[j + lanes - 1];
+        if (amax <= bmax) { i += lanes; }
+        if (bmax <= amax) { j += lanes; }
+    }
+    isect_merge(a + i, na - i, b + j, nb - j, out);
+}
+
+// Pick the kernel for two typed arrays
+template <typename TA, typename TB>
+static void isect_typed(const TA *a, size_t na, const TB *b, size_t nb, std::vector<int64_t> &out) {
+    if (na * k_gallop_ratio < nb) { return isect_gallop(a, na, b, nb, out); }
+    if (nb * k_gallop_ratio < na) { return isect_gallop(b, nb, a, na, out); }
+    if constexpr (std::is_same<TA, TB>::value) { return isect_vector(a, na, b, nb, out); }
+    return isect_merge(a, na, b, nb, out);
+}
+
+// Resolve the width of `b`, members [from, to) of it
+template <typename TA>
+static void isect_with(const TA *a, size_t na, const IntSet *b, uint32_t from, uint32_t to,
+                       std::vector<int64_t> &out) {
+    switch (b->width) {
+    case 2:  return isect_typed(a, na, (const int16_t *)is_data(b) + from, to - from, out);
+    case 4:  return isect_typed(a, na, (const int32_t *)is_data(b) + from, to - from, out);
+    default: return isect_typed(a, na, (const int64_t *)is_data(b) + from, to - from, out);
+    }
+}
+
+// Intersect members [a_from, a_to) of `a` with members [b_from, b_to) of `b`
+static void isect_sets(const IntSet *a, uint32_t a_from, uint32_t a_to,
+                       const IntSet *b, uint32_t b_from, uint32_t b_to, std::vector<int64_t> &out) {
+    if (a_from >= a_to || b_from >= b_to) { return; }
+    switch (a->width) {
+    case 2:  return isect_with((const int16_t *)is_data(a) + a_from, a_to - a_from, b, b_from, b_to, out);
+    case 4:  return isect_with((const int32_t *)is_data(a) + a_from, a_to - a_from, b, b_from, b_to, out);
+    default: return isect_with((const int64_t *)is_data(a) + a_from, a_to - a_from, b, b_from, b_to, out);
+    }
+}
+
+void intset_intersect(const IntSet *a, const IntSet *b, std::vector<int64_t> &out) {
+    if (!a || !b) { return; }
+    isect_sets(a, 0, a->n, b, 0, b->n, out);
+}
+
+void intset_filter(std::vector<int64_t> &vals, const IntSet *set) {
+    std::vector<int64_t> kept;
+    if (set) {
+        kept.reserve(vals.size() < set->n ? vals.size() : set->n);
+        isect_with(vals.data(), vals.size(), set, 0, set->n, kept);
+    }
+    vals.swap(kept);
+}
+
+/** ------------------------------------------------------------
+ *    Chain of intsets
+ * ------------------------------------------------------------
+ */
+
+static int64_t is_first(const IntSet *set) { return intset_get(set, 0); }
+static int64_t is_last(const IntSet *set) { return intset_get(set, set->n - 1); }
+
+// Positions [from, to) of the members within [lo, hi]
+static void is_range(const IntSet *set, int64_t lo, int64_t hi, uint32_t *from, uint32_t *to) {
+    intset_find(set, lo, from);
+    uint32_t pos = 0;
+    *to = intset_find(set, hi, &pos) ? pos + 1 : pos;
+}
+
+// Move the upper half of a set into a new one of the same width
+static IntSet *is_split(IntSet *set) {
+    uint32_t keep = set->n / 2;
+    IntSet *upper = is_reserve(NULL, set->n - keep, set->width);
+    memcpy(is_data(upper), (char *)is_data(set) + (size_t)keep * set->width,
+           (size_t)(set->n - keep) * set->width);
+    upper->n = set->n - keep;
+    set->n = keep;
+    return upper;
+}
+
+// The chunk that holds or would take a value: the first one ending at or after it, else the last
+static size_t ic_locate(const IntChain *chain, int64_t val) {
+    size_t lo = 0, hi = chain->chunks.size() - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (is_last(chain->chunks[mid]) < val) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+bool intchain_find(const IntChain *chain, int64_t val) {
+    if (chain->chunks.empty()) { return false; }
+    uint32_t pos = 0;
+    return intset_find(chain->chunks[ic_locate(chain, val)], val, &pos);
+}
+
+bool intchain_insert(IntChain *chain, int64_t val) {
+    bool added = true;
+    if (chain->chunks.empty()) {
+        chain->chunks.push_back(intset_insert(NULL, val, &added));
+        chain->n = 1;
+        return true;
+    }
+
+    size_t c = ic_locate(chain, val);
+    uint32_t pos = 0;
+    if (intset_find(chain->chunks[c], val, &pos)) { return false; }
+    if (chain->chunks[c]->n >= k_set_intset_chunk_len) {
+        IntSet *upper = is_split(chain->chunks[c]);
+        chain->chunks.insert(chain->chunks.begin() + c + 1, upper);
+        if (val > is_first(upper)) { c++; }
+    }
+    chain->chunks[c] = intset_insert(chain->chunks[c], val, &added);
+    chain->n++;
+    return true;
+}
+
+// Append the members of chunk c + 1 to chunk c and drop it, every one of them is larger
+static void ic_fold(IntChain *chain, size_t c) {
+    std::vector<int64_t> vals;
+    IntSet *next = chain->chunks[c + 1];
+    vals.reserve(next->n);
+    for (uint32_t i = 0; i < next->n; ++i) { vals.push_back(intset_get(next, i)); }
+    chain->chunks[c] = intset_add_sorted(chain->chunks[c], vals.data(), vals.size());
+    free(next);
+    chain->chunks.erase(chain->chunks.begin() + c + 1);
+}
+
+bool intchain_remove(IntChain *chain, int64_t val) {
+    if (chain->chunks.empty()) { return false; }
+    size_t c = ic_locate(chain, val);
+    bool removed = false;
+    chain->chunks[c] = intset_remove(chain->chunks[c], val, &removed);
+    if (!removed) { return false; }
+    chain->n--;
+
+    if (!chain->chunks[c]) {
+        chain->chunks.erase(chain->chunks.begin() + c);
+        return true;
+    }
+    // A thin chunk joins a neighbour while the two fit in half a chunk
+    const uint32_t half = k_set_intset_chunk_len / 2;
+    if (chain->chunks[c]->n < k_set_intset_chunk_len / 4) {
+        if (c > 0 && chain->chunks[c - 1]->n + chain->chunks[c]->n <= half) { ic_fold(chain, c - 1); }
+        else if (c + 1 < chain->chunks.size() && chain->chunks[c]->n + chain->chunks[c + 1]->n <= half) {
+            ic_fold(chain, c);
+        }
+    }
+    return true;
+}
+
+/**
+ * Merge sorted new values into chunk c (NULL for an empty chain). If they overflow it, the
+ * chunk is rebuilt as several evenly filled ones.
+ */
+static void ic_merge(IntChain *chain, size_t c, const int64_t *vals, size_t n) {
+    IntSet *chunk = chain->chunks[c];
+    size_t total = intset_len(chunk) + n;
+    if (total <= k_set_intset_chunk_len) {
+        chain->chunks[c] = intset_add_sorted(chunk, vals, n);
+        return;
+    }
+
+    std::vector<int64_t> merged;
+    merged.reserve(total);
+    for (uint32_t i = 0; i < intset_len(chunk); ++i) { merged.push_back(intset_get(chunk, i)); }
+    merged.insert(merged.end(), vals, vals + n);
+    std::inplace_merge(merged.begin(), merged.begin() + intset_len(chunk), merged.end());
+    free(chunk);
+
+    size_t parts = (total + k_set_intset_chunk_len - 1) / k_set_intset_chunk_len;
+    std::vector<IntSet *> rebuilt(parts, NULL);
+    for (size_t p = 0; p < parts; ++p) {
+        size_t from = total * p / parts, to = total * (p + 1) / parts;
+        rebuilt[p] = intset_add_sorted(NULL, merged.data() + from, to - from);
+    }
+    chain->chunks.erase(chain->chunks.begin() + c);
+    chain->chunks.insert(chain->chunks.begin() + c, rebuilt.begin(), rebuilt.end());
+}
+
+void intchain_add_sorted(IntChain *chain, const int64_t *vals, size_t n) {
+    if (n == 0) { return; }
+    if (chain->chunks.empty()) { chain->chunks.push_back(NULL); }
+
+    // Each chunk takes the values up to its last member, the last chunk takes the rest
+    size_t i = 0;
+    while (i < n) {
+        size_t c = ic_locate(chain, vals[i]);
+        size_t end = n;
+        if (c + 1 < chain->chunks.size()) {
+            end = std::upper_bound(vals + i, vals + n, is_last(chain->chunks[c])) - vals;
+        }
+        ic_merge(chain, c, vals + i, end - i);
+        i = end;
+    }
+    chain->n += n;
+}
+
+void intchain_clear(IntChain *chain) {
+    for (IntSet *chunk : chain->chunks) { free(chunk); }
+    chain->chunks.clear();
+    chain->n = 0;
+}
+
+void intchain_values(const IntChain *chain, std::vector<int64_t> &out) {
+    out.reserve(out.size() + chain->n);
+    for (const IntSet *chunk : chain->chunks) {
+        for (uint32_t i = 0; i < chunk->n; ++i) { out.push_back(intset_get(chunk, i)); }
+    }
+}
+
+void intchain_intersect(const IntChain *a, const IntChain *b, std::vector<int64_t> &out) {
+    const std::vector<IntSet *> &bs = b->chunks;
+    size_t j = 0;
+    for (const IntSet *ca : a->chunks) {
+        int64_t lo = is_first(ca), hi = is_last(ca);
+        while (j < bs.size() && is_last(bs[j]) < lo) { j++; }
+
+        // The chunks of `b` are disjoint ranges, so each member of `ca` meets one of them
+        for (size_t k = j; k < bs.size() && is_first(bs[k]) <= hi; ++k) {
+            uint32_t a_from = 0, a_to = 0, b_from = 0, b_to = 0;
+            is_range(ca, is_first(bs[k]), is_last(bs[k]), &a_from, &a_to);
+            is_range(bs[k], lo, hi, &b_from, &b_to);
+            isect_sets(ca, a_from, a_to, bs[k], b_from, b_to, out);
+        }
+    }
+}
+
+void intchain_filter(std::vector<int64_t> &vals, const IntChain *chain) {
+    std::vector<int64_t> kept;
+    size_t i = 0;
+    for (const IntSet *chunk : chain->chunks) {
+        if (i == vals.size()) { break; }
+        size_t from = std::lower_bound(vals.begin() + i, vals.end(), is_first(chunk)) - vals.begin();
+        size_t to = std::upper_bound(vals.begin() + from, vals.end(), is_last(chunk)) - vals.begin();
+        if (from < to) {
+            uint32_t c_from = 0, c_to = 0;
+            is_range(chunk, vals[from], vals[to - 1], &c_from, &c_to);
+            isect_with(vals.data() + from, to - from, chunk, c_from, c_to, kept);
+        }
+        i = to;
+    }
+    vals.swap(kept);
+}
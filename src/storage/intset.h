@@ -0,0 +1,81 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // int64_t, uint32_t
+
+// C++ stdlib
+#include <vector>   // std::vector (intersections)
+
+/**
+ * Sorted array of distinct integers in one allocation, each stored in the narrowest width
+ * (2, 4 or 8 bytes) that holds every member:
+ *
+ *      +-----+-------+-----+---------------------------+--------+
+ *      |  n  | width | cap | value[0] < ... < value[n-1] | unused |
+ *      +-----+-------+-----+---------------------------+--------+
+ *
+ * The capacity grows and shrinks geometrically, so inserts only pay for shifting the tail.
+ * Inserting a value that does not fit widens every member. A NULL intset is empty.
+ * The header is padded to 8 bytes so the members are aligned for their width.
+ */
+struct alignas(8) IntSet {
+    uint32_t n = 0;         // number of members
+    uint32_t width = 2;     // bytes per member
+    uint32_t cap = 0;       // members the allocation holds
+};
+
+// Accessors
+inline uint32_t intset_len(const IntSet *set) { return set ? set->n : 0; }
+int64_t intset_get(const IntSet *set, uint32_t i);
+bool    intset_find(const IntSet *set, int64_t val, uint32_t *pos);
+size_t  intset_alloc_size(const IntSet *set);
+
+// Updates, each may move the allocation and returns the new pointer
+IntSet *intset_insert(IntSet *set, int64_t val, bool *added);
+IntSet *intset_remove(IntSet *set, int64_t val, bool *removed);
+IntSet *intset_add_sorted(IntSet *set, const int64_t *vals, size_t n);  // sorted values not in the set
+
+/**
+ * Members common to two intsets, appended to `out` in ascending order. Sets of similar size
+ * and equal width are merged block by block with vector compares, a much smaller set is
+ * galloped through the larger one.
+ */
+void intset_intersect(const IntSet *a, const IntSet *b, std::vector<int64_t> &out);
+
+// Keep the values of a sorted vector that are members of `set`
+void intset_filter(std::vector<int64_t> &vals, const IntSet *set);
+
+/**
+ * An integer set of any size, kept sorted as a chain of intsets in ascending order of their
+ * values. Each chunk holds at most `k_set_intset_chunk_len` members in its own width, so an
+ * insert shifts one chunk only:
+ *
+ *      chunks: [ -5 .. 9000 ] -> [ 9001 .. 70000 ] -> [ 70002 .. 2^40 ]
+ *
+ * A full chunk splits in half, a chunk left under a quarter full by removes is folded into
+ * its neighbour and an empty one is dropped.
+ */
+struct IntChain {
+    std::vector<IntSet *> chunks;
+    size_t n = 0;           // members over all the chunks
+};
+
+inline size_t intchain_len(const IntChain *chain) { return chain->n; }
+bool intchain_find(const IntChain *chain, int64_t val);
+bool intchain_insert(IntChain *chain, int64_t val);      // false if already a member
+bool intchain_remove(IntChain *chain, int64_t val);      // false if absent
+void intchain_add_sorted(IntChain *chain, const int64_t *vals, size_t n);  // sorted values not in the chain
+void intchain_clear(IntChain *chain);
+
+// Every member appended to `out` in ascending order
+void intchain_values(const IntChain *chain, std::vector<int64_t> &out);
+
+/**
+ * Members common to two chains in ascending order. Each chunk of `a` is intersected with the
+ * overlapping part of every chunk of `b` whose range it overlaps, using the intset kernels.
+ */
+void intchain_intersect(const IntChain *a, const IntChain *b, std::vector<int64_t> &out);
+
+// Keep the values of a sorted vector that are members of `chain`
+void intchain_filter(std::vector<int64_t> &vals, const IntChain *chain);
@@ -0,0 +1,594 @@
+// C stdlib
+#include <errno.h>   // errno, ERANGE
+#include <math.h>    // isinf, isnan
+#include <stdio.h>   // snprintf
+#include <assert.h>  // assert
+#include <stdlib.h>  // strtod, strtoll, malloc, realloc, free
+#include <string.h>  // memcmp, memcpy
+#include <strings.h> // strcasecmp
+
+// C++ stdlib
+#include <string>    // std::string
+#include <vector>    // std::vector (children while parsing, path steps)
+
+// local
+#include "json.h"
+#include "commands.h"            // Entry, TYPE_JSON, entry_lookup, entry_insert
+#include "../core/common.h"      // str2int
+#include "../core/constants.h"   // k_json_max_depth
+#include "../net/serialize.h"    // out_*, ERR_*
+
+/** ------------------------------------------------------------
+ *    Parsing
+ * ------------------------------------------------------------
+ */
+
+// Cursor over the text being parsed
+struct JsonParser {
+    const char *cur = NULL;
+    const char *end = NULL;
+    uint32_t max_depth = 0;
+    uint64_t nodes = 0;
+};
+
+static void skip_ws(JsonParser *p) {
+    while (p->cur < p->end && (*p->cur == ' ' || *p->cur == '\t' || *p->cur == '\n' || *p->cur == '\r')) { p->cur++; }
+}
+
+static bool match_word(JsonParser *p, const char *word, size_t len) {
+    if ((size_t)(p->end - p->cur) < len || memcmp(p->cur, word, len) != 0) { return false; }
+    p->cur += len;
+    return true;
+}
+
+// 4 hex digits of a \u escape
+static bool parse_hex4(JsonParser *p, uint32_t *code) {
+    if (p->end - p->cur < 4) { return false; }
+    *code = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = *p->cur++;
+        uint32_t digit = 0;
+        if (c >= '0' && c <= '9') { digit = (uint32_t)(c - '0'); }
+        else if (c >= 'a' && c <= 'f') { digit = (uint32_t)(c - 'a' + 10); }
+        else if (c >= 'A' && c <= 'F') { digit = (uint32_t)(c - 'A' + 10); }
+        else { return false; }
+        *code = *code << 4 | digit;
+    }
+    return true;
+}
+
+// Exact-size heap copy of a vector's elements, NULL when empty
+template <typename T>
+static T *array_dup(const std::vector<T> &vec) {
+    if (vec.empty()) { return NULL; }
+    T *arr = (T *)malloc(vec.size() * sizeof(T));
+    assert(arr);    // not a good idea in real projects
+    memcpy((void *)arr, vec.data(), vec.size() * sizeof(T));
+    return arr;
+}
+
+static char *str_dup(const std::string &str) {
+    return array_dup(std::vector<char>(str.begin(), str.end()));
+}
+
+static void put_utf8(std::string &out, uint32_t code) {
+    if (code < 0x80) { out.push_back((char)code); }
+    else if (code < 0x800) {
+        out.push_back((char)(0xc0 | code >> 6));
+        out.push_back((char)(0x80 | (code & 0x3f)));
+    }
+    else if (code < 0x10000) {
+        out.push_back((char)(0xe0 | code >> 12));
+        out.push_back((char)(0x80 | (code >> 6 & 0x3f)));
+        out.push_back((char)(0x80 | (code & 0x3f)));
+    }
+    else {
+        out.push_back((char)(0xf0 | code >> 18));
+        out.push_back((char)(0x80 | (code >> 12 & 0x3f)));
+        out.push_back((char)(0x80 | (code >> 6 & 0x3f)));
+        out.push_back((char)(0x80 | (code & 0x3f)));
+    }
+}
+
+// A quoted string at the cursor, unescaped into `out`
+static bool parse_string(JsonParser *p, std::string &out) {
+    if (p->cur >= p->end || *p->cur != '"') { return false; }
+    p->cur++;
+    while (p->cur < p->end) {
+        // Copy the run up to the next quote or escape in one go
+        const char *run = p->cur;
+        while (p->cur < p->end && *p->cur != '"' && *p->cur != '\\') {
+            if ((uint8_t)*p->cur < 0x20) { return false; }
+            p->cur++;
+        }
+        out.append(run, (size_t)(p->cur - run));
+        if (p->cur >= p->end) { return false; }
+        if (*p->cur++ == '"') { return true; }
+
+        if (p->cur >= p->end) { return false; }
+        char esc = *p->cur++;
+        switch (esc) {
+        case '"':  out.push_back('"'); break;
+        case '\\': out.push_back('\\'); break;
+        case '/':  out.push_back('/'); break;
+        case 'b':  out.push_back('\b'); break;
+        case 'f':  out.push_back('\f'); break;
+        case 'n':  out.push_back('\n'); break;
+        case 'r':  out.push_back('\r'); break;
+        case 't':  out.push_back('\t'); break;
+        case 'u': {
+            uint32_t code = 0, low = 0;
+            if (!parse_hex4(p, &code)) { return false; }
+            if (code >= 0xd800 && code < 0xdc00) {
+                // High surrogate, a low one must follow
+                if (!match_word(p, "\\u", 2) || !parse_hex4(p, &low) || low < 0xdc00 || low >= 0xe000) { return false; }
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            }
+            else if (code >= 0xdc00 && code < 0xe000) { return false; }
+            put_utf8(out, code);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+// A number at the cursor, checked against the JSON grammar before it is converted
+static bool parse_number(JsonParser *p, JsonNode *node) {
+    const char *start = p->cur;
+    bool is_int = true;
+    if (p->cur < p->end && *p->cur == '-') { p->cur++; }
+    if (p->cur >= p->end || *p->cur < '0' || *p->cur > '9') { return false; }
+    if (*p->cur == '0') { p->cur++; }
+    else { while (p->cur < p->end && *p->cur >= '0' && *p->cur <= '9') { p->cur++; } }
+    if (p->cur < p->end && *p->cur == '.') {
+        is_int = false;
+        p->cur++;
+        if (p->cur >= p->end || *p->cur < '0' || *p->cur > '9') { return false; }
+        while (p->cur < p->end && *p->cur >= '0' && *p->cur <= '9') { p->cur++; }
+    }
+    if (p->cur < p->end && (*p->cur == 'e' || *p->cur == 'E')) {
+        is_int = false;
+        p->cur++;
+        if (p->cur < p->end && (*p->cur == '+' || *p->cur == '-')) { p->cur++; }
+        if (p->cur >= p->end || *p->cur < '0' || *p->cur > '9') { return false; }
+        while (p->cur < p->end && *p->cur >= '0' && *p->cur <= '9') { p->cur++; }
+    }
+
+    // The text is not NUL-terminated, convert from a copy
+    std::string text(start, (size_t)(p->cur - start));
+    if (is_int) {
+        errno = 0;
+        long long val = strtoll(text.c_str(), NULL, 10);
+        if (errno != ERANGE) {
+            node->type = JSON_INT;
+            node->int_val = (int64_t)val;
+            return true;
+        }
+    }
+    double val = strtod(text.c_str(), NULL);
+    if (isinf(val)) { return false; }
+    node->type = JSON_DBL;
+    node->dbl_val = val;
+    return true;
+}
+
+static bool parse_value(JsonParser *p, uint32_t depth, JsonNode *node);
+
+/**
+ * The members of an object, the cursor is on the `{`. They are collected in a vector and moved
+ * to an exact-size array at the end; on error whatever was parsed is freed.
+ */
+static bool parse_object(JsonParser *p, uint32_t depth, JsonNode *node) {
+    std::vector<JsonMember> members;
+    bool ok = true;
+    p->cur++;
+    skip_ws(p);
+    if (!match_word(p, "}", 1)) {
+        while (ok) {
+            skip_ws(p);
+            std::string key;
+            JsonMember member;
+            ok = parse_string(p, key);
+            if (ok) { skip_ws(p); ok = match_word(p, ":", 1); }
+            if (ok) { ok = parse_value(p, depth + 1, &member.val); }
+            if (!ok) { break; }
+            member.key = str_dup(key);
+            member.key_len = (uint32_t)key.size();
+            members.push_back(member);
+            skip_ws(p);
+            if (match_word(p, "}", 1)) { break; }
+            ok = match_word(p, ",", 1);
+        }
+    }
+
+    node->type = JSON_OBJ;
+    node->len = (uint32_t)members.size();
+    node->members = array_dup(members);
+    if (!ok) { json_free(node); }
+    return ok;
+}
+
+// The items of an array, the cursor is on the `[`
+static bool parse_array(JsonParser *p, uint32_t depth, JsonNode *node) {
+    std::vector<JsonNode> items;
+    bool ok = true;
+    p->cur++;
+    skip_ws(p);
+    if (!match_word(p, "]", 1)) {
+        while (ok) {
+            JsonNode item;
+            if (!(ok = parse_value(p, depth + 1, &item))) { break; }
+            items.push_back(item);
+            skip_ws(p);
+            if (match_word(p, "]", 1)) { break; }
+            ok = match_word(p, ",", 1);
+        }
+    }
+
+    node->type = JSON_ARR;
+    node->len = (uint32_t)items.size();
+    node->items = array_dup(items);
+    if (!ok) { json_free(node); }
+    return ok;
+}
+
+// A value at the cursor into `node`; containers recurse up to `max_depth` levels
+static bool parse_value(JsonParser *p, uint32_t depth, JsonNode *node) {
+    *node = JsonNode();
+    skip_ws(p);
+    if (p->cur >= p->end || depth > p->max_depth) { return false; }
+
+    p->nodes++;
+    char c = *p->cur;
+    if (c == '{') { return parse_object(p, depth, node); }
+    if (c == '[') { return parse_array(p, depth, node); }
+    if (c == '"') {
+        std::string str;
+        if (!parse_string(p, str)) { return false; }
+        node->type = JSON_STR;
+        node->len = (uint32_t)str.size();
+        node->str = str_dup(str);
+        return true;
+    }
+    if (match_word(p, "true", 4)) {
+        node->type = JSON_BOOL;
+        node->bool_val = true;
+        return true;
+    }
+    if (match_word(p, "false", 5)) {
+        node->type = JSON_BOOL;
+        node->bool_val = false;
+        return true;
+    }
+    if (match_word(p, "null", 4)) { return true; }
+    return parse_number(p, node);
+}
+
+bool json_parse(const std::string &text, uint32_t max_depth, JsonNode *out, uint64_t *nodes) {
+    JsonParser p;
+    p.cur = text.data();
+    p.end = text.data() + text.size();
+    p.max_depth = max_depth;
+    if (!parse_value(&p, 0, out)) { return false; }
+    skip_ws(&p);
+    if (p.cur != p.end) {
+        json_free(out);
+        return false;
+    }
+    *nodes = p.nodes;
+    return true;
+}
+
+/** ------------------------------------------------------------
+ *    Serialization and cleanup
+ * ------------------------------------------------------------
+ */
+
+static void dump_string(const char *str, size_t len, std::string &out) {
+    static const char k_hex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (size_t i = 0; i < len; ++i) {
+        char c = str[i];
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        }
+        else if (c == '\n') { out.append("\\n"); }
+        else if (c == '\r') { out.append("\\r"); }
+        else if (c == '\t') { out.append("\\t"); }
+        else if ((uint8_t)c < 0x20) {
+            out.append("\\u00");
+            out.push_back(k_hex[(uint8_t)c >> 4]);
+            out.push_back(k_hex[(uint8_t)c & 15]);
+        }
+        else { out.push_back(c); }
+    }
+    out.push_back('"');
+}
+
+// Shortest text that parses back to the same double
+static void dump_double(double val, std::string &out) {
+    char buf[32];
+    int len = 0;
+    for (int prec = 15; prec <= 17; ++prec) {
+        len = snprintf(buf, sizeof(buf), "%.*g", prec, val);
+        if (strtod(buf, NULL) == val) { break; }
+    }
+    out.append(buf, (size_t)len);
+}
+
+void json_dump(const JsonNode *node, std::string &out) {
+    switch (node->type) {
+    case JSON_NULL: out.append("null"); break;
+    case JSON_BOOL: out.append(node->bool_val ? "true" : "false"); break;
+    case JSON_INT:  out.append(std::to_string(node->int_val)); break;
+    case JSON_DBL:  dump_double(node->dbl_val, out); break;
+    case JSON_STR:  dump_string(node->str, node->len, out); break;
+    case JSON_ARR:
+        out.push_back('[');
+        for (uint32_t i = 0; i < node->len; ++i) {
+            if (i) { out.push_back(','); }
+            json_dump(&node->items[i], out);
+        }
+        out.push_back(']');
+        break;
+    case JSON_OBJ:
+        out.push_back('{');
+        for (uint32_t i = 0; i < node->len; ++i) {
+            if (i) { out.push_back(','); }
+            dump_string(node->members[i].key, node->members[i].key_len, out);
+            out.push_back(':');
+            json_dump(&node->members[i].val, out);
+        }
+        out.push_back('}');
+        break;
+    }
+}
+
+uint64_t json_free(JsonNode *node) {
+    uint64_t freed = 1;
+    if (node->type == JSON_STR) { free(node->str); }
+    if (node->type == JSON_ARR) {
+        for (uint32_t i = 0; i < node->len; ++i) { freed += json_free(&node->items[i]); }
+        free(node->items);
+    }
+    if (node->type == JSON_OBJ) {
+        for (uint32_t i = 0; i < node->len; ++i) {
+            free(node->members[i].key);
+            freed += json_free(&node->members[i].val);
+        }
+        free(node->members);
+    }
+    *node = JsonNode();
+    return freed;
+}
+
+void json_clear(Json *json) {
+    json_free(&json->root);
+    json->nodes = 0;
+}
+
+/** ------------------------------------------------------------
+ *    Paths
+ * ------------------------------------------------------------
+ */
+
+// One step of a path: a member name or an array index (negative counts from the end)
+struct JsonStep {
+    bool        is_index = false;
+    int64_t     index = 0;
+    std::string key;
+};
+
+/**
+ * Parse `$.a.b[0]["c d"]` into steps. The leading `$` is optional and `.` alone is the root,
+ * so `a.b` and `.a.b` mean the same as `$.a.b`.
+ */
+static bool parse_path(const std::string &path, std::vector<JsonStep> &steps) {
+    size_t i = 0, n = path.size();
+    if (i < n && path[i] == '$') { i++; }
+    if (path == ".") { return true; }
+    bool first = true;
+    while (i < n) {
+        JsonStep step;
+        if (path[i] == '[') {
+            i++;
+            if (i < n && (path[i] == '"' || path[i] == '\'')) {
+                char quote = path[i++];
+                size_t close = path.find(quote, i);
+                if (close == std::string::npos || close + 1 >= n || path[close + 1] != ']') { return false; }
+                step.key = path.substr(i, close - i);
+                i = close + 2;
+            }
+            else {
+                size_t close = path.find(']', i);
+                if (close == std::string::npos || !str2int(path.substr(i, close - i), step.index)) { return false; }
+                step.is_index = true;
+                i = close + 1;
+            }
+        }
+        else {
+            if (path[i] == '.') { i++; }
+            else if (!first) { return false; }
+            size_t stop = i;
+            while (stop < n && path[stop] != '.' && path[stop] != '[') { stop++; }
+            if (stop == i) { return false; }
+            step.key = path.substr(i, stop - i);
+            i = stop;
+        }
+        steps.push_back(step);
+        first = false;
+    }
+    return true;
+}
+
+// Position of a step in a container, -1 if it is not there
+static int64_t step_find(const JsonNode *node, const JsonStep &step) {
+    if (step.is_index) {
+        if (node->type != JSON_ARR) { return -1; }
+        int64_t len = (int64_t)node->len;
+        int64_t idx = step.index < 0 ? step.index + len : step.index;
+        return idx >= 0 && idx < len ? idx : -1;
+    }
+    if (node->type != JSON_OBJ) { return -1; }
+    for (uint32_t i = 0; i < node->len; ++i) {
+        const JsonMember &member = node->members[i];
+        if (member.key_len == step.key.size() && memcmp(member.key, step.key.data(), member.key_len) == 0) { return (int64_t)i; }
+    }
+    return -1;
+}
+
+// Child at a position found by step_find
+static JsonNode *json_kid(JsonNode *node, int64_t pos) {
+    return node->type == JSON_ARR ? &node->items[pos] : &node->members[pos].val;
+}
+
+// Node at the end of `count` steps from `node`, NULL if the path does not exist
+static JsonNode *path_walk(JsonNode *node, const std::vector<JsonStep> &steps, size_t count) {
+    for (size_t i = 0; i < count && node; ++i) {
+        int64_t pos = step_find(node, steps[i]);
+        node = pos < 0 ? NULL : json_kid(node, pos);
+    }
+    return node;
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// Document of a key; `*wrong_type` is set if the key holds another type
+static Json *expect_json(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_JSON;
+    return ent && !*wrong_type ? ent->json : NULL;
+}
+
+/**
+ * Command: JSON.SET <key> <path> <json> [NX|XX]
+ * Replace the value at `path`, or add it as a new member of an existing object. A new document
+ * can only be set at the root. Only the given value is parsed, the rest of the tree is left as
+ * it is. Replies nil, with NX/XX 1 if written and 0 if not; nil if the parent does not exist.
+ */
+void jsoncmd_set(std::vector<std::string> &cmd, Buffer &resp) {
+    bool nx = cmd.size() == 5 && strcasecmp(cmd[4].c_str(), "nx") == 0;
+    bool xx = cmd.size() == 5 && strcasecmp(cmd[4].c_str(), "xx") == 0;
+    if (cmd.size() == 5 && !nx && !xx) { return out_err(resp, ERR_BAD_ARG, "syntax error"); }
+    std::vector<JsonStep> steps;
+    if (!parse_path(cmd[2], steps)) { return out_err(resp, ERR_BAD_ARG, "invalid path"); }
+
+    bool wrong_type = false;
+    Json *json = expect_json(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect json"); }
+    if (!json && !steps.empty()) { return out_err(resp, ERR_BAD_ARG, "new documents must be set at the root"); }
+
+    // Find where the value goes before parsing it
+    JsonNode *parent = NULL;
+    int64_t pos = -1;
+    if (json && !steps.empty()) {
+        parent = path_walk(&json->root, steps, steps.size() - 1);
+        if (!parent) { return out_nil(resp); }
+        pos = step_find(parent, steps.back());
+        if (pos < 0 && (steps.back().is_index || parent->type != JSON_OBJ)) { return out_nil(resp); }
+    }
+    bool exists = json && (steps.empty() || pos >= 0);
+    if ((nx && exists) || (xx && !exists)) { return out_int(resp, 0); }
+
+    // The whole tree stays within k_json_max_depth, which bounds the recursion of dump and free
+    if (steps.size() > k_json_max_depth) { return out_err(resp, ERR_BAD_ARG, "document too deep"); }
+    uint64_t nodes = 0;
+    JsonNode value;
+    if (!json_parse(cmd[3], k_json_max_depth - (uint32_t)steps.size(), &value, &nodes)) {
+        return out_err(resp, ERR_BAD_ARG, "invalid json or too deep");
+    }
+
+    if (!json) {
+        json = entry_insert(cmd[1], TYPE_JSON)->json;
+        json->root = value;
+    }
+    else if (steps.empty()) {
+        json->nodes -= json_free(&json->root);
+        json->root = value;
+    }
+    else if (pos >= 0) {
+        JsonNode *slot = json_kid(parent, pos);
+        json->nodes -= json_free(slot);
+        *slot = value;
+    }
+    else {
+        // A new member, the members array is kept at its exact size
+        JsonMember *members = (JsonMember *)realloc((void *)parent->members, (parent->len + 1) * sizeof(JsonMember));
+        assert(members);    // not a good idea in real projects
+        JsonMember &member = members[parent->len];
+        member.key = str_dup(steps.back().key);
+        member.key_len = (uint32_t)steps.back().key.size();
+        member.val = value;
+        parent->members = members;
+        parent->len++;
+    }
+    json->nodes += nodes;
+    return nx || xx ? out_int(resp, 1) : out_nil(resp);
+}
+
+/**
+ * Command: JSON.GET <key> [path]
+ * The value at `path` (the root by default) as compact JSON text; only that subtree is
+ * serialized. nil if the key or the path does not exist.
+ */
+void jsoncmd_get(std::vector<std::string> &cmd, Buffer &resp) {
+    std::vector<JsonStep> steps;
+    if (cmd.size() == 3 && !parse_path(cmd[2], steps)) { return out_err(resp, ERR_BAD_ARG, "invalid path"); }
+
+    bool wrong_type = false;
+    Json *json = expect_json(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect json"); }
+    if (!json) { return out_nil(resp); }
+
+    JsonNode *node = path_walk(&json->root, steps, steps.size());
+    if (!node) { return out_nil(resp); }
+    std::string text;
+    json_dump(node, text);
+    return out_str(resp, text.data(), text.size());
+}
+
+/**
+ * Command: JSON.NUMINCRBY <key> <path> <number>
+ * Add to the number at `path` in place. Integers stay integers unless the sum overflows or
+ * the increment has a fraction. Replies with the new number as JSON text.
+ */
+void jsoncmd_numincrby(std::vector<std::string> &cmd, Buffer &resp) {
+    std::vector<JsonStep> steps;
+    if (!parse_path(cmd[2], steps)) { return out_err(resp, ERR_BAD_ARG, "invalid path"); }
+    JsonNode delta;
+    JsonParser p;
+    p.cur = cmd[3].data();
+    p.end = cmd[3].data() + cmd[3].size();
+    if (!parse_number(&p, &delta) || p.cur != p.end) { return out_err(resp, ERR_BAD_ARG, "expect number"); }
+
+    bool wrong_type = false;
+    Json *json = expect_json(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect json"); }
+    if (!json) { return out_nil(resp); }
+    JsonNode *node = path_walk(&json->root, steps, steps.size());
+    if (!node) { return out_nil(resp); }
+    if (node->type != JSON_INT && node->type != JSON_DBL) { return out_err(resp, ERR_BAD_TYP, "expect number"); }
+
+    int64_t sum = 0;
+    if (node->type == JSON_INT && delta.type == JSON_INT && !__builtin_add_overflow(node->int_val, delta.int_val, &sum)) {
+        node->int_val = sum;
+    }
+    else {
+        double val = node->type == JSON_INT ? (double)node->int_val : node->dbl_val;
+        val += delta.type == JSON_INT ? (double)delta.int_val : delta.dbl_val;
+        if (isinf(val) || isnan(val)) { return out_err(resp, ERR_BAD_ARG, "increment would produce NaN or Infinity"); }
+        node->type = JSON_DBL;
+        node->dbl_val = val;
+    }
+
+    std::string text;
+    json_dump(node, text);
+    return out_str(resp, text.data(), text.size());
+}
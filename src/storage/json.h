@@ -0,0 +1,66 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t, int64_t, uint8_t
+
+// C++ stdlib
+#include <string>   // std::string (text, command args)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "../core/buffer_io.h"  // Buffer
+
+// Kinds of JSON node
+enum JsonType : uint8_t {
+    JSON_NULL = 0,
+    JSON_BOOL = 1,
+    JSON_INT  = 2,      // a number written without fraction or exponent that fits an int64
+    JSON_DBL  = 3,
+    JSON_STR  = 4,
+    JSON_ARR  = 5,
+    JSON_OBJ  = 6,
+};
+
+struct JsonMember;
+
+/**
+ * A parsed JSON value in 16 bytes: the type tag, a length, and a payload that depends on the
+ * type. Scalars need no allocation; a string points to its bytes, and a container to an exact
+ * size array of its children, which are stored inline (an object's as name/value members, in
+ * document order).
+ */
+struct JsonNode {
+    uint8_t  type = JSON_NULL;
+    uint32_t len = 0;               // JSON_STR bytes, JSON_ARR items, JSON_OBJ members
+    union {
+        bool        bool_val;
+        int64_t     int_val = 0;
+        double      dbl_val;
+        char       *str;            // JSON_STR, not NUL-terminated
+        JsonNode   *items;          // JSON_ARR
+        JsonMember *members;        // JSON_OBJ
+    };
+};
+
+struct JsonMember {
+    char     *key = NULL;
+    uint32_t  key_len = 0;
+    JsonNode  val;
+};
+
+// A JSON document value, parsed once when it is set
+struct Json {
+    JsonNode root;
+    uint64_t nodes = 0;     // nodes in the tree, sizes the delete like the other containers
+};
+
+bool     json_parse(const std::string &text, uint32_t max_depth, JsonNode *out, uint64_t *nodes);  // false if invalid or deeper
+void     json_dump(const JsonNode *node, std::string &out);         // append the compact text
+uint64_t json_free(JsonNode *node);     // free what the node owns, it is null afterwards; nodes freed
+void     json_clear(Json *json);
+
+// JSON command handlers (operate on top-level HMap `db`)
+void jsoncmd_set(std::vector<std::string> &cmd, Buffer &resp);
+void jsoncmd_get(std::vector<std::string> &cmd, Buffer &resp);
+void jsoncmd_numincrby(std::vector<std::string> &cmd, Buffer &resp);
@@ -0,0 +1,333 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <stdlib.h>  // malloc, free
+#include <string.h>  // memcpy, memmove
+
+// local
+#include "quicklist.h"
+#include "commands.h"            // Entry, TYPE_LIST, entry_lookup, entry_insert, entry_erase
+#include "../core/common.h"      // container_of, str2int
+#include "../core/constants.h"   // k_qlist_chunk_size
+#include "../net/serialize.h"    // out_*, ERR_*
+
+/** ------------------------------------------------------------
+ *    Chunks
+ * ------------------------------------------------------------
+ */
+
+// Bytes of the two length fields framing an item
+const uint32_t k_qframe = 2 * sizeof(uint32_t);
+
+static uint32_t qc_u32(const QChunk *chunk, uint32_t pos) {
+    uint32_t val = 0;
+    memcpy(&val, chunk->data + pos, 4);
+    return val;
+}
+
+// Allocate an empty chunk, its free space on the side the list grows from
+static QChunk *qc_new(size_t cap, bool front) {
+    QChunk *chunk = (QChunk *)malloc(sizeof(QChunk) + cap);
+    assert(chunk);  // not a good idea in real projects
+    chunk->node.prev = chunk->node.next = NULL;
+    chunk->count = 0;
+    chunk->cap = (uint32_t)cap;
+    chunk->begin = chunk->end = front ? (uint32_t)cap : 0;
+    return chunk;
+}
+
+static QChunk *qc_of(DList *node) {
+    return container_of(node, QChunk, node);
+}
+
+static void qc_free(QChunk *chunk) {
+    dlist_detach(&chunk->node);
+    free(chunk);
+}
+
+// Write a framed item at `pos`
+static void qc_write(QChunk *chunk, uint32_t pos, const char *item, size_t len) {
+    uint32_t len32 = (uint32_t)len;
+    memcpy(chunk->data + pos, &len32, 4);
+    if (len) { memcpy(chunk->data + pos + 4, item, len); }
+    memcpy(chunk->data + pos + 4 + len, &len32, 4);
+}
+
+/**
+ * Make room for `need` bytes on one side of a chunk, re-centering the used bytes if the free
+ * space is split: the requested side gets `need` plus half of the rest, so pushes alternating
+ * between the ends shift a chunk a logarithmic number of times, not on every push.
+ * Returns false if the chunk is too full.
+ */
+static bool qc_reserve(QChunk *chunk, bool front, uint32_t need) {
+    uint32_t used = chunk->end - chunk->begin;
+    if (front ? chunk->begin >= need : chunk->cap - chunk->end >= need) { return true; }
+    uint32_t spare = chunk->cap - used;
+    if (spare < need) { return false; }
+
+    uint32_t side = need + (spare - need) / 2;  // free bytes left on the requested side
+    uint32_t to = front ? side : spare - side;
+    memmove(chunk->data + to, chunk->data + chunk->begin, used);
+    chunk->begin = to;
+    chunk->end = to + used;
+    return true;
+}
+
+/** ------------------------------------------------------------
+ *    List API
+ * ------------------------------------------------------------
+ */
+
+void qlist_init(QList *list) {
+    dlist_init(&list->chunks);
+    list->len = 0;
+}
+
+// Push an item at the head (front) or the tail
+void qlist_push(QList *list, bool front, const char *item, size_t len) {
+    uint32_t need = (uint32_t)len + k_qframe;
+    DList *end = front ? list->chunks.next : list->chunks.prev;
+    QChunk *chunk = end != &list->chunks ? qc_of(end) : NULL;
+
+    if (!chunk || !qc_reserve(chunk, front, need)) {
+        chunk = qc_new(need > k_qlist_chunk_size ? need : k_qlist_chunk_size, front);
+        dlist_insert_before(front ? list->chunks.next : &list->chunks, &chunk->node);
+    }
+
+    if (front) {
+        chunk->begin -= need;
+        qc_write(chunk, chunk->begin, item, len);
+    }
+    else {
+        qc_write(chunk, chunk->end, item, len);
+        chunk->end += need;
+    }
+    chunk->count++;
+    list->len++;
+}
+
+// Pop the item at the head (front) or the tail, returns false if the list is empty
+bool qlist_pop(QList *list, bool front, std::string *out) {
+    if (list->len == 0) { return false; }
+    QChunk *chunk = qc_of(front ? list->chunks.next : list->chunks.prev);
+
+    if (front) {
+        uint32_t len = qc_u32(chunk, chunk->begin);
+        out->assign((const char *)chunk->data + chunk->begin + 4, len);
+        chunk->begin += len + k_qframe;
+    }
+    else {
+        uint32_t len = qc_u32(chunk, chunk->end - 4);
+        chunk->end -= len + k_qframe;
+        out->assign((const char *)chunk->data + chunk->end + 4, len);
+    }
+
+    list->len--;
+    if (--chunk->count == 0) { qc_free(chunk); }
+    return true;
+}
+
+/**
+ * Drop `front` items from the head and `back` items from the tail.
+ * Whole chunks are freed without looking at their items.
+ */
+void qlist_trim(QList *list, size_t front, size_t back) {
+    if (front + back >= list->len) { return qlist_clear(list); }
+    list->len -= front + back;
+
+    while (front > 0) {
+        QChunk *chunk = qc_of(list->chunks.next);
+        if (front >= chunk->count) {
+            front -= chunk->count;
+            qc_free(chunk);
+            continue;
+        }
+        for (; front > 0; --front, --chunk->count) { chunk->begin += qc_u32(chunk, chunk->begin) + k_qframe; }
+    }
+    while (back > 0) {
+        QChunk *chunk = qc_of(list->chunks.prev);
+        if (back >= chunk->count) {
+            back -= chunk->count;
+            qc_free(chunk);
+            continue;
+        }
+        for (; back > 0; --back, --chunk->count) { chunk->end -= qc_u32(chunk, chunk->end - 4) + k_qframe; }
+    }
+}
+
+// Free every chunk, the list is empty afterwards
+void qlist_clear(QList *list) {
+    while (!dlist_empty(&list->chunks)) { qc_free(qc_of(list->chunks.next)); }
+    list->len = 0;
+}
+
+// Load the item under the cursor
+static bool qiter_load(QIter *iter) {
+    QChunk *chunk = iter->chunk;
+    iter->len = qc_u32(chunk, iter->pos);
+    iter->item = (const char *)chunk->data + iter->pos + 4;
+    return iter->valid = true;
+}
+
+// Item at a 0-based index, the chunks are walked from the nearer end
+bool qlist_seek(QList *list, QIter *iter, size_t index) {
+    if (index >= list->len) { return iter->valid = false; }
+
+    QChunk *chunk = NULL;
+    size_t first = 0;   // index of the chunk's first item
+    if (index < list->len / 2) {
+        for (DList *node = list->chunks.next; ; node = node->next) {
+            chunk = qc_of(node);
+            if (index < first + chunk->count) { break; }
+            first += chunk->count;
+        }
+    }
+    else {
+        first = list->len;
+        for (DList *node = list->chunks.prev; ; node = node->prev) {
+            chunk = qc_of(node);
+            first -= chunk->count;
+            if (index >= first) { break; }
+        }
+    }
+
+    iter->chunk = chunk;
+    iter->pos = chunk->begin;
+    for (size_t i = first; i < index; ++i) { iter->pos += qc_u32(chunk, iter->pos) + k_qframe; }
+    return qiter_load(iter);
+}
+
+// Move the cursor to the next item
+bool qlist_iter_next(QList *list, QIter *iter) {
+    if (!iter->valid) { return false; }
+
+    iter->pos += (uint32_t)iter->len + k_qframe;
+    if (iter->pos >= iter->chunk->end) {
+        DList *next = iter->chunk->node.next;
+        if (next == &list->chunks) { return iter->valid = false; }
+        iter->chunk = qc_of(next);
+        iter->pos = iter->chunk->begin;
+    }
+    return qiter_load(iter);
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// List of a key; `*wrong_type` is set if the key holds another type
+static Entry *expect_list(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_LIST;
+    return *wrong_type ? NULL : ent;
+}
+
+/**
+ * Command: LPUSH|RPUSH <key> <item> [<item> ...]
+ * Push items at the head or the tail one after the other, replies with the new length.
+ */
+void lcmd_push(std::vector<std::string> &cmd, Buffer &resp) {
+    bool front = cmd[0] == "lpush";
+    Entry *ent = entry_lookup(cmd[1]);
+    if (!ent) { ent = entry_insert(cmd[1], TYPE_LIST); }
+    if (ent->type != TYPE_LIST) { return out_err(resp, ERR_BAD_TYP, "expect list"); }
+
+    for (size_t i = 2; i < cmd.size(); ++i) { qlist_push(ent->list, front, cmd[i].data(), cmd[i].size()); }
+    return out_int(resp, (int64_t)qlist_len(ent->list));
+}
+
+/**
+ * Command: LPOP|RPOP <key> [count]
+ * Pop an item (nil if empty), or with a count an array of up to `count` items.
+ * The key goes with its last item.
+ */
+void lcmd_pop(std::vector<std::string> &cmd, Buffer &resp) {
+    bool front = cmd[0] == "lpop";
+    int64_t count = 1;
+    if (cmd.size() == 3 && (!str2int(cmd[2], count) || count < 0)) {
+        return out_err(resp, ERR_BAD_ARG, "expect int");
+    }
+
+    bool wrong_type = false;
+    Entry *ent = expect_list(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect list"); }
+
+    std::string item;
+    if (cmd.size() == 2) {
+        if (!ent || !qlist_pop(ent->list, front, &item)) { return out_nil(resp); }
+        out_str(resp, item.data(), item.size());
+    }
+    else {
+        size_t len = ent ? qlist_len(ent->list) : 0;
+        size_t n = (size_t)count < len ? (size_t)count : len;
+        out_arr(resp, (uint32_t)n);
+        for (size_t i = 0; i < n && qlist_pop(ent->list, front, &item); ++i) { out_str(resp, item.data(), item.size()); }
+    }
+    if (ent && qlist_len(ent->list) == 0) { entry_erase(ent); }
+}
+
+/**
+ * Command: LLEN <key>
+ * Number of items, 0 for a missing key.
+ */
+void lcmd_len(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Entry *ent = expect_list(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect list"); }
+    return out_int(resp, ent ? (int64_t)qlist_len(ent->list) : 0);
+}
+
+// Normalize an index range to [start, stop] within [0, size), false if it is empty
+static bool list_range(int64_t size, int64_t &start, int64_t &stop) {
+    if (start < 0) { start += size; }
+    if (stop < 0) { stop += size; }
+    if (start < 0) { start = 0; }
+    if (stop >= size) { stop = size - 1; }
+    return start <= stop;
+}
+
+/**
+ * Command: LRANGE <key> <start> <stop>
+ * Items by index, inclusive; negative indexes count from the end.
+ */
+void lcmd_range(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t start = 0, stop = 0;
+    if (!str2int(cmd[2], start) || !str2int(cmd[3], stop)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+
+    bool wrong_type = false;
+    Entry *ent = expect_list(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect list"); }
+    if (!ent || !list_range((int64_t)qlist_len(ent->list), start, stop)) { return out_arr(resp, 0); }
+
+    // Seek once, then read the chunks in order
+    int64_t n = stop - start + 1;
+    out_arr(resp, (uint32_t)n);
+    QIter iter;
+    qlist_seek(ent->list, &iter, (size_t)start);
+    for (int64_t i = 0; i < n && iter.valid; ++i) {
+        out_str(resp, iter.item, iter.len);
+        qlist_iter_next(ent->list, &iter);
+    }
+}
+
+/**
+ * Command: LTRIM <key> <start> <stop>
+ * Keep only the items in [start, stop]; the key goes when nothing is left.
+ */
+void lcmd_trim(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t start = 0, stop = 0;
+    if (!str2int(cmd[2], start) || !str2int(cmd[3], stop)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+
+    bool wrong_type = false;
+    Entry *ent = expect_list(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect list"); }
+    if (!ent) { return out_nil(resp); }
+
+    int64_t size = (int64_t)qlist_len(ent->list);
+    if (!list_range(size, start, stop)) {
+        entry_erase(ent);
+        return out_nil(resp);
+    }
+    qlist_trim(ent->list, (size_t)start, (size_t)(size - 1 - stop));
+    return out_nil(resp);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+// C++ stdlib
+#include <string>   // std::string (popped items)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "list.h"               // DList
+#include "../core/buffer_io.h"  // Buffer
+
+/**
+ * One chunk of a quicklist: a fixed-size buffer of packed items
+ *
+ *      data: | free ... | len | item | len | len | item | len | ... free |
+ *                       ^ begin                                ^ end
+ *
+ * Each item is framed by its length on both sides, so a chunk is walked in either direction.
+ * Chunks made for pushes at the tail start filling at the front of the buffer, those made
+ * for pushes at the head start at the back. An item larger than k_qlist_chunk_size gets a
+ * chunk of its own.
+ */
+struct QChunk {
+    DList    node;          // link in QList::chunks, head to tail
+    uint32_t count = 0;     // number of items
+    uint32_t begin = 0;     // used bytes are data[begin, end)
+    uint32_t end = 0;
+    uint32_t cap = 0;       // bytes of data
+    uint8_t  data[0];
+};
+
+// List of items kept in linked chunks: O(1) push/pop at both ends, ranges read contiguous memory
+struct QList {
+    DList  chunks;          // QChunk sentinel
+    size_t len = 0;         // number of items
+};
+
+// Cursor over the items of a QList, invalidated by any modification
+struct QIter {
+    bool        valid = false;
+    const char *item = NULL;    // item under the cursor
+    size_t      len = 0;
+    QChunk     *chunk = NULL;
+    uint32_t    pos = 0;        // offset of the item's frame in the chunk
+};
+
+void   qlist_init(QList *list);
+void   qlist_push(QList *list, bool front, const char *item, size_t len);
+bool   qlist_pop(QList *list, bool front, std::string *out);
+void   qlist_trim(QList *list, size_t front, size_t back);
+void   qlist_clear(QList *list);
+inline size_t qlist_len(const QList *list) { return list->len; }
+
+// Cursor positioning, each returns whether the cursor is on an item
+bool qlist_seek(QList *list, QIter *iter, size_t index);
+bool qlist_iter_next(QList *list, QIter *iter);
+
+// List command handlers (operate on top-level HMap `db`)
+void lcmd_push(std::vector<std::string> &cmd, Buffer &resp);
+void lcmd_pop(std::vector<std::string> &cmd, Buffer &resp);
+void lcmd_len(std::vector<std::string> &cmd, Buffer &resp);
+void lcmd_range(std::vector<std::string> &cmd, Buffer &resp);
+void lcmd_trim(std::vector<std::string> &cmd, Buffer &resp);
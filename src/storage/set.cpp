@@ -0,0 +1,393 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <stdlib.h>  // malloc, free
+#include <string.h>  // memcmp, memcpy
+#include <stdio.h>   // snprintf
+
+// C++ stdlib
+#include <algorithm> // std::sort, std::unique
+#include <vector>    // std::vector (set_clear, bulk adds, set algebra)
+
+// local
+#include "set.h"
+#include "commands.h"            // Entry, TYPE_SET, entry_lookup, entry_insert, entry_erase
+#include "../core/common.h"      // container_of, string_hash, str_is_int
+#include "../net/serialize.h"    // out_*, ERR_*
+
+// Bytes of the longest int64 in decimal, with the sign and the NUL
+const size_t k_int_buf = 21;
+
+// A member stored in the intset, only if it prints back identically
+static bool member_int(const char *name, size_t len, int64_t *val) {
+    if (len == 0 || len >= k_int_buf) { return false; }
+    return str_is_int(std::string(name, len), *val);
+}
+
+static int int_format(int64_t val, char *buf) {
+    return snprintf(buf, k_int_buf, "%lld", (long long)val);
+}
+
+/** ------------------------------------------------------------
+ *    Hash table encoding
+ * ------------------------------------------------------------
+ */
+
+// Helper structure for the member lookup
+struct SetKey {
+    HNode node;
+    const char *name = NULL;
+    size_t len = 0;
+};
+
+static bool smember_equals(HNode *node, HNode *key) {
+    SetMember *member = container_of(node, SetMember, node);
+    SetKey *skey = container_of(key, SetKey, node);
+    return member->len == skey->len && memcmp(member->name, skey->name, skey->len) == 0;
+}
+
+static void smember_insert(Set *set, const char *name, size_t len) {
+    SetMember *member = (SetMember *)malloc(sizeof(SetMember) + len);
+    assert(member); // not a good idea in real projects
+    member->node.next = NULL;
+    member->node.hash_code = string_hash((uint8_t *)name, len);
+    member->len = (uint32_t)len;
+    if (len) { memcpy(member->name, name, len); }
+    hm_insert(&set->members, &member->node);
+}
+
+// Move an integer set to the hash table
+static void set_unpack(Set *set) {
+    assert(set->encoding == SET_ENC_INTSET);
+    hm_reserve(&set->members, intchain_len(&set->ints) + 1);
+    for (const IntSet *chunk : set->ints.chunks) {
+        for (uint32_t i = 0; i < intset_len(chunk); ++i) {
+            char buf[k_int_buf];
+            int len = int_format(intset_get(chunk, i), buf);
+            smember_insert(set, buf, (size_t)len);
+        }
+    }
+    intchain_clear(&set->ints);
+    set->encoding = SET_ENC_HMAP;
+}
+
+/** ------------------------------------------------------------
+ *    Set API
+ * ------------------------------------------------------------
+ */
+
+size_t set_len(Set *set) {
+    if (set->encoding == SET_ENC_INTSET) { return intchain_len(&set->ints); }
+    return hm_size(&set->members);
+}
+
+bool set_contains(Set *set, const char *name, size_t len) {
+    if (set->encoding == SET_ENC_INTSET) {
+        int64_t val = 0;
+        return member_int(name, len, &val) && intchain_find(&set->ints, val);
+    }
+
+    SetKey key;
+    key.node.hash_code = string_hash((uint8_t *)name, len);
+    key.name = name;
+    key.len = len;
+    return hm_lookup(&set->members, &key.node, &smember_equals) != NULL;
+}
+
+// Add a member, returns true if it is new
+bool set_add(Set *set, const char *name, size_t len) {
+    if (set->encoding == SET_ENC_INTSET) {
+        int64_t val = 0;
+        if (member_int(name, len, &val)) { return intchain_insert(&set->ints, val); }
+        set_unpack(set);
+    }
+
+    if (set_contains(set, name, len)) { return false; }
+    smember_insert(set, name, len);
+    return true;
+}
+
+// Remove a member, returns false if it was absent
+bool set_remove(Set *set, const char *name, size_t len) {
+    if (set->encoding == SET_ENC_INTSET) {
+        int64_t val = 0;
+        return member_int(name, len, &val) && intchain_remove(&set->ints, val);
+    }
+
+    SetKey key;
+    key.node.hash_code = string_hash((uint8_t *)name, len);
+    key.name = name;
+    key.len = len;
+    HNode *node = hm_delete(&set->members, &key.node, &smember_equals);
+    if (node) { free(container_of(node, SetMember, node)); }
+    return node != NULL;
+}
+
+// hm_foreach callback: gather the members of the hash table
+static bool smember_collect(HNode *node, void *arg) {
+    ((std::vector<SetMember *> *)arg)->push_back(container_of(node, SetMember, node));
+    return true;
+}
+
+// Free every member, the set is empty and integer-encoded afterwards
+void set_clear(Set *set) {
+    intchain_clear(&set->ints);
+
+    // The chains are walked before the nodes go away
+    std::vector<SetMember *> members;
+    members.reserve(hm_size(&set->members));
+    hm_foreach(&set->members, &smember_collect, &members);
+    hm_clear(&set->members);
+    for (SetMember *member : members) { free(member); }
+    set->encoding = SET_ENC_INTSET;
+}
+
+// Adapter from hm_foreach to the member callback
+struct SetVisit {
+    bool (*f)(const char *, size_t, void *) = NULL;
+    void *arg = NULL;
+};
+
+static bool smember_visit(HNode *node, void *arg) {
+    SetVisit *visit = (SetVisit *)arg;
+    SetMember *member = container_of(node, SetMember, node);
+    return visit->f(member->name, member->len, visit->arg);
+}
+
+void set_foreach(Set *set, bool (*f)(const char *, size_t, void *), void *arg) {
+    if (set->encoding == SET_ENC_INTSET) {
+        for (const IntSet *chunk : set->ints.chunks) {
+            for (uint32_t i = 0; i < intset_len(chunk); ++i) {
+                char buf[k_int_buf];
+                int len = int_format(intset_get(chunk, i), buf);
+                if (!f(buf, (size_t)len, arg)) { return; }
+            }
+        }
+        return;
+    }
+
+    SetVisit visit;
+    visit.f = f;
+    visit.arg = arg;
+    hm_foreach(&set->members, &smember_visit, &visit);
+}
+
+/**
+ * Add many members to an integer set at once: the new values are sorted and merged into
+ * each chunk in place, in one pass instead of shifting the array for each of them.
+ * Returns false (adding nothing) if a member is not an integer.
+ */
+static bool set_add_ints(Set *set, std::vector<std::string> &names, size_t from, int64_t *added) {
+    std::vector<int64_t> vals;
+    vals.reserve(names.size() - from);
+    for (size_t i = from; i < names.size(); ++i) {
+        int64_t val = 0;
+        if (!member_int(names[i].data(), names[i].size(), &val)) { return false; }
+        vals.push_back(val);
+    }
+    std::sort(vals.begin(), vals.end());
+    vals.erase(std::unique(vals.begin(), vals.end()), vals.end());
+
+    // Keep the new ones only
+    size_t kept = 0;
+    for (int64_t val : vals) {
+        if (!intchain_find(&set->ints, val)) { vals[kept++] = val; }
+    }
+    vals.resize(kept);
+
+    intchain_add_sorted(&set->ints, vals.data(), vals.size());
+    *added = (int64_t)vals.size();
+    return true;
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// Set of a key; `*wrong_type` is set if the key holds another type
+static Set *expect_set(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_SET;
+    return ent && !*wrong_type ? ent->set : NULL;
+}
+
+// Below this many new members an integer set takes them one at a time
+const size_t k_set_bulk_add_min = 16;
+
+/**
+ * Command: SADD <key> <member> [<member> ...]
+ * Add members to a set, replies with the number of new members.
+ */
+void scmd_add(std::vector<std::string> &cmd, Buffer &resp) {
+    Entry *ent = entry_lookup(cmd[1]);
+    if (!ent) { ent = entry_insert(cmd[1], TYPE_SET); }
+    if (ent->type != TYPE_SET) { return out_err(resp, ERR_BAD_TYP, "expect set"); }
+
+    Set *set = ent->set;
+    int64_t added = 0;
+    if (set->encoding == SET_ENC_INTSET && cmd.size() - 2 >= k_set_bulk_add_min && set_add_ints(set, cmd, 2, &added)) {
+        return out_int(resp, added);
+    }
+    for (size_t i = 2; i < cmd.size(); ++i) { added += set_add(set, cmd[i].data(), cmd[i].size()); }
+    return out_int(resp, added);
+}
+
+/**
+ * Command: SREM <key> <member> [<member> ...]
+ * Remove members, replies with the number removed. The key goes with its last member.
+ */
+void scmd_rem(std::vector<std::string> &cmd, Buffer &resp) {
+    Entry *ent = entry_lookup(cmd[1]);
+    if (!ent) { return out_int(resp, 0); }
+    if (ent->type != TYPE_SET) { return out_err(resp, ERR_BAD_TYP, "expect set"); }
+
+    int64_t removed = 0;
+    for (size_t i = 2; i < cmd.size(); ++i) { removed += set_remove(ent->set, cmd[i].data(), cmd[i].size()); }
+    if (set_len(ent->set) == 0) { entry_erase(ent); }
+    return out_int(resp, removed);
+}
+
+/**
+ * Command: SISMEMBER <key> <member>
+ * 1 if the member is in the set, 0 otherwise.
+ */
+void scmd_ismember(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Set *set = expect_set(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect set"); }
+    return out_int(resp, set && set_contains(set, cmd[2].data(), cmd[2].size()));
+}
+
+/**
+ * Command: SCARD <key>
+ * Number of members, 0 for a missing key.
+ */
+void scmd_card(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Set *set = expect_set(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect set"); }
+    return out_int(resp, set ? (int64_t)set_len(set) : 0);
+}
+
+// set_foreach callback: emit a member
+static bool smember_out(const char *name, size_t len, void *arg) {
+    out_str(*(Buffer *)arg, name, len);
+    return true;
+}
+
+/**
+ * Command: SMEMBERS <key>
+ * Every member of a set, integer sets in ascending order.
+ */
+void scmd_members(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Set *set = expect_set(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect set"); }
+    if (!set) { return out_arr(resp, 0); }
+
+    out_arr(resp, (uint32_t)set_len(set));
+    set_foreach(set, &smember_out, &resp);
+}
+
+// Sets of the keys cmd[1..], NULL for missing keys; false if a key holds another type
+static bool expect_sets(std::vector<std::string> &cmd, std::vector<Set *> &sets) {
+    for (size_t i = 1; i < cmd.size(); ++i) {
+        bool wrong_type = false;
+        sets.push_back(expect_set(cmd[i], &wrong_type));
+        if (wrong_type) { return false; }
+    }
+    return true;
+}
+
+static void out_ints(Buffer &resp, const std::vector<int64_t> &vals) {
+    out_arr(resp, (uint32_t)vals.size());
+    for (int64_t val : vals) {
+        char buf[k_int_buf];
+        int len = int_format(val, buf);
+        out_str(resp, buf, (size_t)len);
+    }
+}
+
+// Members of the smallest set found in all the others
+struct SetInter {
+    std::vector<Set *> *others = NULL;
+    std::vector<std::string> out;
+};
+
+static bool smember_inter(const char *name, size_t len, void *arg) {
+    SetInter *inter = (SetInter *)arg;
+    for (Set *other : *inter->others) {
+        if (!set_contains(other, name, len)) { return true; }
+    }
+    inter->out.emplace_back(name, len);
+    return true;
+}
+
+/**
+ * Command: SINTER <key> [<key> ...]
+ * Members common to all the sets. Integer sets are intersected smallest first with
+ * vector block merges or galloping, mixed sets probe the others for each member of the
+ * smallest one.
+ */
+void scmd_inter(std::vector<std::string> &cmd, Buffer &resp) {
+    std::vector<Set *> sets;
+    if (!expect_sets(cmd, sets)) { return out_err(resp, ERR_BAD_TYP, "expect set"); }
+    for (Set *set : sets) {
+        if (!set) { return out_arr(resp, 0); }   // a missing key is the empty set
+    }
+    std::sort(sets.begin(), sets.end(), [](Set *a, Set *b) { return set_len(a) < set_len(b); });
+
+    bool all_ints = true;
+    for (Set *set : sets) { all_ints = all_ints && set->encoding == SET_ENC_INTSET; }
+    if (all_ints) {
+        std::vector<int64_t> vals;
+        if (sets.size() == 1) { intchain_values(&sets[0]->ints, vals); }
+        else {
+            intchain_intersect(&sets[0]->ints, &sets[1]->ints, vals);
+            for (size_t i = 2; i < sets.size() && !vals.empty(); ++i) { intchain_filter(vals, &sets[i]->ints); }
+        }
+        return out_ints(resp, vals);
+    }
+
+    std::vector<Set *> others(sets.begin() + 1, sets.end());
+    SetInter inter;
+    inter.others = &others;
+    set_foreach(sets[0], &smember_inter, &inter);
+    out_arr(resp, (uint32_t)inter.out.size());
+    for (const std::string &name : inter.out) { out_str(resp, name.data(), name.size()); }
+}
+
+// set_foreach callback: add a member to a scratch set
+static bool smember_union(const char *name, size_t len, void *arg) {
+    set_add((Set *)arg, name, len);
+    return true;
+}
+
+/**
+ * Command: SUNION <key> [<key> ...]
+ * Members of any of the sets.
+ */
+void scmd_union(std::vector<std::string> &cmd, Buffer &resp) {
+    std::vector<Set *> sets;
+    if (!expect_sets(cmd, sets)) { return out_err(resp, ERR_BAD_TYP, "expect set"); }
+
+    bool all_ints = true;
+    for (Set *set : sets) { all_ints = all_ints && (!set || set->encoding == SET_ENC_INTSET); }
+    if (all_ints) {
+        std::vector<int64_t> vals;
+        for (Set *set : sets) {
+            if (set) { intchain_values(&set->ints, vals); }
+        }
+        std::sort(vals.begin(), vals.end());
+        vals.erase(std::unique(vals.begin(), vals.end()), vals.end());
+        return out_ints(resp, vals);
+    }
+
+    Set scratch;
+    for (Set *set : sets) {
+        if (set) { set_foreach(set, &smember_union, &scratch); }
+    }
+    out_arr(resp, (uint32_t)set_len(&scratch));
+    set_foreach(&scratch, &smember_out, &resp);
+    set_clear(&scratch);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint32_t
+
+// C++ stdlib
+#include <string>   // std::string (command args)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "hashtable.h"          // HMap, HNode
+#include "intset.h"             // IntChain
+#include "../core/buffer_io.h"  // Buffer
+
+// Representation of a set, integer-only sets of any size are kept sorted and move to the
+// hash table on their first non-integer member
+enum SetEncoding : uint8_t {
+    SET_ENC_INTSET = 0,     // sorted integers in a chain of IntSets
+    SET_ENC_HMAP   = 1,     // hash table of SetMember nodes
+};
+
+// One member of a hash-encoded set, allocated with the name inline
+struct SetMember {
+    HNode    node;
+    uint32_t len = 0;
+    char     name[0];
+};
+
+struct Set {
+    uint8_t encoding = SET_ENC_INTSET;
+    IntChain ints;          // members of an integer set
+    HMap    members;        // members of a hash set
+};
+
+size_t set_len(Set *set);
+bool   set_contains(Set *set, const char *name, size_t len);
+bool   set_add(Set *set, const char *name, size_t len);
+bool   set_remove(Set *set, const char *name, size_t len);
+void   set_clear(Set *set);
+
+// Visit each member until the callback returns false, the set must not change meanwhile
+void set_foreach(Set *set, bool (*f)(const char *, size_t, void *), void *arg);
+
+// Set command handlers (operate on top-level HMap `db`)
+void scmd_add(std::vector<std::string> &cmd, Buffer &resp);
+void scmd_rem(std::vector<std::string> &cmd, Buffer &resp);
+void scmd_ismember(std::vector<std::string> &cmd, Buffer &resp);
+void scmd_card(std::vector<std::string> &cmd, Buffer &resp);
+void scmd_members(std::vector<std::string> &cmd, Buffer &resp);
+void scmd_inter(std::vector<std::string> &cmd, Buffer &resp);
+void scmd_union(std::vector<std::string> &cmd, Buffer &resp);
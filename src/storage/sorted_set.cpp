@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <math.h>
 
@@ -8,8 +9,18 @@
 #include "../core/common.h"      // container_of, string_hash
 #include "../net/serialize.h"    // out_*, ERR_*
 #include "avl_tree.h"            // avl_init, avl_delete, avl_offset
+#include "btree.h"               // bt_* (index of large sets)
 #include "hashtable.h"           // hm_lookup, hm_insert, hm_delete, hm_clear
 #include "commands.h"            // Entry, TYPE_ZSET
+#include "../core/constants.h"   // k_zset_btree_threshold, k_zset_pack_max_*
+#include "zset_merge.h"          // zset_merge (ZUNIONSTORE, ZINTERSTORE, ZDIFFSTORE)
+#include "../net/blocking.h"     // block_signal_key
+#include "../core/sys.h"         // get_current_time_ms (member deadlines)
+#include "heap.h"                // heap_upsert, heap_delete (member deadlines)
+
+// C++ stdlib
+#include <algorithm>             // std::sort (zset_rebuild)
+#include <vector>                // std::vector (zset_use_btree, zset_rebuild)
 
 // Return the minimum of two values
 static size_t min(size_t lhs, size_t rhs) {
@@ -18,7 +29,7 @@ static size_t min(size_t lhs, size_t rhs) {
 
 // Create a new ZNode
 static ZNode *znode_new(const char *name, size_t len, double score) {
-    ZNode *node = (ZNode *)malloc(sizeof(ZNode) + len);
+    ZNode *node = (ZNode *)malloc(sizeof(ZNode) + len + 1);    // +1 for the terminating NUL
     assert(node);   // not a good idea in real projects
 
     // Initialize the AVL tree and hash table
@@ -26,6 +37,7 @@ static ZNode *znode_new(const char *name, size_t len, double score) {
     node->hmap.next = NULL;
     node->hmap.hash_code = string_hash((uint8_t *)name, len);
     node->score = score;       // score of the node
+    node->heap_idx = (size_t)-1;   // no deadline
     node->len = len;           // length of the name
     
     // copy the name (len bytes) and add a terminating NUL so it's safe as a C string.
@@ -59,8 +71,26 @@ static bool zless(AVLNode *lhs, AVLNode *rhs) {
     return zless(lhs, zr->score, zr->name, zr->len);
 }
 
+// Tie-breaker of the B+-tree index: compare a member's name with a HashKey
+static int zcmp_name(void *item, const void *key) {
+    ZNode *znode = (ZNode *)item;
+    const HashKey *hkey = (const HashKey *)key;
+
+    int rv = memcmp(znode->name, hkey->name, min(znode->len, hkey->len));
+    if (rv != 0) { return rv; }
+    return znode->len < hkey->len ? -1 : (znode->len > hkey->len ? 1 : 0);
+}
+
+// Search key of a member in the B+-tree index
+static HashKey znode_key(ZNode *node) {
+    HashKey key;
+    key.name = node->name;
+    key.len = node->len;
+    return key;
+}
+
 // Insert into the AVL tree
-static void tree_insert(ZSet *zset, ZNode *node) {
+static void avl_tree_insert(ZSet *zset, ZNode *node) {
     AVLNode *parent = NULL;         // insert under this node
     AVLNode **from = &zset->root;   // the incoming pointer to the next node
     
@@ -76,13 +106,126 @@ static void tree_insert(ZSet *zset, ZNode *node) {
     zset->root = avl_fix_tree(&node->tree);
 }
 
+// Insert into whichever (score, name) index the set uses
+static void tree_insert(ZSet *zset, ZNode *node) {
+    if (zset->encoding == ZSET_ENC_BTREE) {
+        HashKey key = znode_key(node);
+        return bt_insert(zset->btree, node->score, &key, node);
+    }
+    avl_tree_insert(zset, node);
+}
+
+// Detach from the (score, name) index
+static void tree_detach(ZSet *zset, ZNode *node) {
+    if (zset->encoding == ZSET_ENC_BTREE) {
+        HashKey key = znode_key(node);
+        void *found = bt_delete(zset->btree, node->score, &key);
+        assert(found == node);
+        return;
+    }
+    zset->root = avl_delete(&node->tree);
+    avl_init(&node->tree);
+}
+
+/**
+ * Move a grown set from the AVL index to the B+-tree index.
+ * The AVL tree is walked in order once and the B+-tree is bulk-loaded in O(N).
+ */
+static void zset_use_btree(ZSet *zset) {
+    size_t n = avl_cnt(zset->root);
+    std::vector<double> scores(n);
+    std::vector<void *> items(n);
+
+    // Start from the minimum and walk neighbours
+    AVLNode *node = zset->root;
+    while (node && node->left) { node = node->left; }
+    for (size_t i = 0; i < n; ++i, node = avl_offset(node, +1)) {
+        ZNode *znode = container_of(node, ZNode, tree);
+        scores[i] = znode->score;
+        items[i] = znode;
+    }
+
+    zset->btree = new BTree();
+    bt_init(zset->btree, &zcmp_name);
+    bt_build(zset->btree, scores.data(), items.data(), n);
+    zset->root = NULL;
+    zset->encoding = ZSET_ENC_BTREE;
+}
+
+/**
+ * Unpack a small set into ZNodes indexed by the hash table and the AVL tree,
+ * once it outgrows the packed limits.
+ */
+static void zset_unpack(ZSet *zset) {
+    assert(zset->encoding == ZSET_ENC_PACKED);
+    ZPack *pack = zset->pack;
+    for (uint32_t i = 0; i < zpack_len(pack); ++i) {
+        size_t len = 0;
+        const char *name = zpack_name(pack, i, &len);
+        ZNode *node = znode_new(name, len, zpack_score(pack, i));
+        hm_insert(&zset->hmap, &node->hmap);
+        avl_tree_insert(zset, node);
+    }
+    free(pack);
+    zset->pack = NULL;
+    zset->encoding = ZSET_ENC_AVL;
+}
+
+// Order of two members by the (score, name) tuple
+static bool znode_less(const ZNode *lhs, const ZNode *rhs) {
+    return zless((AVLNode *)&lhs->tree, rhs->score, rhs->name, rhs->len);
+}
+
+// hm_foreach callback: gather the members of the hash table
+static bool znode_collect(HNode *node, void *arg) {
+    ((std::vector<ZNode *> *)arg)->push_back(container_of(node, ZNode, hmap));
+    return true;
+}
+
+/**
+ * Rebuild the (score, name) index from the members in the hash table: one sort and a
+ * linear bulk build, instead of a rebalancing insert per member. The old index is
+ * dropped without being unlinked, so member scores may change freely beforehand.
+ */
+static void zset_rebuild(ZSet *zset) {
+    assert(zset->encoding != ZSET_ENC_PACKED);
+    std::vector<ZNode *> nodes;
+    nodes.reserve(hm_size(&zset->hmap));
+    hm_foreach(&zset->hmap, &znode_collect, &nodes);
+    std::sort(nodes.begin(), nodes.end(), &znode_less);
+    size_t n = nodes.size();
+
+    // Large sets go straight to the B+-tree
+    if (zset->encoding == ZSET_ENC_AVL && n > k_zset_btree_threshold) {
+        zset->btree = new BTree();
+        bt_init(zset->btree, &zcmp_name);
+        zset->encoding = ZSET_ENC_BTREE;
+    }
+    zset->root = NULL;
+
+    if (zset->encoding == ZSET_ENC_BTREE) {
+        std::vector<double> scores(n);
+        std::vector<void *> items(n);
+        for (size_t i = 0; i < n; ++i) {
+            scores[i] = nodes[i]->score;
+            items[i] = nodes[i];
+        }
+        bt_clear(zset->btree, NULL);
+        bt_build(zset->btree, scores.data(), items.data(), n);
+        return;
+    }
+
+    std::vector<AVLNode *> trees(n);
+    for (size_t i = 0; i < n; ++i) { trees[i] = &nodes[i]->tree; }
+    zset->root = avl_build(trees.data(), n);
+}
+
 // update the score of an existing node
 static void zset_update(ZSet *zset, ZNode *node, double score) {
     if (node->score == score) { return; }   // If the score is the same, do nothing
 
     // Detach the tree node
-    zset->root = avl_delete(&node->tree);
-    avl_init(&node->tree);
+    tree_detach(zset, node);
 
     // Update the score and reinsert the tree node
     node->score = score;
@@ -99,9 +242,9 @@ static bool hcmp(HNode *node, HNode *key) {
     return 0 == memcmp(znode->name, hkey->name, znode->len); // If the name is the same, return true
 }
 
-// Lookup by name
-ZNode *zset_lookup(ZSet *zset, const char *name, size_t len) {
-    if (!zset->root) { return NULL; }   // If the root is NULL, return NULL
+// Lookup by name in the hash table (AVL and B+-tree encodings)
+static ZNode *zset_lookup(ZSet *zset, const char *name, size_t len) {
+    if (hm_size(&zset->hmap) == 0) { return NULL; }   // nothing to look up in an empty set
 
     HashKey key;
     key.node.hash_code = string_hash((uint8_t *)name, len);
@@ -112,8 +255,73 @@ ZNode *zset_lookup(ZSet *zset, const char *name, size_t len) {
     return found ? container_of(found, ZNode, hmap) : NULL;
 }
 
+// Keep the set's slot in `server_data.zset_heap` at its earliest member deadline
+static void zset_expiry_sync(ZSet *zset) {
+    if (zset->expiry && !zset->expiry->empty()) {
+        HeapItem item = { (*zset->expiry)[0].val, &zset->expiry_idx };
+        heap_upsert(server_data.zset_heap, zset->expiry_idx, item);
+    }
+    else if (zset->expiry_idx != (size_t)-1) {
+        heap_delete(server_data.zset_heap, zset->expiry_idx);
+        zset->expiry_idx = (size_t)-1;
+    }
+}
+
+// Drop the deadline of a member, if it has one
+static void znode_clear_ttl(ZSet *zset, ZNode *node) {
+    if (node->heap_idx == (size_t)-1) { return; }
+
+    bool head = node->heap_idx == 0;   // only removing the earliest deadline moves the set's own
+    heap_delete(*zset->expiry, node->heap_idx);
+    node->heap_idx = (size_t)-1;
+    if (head) { zset_expiry_sync(zset); }
+}
+
+// Delete a node
+static void zset_delete(ZSet *zset, ZNode *node) {
+    // Copy the node details 
+    HashKey key;
+    key.node.hash_code = node->hmap.hash_code;
+    key.name = node->name;
+    key.len = node->len;
+
+    // Remove from the hash table
+    HNode *found = hm_delete(&zset->hmap, &key.node, &hcmp);
+    assert(found);
+
+    // Remove from the tree and the deadlines
+    tree_detach(zset, node);
+    znode_clear_ttl(zset, node);
+    
+    // Deallocate the node
+    znode_del(node);
+}
+
+// Add or re-position a member of a packed set, returns false if it outgrew the packed limits
+static bool zpack_upsert(ZSet *zset, const char *name, size_t len, double score, bool *added) {
+    int64_t found = zpack_find(zset->pack, name, len);
+    *added = found < 0;
+    if (!*added) {
+        if (zpack_score(zset->pack, (uint32_t)found) == score) { return true; }
+        zset->pack = zpack_remove(zset->pack, (uint32_t)found);     // re-inserted below at its new rank
+    }
+    else if (zpack_len(zset->pack) + 1 > k_zset_pack_max_len || len > k_zset_pack_max_name) {
+        return false;
+    }
+
+    uint32_t pos = zpack_lower_bound(zset->pack, score, name, len);
+    zset->pack = zpack_insert(zset->pack, pos, score, name, len);
+    return true;
+}
+
 // Add a new (score, name) tuple, or update the score of the existing tuple
 bool zset_insert(ZSet *zset, const char *name, size_t len, double score) {
+    if (zset->encoding == ZSET_ENC_PACKED) {
+        bool added = false;
+        if (zpack_upsert(zset, name, len, score, &added)) { return added; }
+        zset_unpack(zset);
+    }
+
     // If the node exists, update the score
     ZNode *node = zset_lookup(zset, name, len);
     if (node) {
@@ -125,30 +333,157 @@ bool zset_insert(ZSet *zset, const char *name, size_t len, double score) {
     node = znode_new(name, len, score);
     hm_insert(&zset->hmap, &node->hmap);
     tree_insert(zset, node);
+
+    // Large sets switch to the cache-friendly index
+    if (zset->encoding == ZSET_ENC_AVL && zset_len(zset) > k_zset_btree_threshold) { zset_use_btree(zset); }
     return true;
 }
 
-// Delete a node
-void zset_delete(ZSet *zset, ZNode *node) {
-    // Copy the node details 
-    HashKey key;
-    key.node.hash_code = node->hmap.hash_code;
-    key.name = node->name;
-    key.len = node->len;
+// Remove a member by name, returns false if it was absent
+bool zset_remove(ZSet *zset, const char *name, size_t len) {
+    if (zset->encoding == ZSET_ENC_PACKED) {
+        int64_t found = zpack_find(zset->pack, name, len);
+        if (found < 0) { return false; }
+        zset->pack = zpack_remove(zset->pack, (uint32_t)found);
+        return true;
+    }
 
-    // Remove from the hash table
-    HNode *found = hm_delete(&zset->hmap, &key.node, &hcmp);
-    assert(found);
+    ZNode *node = zset_lookup(zset, name, len);
+    if (node) { zset_delete(zset, node); }
+    return node != NULL;
+}
 
-    // Remove from the tree
-    zset->root = avl_delete(&node->tree);
-    
-    // Deallocate the node
-    znode_del(node);
+// Score of a member by name, returns false if it is absent
+bool zset_score(ZSet *zset, const char *name, size_t len, double *score) {
+    if (zset->encoding == ZSET_ENC_PACKED) {
+        int64_t found = zpack_find(zset->pack, name, len);
+        if (found >= 0) { *score = zpack_score(zset->pack, (uint32_t)found); }
+        return found >= 0;
+    }
+
+    ZNode *node = zset_lookup(zset, name, len);
+    if (node) { *score = node->score; }
+    return node != NULL;
+}
+
+/**
+ * Expire a member `ttl_ms` from now, or clear its deadline when `ttl_ms` is negative.
+ * Returns false if the member is absent.
+ */
+bool zset_set_ttl(ZSet *zset, const char *name, size_t len, int64_t ttl_ms) {
+    if (zset->encoding == ZSET_ENC_PACKED) {
+        if (zpack_find(zset->pack, name, len) < 0) { return false; }
+        if (ttl_ms < 0) { return true; }    // packed members never have a deadline
+        zset_unpack(zset);                  // deadlines live on ZNodes
+    }
+
+    ZNode *node = zset_lookup(zset, name, len);
+    if (!node) { return false; }
+    if (ttl_ms < 0) {
+        znode_clear_ttl(zset, node);
+        return true;
+    }
+
+    if (!zset->expiry) { zset->expiry = new std::vector<HeapItem>(); }
+    HeapItem item = { get_current_time_ms() + (uint64_t)ttl_ms, &node->heap_idx };
+    heap_upsert(*zset->expiry, node->heap_idx, item);
+    zset_expiry_sync(zset);
+    return true;
+}
+
+// Milliseconds left before a member expires, -1 without a deadline, -2 if the member is absent
+int64_t zset_ttl(ZSet *zset, const char *name, size_t len) {
+    if (zset->encoding == ZSET_ENC_PACKED) { return zpack_find(zset->pack, name, len) < 0 ? -2 : -1; }
+
+    ZNode *node = zset_lookup(zset, name, len);
+    if (!node) { return -2; }
+    if (node->heap_idx == (size_t)-1) { return -1; }
+
+    uint64_t expires_at = (*zset->expiry)[node->heap_idx].val;
+    uint64_t now_ms = get_current_time_ms();
+    return expires_at > now_ms ? (int64_t)(expires_at - now_ms) : 0;
+}
+
+/**
+ * Remove up to `max_work` members whose deadline is at or before `now_ms`, earliest first.
+ * Returns the number removed.
+ */
+size_t zset_expire(ZSet *zset, uint64_t now_ms, size_t max_work) {
+    std::vector<HeapItem> *heap = zset->expiry;
+    size_t removed = 0;
+    while (heap && removed < max_work && !heap->empty() && (*heap)[0].val <= now_ms) {
+        zset_delete(zset, container_of((*heap)[0].ref, ZNode, heap_idx));
+        removed++;
+    }
+    return removed;
+}
+
+/**
+ * Leave `server_data.zset_heap` and free the deadline index. Runs on the main thread
+ * before a set is handed to a worker to be freed.
+ */
+void zset_expiry_release(ZSet *zset) {
+    if (zset->expiry_idx != (size_t)-1) {
+        heap_delete(server_data.zset_heap, zset->expiry_idx);
+        zset->expiry_idx = (size_t)-1;
+    }
+    delete zset->expiry;
+    zset->expiry = NULL;
+}
+
+// Reads never see a member past its deadline, the due ones are removed first
+static void zset_expire_due(ZSet *zset) {
+    if (zset->expiry_idx == (size_t)-1) { return; }     // no deadlines, the common case
+    zset_expire(zset, get_current_time_ms(), (size_t)-1);
+}
+
+// Load the member under the cursor for the current encoding
+static bool ziter_load(ZSet *zset, ZIter *iter) {
+    switch (zset->encoding) {
+    case ZSET_ENC_PACKED:
+        iter->valid = iter->slot < zpack_len(zset->pack);
+        if (iter->valid) {
+            iter->score = zpack_score(zset->pack, iter->slot);
+            iter->name = zpack_name(zset->pack, iter->slot, &iter->len);
+        }
+        return iter->valid;
+    case ZSET_ENC_BTREE:
+        iter->node = bt_iter_valid(&iter->pos) ? (ZNode *)bt_iter_item(&iter->pos) : NULL;
+        break;
+    default:
+        break;
+    }
+
+    // AVL and B+-tree cursors end on a ZNode
+    iter->valid = iter->node != NULL;
+    if (iter->valid) {
+        iter->score = iter->node->score;
+        iter->name = iter->node->name;
+        iter->len = iter->node->len;
+    }
+    return iter->valid;
+}
+
+// Point the cursor at a member of the AVL index
+static bool ziter_set_avl(ZSet *zset, ZIter *iter, AVLNode *node) {
+    iter->node = node ? container_of(node, ZNode, tree) : NULL;
+    return ziter_load(zset, iter);
 }
 
 // Find the first (score, name) tuple that is >= key.
-ZNode *zset_seek_greater_equal(ZSet *zset, double score, const char *name, size_t len) {
+bool zset_seek_greater_equal(ZSet *zset, ZIter *iter, double score, const char *name, size_t len) {
+    if (zset->encoding == ZSET_ENC_PACKED) {
+        iter->slot = zpack_lower_bound(zset->pack, score, name, len);
+        return ziter_load(zset, iter);
+    }
+    if (zset->encoding == ZSET_ENC_BTREE) {
+        HashKey key;
+        key.name = name;
+        key.len = len;
+        bt_seek_greater_equal(zset->btree, score, &key, &iter->pos);
+        return ziter_load(zset, iter);
+    }
+
     AVLNode *found = NULL;
     for (AVLNode *node = zset->root; node; ) {
         if (zless(node, score, name, len)) {
@@ -160,13 +495,104 @@ ZNode *zset_seek_greater_equal(ZSet *zset, double score, const char *name, size_
             node = node->left;
         }
     }
-    return found ? container_of(found, ZNode, tree) : NULL;
+    return ziter_set_avl(zset, iter, found);
+}
+
+// Member at the given rank, O(log N).
+bool zset_seek_rank(ZSet *zset, ZIter *iter, int64_t rank) {
+    if (rank < 0 || rank >= (int64_t)zset_len(zset)) { return iter->valid = false; }
+
+    if (zset->encoding == ZSET_ENC_PACKED) {
+        iter->slot = (uint32_t)rank;
+        return ziter_load(zset, iter);
+    }
+    if (zset->encoding == ZSET_ENC_BTREE) {
+        bt_seek_rank(zset->btree, (uint64_t)rank, &iter->pos);
+        return ziter_load(zset, iter);
+    }
+
+    // The root's rank is the size of its left subtree, offset from there
+    AVLNode *root = zset->root;
+    return ziter_set_avl(zset, iter, avl_offset(root, (int32_t)(rank - avl_cnt(root->left))));
+}
+
+// Rank of the member under a valid cursor
+static int64_t ziter_rank(ZSet *zset, ZIter *iter) {
+    switch (zset->encoding) {
+    case ZSET_ENC_PACKED:
+        return iter->slot;
+    case ZSET_ENC_BTREE: {
+        HashKey key = znode_key(iter->node);
+        return (int64_t)bt_rank(zset->btree, iter->score, &key);
+    }
+    default:
+        return avl_rank(&iter->node->tree);
+    }
+}
+
+// Move the cursor by N positions in sorted order.
+bool zset_iter_offset(ZSet *zset, ZIter *iter, int64_t offset) {
+    if (!iter->valid) { return false; }
+
+    if (zset->encoding == ZSET_ENC_PACKED) {
+        int64_t slot = (int64_t)iter->slot + offset;
+        if (slot < 0) { return iter->valid = false; }
+        iter->slot = (uint32_t)slot;
+        return ziter_load(zset, iter);
+    }
+    if (zset->encoding == ZSET_ENC_BTREE) {
+        // Neighbours are in the same or an adjacent leaf, longer jumps go through the rank
+        if (offset == +1) { bt_iter_next(&iter->pos); }
+        else if (offset == -1) { bt_iter_prev(&iter->pos); }
+        else if (offset != 0) { return zset_seek_rank(zset, iter, ziter_rank(zset, iter) + offset); }
+        return ziter_load(zset, iter);
+    }
+    return ziter_set_avl(zset, iter, avl_offset(&iter->node->tree, (int32_t)offset));
+}
+
+// Number of members in the ZSet.
+size_t zset_len(ZSet *zset) {
+    switch (zset->encoding) {
+    case ZSET_ENC_PACKED: return zpack_len(zset->pack);
+    case ZSET_ENC_BTREE:  return zset->btree->size;
+    default:              return avl_cnt(zset->root);
+    }
+}
+
+// Rank (0-based position in sorted order) of a member, -1 if absent, O(log N).
+int64_t zset_rank(ZSet *zset, const char *name, size_t len) {
+    if (zset->encoding == ZSET_ENC_PACKED) { return zpack_find(zset->pack, name, len); }
+
+    ZNode *node = zset_lookup(zset, name, len);
+    if (!node) { return -1; }
+    if (zset->encoding == ZSET_ENC_BTREE) {
+        HashKey key = znode_key(node);
+        return (int64_t)bt_rank(zset->btree, node->score, &key);
+    }
+    return avl_rank(&node->tree);
 }
 
-// Get node offset by N positions in sorted order.
-ZNode *znode_offset(ZNode *node, int64_t offset) {
-    AVLNode *tnode = node ? avl_offset(&node->tree, offset) : NULL;
-    return tnode ? container_of(tnode, ZNode, tree) : NULL;
+/**
+ * Number of members whose score is below `score` (or at most `score` when inclusive).
+ * A single root-to-leaf descent that sums the subtree counts skipped on the left.
+ */
+int64_t zset_count_below(ZSet *zset, double score, bool inclusive) {
+    if (zset->encoding == ZSET_ENC_PACKED) { return zpack_count_below(zset->pack, score, inclusive); }
+    if (zset->encoding == ZSET_ENC_BTREE) { return (int64_t)bt_count_below(zset->btree, score, inclusive); }
+
+    int64_t count = 0;
+    for (AVLNode *node = zset->root; node; ) {
+        double node_score = container_of(node, ZNode, tree)->score;
+        bool before = inclusive ? node_score <= score : node_score < score;
+        if (before) {
+            count += avl_cnt(node->left) + 1;   // node and its left subtree come before the bound
+            node = node->right;
+        }
+        else {
+            node = node->left;
+        }
+    }
+    return count;
 }
 
 // Recursively delete the AVL tree.
@@ -179,14 +605,74 @@ static void tree_dispose(AVLNode *node) {
     znode_del(container_of(node, ZNode, tree));
 }
 
+// Item destructor for the B+-tree index
+static void znode_del_item(void *item) {
+    znode_del((ZNode *)item);
+}
+
 // Destroy all nodes and clear the ZSet.
 void zset_clear(ZSet *zset) {
+    // Drop the member deadlines
+    zset_expiry_release(zset);
+    // Free the packed members
+    free(zset->pack);
+    zset->pack = NULL;
     // Clear the hash table
     hm_clear(&zset->hmap);
-    // Clear the AVL tree
+    // Clear the index, freeing every member once
+    if (zset->btree) {
+        bt_clear(zset->btree, &znode_del_item);
+        delete zset->btree;
+        zset->btree = NULL;
+    }
     tree_dispose(zset->root);
     // Set the root to NULL
     zset->root = NULL;
+    zset->encoding = ZSET_ENC_PACKED;
+}
+
+// Order of two pairs by the (score, name) tuple
+static bool zpair_less(const ZPair &lhs, const ZPair &rhs) {
+    if (lhs.score != rhs.score) { return lhs.score < rhs.score; }
+    int rv = memcmp(lhs.name, rhs.name, min(lhs.len, rhs.len));
+    return rv != 0 ? rv < 0 : lhs.len < rhs.len;
+}
+
+/**
+ * Fill an empty ZSet from pairs with distinct names, given in any order.
+ * Small results are packed directly, larger ones go through zset_rebuild.
+ */
+void zset_load(ZSet *zset, std::vector<ZPair> &pairs) {
+    assert(zset_len(zset) == 0);
+
+    bool packed = pairs.size() <= k_zset_pack_max_len;
+    for (size_t i = 0; packed && i < pairs.size(); ++i) { packed = pairs[i].len <= k_zset_pack_max_name; }
+    if (packed && zset->encoding == ZSET_ENC_PACKED) {
+        std::sort(pairs.begin(), pairs.end(), &zpair_less);
+        for (uint32_t i = 0; i < pairs.size(); ++i) {
+            zset->pack = zpack_insert(zset->pack, i, pairs[i].score, pairs[i].name, pairs[i].len);
+        }
+        return;
+    }
+
+    if (zset->encoding == ZSET_ENC_PACKED) { zset_unpack(zset); }
+    hm_reserve(&zset->hmap, pairs.size());
+    for (const ZPair &pair : pairs) {
+        ZNode *node = znode_new(pair.name, pair.len, pair.score);
+        hm_insert(&zset->hmap, &node->hmap);
+    }
+    zset_rebuild(zset);
+}
+
+// Pop the member with the lowest (or highest) score, returns false if the set is empty
+bool zset_pop(ZSet *zset, bool max, std::string *name, double *score) {
+    ZIter iter;
+    if (!zset_seek_rank(zset, &iter, max ? (int64_t)zset_len(zset) - 1 : 0)) { return false; }
+
+    name->assign(iter.name, iter.len);
+    *score = iter.score;
+    zset_remove(zset, name->data(), name->size());
+    return true;
 }
 
 /** ------------------------------------------------------------
@@ -214,18 +700,123 @@ static ZSet *expect_zset(std::string &s) {
     
     // Get the entry from the hash node
     Entry *ent = container_of(hnode, Entry, node);
-    return ent->type == TYPE_ZSET ? &ent->zset : NULL;
+    if (ent->type != TYPE_ZSET) { return NULL; }
+    zset_expire_due(&ent->zset);
+    return &ent->zset;
+}
+
+// ZADD options
+enum {
+    ZADD_NX   = 1 << 0,     // only add new members
+    ZADD_XX   = 1 << 1,     // only update existing members
+    ZADD_GT   = 1 << 2,     // only update when the new score is greater
+    ZADD_LT   = 1 << 3,     // only update when the new score is less
+    ZADD_INCR = 1 << 4,     // add to the score instead of replacing it
+};
+
+// A (score, member) pair of a ZADD
+struct ZAddPair {
+    double score = 0;
+    const std::string *name = NULL;
+};
+
+/**
+ * Resolve the score a ZADD pair leaves on a member, `old` is NULL for a new member.
+ * Returns false when the options skip the pair.
+ */
+static bool zadd_resolve(uint32_t flags, const double *old, double *score) {
+    if (old && (flags & ZADD_NX)) { return false; }
+    if (!old && (flags & ZADD_XX)) { return false; }
+    if (!old) { return true; }
+
+    if (flags & ZADD_INCR) { *score += *old; }
+    if ((flags & ZADD_GT) && !(*score > *old)) { return false; }
+    if ((flags & ZADD_LT) && !(*score < *old)) { return false; }
+    return true;
+}
+
+// Apply the pairs one at a time, returns the number of new members
+static int64_t zadd_each(ZSet *zset, uint32_t flags, const std::vector<ZAddPair> &pairs) {
+    int64_t added = 0;
+    for (const ZAddPair &pair : pairs) {
+        const std::string &name = *pair.name;
+        double old = 0, score = pair.score;
+        bool exists = zset_score(zset, name.data(), name.size(), &old);
+        if (zadd_resolve(flags, exists ? &old : NULL, &score)) {
+            added += zset_insert(zset, name.data(), name.size(), score);
+        }
+    }
+    return added;
+}
+
+/**
+ * Apply a large batch to the hash table only, then rebuild the ordered index once.
+ * Later pairs for the same member see the earlier ones, as in zadd_each.
+ */
+static int64_t zadd_bulk(ZSet *zset, uint32_t flags, const std::vector<ZAddPair> &pairs) {
+    if (zset->encoding == ZSET_ENC_PACKED) { zset_unpack(zset); }
+    hm_reserve(&zset->hmap, pairs.size());
+
+    int64_t added = 0;
+    for (const ZAddPair &pair : pairs) {
+        const std::string &name = *pair.name;
+        ZNode *node = zset_lookup(zset, name.data(), name.size());
+        double score = pair.score;
+        if (!zadd_resolve(flags, node ? &node->score : NULL, &score)) { continue; }
+
+        if (node) {
+            node->score = score;    // re-indexed by the rebuild
+            continue;
+        }
+        node = znode_new(name.data(), name.size(), score);
+        hm_insert(&zset->hmap, &node->hmap);
+        added++;
+    }
+
+    zset_rebuild(zset);
+    return added;
 }
 
 /**
- * Command: ZADD <key> <score> <member>
- * Add or update a member’s score in a ZSet.
+ * Command: ZADD <key> [NX|XX] [GT|LT] [INCR] <score> <member> [<score> <member> ...]
+ * Add or update members’ scores in a ZSet, replies with the number of new members
+ * (with INCR, the new score or nil).
  */
 void zcmd_add(std::vector<std::string> &cmd, Buffer &resp) {
-    // Convert the score to a double
-    double score = 0;
-    if (!str2dbl(cmd[2], score)) {
-        return out_err(resp, ERR_BAD_ARG, "expect float");
+    // Options come before the first score
+    uint32_t flags = 0;
+    size_t pos = 2;
+    for (; pos < cmd.size(); ++pos) {
+        const char *opt = cmd[pos].c_str();
+        if (strcasecmp(opt, "nx") == 0) { flags |= ZADD_NX; }
+        else if (strcasecmp(opt, "xx") == 0) { flags |= ZADD_XX; }
+        else if (strcasecmp(opt, "gt") == 0) { flags |= ZADD_GT; }
+        else if (strcasecmp(opt, "lt") == 0) { flags |= ZADD_LT; }
+        else if (strcasecmp(opt, "incr") == 0) { flags |= ZADD_INCR; }
+        else { break; }
+    }
+
+    size_t nargs = cmd.size() - pos;
+    if (nargs == 0 || nargs % 2 != 0) {
+        return out_err(resp, ERR_BAD_ARG, "expect score member pairs");
+    }
+    if ((flags & ZADD_NX) && (flags & (ZADD_XX | ZADD_GT | ZADD_LT))) {
+        return out_err(resp, ERR_BAD_ARG, "NX is incompatible with XX, GT and LT");
+    }
+    if ((flags & ZADD_GT) && (flags & ZADD_LT)) {
+        return out_err(resp, ERR_BAD_ARG, "GT and LT are incompatible");
+    }
+    if ((flags & ZADD_INCR) && nargs != 2) {
+        return out_err(resp, ERR_BAD_ARG, "INCR expects a single score member pair");
+    }
+
+    // Parse every score before touching the set
+    std::vector<ZAddPair> pairs(nargs / 2);
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (!str2dbl(cmd[pos + 2 * i], pairs[i].score)) {
+            return out_err(resp, ERR_BAD_ARG, "expect float");
+        }
+        pairs[i].name = &cmd[pos + 2 * i + 1];
     }
 
     // look up or create the zset
@@ -236,6 +827,9 @@ void zcmd_add(std::vector<std::string> &cmd, Buffer &resp) {
 
     Entry *ent = NULL;
     if (!hnode) {   // insert a new key
+        // XX only updates, so a missing key stays missing
+        if (flags & ZADD_XX) { return (flags & ZADD_INCR) ? out_nil(resp) : out_int(resp, 0); }
+
         ent = entry_new(TYPE_ZSET);
         ent->key.swap(key.key);
         ent->node.hash_code = key.node.hash_code;
@@ -247,11 +841,28 @@ void zcmd_add(std::vector<std::string> &cmd, Buffer &resp) {
             return out_err(resp, ERR_BAD_TYP, "expect zset");
         }
     }
+    ZSet *zset = &ent->zset;
+    zset_expire_due(zset);      // an expired member is re-added as new
 
-    // Insert the score and name into the ZSet
-    const std::string &name = cmd[3];
-    bool added = zset_insert(&ent->zset, name.data(), name.size(), score);
-    return out_int(resp, (int64_t)added);
+    // INCR replies with the new score, or nil when the options skip it
+    if (flags & ZADD_INCR) {
+        const std::string &name = *pairs[0].name;
+        double old = 0, score = pairs[0].score;
+        bool exists = zset_score(zset, name.data(), name.size(), &old);
+        if (!zadd_resolve(flags, exists ? &old : NULL, &score)) { return out_nil(resp); }
+        if (isnan(score)) { return out_err(resp, ERR_BAD_ARG, "resulting score is not a number"); }
+
+        zset_insert(zset, name.data(), name.size(), score);
+        block_signal_key(ent->key);
+        return out_dbl(resp, score);
+    }
+
+    // A batch too large to stay packed that is at least the size of the set is cheaper
+    // to apply by rebuilding the index than by inserting pair by pair
+    bool bulk = pairs.size() > k_zset_pack_max_len && pairs.size() >= zset_len(zset);
+    int64_t added = bulk ? zadd_bulk(zset, flags, pairs) : zadd_each(zset, flags, pairs);
+    if (zset_len(zset) > 0) { block_signal_key(ent->key); }    // wake BZPOPMIN waiters
+    return out_int(resp, added);
 }
 
 /**
@@ -265,11 +876,10 @@ void zcmd_remove(std::vector<std::string> &cmd, Buffer &resp) {
     
     // Get the name from the command
     const std::string &name = cmd[2];
-    ZNode *znode = zset_lookup(zset, name.data(), name.size());
     
-    // Delete the node if it exists
-    if (znode) { zset_delete(zset, znode); }
-    return out_int(resp, znode ? 1 : 0);
+    // Delete the member if it exists
+    bool removed = zset_remove(zset, name.data(), name.size());
+    return out_int(resp, removed ? 1 : 0);
 }
 
 /**
@@ -282,10 +892,10 @@ void zcmd_score(std::vector<std::string> &cmd, Buffer &resp) {
     
     // Get the name from the command
     const std::string &name = cmd[2];
-    ZNode *znode = zset_lookup(zset, name.data(), name.size());
+    double score = 0;
 
     // Return the score
-    return znode ? out_dbl(resp, znode->score) : out_nil(resp);
+    return zset_score(zset, name.data(), name.size(), &score) ? out_dbl(resp, score) : out_nil(resp);
 }
 
 /**
@@ -311,32 +921,317 @@ void zcmd_query(std::vector<std::string> &cmd, Buffer &resp) {
     if (limit <= 0) { return out_arr(resp, 0); }
 
     // Get the first node that is >= the score and name
-    ZNode *znode = zset_seek_greater_equal(zset, score, name.data(), name.size());
-    if (!znode) {
+    ZIter iter;
+    if (!zset_seek_greater_equal(zset, &iter, score, name.data(), name.size())) {
         out_arr(resp, 0);
         return;
     }
 
     // Get the node at the offset
-    znode = znode_offset(znode, offset);
-    if (!znode) {
+    if (!zset_iter_offset(zset, &iter, offset)) {
         out_arr(resp, 0);
         return;
     }
 
-    // Count the number of nodes
-    size_t n = 0;
-    for (ZNode *iter = znode; iter && n < (size_t)limit; iter = znode_offset(iter, +1)) {
-        n += 2;
-    }
+    // Count the number of nodes from the ranks instead of walking them twice
+    int64_t avail = (int64_t)zset_len(zset) - zset_rank(zset, iter.name, iter.len);
+    size_t n = 2 * (size_t)(avail < limit ? avail : limit);
 
     // Output the number of nodes
     out_arr(resp, (uint32_t)n);
 
     // Output the nodes
-    for (uint32_t i = 0; i < n / 2 && znode; ++i) {
-        out_str(resp, znode->name, znode->len);
-        out_dbl(resp, znode->score);
-        znode = znode_offset(znode, +1);
+    for (uint32_t i = 0; i < n / 2 && iter.valid; ++i) {
+        out_str(resp, iter.name, iter.len);
+        out_dbl(resp, iter.score);
+        zset_iter_offset(zset, &iter, +1);
+    }
+}
+
+// Shared by ZRANK and ZREVRANK
+static void zcmd_rank_impl(std::vector<std::string> &cmd, Buffer &resp, bool reverse) {
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+
+    const std::string &name = cmd[2];
+    int64_t rank = zset_rank(zset, name.data(), name.size());
+    if (rank < 0) { return out_nil(resp); }
+
+    return out_int(resp, reverse ? (int64_t)zset_len(zset) - 1 - rank : rank);
+}
+
+/**
+ * Command: ZRANK <key> <member>
+ * 0-based rank of a member in ascending (score, name) order, or nil.
+ */
+void zcmd_rank(std::vector<std::string> &cmd, Buffer &resp) {
+    return zcmd_rank_impl(cmd, resp, false);
+}
+
+/**
+ * Command: ZREVRANK <key> <member>
+ * 0-based rank of a member in descending order, or nil.
+ */
+void zcmd_revrank(std::vector<std::string> &cmd, Buffer &resp) {
+    return zcmd_rank_impl(cmd, resp, true);
+}
+
+// Parse a score bound, a leading '(' makes it exclusive (e.g. "(1.5", "-inf", "+inf")
+static bool parse_score_bound(const std::string &s, double &score, bool &exclusive) {
+    exclusive = !s.empty() && s[0] == '(';
+    return str2dbl(exclusive ? s.substr(1) : s, score);
+}
+
+/**
+ * Command: ZCOUNT <key> <min> <max>
+ * Number of members with min <= score <= max, as the difference of two rank bounds.
+ */
+void zcmd_count(std::vector<std::string> &cmd, Buffer &resp) {
+    double min_score = 0, max_score = 0;
+    bool min_excl = false, max_excl = false;
+    if (!parse_score_bound(cmd[2], min_score, min_excl) || !parse_score_bound(cmd[3], max_score, max_excl)) {
+        return out_err(resp, ERR_BAD_ARG, "expect fp number");
     }
-}
\ No newline at end of file
+
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+
+    // members before the lower bound vs. members up to the upper bound
+    int64_t lo = zset_count_below(zset, min_score, min_excl);
+    int64_t hi = zset_count_below(zset, max_score, !max_excl);
+    return out_int(resp, hi > lo ? hi - lo : 0);
+}
+
+// Shared by ZRANGE and ZREVRANGE, negative indexes count from the end
+static void zcmd_range_impl(std::vector<std::string> &cmd, Buffer &resp, bool reverse) {
+    int64_t start = 0, stop = 0;
+    if (!str2int(cmd[2], start) || !str2int(cmd[3], stop)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+
+    // Normalize the index range to [start, stop] within [0, size)
+    int64_t size = (int64_t)zset_len(zset);
+    if (start < 0) { start += size; }
+    if (stop < 0) { stop += size; }
+    if (start < 0) { start = 0; }
+    if (stop >= size) { stop = size - 1; }
+    if (start > stop) { return out_arr(resp, 0); }
+
+    // Seek once, then walk neighbours in the requested direction
+    int64_t n = stop - start + 1;
+    ZIter iter;
+    zset_seek_rank(zset, &iter, reverse ? size - 1 - start : start);
+    out_arr(resp, (uint32_t)(n * 2));
+    for (int64_t i = 0; i < n && iter.valid; ++i) {
+        out_str(resp, iter.name, iter.len);
+        out_dbl(resp, iter.score);
+        zset_iter_offset(zset, &iter, reverse ? -1 : +1);
+    }
+}
+
+/**
+ * Command: ZRANGE <key> <start> <stop>
+ * Members by rank position in ascending order, as [name, score, ...] pairs.
+ */
+void zcmd_range(std::vector<std::string> &cmd, Buffer &resp) {
+    return zcmd_range_impl(cmd, resp, false);
+}
+
+/**
+ * Command: ZREVRANGE <key> <start> <stop>
+ * Members by rank position in descending order, as [name, score, ...] pairs.
+ */
+void zcmd_revrange(std::vector<std::string> &cmd, Buffer &resp) {
+    return zcmd_range_impl(cmd, resp, true);
+}
+
+// Replace `dst` with the set `result`, an empty result deletes the key
+static void zset_store(std::string &dst, ZSet *result) {
+    LookupKey key;
+    key.key.swap(dst);
+    key.node.hash_code = string_hash((uint8_t *)key.key.data(), key.key.size());
+
+    // The old value goes whatever its type, along with its TTL
+    HNode *hnode = hm_delete(&server_data.db, &key.node, &entry_key_equals);
+    if (hnode) { entry_del(container_of(hnode, Entry, node)); }
+
+    if (zset_len(result) == 0) {
+        zset_clear(result);
+        return;
+    }
+    Entry *ent = entry_new(TYPE_ZSET);
+    ent->key.swap(key.key);
+    ent->node.hash_code = key.node.hash_code;
+    ent->zset = *result;    // the set owns no pointers into itself, so it moves by copy
+    hm_insert(&server_data.db, &ent->node);
+    block_signal_key(ent->key);
+}
+
+/**
+ * Shared body of the set algebra commands:
+ *   <dst> <numkeys> <key> [<key> ...] [WEIGHTS <weight> ...] [AGGREGATE SUM|MIN|MAX]
+ * ZDIFFSTORE takes no options. Replies with the size of the stored set.
+ */
+static void zcmd_store_impl(std::vector<std::string> &cmd, Buffer &resp, ZMergeOp op) {
+    int64_t numkeys = 0;
+    if (!str2int(cmd[2], numkeys) || numkeys < 1 || (size_t)numkeys > cmd.size() - 3) {
+        return out_err(resp, ERR_BAD_ARG, "expect numkeys");
+    }
+
+    // Options
+    std::vector<double> weights((size_t)numkeys, 1.0);
+    ZAggregate agg = ZAGG_SUM;
+    size_t pos = 3 + (size_t)numkeys;
+    while (op != ZMERGE_DIFF && pos < cmd.size()) {
+        const char *opt = cmd[pos].c_str();
+        if (strcasecmp(opt, "weights") == 0 && pos + (size_t)numkeys < cmd.size()) {
+            for (size_t i = 0; i < weights.size(); ++i) {
+                if (!str2dbl(cmd[pos + 1 + i], weights[i])) {
+                    return out_err(resp, ERR_BAD_ARG, "expect float weight");
+                }
+            }
+            pos += 1 + (size_t)numkeys;
+        }
+        else if (strcasecmp(opt, "aggregate") == 0 && pos + 1 < cmd.size()) {
+            const char *name = cmd[pos + 1].c_str();
+            if (strcasecmp(name, "sum") == 0) { agg = ZAGG_SUM; }
+            else if (strcasecmp(name, "min") == 0) { agg = ZAGG_MIN; }
+            else if (strcasecmp(name, "max") == 0) { agg = ZAGG_MAX; }
+            else { return out_err(resp, ERR_BAD_ARG, "expect SUM, MIN or MAX"); }
+            pos += 2;
+        }
+        else {
+            break;
+        }
+    }
+    if (pos != cmd.size()) { return out_err(resp, ERR_BAD_ARG, "syntax error"); }
+
+    // Inputs, a missing key is an empty set
+    std::vector<ZSet *> inputs((size_t)numkeys);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        inputs[i] = expect_zset(cmd[3 + i]);
+        if (!inputs[i]) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+    }
+
+    // Build the result aside, the destination may be one of the inputs
+    ZSet result;
+    zset_merge(&result, inputs.data(), weights.data(), inputs.size(), op, agg, &server_data.thread_pool);
+    int64_t size = (int64_t)zset_len(&result);
+    zset_store(cmd[1], &result);
+    return out_int(resp, size);
+}
+
+/**
+ * Command: ZUNIONSTORE <dst> <numkeys> <key> [<key> ...] [WEIGHTS <weight> ...] [AGGREGATE SUM|MIN|MAX]
+ * Store the members of any input, with their weighted scores aggregated.
+ */
+void zcmd_unionstore(std::vector<std::string> &cmd, Buffer &resp) {
+    zcmd_store_impl(cmd, resp, ZMERGE_UNION);
+}
+
+/**
+ * Command: ZINTERSTORE <dst> <numkeys> <key> [<key> ...] [WEIGHTS <weight> ...] [AGGREGATE SUM|MIN|MAX]
+ * Store the members of every input, with their weighted scores aggregated.
+ */
+void zcmd_interstore(std::vector<std::string> &cmd, Buffer &resp) {
+    zcmd_store_impl(cmd, resp, ZMERGE_INTER);
+}
+
+/**
+ * Command: ZDIFFSTORE <dst> <numkeys> <key> [<key> ...]
+ * Store the members of the first input that are in no other input, with their scores.
+ */
+void zcmd_diffstore(std::vector<std::string> &cmd, Buffer &resp) {
+    zcmd_store_impl(cmd, resp, ZMERGE_DIFF);
+}
+
+// A set drained by a pop goes away with its key, like an emptied hash, list or set
+static void zset_erase_if_empty(ZSet *zset) {
+    if (zset == &k_empty_zset || zset_len(zset) > 0) { return; }
+    entry_erase(container_of(zset, Entry, zset));
+}
+
+// Shared body of ZPOPMIN / ZPOPMAX
+static void zcmd_pop_impl(std::vector<std::string> &cmd, Buffer &resp, bool max) {
+    int64_t count = 1;
+    if (cmd.size() == 3 && (!str2int(cmd[2], count) || count < 0)) {
+        return out_err(resp, ERR_BAD_ARG, "expect int");
+    }
+
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+
+    int64_t size = (int64_t)zset_len(zset);
+    int64_t n = count < size ? count : size;
+    out_arr(resp, (uint32_t)(n * 2));
+
+    std::string name;
+    double score = 0;
+    for (int64_t i = 0; i < n && zset_pop(zset, max, &name, &score); ++i) {
+        out_str(resp, name.data(), name.size());
+        out_dbl(resp, score);
+    }
+    zset_erase_if_empty(zset);
+}
+
+/**
+ * Command: ZPOPMIN <key> [count]
+ * Remove and return up to `count` (default 1) members with the lowest scores.
+ */
+void zcmd_popmin(std::vector<std::string> &cmd, Buffer &resp) {
+    zcmd_pop_impl(cmd, resp, false);
+}
+
+/**
+ * Command: ZPOPMAX <key> [count]
+ * Remove and return up to `count` (default 1) members with the highest scores.
+ */
+void zcmd_popmax(std::vector<std::string> &cmd, Buffer &resp) {
+    zcmd_pop_impl(cmd, resp, true);
+}
+
+int zset_pop_reply(const std::string &key, bool max, Buffer &resp) {
+    std::string lookup = key;   // expect_zset consumes its argument
+    ZSet *zset = expect_zset(lookup);
+    if (!zset) { return -1; }
+
+    std::string name;
+    double score = 0;
+    if (!zset_pop(zset, max, &name, &score)) { return 0; }
+
+    out_arr(resp, 3);
+    out_str(resp, key.data(), key.size());
+    out_str(resp, name.data(), name.size());
+    out_dbl(resp, score);
+    zset_erase_if_empty(zset);
+    return 1;
+}
+
+/**
+ * Command: ZPEXPIRE <key> <member> <ttl ms>
+ * Expire a member after `ttl` milliseconds, a negative ttl clears its deadline.
+ * Replies 1 if the member exists, 0 otherwise.
+ */
+void zcmd_pexpire(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t ttl_ms = 0;
+    if (!str2int(cmd[3], ttl_ms)) { return out_err(resp, ERR_BAD_ARG, "expect int"); }
+
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+
+    const std::string &name = cmd[2];
+    return out_int(resp, zset_set_ttl(zset, name.data(), name.size(), ttl_ms) ? 1 : 0);
+}
+
+/**
+ * Command: ZPTTL <key> <member>
+ * Milliseconds left before a member expires, -1 without a deadline, -2 if it is absent.
+ */
+void zcmd_pttl(std::vector<std::string> &cmd, Buffer &resp) {
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) { return out_err(resp, ERR_BAD_TYP, "expect zset"); }
+
+    const std::string &name = cmd[2];
+    return out_int(resp, zset_ttl(zset, name.data(), name.size()));
+}
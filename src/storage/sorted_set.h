@@ -1,17 +1,35 @@
 #pragma once
 
 #include "avl_tree.h"
+#include "btree.h"
 #include "hashtable.h"
+#include "heap.h"
+#include "zpack.h"
 #include "../core/buffer_io.h"
 
 // C++ stdlib
 #include <string>
 #include <vector>
 
+// Representation of a ZSet, small sets are packed and move to the indexed forms as they grow
+enum ZSetEncoding : uint8_t {
+    ZSET_ENC_PACKED = 0,    // sorted (score, name) array in one allocation
+    ZSET_ENC_AVL    = 1,    // AVL tree + hash table of ZNodes
+    ZSET_ENC_BTREE  = 2,    // B+-tree + hash table of ZNodes
+};
+
 // Set used for storing the AVL tree and hash table
 struct ZSet {
+    uint8_t  encoding = ZSET_ENC_PACKED;
+    ZPack   *pack = NULL;   // members of a packed set, NULL when empty
     AVLNode *root = NULL;   // index by (score, name)
+    BTree   *btree = NULL;  // replaces `root` as the (score, name) index once the set is large
     HMap hmap;              // index by name
+
+    // Member deadlines, a min-heap over ZNode::heap_idx allocated on the first deadline.
+    // The set sits in `server_data.zset_heap` under its earliest deadline.
+    std::vector<HeapItem> *expiry = NULL;
+    size_t expiry_idx = (size_t)-1;
 };
 
 // Node used for storing the (score, name) tuple
@@ -19,6 +37,7 @@ struct ZNode {
     AVLNode tree;
     HNode   hmap;
     double  score = 0;
+    size_t  heap_idx = (size_t)-1;  // position in ZSet::expiry, -1 without a deadline
     size_t  len = 0;
     char    name[0];        // flexible array, during initialisation, we do malloc(sizeof(ZNode) + len of string)
 };
@@ -30,18 +49,68 @@ struct HashKey {
     size_t len = 0;
 };
 
+// A (score, name) pair whose name is owned by the caller
+struct ZPair {
+    double      score = 0;
+    const char *name = NULL;
+    size_t      len = 0;
+};
+
+// Cursor over a ZSet in sorted order, invalidated by any modification of the set
+struct ZIter {
+    bool        valid = false;  // false once the cursor runs off either end
+    double      score = 0;      // member under the cursor
+    const char *name = NULL;
+    size_t      len = 0;
+
+    // position, depending on the encoding
+    uint32_t slot = 0;          // packed
+    ZNode   *node = NULL;       // AVL
+    BIter    pos;               // B+-tree
+};
+
 // Empty zset used for non-existent keys
 static const ZSet k_empty_zset = {};
 
-ZNode *zset_lookup(ZSet *zset, const char *name, size_t len);
-bool   zset_insert(ZSet *zset, const char *name, size_t len, double score);
-void   zset_delete(ZSet *zset, ZNode *node);
-ZNode *zset_seek_greater_equal(ZSet *zset, double score, const char *name, size_t len);
-void   zset_clear(ZSet *zset);
-ZNode *znode_offset(ZNode *node, int64_t offset);
+bool    zset_insert(ZSet *zset, const char *name, size_t len, double score);
+bool    zset_remove(ZSet *zset, const char *name, size_t len);
+bool    zset_score(ZSet *zset, const char *name, size_t len, double *score);
+void    zset_clear(ZSet *zset);
+void    zset_load(ZSet *zset, std::vector<ZPair> &pairs);
+bool    zset_pop(ZSet *zset, bool max, std::string *name, double *score);
+size_t  zset_len(ZSet *zset);
+int64_t zset_rank(ZSet *zset, const char *name, size_t len);
+int64_t zset_count_below(ZSet *zset, double score, bool inclusive);
+
+// Member deadlines, packed sets move to the AVL encoding on the first one
+bool    zset_set_ttl(ZSet *zset, const char *name, size_t len, int64_t ttl_ms);
+int64_t zset_ttl(ZSet *zset, const char *name, size_t len);
+size_t  zset_expire(ZSet *zset, uint64_t now_ms, size_t max_work);
+void    zset_expiry_release(ZSet *zset);
+
+// Cursor positioning, each returns whether the cursor is on a member
+bool zset_seek_greater_equal(ZSet *zset, ZIter *iter, double score, const char *name, size_t len);
+bool zset_seek_rank(ZSet *zset, ZIter *iter, int64_t rank);
+bool zset_iter_offset(ZSet *zset, ZIter *iter, int64_t offset);
 
 // Z-set command handlers (operate on top-level HMap `db`)
 void zcmd_add(std::vector<std::string> &cmd, Buffer &resp);
 void zcmd_remove(std::vector<std::string> &cmd, Buffer &resp);
 void zcmd_score(std::vector<std::string> &cmd, Buffer &resp);
 void zcmd_query(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_rank(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_revrank(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_count(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_range(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_revrange(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_unionstore(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_interstore(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_diffstore(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_popmin(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_popmax(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_pexpire(std::vector<std::string> &cmd, Buffer &resp);
+void zcmd_pttl(std::vector<std::string> &cmd, Buffer &resp);
+
+// BZPOPMIN/BZPOPMAX: reply [key, member, score] if `key` holds members,
+// returns 1 if it replied, 0 if the key is missing or empty, -1 if it is not a zset
+int zset_pop_reply(const std::string &key, bool max, Buffer &resp);
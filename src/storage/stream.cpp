@@ -0,0 +1,446 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <stdlib.h>  // malloc, free, strtoull
+#include <string.h>  // memcpy
+#include <strings.h> // strcasecmp
+#include <stdio.h>   // snprintf
+#include <errno.h>   // errno (ID parsing)
+
+// C++ stdlib
+#include <vector>    // std::vector (entry offsets of a block)
+
+// local
+#include "stream.h"
+#include "commands.h"            // Entry, TYPE_STREAM, entry_lookup, entry_insert
+#include "../core/common.h"      // str2int
+#include "../core/constants.h"   // k_stream_block_size
+#include "../core/sys.h"         // get_wall_time_ms
+#include "../net/serialize.h"    // out_*, ERR_*
+
+// Bytes before the fields of an entry: size, ms, seq, nfields
+const size_t k_sentry_header = 4 + 8 + 8 + 4;
+
+// Longest "ms-seq" text, with the NUL
+const size_t k_id_buf = 42;
+
+/** ------------------------------------------------------------
+ *    IDs
+ * ------------------------------------------------------------
+ */
+
+static int id_cmp(const StreamID &a, const StreamID &b) {
+    if (a.ms != b.ms) { return a.ms < b.ms ? -1 : 1; }
+    if (a.seq != b.seq) { return a.seq < b.seq ? -1 : 1; }
+    return 0;
+}
+
+static size_t id_format(const StreamID &id, char *buf) {
+    return (size_t)snprintf(buf, k_id_buf, "%llu-%llu", (unsigned long long)id.ms, (unsigned long long)id.seq);
+}
+
+// Unsigned decimal that spans the whole of [s, end)
+static bool parse_u64(const char *s, const char *end, uint64_t *out) {
+    if (s == end || *s < '0' || *s > '9') { return false; }
+    char *endp = NULL;
+    errno = 0;
+    *out = strtoull(s, &endp, 10);
+    return errno == 0 && endp == end;
+}
+
+/**
+ * Parse "ms-seq" or "ms", a missing seq is set to `seq_default`. "ms-*" sets `*seq_auto`
+ * when the caller allows it.
+ */
+static bool id_parse(const std::string &s, StreamID *id, uint64_t seq_default, bool *seq_auto) {
+    const char *begin = s.c_str(), *end = begin + s.size();
+    const char *dash = (const char *)memchr(begin, '-', s.size());
+    if (seq_auto) { *seq_auto = false; }
+    if (!dash) {
+        id->seq = seq_default;
+        return parse_u64(begin, end, &id->ms);
+    }
+    if (!parse_u64(begin, dash, &id->ms)) { return false; }
+    if (seq_auto && end - dash == 2 && dash[1] == '*') {
+        *seq_auto = true;
+        return true;
+    }
+    return parse_u64(dash + 1, end, &id->seq);
+}
+
+/**
+ * Bound of XRANGE: "-" and "+" are the smallest and largest IDs, "ms" alone covers the whole
+ * millisecond, and a leading "(" excludes the ID itself. `*empty` is set when nothing lies past
+ * an excluded bound.
+ */
+static bool range_bound(const std::string &s, bool is_start, StreamID *id, bool *empty) {
+    if (s == "-") { *id = StreamID(); return true; }
+    if (s == "+") {
+        id->ms = id->seq = UINT64_MAX;
+        return true;
+    }
+
+    bool exclusive = !s.empty() && s[0] == '(';
+    if (!id_parse(exclusive ? s.substr(1) : s, id, is_start ? 0 : UINT64_MAX, NULL)) { return false; }
+    if (!exclusive) { return true; }
+
+    // Step over the excluded ID
+    if (is_start) {
+        if (id->seq != UINT64_MAX) { id->seq++; }
+        else if (id->ms == UINT64_MAX) { *empty = true; }
+        else { id->ms++; id->seq = 0; }
+    }
+    else {
+        if (id->seq != 0) { id->seq--; }
+        else if (id->ms == 0) { *empty = true; }
+        else { id->ms--; id->seq = UINT64_MAX; }
+    }
+    return true;
+}
+
+/** ------------------------------------------------------------
+ *    Blocks
+ * ------------------------------------------------------------
+ */
+
+// Tie-breaker of the index: blocks whose key.ms round to the same double are ordered by full ID
+static int sblock_cmp(void *item, const void *key) {
+    return id_cmp(((SBlock *)item)->key, *(const StreamID *)key);
+}
+
+static SBlock *sblock_new(const StreamID &key, size_t need) {
+    size_t cap = need > k_stream_block_size ? need : k_stream_block_size;
+    SBlock *block = (SBlock *)malloc(sizeof(SBlock) + cap);
+    assert(block);  // not a good idea in real projects
+    block->key = key;
+    block->count = 0;
+    block->begin = 0;
+    block->end = 0;
+    block->cap = (uint32_t)cap;
+    return block;
+}
+
+// Decoded view of the entry at `pos` of a block
+struct SEntry {
+    uint32_t size = 0;
+    StreamID id;
+    uint32_t nfields = 0;           // field/value pairs
+    const uint8_t *fields = NULL;   // [len][bytes] for each field and value
+};
+
+static SEntry sentry_read(const SBlock *block, uint32_t pos) {
+    SEntry ent;
+    const uint8_t *p = block->data + pos;
+    memcpy(&ent.size, p, 4);
+    memcpy(&ent.id.ms, p + 4, 8);
+    memcpy(&ent.id.seq, p + 12, 8);
+    memcpy(&ent.nfields, p + 20, 4);
+    ent.fields = p + k_sentry_header;
+    return ent;
+}
+
+static SBlock *iter_block(const BIter *iter) {
+    return (SBlock *)bt_iter_item(iter);
+}
+
+// Remove a block from the index and free it
+static void sblock_drop(Stream *stream, SBlock *block) {
+    void *item = bt_delete(&stream->index, (double)block->key.ms, &block->key);
+    assert(item == block);
+    if (stream->tail == block) { stream->tail = NULL; }
+    free(block);
+}
+
+/** ------------------------------------------------------------
+ *    Stream API
+ * ------------------------------------------------------------
+ */
+
+void stream_init(Stream *stream) {
+    bt_init(&stream->index, &sblock_cmp);
+}
+
+void stream_clear(Stream *stream) {
+    bt_clear(&stream->index, &free);
+    stream->tail = NULL;
+    stream->len = 0;
+}
+
+// Append an entry with the field/value pairs cmd[from..], the ID is already validated
+static void stream_append(Stream *stream, const StreamID &id, std::vector<std::string> &cmd, size_t from) {
+    size_t need = k_sentry_header;
+    for (size_t i = from; i < cmd.size(); ++i) { need += 4 + cmd[i].size(); }
+
+    SBlock *block = stream->tail;
+    if (!block || block->end + need > block->cap) {
+        block = sblock_new(id, need);
+        bt_insert(&stream->index, (double)id.ms, &block->key, block);
+        stream->tail = block;
+    }
+
+    uint8_t *p = block->data + block->end;
+    uint32_t size = (uint32_t)need, nfields = (uint32_t)((cmd.size() - from) / 2);
+    memcpy(p, &size, 4);
+    memcpy(p + 4, &id.ms, 8);
+    memcpy(p + 12, &id.seq, 8);
+    memcpy(p + 20, &nfields, 4);
+    p += k_sentry_header;
+    for (size_t i = from; i < cmd.size(); ++i) {
+        uint32_t len = (uint32_t)cmd[i].size();
+        memcpy(p, &len, 4);
+        if (len) { memcpy(p + 4, cmd[i].data(), len); }
+        p += 4 + len;
+    }
+
+    block->end += size;
+    block->count++;
+    stream->len++;
+    stream->last_id = id;
+}
+
+/**
+ * Keep at most `maxlen` entries, oldest first out. Whole blocks are freed without reading
+ * them; unless `approx`, the entries left over at the head of the first block are skipped.
+ * Returns the number of entries removed.
+ */
+uint64_t stream_trim(Stream *stream, uint64_t maxlen, bool approx) {
+    uint64_t removed = 0;
+    while (stream->len > maxlen) {
+        BIter iter;
+        bool ok = bt_seek_rank(&stream->index, 0, &iter);
+        assert(ok);
+        SBlock *block = iter_block(&iter);
+
+        if (stream->len - block->count >= maxlen) {
+            stream->len -= block->count;
+            removed += block->count;
+            sblock_drop(stream, block);
+            continue;
+        }
+        if (approx) { break; }
+
+        while (stream->len > maxlen) {
+            block->begin += sentry_read(block, block->begin).size;
+            block->count--;
+            stream->len--;
+            removed++;
+        }
+    }
+    return removed;
+}
+
+/**
+ * Position the cursor on the block that may hold `id`: the one with the largest key <= id,
+ * or the first block when every key is larger.
+ */
+static bool stream_seek_block(Stream *stream, const StreamID &id, BIter *iter) {
+    if (!bt_seek_greater_equal(&stream->index, (double)id.ms, &id, iter)) {
+        return bt_seek_rank(&stream->index, stream->index.size - 1, iter);
+    }
+    if (id_cmp(iter_block(iter)->key, id) != 0) {
+        BIter prev = *iter;
+        if (bt_iter_prev(&prev)) { *iter = prev; }
+    }
+    return true;
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// Stream of a key; `*wrong_type` is set if the key holds another type
+static Stream *expect_stream(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_STREAM;
+    return ent && !*wrong_type ? ent->stream : NULL;
+}
+
+/**
+ * Parse "MAXLEN [=|~] <n>" at cmd[*pos], advancing `*pos` past it.
+ * Returns false on a malformed clause, `*present` tells whether there was one.
+ */
+static bool parse_maxlen(std::vector<std::string> &cmd, size_t *pos, bool *present, uint64_t *maxlen, bool *approx) {
+    *present = false;
+    *approx = false;
+    if (*pos >= cmd.size() || strcasecmp(cmd[*pos].c_str(), "maxlen") != 0) { return true; }
+    size_t i = *pos + 1;
+    if (i < cmd.size() && (cmd[i] == "~" || cmd[i] == "=")) {
+        *approx = cmd[i] == "~";
+        i++;
+    }
+    int64_t n = 0;
+    if (i >= cmd.size() || !str2int(cmd[i], n) || n < 0) { return false; }
+    *present = true;
+    *maxlen = (uint64_t)n;
+    *pos = i + 1;
+    return true;
+}
+
+// Output one entry as [id, [field, value, ...]]
+static void out_sentry(Buffer &resp, const SEntry &ent) {
+    char buf[k_id_buf];
+    size_t len = id_format(ent.id, buf);
+    out_arr(resp, 2);
+    out_str(resp, buf, len);
+    out_arr(resp, ent.nfields * 2);
+    const uint8_t *p = ent.fields;
+    for (uint32_t i = 0; i < ent.nfields * 2; ++i) {
+        uint32_t flen = 0;
+        memcpy(&flen, p, 4);
+        out_str(resp, (const char *)p + 4, flen);
+        p += 4 + flen;
+    }
+}
+
+/**
+ * Command: XADD <key> [MAXLEN [=|~] <n>] <id|*> <field> <value> [<field> <value> ...]
+ * Append an entry and reply with its ID. `*` takes the wall clock (and a sequence number
+ * within the same millisecond), `ms-*` only the sequence number; explicit IDs must grow.
+ */
+void xcmd_add(std::vector<std::string> &cmd, Buffer &resp) {
+    size_t pos = 2;
+    bool has_maxlen = false, approx = false;
+    uint64_t maxlen = 0;
+    if (!parse_maxlen(cmd, &pos, &has_maxlen, &maxlen, &approx)) { return out_err(resp, ERR_BAD_ARG, "bad MAXLEN"); }
+    if (pos + 3 > cmd.size() || (cmd.size() - pos - 1) % 2 != 0) {
+        return out_err(resp, ERR_BAD_ARG, "wrong number of arguments for XADD");
+    }
+
+    bool wrong_type = false;
+    Stream *stream = expect_stream(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect stream"); }
+    StreamID last = stream ? stream->last_id : StreamID();
+    bool empty_history = !stream || (last.ms == 0 && last.seq == 0);
+
+    // Resolve the ID against the last one
+    StreamID id;
+    const std::string &arg = cmd[pos];
+    bool seq_auto = false;
+    if (arg == "*") {
+        id.ms = get_wall_time_ms();
+        seq_auto = true;
+        if (id.ms < last.ms) { id.ms = last.ms; }   // the wall clock went back
+    }
+    else if (!id_parse(arg, &id, 0, &seq_auto)) {
+        return out_err(resp, ERR_BAD_ARG, "invalid stream ID");
+    }
+    if (seq_auto) {
+        if (empty_history || id.ms > last.ms) { id.seq = id.ms == 0 ? 1 : 0; }
+        else if (id.ms == last.ms && last.seq != UINT64_MAX) { id.seq = last.seq + 1; }
+        else if (id.ms == last.ms && arg == "*" && last.ms != UINT64_MAX) {
+            id.ms++;    // the millisecond ran out of sequence numbers
+            id.seq = 0;
+        }
+        else { return out_err(resp, ERR_BAD_ARG, "the ID is equal or smaller than the last one"); }
+    }
+    if (id.ms == 0 && id.seq == 0) { return out_err(resp, ERR_BAD_ARG, "the ID must be greater than 0-0"); }
+    if (!empty_history && id_cmp(id, last) <= 0) {
+        return out_err(resp, ERR_BAD_ARG, "the ID is equal or smaller than the last one");
+    }
+
+    if (!stream) { stream = entry_insert(cmd[1], TYPE_STREAM)->stream; }
+    stream_append(stream, id, cmd, pos + 1);
+    if (has_maxlen) { stream_trim(stream, maxlen, approx); }
+
+    char buf[k_id_buf];
+    size_t len = id_format(id, buf);
+    return out_str(resp, buf, len);
+}
+
+/**
+ * Command: XRANGE <key> <start> <end> [COUNT <n>], XREVRANGE <key> <end> <start> [COUNT <n>]
+ * Entries with IDs in [start, end] as [[id, [field, value, ...]], ...], oldest or newest first.
+ */
+void xcmd_range(std::vector<std::string> &cmd, Buffer &resp) {
+    bool reverse = cmd[0] == "xrevrange";
+    StreamID start, end;
+    const std::string &lo = reverse ? cmd[3] : cmd[2], &hi = reverse ? cmd[2] : cmd[3];
+    bool empty = false;
+    if (!range_bound(lo, true, &start, &empty) || !range_bound(hi, false, &end, &empty)) {
+        return out_err(resp, ERR_BAD_ARG, "invalid stream ID");
+    }
+
+    int64_t count = -1;
+    if (cmd.size() == 6) {
+        if (strcasecmp(cmd[4].c_str(), "count") != 0 || !str2int(cmd[5], count)) {
+            return out_err(resp, ERR_BAD_ARG, "syntax error");
+        }
+        if (count < 0) { count = 0; }
+    }
+
+    bool wrong_type = false;
+    Stream *stream = expect_stream(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect stream"); }
+
+    size_t ctx = out_begin_arr(resp);
+    uint32_t n = 0;
+    BIter iter;
+    empty = empty || !stream || id_cmp(start, end) > 0 || count == 0;
+    if (!empty && !reverse && stream_seek_block(stream, start, &iter)) {
+        for (bool more = true; more && bt_iter_valid(&iter); bt_iter_next(&iter)) {
+            SBlock *block = iter_block(&iter);
+            for (uint32_t pos = block->begin; pos < block->end; ) {
+                SEntry ent = sentry_read(block, pos);
+                pos += ent.size;
+                if (id_cmp(ent.id, start) < 0) { continue; }
+                if (id_cmp(ent.id, end) > 0 || (count >= 0 && n == (uint64_t)count)) {
+                    more = false;
+                    break;
+                }
+                out_sentry(resp, ent);
+                n++;
+            }
+        }
+    }
+    if (!empty && reverse && stream_seek_block(stream, end, &iter)) {
+        std::vector<uint32_t> offsets;     // entries are only walked forward, so a block is indexed first
+        for (bool more = true; more && bt_iter_valid(&iter); bt_iter_prev(&iter)) {
+            SBlock *block = iter_block(&iter);
+            offsets.clear();
+            for (uint32_t pos = block->begin; pos < block->end; pos += sentry_read(block, pos).size) {
+                offsets.push_back(pos);
+            }
+            for (size_t i = offsets.size(); i-- > 0; ) {
+                SEntry ent = sentry_read(block, offsets[i]);
+                if (id_cmp(ent.id, end) > 0) { continue; }
+                if (id_cmp(ent.id, start) < 0 || (count >= 0 && n == (uint64_t)count)) {
+                    more = false;
+                    break;
+                }
+                out_sentry(resp, ent);
+                n++;
+            }
+        }
+    }
+    out_end_arr(resp, ctx, n);
+}
+
+/**
+ * Command: XTRIM <key> MAXLEN [=|~] <n>
+ * Drop the oldest entries beyond `n`, replies with how many were removed. With `~` only
+ * whole blocks go, so a few more entries than `n` may stay.
+ */
+void xcmd_trim(std::vector<std::string> &cmd, Buffer &resp) {
+    size_t pos = 2;
+    bool has_maxlen = false, approx = false;
+    uint64_t maxlen = 0;
+    if (!parse_maxlen(cmd, &pos, &has_maxlen, &maxlen, &approx) || !has_maxlen || pos != cmd.size()) {
+        return out_err(resp, ERR_BAD_ARG, "syntax error");
+    }
+
+    bool wrong_type = false;
+    Stream *stream = expect_stream(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect stream"); }
+    return out_int(resp, stream ? (int64_t)stream_trim(stream, maxlen, approx) : 0);
+}
+
+/**
+ * Command: XLEN <key>
+ * Number of entries, 0 for a missing key.
+ */
+void xcmd_len(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    Stream *stream = expect_stream(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect stream"); }
+    return out_int(resp, stream ? (int64_t)stream->len : 0);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t, uint32_t
+
+// C++ stdlib
+#include <string>   // std::string (command args)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "btree.h"              // BTree (block index)
+#include "../core/buffer_io.h"  // Buffer
+
+// Entry ID: milliseconds and a sequence number within the millisecond, ordered as a pair
+struct StreamID {
+    uint64_t ms = 0;
+    uint64_t seq = 0;
+};
+
+/**
+ * A block of entries packed back to back in ID order
+ *
+ *      data: | dead entries ... | size | ms | seq | nfields | flen | field | vlen | value | ... |
+ *                               ^ begin                                                     ^ end
+ *
+ * Entries are only appended at the end; trimming moves `begin` forward, and a block whose
+ * entries are all gone is freed. An entry larger than k_stream_block_size gets a block of its own.
+ */
+struct SBlock {
+    StreamID key;           // ID of the first entry ever appended, the index key
+    uint32_t count = 0;     // live entries
+    uint32_t begin = 0;     // offset of the first live entry
+    uint32_t end = 0;       // bytes in use
+    uint32_t cap = 0;       // bytes of data
+    uint8_t  data[0];
+};
+
+/**
+ * Append-only log of field/value entries. Blocks are indexed by their key in the B+-tree
+ * (score = key.ms, ties broken by the full ID), so a range seek is O(log blocks) and then
+ * reads contiguous memory.
+ */
+struct Stream {
+    BTree    index;         // SBlock by key
+    SBlock  *tail = NULL;   // block receiving appends
+    uint64_t len = 0;       // live entries
+    StreamID last_id;       // largest ID ever added, new IDs must be greater
+};
+
+void     stream_init(Stream *stream);
+void     stream_clear(Stream *stream);
+uint64_t stream_trim(Stream *stream, uint64_t maxlen, bool approx);
+
+// Stream command handlers (operate on top-level HMap `db`)
+void xcmd_add(std::vector<std::string> &cmd, Buffer &resp);
+void xcmd_range(std::vector<std::string> &cmd, Buffer &resp);
+void xcmd_trim(std::vector<std::string> &cmd, Buffer &resp);
+void xcmd_len(std::vector<std::string> &cmd, Buffer &resp);
@@ -0,0 +1,440 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <stdlib.h>  // calloc, free
+#include <string.h>  // memcpy
+#include <strings.h> // strcasecmp
+#include <math.h>    // isnan
+
+// local
+#include "timeseries.h"
+#include "commands.h"            // Entry, TYPE_TS, entry_lookup, entry_insert, server_data
+#include "heap.h"                // heap_upsert, heap_delete
+#include "../core/common.h"      // str2dbl, str2int
+#include "../core/constants.h"   // k_ts_chunk_size
+#include "../core/sys.h"         // get_wall_time_ms, get_current_time_ms
+#include "../net/serialize.h"    // out_*, ERR_*
+
+// Most bits one sample can take: '1111' + 64-bit delta of delta, '11' + 5 + 6 + 64 value bits
+const uint32_t k_ts_sample_max_bits = 4 + 64 + 2 + 5 + 6 + 64;
+
+/** ------------------------------------------------------------
+ *    Bit stream
+ * ------------------------------------------------------------
+ */
+
+// Append the low `n` bits of `val`, most significant first
+static void bits_write(TSChunk *chunk, uint64_t val, uint32_t n) {
+    while (n > 0) {
+        uint32_t off = chunk->nbits % 8, take = 8 - off < n ? 8 - off : n;
+        uint32_t part = (uint32_t)(val >> (n - take)) & ((1u << take) - 1);
+        chunk->data[chunk->nbits / 8] |= (uint8_t)(part << (8 - off - take));
+        chunk->nbits += take;
+        n -= take;
+    }
+}
+
+static uint64_t bits_read(const TSChunk *chunk, uint32_t *pos, uint32_t n) {
+    uint64_t val = 0;
+    while (n > 0) {
+        uint32_t off = *pos % 8, take = 8 - off < n ? 8 - off : n;
+        uint32_t part = (chunk->data[*pos / 8] >> (8 - off - take)) & ((1u << take) - 1);
+        val = (val << take) | part;
+        *pos += take;
+        n -= take;
+    }
+    return val;
+}
+
+// Sign-extend the low `n` bits
+static int64_t sign_extend(uint64_t val, uint32_t n) {
+    uint64_t sign = 1ull << (n - 1);
+    return (int64_t)((val ^ sign) - sign);
+}
+
+static uint64_t dbl_bits(double val) {
+    uint64_t bits = 0;
+    memcpy(&bits, &val, 8);
+    return bits;
+}
+
+static double bits_dbl(uint64_t bits) {
+    double val = 0;
+    memcpy(&val, &bits, 8);
+    return val;
+}
+
+/** ------------------------------------------------------------
+ *    Chunks
+ * ------------------------------------------------------------
+ */
+
+static TSChunk *chunk_new() {
+    TSChunk *chunk = (TSChunk *)calloc(1, sizeof(TSChunk) + k_ts_chunk_size);
+    assert(chunk);  // not a good idea in real projects
+    chunk->leading = 0xff;
+    return chunk;
+}
+
+// Delta of delta, by the smallest bucket that holds it
+static void write_dod(TSChunk *chunk, int64_t dod) {
+    if (dod == 0) { return bits_write(chunk, 0, 1); }
+    if (dod >= -64 && dod <= 63) {
+        bits_write(chunk, 0x2, 2);
+        return bits_write(chunk, (uint64_t)dod, 7);
+    }
+    if (dod >= -256 && dod <= 255) {
+        bits_write(chunk, 0x6, 3);
+        return bits_write(chunk, (uint64_t)dod, 9);
+    }
+    if (dod >= -2048 && dod <= 2047) {
+        bits_write(chunk, 0xe, 4);
+        return bits_write(chunk, (uint64_t)dod, 12);
+    }
+    bits_write(chunk, 0xf, 4);
+    return bits_write(chunk, (uint64_t)dod, 64);
+}
+
+// XOR with the previous value, reusing its window of meaningful bits when the new one fits
+static void write_value(TSChunk *chunk, uint64_t bits) {
+    uint64_t x = bits ^ chunk->last_bits;
+    if (x == 0) { return bits_write(chunk, 0, 1); }
+
+    uint32_t lead = (uint32_t)__builtin_clzll(x), trail = (uint32_t)__builtin_ctzll(x);
+    if (lead > 31) { lead = 31; }   // 5 bits of leading zeros
+    if (chunk->leading != 0xff && lead >= chunk->leading && trail >= chunk->trailing) {
+        bits_write(chunk, 0x2, 2);
+        return bits_write(chunk, x >> chunk->trailing, 64 - chunk->leading - chunk->trailing);
+    }
+
+    uint32_t len = 64 - lead - trail;
+    bits_write(chunk, 0x3, 2);
+    bits_write(chunk, lead, 5);
+    bits_write(chunk, len - 1, 6);
+    bits_write(chunk, x >> trail, len);
+    chunk->leading = (uint8_t)lead;
+    chunk->trailing = (uint8_t)trail;
+}
+
+static void chunk_append(TSChunk *chunk, uint64_t timestamp, uint64_t bits) {
+    if (chunk->count == 0) {
+        bits_write(chunk, timestamp, 64);
+        bits_write(chunk, bits, 64);
+        chunk->first_ts = timestamp;
+    }
+    else {
+        int64_t delta = (int64_t)(timestamp - chunk->last_ts);
+        write_dod(chunk, delta - chunk->last_delta);
+        write_value(chunk, bits);
+        chunk->last_delta = delta;
+    }
+    chunk->last_ts = timestamp;
+    chunk->last_bits = bits;
+    chunk->count++;
+}
+
+// Decoder over one chunk, mirrors the encoder state
+struct TSReader {
+    const TSChunk *chunk = NULL;
+    uint32_t pos = 0;       // bit position
+    uint32_t index = 0;     // samples read
+    uint64_t ts = 0;
+    int64_t  delta = 0;
+    uint64_t bits = 0;
+    uint32_t leading = 0;
+    uint32_t trailing = 0;
+};
+
+static bool reader_next(TSReader *r, uint64_t *timestamp, double *value) {
+    const TSChunk *chunk = r->chunk;
+    if (r->index == chunk->count) { return false; }
+
+    if (r->index == 0) {
+        r->ts = bits_read(chunk, &r->pos, 64);
+        r->bits = bits_read(chunk, &r->pos, 64);
+    }
+    else {
+        // Delta of delta: count the leading 1s of the prefix, up to 4
+        uint32_t ones = 0;
+        while (ones < 4 && bits_read(chunk, &r->pos, 1)) { ones++; }
+        static const uint32_t k_dod_bits[5] = { 0, 7, 9, 12, 64 };
+        int64_t dod = ones ? sign_extend(bits_read(chunk, &r->pos, k_dod_bits[ones]), k_dod_bits[ones]) : 0;
+        r->delta += dod;
+        r->ts += (uint64_t)r->delta;
+
+        if (bits_read(chunk, &r->pos, 1)) {
+            if (bits_read(chunk, &r->pos, 1)) {
+                r->leading = (uint32_t)bits_read(chunk, &r->pos, 5);
+                uint32_t len = (uint32_t)bits_read(chunk, &r->pos, 6) + 1;
+                r->trailing = 64 - r->leading - len;
+            }
+            uint32_t len = 64 - r->leading - r->trailing;
+            r->bits ^= bits_read(chunk, &r->pos, len) << r->trailing;
+        }
+    }
+    r->index++;
+    *timestamp = r->ts;
+    *value = bits_dbl(r->bits);
+    return true;
+}
+
+/** ------------------------------------------------------------
+ *    Series API
+ * ------------------------------------------------------------
+ */
+
+/**
+ * Keep the series' slot in `server_data.ts_heap` at the deadline of its oldest chunk. Samples
+ * carry Unix time while the timers run on the monotonic clock, so the deadline is converted
+ * by the current distance between the two.
+ */
+static void ts_expiry_sync(TimeSeries *ts) {
+    if (ts->retention_ms > 0 && ts->head) {
+        uint64_t deadline = ts->head->last_ts + ts->retention_ms, wall_ms = get_wall_time_ms();
+        uint64_t now_ms = get_current_time_ms();
+        HeapItem item = { deadline > wall_ms ? now_ms + (deadline - wall_ms) : now_ms, &ts->expiry_idx };
+        heap_upsert(server_data.ts_heap, ts->expiry_idx, item);
+    }
+    else if (ts->expiry_idx != (size_t)-1) {
+        heap_delete(server_data.ts_heap, ts->expiry_idx);
+        ts->expiry_idx = (size_t)-1;
+    }
+}
+
+bool ts_add(TimeSeries *ts, uint64_t timestamp, double value) {
+    if (ts->has_last && timestamp <= ts->last_ts) { return false; }
+
+    TSChunk *chunk = ts->tail;
+    if (!chunk || chunk->nbits + k_ts_sample_max_bits > k_ts_chunk_size * 8) {
+        chunk = chunk_new();
+        if (ts->tail) { ts->tail->next = chunk; }
+        else { ts->head = chunk; }
+        ts->tail = chunk;
+        ts->nchunks++;
+    }
+    chunk_append(chunk, timestamp, dbl_bits(value));
+    ts->count++;
+    ts->last_ts = timestamp;
+    ts->has_last = true;
+    if (chunk == ts->head) { ts_expiry_sync(ts); }  // only the oldest chunk sets the deadline
+    return true;
+}
+
+/**
+ * Drop up to `max_work` chunks whose newest sample is past the retention at `now_ms` (Unix
+ * time), oldest first. Returns the number dropped.
+ */
+size_t ts_expire(TimeSeries *ts, uint64_t now_ms, size_t max_work) {
+    size_t dropped = 0;
+    while (dropped < max_work && ts->retention_ms > 0 && ts->head && ts->head->last_ts + ts->retention_ms <= now_ms) {
+        TSChunk *chunk = ts->head;
+        ts->head = chunk->next;
+        if (!ts->head) { ts->tail = NULL; }
+        ts->count -= chunk->count;
+        ts->nchunks--;
+        free(chunk);
+        dropped++;
+    }
+    ts_expiry_sync(ts);
+    return dropped;
+}
+
+/**
+ * Leave `server_data.ts_heap`. Runs on the main thread before a series is handed to a
+ * worker to be freed.
+ */
+void ts_expiry_release(TimeSeries *ts) {
+    if (ts->expiry_idx != (size_t)-1) {
+        heap_delete(server_data.ts_heap, ts->expiry_idx);
+        ts->expiry_idx = (size_t)-1;
+    }
+}
+
+void ts_clear(TimeSeries *ts) {
+    for (TSChunk *chunk = ts->head; chunk; ) {
+        TSChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    ts->head = ts->tail = NULL;
+    ts->count = 0;
+    ts->nchunks = 0;
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// Series of a key; `*wrong_type` is set if the key holds another type
+static TimeSeries *expect_ts(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_TS;
+    return ent && !*wrong_type ? ent->ts : NULL;
+}
+
+static bool parse_ts(const std::string &s, uint64_t *out) {
+    int64_t val = 0;
+    if (!str2int(s, val) || val < 0) { return false; }
+    *out = (uint64_t)val;
+    return true;
+}
+
+/**
+ * Command: TS.ADD <key> <timestamp|*> <value> [RETENTION <ms>]
+ * Append a sample, `*` is the current Unix time in ms. Timestamps must grow. RETENTION
+ * sets how long samples are kept, 0 for ever. Replies with the timestamp.
+ */
+void tscmd_add(std::vector<std::string> &cmd, Buffer &resp) {
+    uint64_t timestamp = 0, retention = 0;
+    double value = 0;
+    bool has_retention = cmd.size() == 6;
+    if (cmd[2] == "*") { timestamp = get_wall_time_ms(); }
+    else if (!parse_ts(cmd[2], &timestamp)) { return out_err(resp, ERR_BAD_ARG, "invalid timestamp"); }
+    if (!str2dbl(cmd[3], value) || isnan(value)) { return out_err(resp, ERR_BAD_ARG, "expect float"); }
+    if (has_retention && (strcasecmp(cmd[4].c_str(), "retention") != 0 || !parse_ts(cmd[5], &retention))) {
+        return out_err(resp, ERR_BAD_ARG, "syntax error");
+    }
+
+    bool wrong_type = false;
+    TimeSeries *ts = expect_ts(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect time series"); }
+    if (ts && ts->has_last && timestamp <= ts->last_ts) {
+        return out_err(resp, ERR_BAD_ARG, "timestamp must be after the last sample");
+    }
+
+    if (!ts) { ts = entry_insert(cmd[1], TYPE_TS)->ts; }
+    if (has_retention) { ts->retention_ms = retention; }
+    ts_add(ts, timestamp, value);
+    if (has_retention) { ts_expire(ts, get_wall_time_ms(), (size_t)-1); }   // applies a shorter retention now
+    return out_int(resp, (int64_t)timestamp);
+}
+
+// Aggregations of TS.RANGE
+enum TSAgg {
+    TS_AGG_NONE = 0,
+    TS_AGG_AVG,
+    TS_AGG_MIN,
+    TS_AGG_MAX,
+    TS_AGG_SUM,
+    TS_AGG_COUNT,
+};
+
+// Running aggregate of one bucket
+struct TSBucket {
+    uint64_t start = 0;
+    uint64_t count = 0;
+    double   sum = 0;
+    double   min = 0;
+    double   max = 0;
+};
+
+static void out_sample(Buffer &resp, uint64_t timestamp, double value) {
+    out_arr(resp, 2);
+    out_int(resp, (int64_t)timestamp);
+    out_dbl(resp, value);
+}
+
+static double bucket_value(const TSBucket &b, TSAgg agg) {
+    switch (agg) {
+    case TS_AGG_AVG: return b.sum / (double)b.count;
+    case TS_AGG_MIN: return b.min;
+    case TS_AGG_MAX: return b.max;
+    case TS_AGG_SUM: return b.sum;
+    default:         return (double)b.count;
+    }
+}
+
+/**
+ * Command: TS.RANGE <key> <from|-> <to|+> [AGGREGATION avg|min|max|sum|count <bucket_ms>]
+ * Samples in [from, to] as [[timestamp, value], ...], or one [bucket_start, aggregate] per
+ * non-empty bucket of `bucket_ms` aligned to 0. Chunks outside the range are skipped
+ * without decoding them.
+ */
+void tscmd_range(std::vector<std::string> &cmd, Buffer &resp) {
+    uint64_t from = 0, to = UINT64_MAX, bucket_ms = 0;
+    if (cmd[2] != "-" && !parse_ts(cmd[2], &from)) { return out_err(resp, ERR_BAD_ARG, "invalid timestamp"); }
+    if (cmd[3] != "+" && !parse_ts(cmd[3], &to)) { return out_err(resp, ERR_BAD_ARG, "invalid timestamp"); }
+
+    TSAgg agg = TS_AGG_NONE;
+    if (cmd.size() == 7) {
+        const char *name = cmd[5].c_str();
+        if (strcasecmp(name, "avg") == 0) { agg = TS_AGG_AVG; }
+        else if (strcasecmp(name, "min") == 0) { agg = TS_AGG_MIN; }
+        else if (strcasecmp(name, "max") == 0) { agg = TS_AGG_MAX; }
+        else if (strcasecmp(name, "sum") == 0) { agg = TS_AGG_SUM; }
+        else if (strcasecmp(name, "count") == 0) { agg = TS_AGG_COUNT; }
+        if (strcasecmp(cmd[4].c_str(), "aggregation") != 0 || agg == TS_AGG_NONE) {
+            return out_err(resp, ERR_BAD_ARG, "syntax error");
+        }
+        if (!parse_ts(cmd[6], &bucket_ms) || bucket_ms == 0) { return out_err(resp, ERR_BAD_ARG, "bucket must be > 0"); }
+    }
+
+    bool wrong_type = false;
+    TimeSeries *ts = expect_ts(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect time series"); }
+
+    // Samples past the retention may still wait for the timers, hide them
+    if (ts && ts->retention_ms > 0) {
+        uint64_t now_ms = get_wall_time_ms();
+        if (now_ms >= ts->retention_ms && from <= now_ms - ts->retention_ms) { from = now_ms - ts->retention_ms + 1; }
+    }
+
+    size_t ctx = out_begin_arr(resp);
+    uint32_t n = 0;
+    TSBucket bucket;
+    for (TSChunk *chunk = ts ? ts->head : NULL; chunk && chunk->first_ts <= to; chunk = chunk->next) {
+        if (chunk->last_ts < from) { continue; }
+
+        TSReader reader;
+        reader.chunk = chunk;
+        uint64_t timestamp = 0;
+        double value = 0;
+        while (reader_next(&reader, &timestamp, &value) && timestamp <= to) {
+            if (timestamp < from) { continue; }
+            if (agg == TS_AGG_NONE) {
+                out_sample(resp, timestamp, value);
+                n++;
+                continue;
+            }
+
+            uint64_t start = timestamp - timestamp % bucket_ms;
+            if (bucket.count > 0 && start != bucket.start) {
+                out_sample(resp, bucket.start, bucket_value(bucket, agg));
+                n++;
+                bucket = TSBucket();
+            }
+            if (bucket.count == 0) {
+                bucket.start = start;
+                bucket.min = bucket.max = value;
+            }
+            bucket.count++;
+            bucket.sum += value;
+            if (value < bucket.min) { bucket.min = value; }
+            if (value > bucket.max) { bucket.max = value; }
+        }
+    }
+    if (bucket.count > 0) {
+        out_sample(resp, bucket.start, bucket_value(bucket, agg));
+        n++;
+    }
+    out_end_arr(resp, ctx, n);
+}
+
+/**
+ * Command: TS.INFO <key>
+ * [samples, chunks, bytes of compressed samples, retention ms], nil for a missing key.
+ */
+void tscmd_info(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    TimeSeries *ts = expect_ts(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect time series"); }
+    if (!ts) { return out_nil(resp); }
+
+    uint64_t bytes = 0;
+    for (TSChunk *chunk = ts->head; chunk; chunk = chunk->next) { bytes += (chunk->nbits + 7) / 8; }
+    out_arr(resp, 4);
+    out_int(resp, (int64_t)ts->count);
+    out_int(resp, (int64_t)ts->nchunks);
+    out_int(resp, (int64_t)bytes);
+    out_int(resp, (int64_t)ts->retention_ms);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t, uint32_t, uint8_t
+
+// C++ stdlib
+#include <string>   // std::string (command args)
+#include <vector>   // std::vector (command args)
+
+// local
+#include "../core/buffer_io.h"  // Buffer
+
+/**
+ * A chunk of samples compressed Gorilla-style into a bit stream
+ *
+ *      timestamps: delta of delta, '0' | '10' 7 bits | '110' 9 bits | '1110' 12 bits | '1111' 64 bits
+ *      values:     XOR with the previous, '0' | '10' bits in the last window | '11' 5 bits lead, 6 bits len, bits
+ *
+ * The first sample is stored raw. The encoder state after the last sample is kept so appends
+ * continue the stream; a chunk is closed when the next sample might not fit.
+ */
+struct TSChunk {
+    TSChunk *next = NULL;
+    uint64_t first_ts = 0;
+    uint64_t last_ts = 0;
+    uint32_t count = 0;         // samples
+    uint32_t nbits = 0;         // bits written to `data`
+
+    // encoder state
+    int64_t  last_delta = 0;
+    uint64_t last_bits = 0;     // last value as IEEE bits
+    uint8_t  leading = 0xff;    // XOR window of the last written value, 0xff before the first
+    uint8_t  trailing = 0;
+    uint8_t  data[0];           // k_ts_chunk_size bytes, zeroed
+};
+
+/**
+ * Append-only series of (Unix ms timestamp, double) samples in a list of chunks, oldest first.
+ * With a retention, the series sits in `server_data.ts_heap` until its oldest chunk's newest
+ * sample is `retention_ms` old, and the timers drop whole chunks.
+ */
+struct TimeSeries {
+    TSChunk *head = NULL;
+    TSChunk *tail = NULL;       // chunk receiving appends
+    uint64_t count = 0;         // samples in the chunks
+    uint64_t nchunks = 0;
+    uint64_t last_ts = 0;       // newest timestamp ever added, new samples must be later
+    bool     has_last = false;
+    uint64_t retention_ms = 0;  // 0 keeps every sample
+    size_t   expiry_idx = (size_t)-1;   // position in `server_data.ts_heap`
+};
+
+bool   ts_add(TimeSeries *ts, uint64_t timestamp, double value);    // false if not after the last sample
+size_t ts_expire(TimeSeries *ts, uint64_t now_ms, size_t max_work);  // chunks dropped
+void   ts_expiry_release(TimeSeries *ts);
+void   ts_clear(TimeSeries *ts);
+
+// Time series command handlers (operate on top-level HMap `db`)
+void tscmd_add(std::vector<std::string> &cmd, Buffer &resp);
+void tscmd_range(std::vector<std::string> &cmd, Buffer &resp);
+void tscmd_info(std::vector<std::string> &cmd, Buffer &resp);
@@ -0,0 +1,288 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <math.h>    // pow
+#include <strings.h> // strcasecmp
+
+// C++ stdlib
+#include <algorithm> // std::sort
+#include <string>    // std::string
+#include <vector>    // std::vector
+
+// local
+#include "topk.h"
+#include "commands.h"            // Entry, TYPE_TOPK, entry_lookup, entry_insert
+#include "../core/common.h"      // string_hash, str2dbl, str2int, container_of
+#include "../core/constants.h"   // k_topk_*
+#include "../net/serialize.h"    // out_*, ERR_*
+
+/** ------------------------------------------------------------
+ *    Hashing
+ * ------------------------------------------------------------
+ */
+
+// splitmix64 finalizer
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * The project hash spread over 64 bits: the high half is the fingerprint, the low half seeds
+ * the bucket of each row (double hashing with an odd step).
+ */
+struct TopKHash {
+    uint64_t full = 0;      // keys the index of tracked items
+    uint32_t fp = 0;
+    uint32_t h1 = 0;
+    uint32_t h2 = 0;
+};
+
+static TopKHash topk_hash(const std::string &item) {
+    uint64_t h = mix64(string_hash((const uint8_t *)item.data(), item.size()));
+    TopKHash hash;
+    hash.full = h;
+    hash.fp = (uint32_t)(h >> 32);
+    hash.h1 = (uint32_t)h;
+    hash.h2 = (uint32_t)mix64(h) | 1;
+    return hash;
+}
+
+// Bucket of an item in a row, by multiply-shift instead of a modulo
+static TopKBucket *row_bucket(TopK *topk, uint32_t row, const TopKHash &hash) {
+    uint32_t h = hash.h1 + row * hash.h2;
+    uint32_t col = (uint32_t)(((uint64_t)h * topk->width) >> 32);
+    return &topk->buckets[(size_t)row * topk->width + col];
+}
+
+// xorshift64, uniform in [0, 1)
+static double topk_rand(TopK *topk) {
+    topk->rng ^= topk->rng << 13;
+    topk->rng ^= topk->rng >> 7;
+    topk->rng ^= topk->rng << 17;
+    return (double)(topk->rng >> 11) * 0x1p-53;
+}
+
+/** ------------------------------------------------------------
+ *    TopK API
+ * ------------------------------------------------------------
+ */
+
+void topk_init(TopK *topk, uint32_t k, uint32_t width, uint32_t depth, double decay) {
+    topk->k = k;
+    topk->width = width;
+    topk->depth = depth;
+    topk->decay = decay;
+    topk->rng = 0x9e3779b97f4a7c15ull;
+    topk->buckets.assign((size_t)width * depth, TopKBucket());
+    topk->items.reserve(k);
+    topk->heap.reserve(k);
+    hm_reserve(&topk->index, k);
+    for (uint32_t i = 0; i < k_topk_decay_table; ++i) { topk->decay_pow[i] = pow(decay, i); }
+}
+
+void topk_clear(TopK *topk) {
+    hm_clear(&topk->index);
+    topk->items.clear();
+    topk->heap.clear();
+}
+
+// Helper structure for the index lookup
+struct TopKKey {
+    HNode node;
+    const std::string *item = NULL;
+};
+
+static bool topk_item_eq(HNode *node, HNode *key) {
+    return container_of(node, TopKItem, node)->item == *container_of(key, TopKKey, node)->item;
+}
+
+static bool topk_node_same(HNode *node, HNode *key) {
+    return node == key;
+}
+
+// A tracked item, NULL if it is not in the top-k
+static TopKItem *topk_find(TopK *topk, const TopKHash &hash, const std::string &item) {
+    TopKKey key;
+    key.node.hash_code = hash.full;
+    key.item = &item;
+    HNode *node = hm_lookup(&topk->index, &key.node, &topk_item_eq);
+    return node ? container_of(node, TopKItem, node) : NULL;
+}
+
+// Count the item in every row and return its estimate, the largest count among its buckets
+static uint32_t topk_count(TopK *topk, const TopKHash &hash) {
+    uint32_t est = 0;
+    for (uint32_t row = 0; row < topk->depth; ++row) {
+        TopKBucket *bucket = row_bucket(topk, row, hash);
+        if (bucket->count == 0) {
+            bucket->fp = hash.fp;
+            bucket->count = 1;
+        }
+        else if (bucket->fp == hash.fp) {
+            if (bucket->count < UINT32_MAX) { bucket->count++; }
+        }
+        else {
+            // Decay another item's counter, taking the bucket over once it is empty
+            double chance = bucket->count < k_topk_decay_table ? topk->decay_pow[bucket->count] : 0;
+            if (chance == 0 || topk_rand(topk) >= chance) { continue; }
+            if (--bucket->count == 0) {
+                bucket->fp = hash.fp;
+                bucket->count = 1;
+            }
+            else { continue; }
+        }
+        if (bucket->count > est) { est = bucket->count; }
+    }
+    return est;
+}
+
+bool topk_add(TopK *topk, std::string &item) {
+    TopKHash hash = topk_hash(item);
+    uint32_t est = topk_count(topk, hash);
+    if (est == 0) { return false; }
+
+    TopKItem *tracked = topk_find(topk, hash, item);
+    if (tracked) {
+        // Already tracked, its count only grows
+        size_t pos = tracked->heap_idx;
+        if (est > topk->heap[pos].val) {
+            topk->heap[pos].val = est;
+            heap_update(topk->heap.data(), pos, topk->heap.size());
+        }
+        return false;
+    }
+
+    if (topk->items.size() < topk->k) {
+        topk->items.emplace_back();
+        TopKItem &fresh = topk->items.back();
+        fresh.item.swap(item);
+        fresh.fp = hash.fp;
+        fresh.node.hash_code = hash.full;
+        hm_insert(&topk->index, &fresh.node);
+        HeapItem hi = { est, &fresh.heap_idx };
+        heap_upsert(topk->heap, (size_t)-1, hi);
+        return false;
+    }
+
+    if (est <= topk->heap[0].val) { return false; }
+
+    // Replace the smallest tracked item, handing its name back to the caller
+    TopKItem *root = container_of(topk->heap[0].ref, TopKItem, heap_idx);
+    HNode *node = hm_delete(&topk->index, &root->node, &topk_node_same);
+    assert(node == &root->node);
+    root->item.swap(item);
+    root->fp = hash.fp;
+    root->node.hash_code = hash.full;
+    hm_insert(&topk->index, &root->node);
+    topk->heap[0].val = est;
+    heap_update(topk->heap.data(), 0, topk->heap.size());
+    return true;
+}
+
+bool topk_query(TopK *topk, const std::string &item) {
+    return topk_find(topk, topk_hash(item), item) != NULL;
+}
+
+/** ------------------------------------------------------------
+ *    Command Handlers
+ * ------------------------------------------------------------
+ */
+
+// Sketch of a key; `*wrong_type` is set if the key holds another type
+static TopK *expect_topk(std::string &key, bool *wrong_type) {
+    Entry *ent = entry_lookup(key);
+    *wrong_type = ent && ent->type != TYPE_TOPK;
+    return ent && !*wrong_type ? ent->topk : NULL;
+}
+
+/**
+ * Command: TOPK.RESERVE <key> <k> [<width> <depth> <decay>]
+ * Create an empty sketch tracking the `k` most frequent items.
+ */
+void topkcmd_reserve(std::vector<std::string> &cmd, Buffer &resp) {
+    int64_t k = 0, width = 0, depth = k_topk_default_depth;
+    double decay = k_topk_default_decay;
+    if (!str2int(cmd[2], k) || k < 1 || (uint64_t)k > k_topk_max_k) { return out_err(resp, ERR_BAD_ARG, "k out of range"); }
+    width = k * k_topk_width_per_k;
+    if (cmd.size() == 6) {
+        if (!str2int(cmd[3], width) || !str2int(cmd[4], depth) || width < 1 || depth < 1
+            || (uint64_t)width * (uint64_t)depth > k_topk_max_counters) {
+            return out_err(resp, ERR_BAD_ARG, "width or depth out of range");
+        }
+        if (!str2dbl(cmd[5], decay) || !(decay > 0 && decay < 1)) {
+            return out_err(resp, ERR_BAD_ARG, "decay should be between 0 and 1");
+        }
+    }
+    if (entry_lookup(cmd[1])) { return out_err(resp, ERR_BAD_ARG, "item exists"); }
+
+    Entry *ent = entry_insert(cmd[1], TYPE_TOPK);
+    topk_init(ent->topk, (uint32_t)k, (uint32_t)width, (uint32_t)depth, decay);
+    return out_nil(resp);
+}
+
+/**
+ * Command: TOPK.ADD <key> <item> [<item> ...]
+ * Count the items, a missing key starts a default sketch. Replies with an array holding, for
+ * each item, the item it expelled from the top-k or nil.
+ */
+void topkcmd_add(std::vector<std::string> &cmd, Buffer &resp) {
+    Entry *ent = entry_lookup(cmd[1]);
+    if (ent && ent->type != TYPE_TOPK) { return out_err(resp, ERR_BAD_TYP, "expect topk"); }
+    if (!ent) {
+        ent = entry_insert(cmd[1], TYPE_TOPK);
+        topk_init(ent->topk, k_topk_default_k, k_topk_default_k * k_topk_width_per_k, k_topk_default_depth, k_topk_default_decay);
+    }
+
+    out_arr(resp, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i) {
+        if (topk_add(ent->topk, cmd[i])) { out_str(resp, cmd[i].data(), cmd[i].size()); }
+        else { out_nil(resp); }
+    }
+}
+
+/**
+ * Command: TOPK.QUERY <key> <item> [<item> ...]
+ * Array of 1 if the item is currently in the top-k, 0 if not.
+ */
+void topkcmd_query(std::vector<std::string> &cmd, Buffer &resp) {
+    bool wrong_type = false;
+    TopK *topk = expect_topk(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect topk"); }
+
+    out_arr(resp, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i) { out_int(resp, topk && topk_query(topk, cmd[i])); }
+}
+
+/**
+ * Command: TOPK.LIST <key> [WITHCOUNT]
+ * The tracked items, most frequent first; with WITHCOUNT each is followed by its estimate.
+ */
+void topkcmd_list(std::vector<std::string> &cmd, Buffer &resp) {
+    bool with_count = cmd.size() == 3;
+    if (with_count && strcasecmp(cmd[2].c_str(), "withcount") != 0) { return out_err(resp, ERR_BAD_ARG, "syntax error"); }
+
+    bool wrong_type = false;
+    TopK *topk = expect_topk(cmd[1], &wrong_type);
+    if (wrong_type) { return out_err(resp, ERR_BAD_TYP, "expect topk"); }
+    if (!topk) { return out_arr(resp, 0); }
+
+    // Order the heap by count, ties by name so the listing is stable
+    std::vector<const HeapItem *> order;
+    order.reserve(topk->heap.size());
+    for (const HeapItem &hi : topk->heap) { order.push_back(&hi); }
+    std::sort(order.begin(), order.end(), [](const HeapItem *a, const HeapItem *b) {
+        if (a->val != b->val) { return a->val > b->val; }
+        return container_of(a->ref, TopKItem, heap_idx)->item < container_of(b->ref, TopKItem, heap_idx)->item;
+    });
+
+    out_arr(resp, (uint32_t)(order.size() * (with_count ? 2 : 1)));
+    for (const HeapItem *hi : order) {
+        const TopKItem *it = container_of(hi->ref, TopKItem, heap_idx);
+        out_str(resp, it->item.data(), it->item.size());
+        if (with_count) { out_int(resp, (int64_t)hi->val); }
+    }
+}
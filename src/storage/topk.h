@@ -0,0 +1,62 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t, uint32_t
+
+// C++ stdlib
+#include <string>   // std::string (items, command args)
+#include <vector>   // std::vector (buckets, items, heap, command args)
+
+// local
+#include "heap.h"               // HeapItem
+#include "hashtable.h"          // HMap, HNode
+#include "../core/buffer_io.h"  // Buffer
+
+// Counts up to which the decay probability is tabulated, past it the chance is negligible
+const uint32_t k_topk_decay_table = 256;
+
+// One HeavyKeeper counter: fingerprint of the item holding it and its count
+struct TopKBucket {
+    uint32_t fp = 0;
+    uint32_t count = 0;     // 0 is an empty bucket
+};
+
+// An item in the top-k, `heap_idx` is its place in `TopK::heap`
+struct TopKItem {
+    HNode    node;                      // in `TopK::index`, keyed by the item's hash
+    std::string item;
+    uint32_t fp = 0;
+    size_t   heap_idx = (size_t)-1;
+};
+
+/**
+ * Top-k heavy hitters in fixed memory (HeavyKeeper): `depth` rows of `width` counters, where
+ * an item only counts up the buckets it owns and decays those of others with probability
+ * decay^count, so small flows fade and large ones keep their counters. The k items with the
+ * largest estimates sit in a min-heap keyed by count; a newcomer replaces the root when its
+ * estimate is larger. `index` finds a tracked item by name without scanning the k slots.
+ */
+struct TopK {
+    uint32_t k = 0;
+    uint32_t width = 0;
+    uint32_t depth = 0;
+    double   decay = 0;
+    uint64_t rng = 0;                   // xorshift state for the decay coin
+    std::vector<TopKBucket> buckets;    // depth * width, row-major
+    std::vector<TopKItem> items;        // k slots, reserved up front so `heap` refs stay put
+    std::vector<HeapItem> heap;         // min-heap of estimated counts, refs into `items`
+    HMap index;                         // the tracked items by name
+    double decay_pow[k_topk_decay_table];   // decay^count
+};
+
+void topk_init(TopK *topk, uint32_t k, uint32_t width, uint32_t depth, double decay);
+bool topk_add(TopK *topk, std::string &item);       // true if an item was expelled, it is swapped into `item`
+bool topk_query(TopK *topk, const std::string &item);
+void topk_clear(TopK *topk);
+
+// Top-k command handlers (operate on top-level HMap `db`)
+void topkcmd_reserve(std::vector<std::string> &cmd, Buffer &resp);
+void topkcmd_add(std::vector<std::string> &cmd, Buffer &resp);
+void topkcmd_query(std::vector<std::string> &cmd, Buffer &resp);
+void topkcmd_list(std::vector<std::string> &cmd, Buffer &resp);
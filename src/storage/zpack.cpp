@@ -0,0 +1,160 @@
+// C stdlib
+#include <assert.h>  // assert
+#include <stdlib.h>  // malloc, realloc, free
+#include <string.h>  // memcmp, memcpy, memmove
+
+// local
+#include "zpack.h"
+
+// Section pointers for a pack holding n members
+static double *zp_scores(ZPack *pack) { return (double *)(pack + 1); }
+static uint32_t *zp_ends(ZPack *pack, uint32_t n) { return (uint32_t *)(zp_scores(pack) + n); }
+static char *zp_names(ZPack *pack, uint32_t n) { return (char *)(zp_ends(pack, n) + n); }
+
+// Bytes needed for n members with `bytes` of names
+static size_t zp_size(uint32_t n, size_t bytes) {
+    return sizeof(ZPack) + n * (sizeof(double) + sizeof(uint32_t)) + bytes;
+}
+
+// Offset of name i inside the name area
+static uint32_t zp_begin(ZPack *pack, uint32_t i) {
+    return i ? zp_ends(pack, pack->n)[i - 1] : 0;
+}
+
+double zpack_score(const ZPack *pack, uint32_t i) {
+    return zp_scores((ZPack *)pack)[i];
+}
+
+const char *zpack_name(const ZPack *pack, uint32_t i, size_t *len) {
+    ZPack *p = (ZPack *)pack;
+    uint32_t begin = zp_begin(p, i);
+    *len = zp_ends(p, p->n)[i] - begin;
+    return zp_names(p, p->n) + begin;
+}
+
+size_t zpack_alloc_size(const ZPack *pack) {
+    return pack ? zp_size(pack->n, pack->bytes) : 0;
+}
+
+// Compare member i with (score, name) by the sorted-set order
+static bool zp_less(const ZPack *pack, uint32_t i, double score, const char *name, size_t len) {
+    double s = zpack_score(pack, i);
+    if (s != score) { return s < score; }
+
+    size_t ilen = 0;
+    const char *iname = zpack_name(pack, i, &ilen);
+    int rv = memcmp(iname, name, ilen < len ? ilen : len);
+    if (rv != 0) { return rv < 0; }
+    return ilen < len;
+}
+
+// Index of the member with this name, -1 if absent
+int64_t zpack_find(const ZPack *pack, const char *name, size_t len) {
+    for (uint32_t i = 0; i < zpack_len(pack); ++i) {
+        size_t ilen = 0;
+        const char *iname = zpack_name(pack, i, &ilen);
+        if (ilen == len && memcmp(iname, name, len) == 0) { return i; }
+    }
+    return -1;
+}
+
+// Index of the first member >= (score, name)
+uint32_t zpack_lower_bound(const ZPack *pack, double score, const char *name, size_t len) {
+    uint32_t lo = 0, hi = zpack_len(pack);
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (zp_less(pack, mid, score, name, len)) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+// Number of members whose score is below `score` (or at most `score` when inclusive)
+uint32_t zpack_count_below(const ZPack *pack, double score, bool inclusive) {
+    uint32_t lo = 0, hi = zpack_len(pack);
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        double s = zpack_score(pack, mid);
+        if (inclusive ? s <= score : s < score) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+/**
+ * Insert a member at index i (the caller keeps the order).
+ * Every section moves towards the end, so they are shifted back to front.
+ */
+ZPack *zpack_insert(ZPack *pack, uint32_t i, double score, const char *name, size_t len) {
+    uint32_t n = zpack_len(pack);
+    uint32_t bytes = pack ? pack->bytes : 0;
+    assert(i <= n);
+
+    ZPack *grown = (ZPack *)realloc(pack, zp_size(n + 1, bytes + len));
+    assert(grown);  // not a good idea in real projects
+    if (!pack) { grown->n = grown->bytes = 0; }
+    pack = grown;
+
+    uint32_t begin = zp_begin(pack, i);
+    double   *old_scores = zp_scores(pack);
+    uint32_t *old_ends = zp_ends(pack, n);
+    char     *old_names = zp_names(pack, n);
+    uint32_t *new_ends = zp_ends(pack, n + 1);
+    char     *new_names = zp_names(pack, n + 1);
+
+    // names after and before the insertion point
+    memmove(new_names + begin + len, old_names + begin, bytes - begin);
+    memmove(new_names, old_names, begin);
+
+    // name end offsets, those after the new member grow by len
+    memmove(new_ends + i + 1, old_ends + i, (n - i) * sizeof(uint32_t));
+    memmove(new_ends, old_ends, i * sizeof(uint32_t));
+    for (uint32_t j = i + 1; j <= n; ++j) { new_ends[j] += (uint32_t)len; }
+
+    // scores
+    memmove(old_scores + i + 1, old_scores + i, (n - i) * sizeof(double));
+
+    // the new member
+    old_scores[i] = score;
+    new_ends[i] = begin + (uint32_t)len;
+    if (len) { memcpy(new_names + begin, name, len); }
+
+    pack->n = n + 1;
+    pack->bytes = bytes + (uint32_t)len;
+    return pack;
+}
+
+/**
+ * Remove the member at index i, returns NULL once the pack is empty.
+ * Every section moves towards the front, so they are shifted front to back.
+ */
+ZPack *zpack_remove(ZPack *pack, uint32_t i) {
+    uint32_t n = pack->n;
+    assert(i < n);
+    if (n == 1) {
+        free(pack);
+        return NULL;
+    }
+
+    uint32_t begin = zp_begin(pack, i);
+    uint32_t end = zp_ends(pack, n)[i];
+    uint32_t len = end - begin;
+
+    double   *scores = zp_scores(pack);
+    uint32_t *old_ends = zp_ends(pack, n);
+    char     *old_names = zp_names(pack, n);
+    uint32_t *new_ends = zp_ends(pack, n - 1);
+    char     *new_names = zp_names(pack, n - 1);
+
+    memmove(scores + i, scores + i + 1, (n - i - 1) * sizeof(double));
+    memmove(new_ends, old_ends, i * sizeof(uint32_t));
+    memmove(new_ends + i, old_ends + i + 1, (n - i - 1) * sizeof(uint32_t));
+    for (uint32_t j = i; j < n - 1; ++j) { new_ends[j] -= len; }
+    memmove(new_names, old_names, begin);
+    memmove(new_names + begin, old_names + end, pack->bytes - end);
+
+    pack->n = n - 1;
+    pack->bytes -= len;
+    ZPack *shrunk = (ZPack *)realloc(pack, zp_size(pack->n, pack->bytes));
+    return shrunk ? shrunk : pack;
+}
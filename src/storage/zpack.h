@@ -0,0 +1,35 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+/**
+ * Packed encoding of a small sorted set: a single allocation laid out as
+ *
+ *      +-----+-------+----------------+----------------+----------------------+
+ *      |  n  | bytes | score[0..n-1]  |  end[0..n-1]   | name0 name1 ... name |
+ *      +-----+-------+----------------+----------------+----------------------+
+ *
+ * Members are sorted by (score, name). `end[i]` is the offset just past name i inside
+ * the name area, so name i spans [end[i-1], end[i]). A NULL pack is an empty set.
+ */
+struct ZPack {
+    uint32_t n = 0;         // number of members
+    uint32_t bytes = 0;     // total bytes of the names
+};
+
+// Accessors
+inline uint32_t zpack_len(const ZPack *pack) { return pack ? pack->n : 0; }
+double      zpack_score(const ZPack *pack, uint32_t i);
+const char *zpack_name(const ZPack *pack, uint32_t i, size_t *len);
+size_t      zpack_alloc_size(const ZPack *pack);
+
+// Searches, O(log N) on the score order, linear by name (packs are small)
+int64_t  zpack_find(const ZPack *pack, const char *name, size_t len);
+uint32_t zpack_lower_bound(const ZPack *pack, double score, const char *name, size_t len);
+uint32_t zpack_count_below(const ZPack *pack, double score, bool inclusive);
+
+// Updates, both may move the allocation and return the new pointer
+ZPack *zpack_insert(ZPack *pack, uint32_t i, double score, const char *name, size_t len);
+ZPack *zpack_remove(ZPack *pack, uint32_t i);
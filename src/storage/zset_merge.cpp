@@ -0,0 +1,141 @@
+// C stdlib
+#include <math.h>    // isnan
+#include <string.h>  // memcmp
+
+// C++ stdlib
+#include <algorithm> // std::sort
+#include <vector>    // std::vector
+
+// local
+#include "zset_merge.h"
+#include "../core/common.h"      // string_hash
+#include "../core/constants.h"   // k_zset_merge_parallel_min
+
+// A member of one input, tagged with the input it came from
+struct ZMergeItem {
+    uint64_t    hash = 0;   // hash of the name, orders the partition before the name does
+    const char *name = NULL;
+    uint32_t    len = 0;
+    uint32_t    input = 0;  // index of the input set
+    double      score = 0;  // weighted score
+};
+
+// One partition of the members, merged by one thread
+struct ZMergeTask {
+    std::vector<ZMergeItem> items;  // members from every input that hash to this partition
+    std::vector<ZPair> out;         // merged result
+    ZMergeOp   op = ZMERGE_UNION;
+    ZAggregate agg = ZAGG_SUM;
+    size_t     ninputs = 0;
+    Latch     *latch = NULL;
+};
+
+// Items of the same name end up adjacent, ordered by input
+static bool item_less(const ZMergeItem &lhs, const ZMergeItem &rhs) {
+    if (lhs.hash != rhs.hash) { return lhs.hash < rhs.hash; }
+    int rv = memcmp(lhs.name, rhs.name, lhs.len < rhs.len ? lhs.len : rhs.len);
+    if (rv != 0) { return rv < 0; }
+    if (lhs.len != rhs.len) { return lhs.len < rhs.len; }
+    return lhs.input < rhs.input;
+}
+
+static bool item_same_name(const ZMergeItem &lhs, const ZMergeItem &rhs) {
+    return lhs.hash == rhs.hash && lhs.len == rhs.len && memcmp(lhs.name, rhs.name, lhs.len) == 0;
+}
+
+// Combine two scores, an undefined sum (inf + -inf) counts as 0
+static double zaggregate(ZAggregate agg, double acc, double val) {
+    switch (agg) {
+    case ZAGG_MIN: return val < acc ? val : acc;
+    case ZAGG_MAX: return val > acc ? val : acc;
+    default: {
+        double sum = acc + val;
+        return isnan(sum) ? 0 : sum;
+    }
+    }
+}
+
+// Sort the partition, then walk each run of equal names once
+static void merge_partition(ZMergeTask *task) {
+    std::vector<ZMergeItem> &items = task->items;
+    std::sort(items.begin(), items.end(), &item_less);
+
+    for (size_t i = 0, j = 0; i < items.size(); i = j) {
+        for (j = i + 1; j < items.size() && item_same_name(items[i], items[j]); ++j) {}
+
+        size_t found = j - i;   // number of inputs holding the member
+        bool keep = task->op == ZMERGE_UNION
+            || (task->op == ZMERGE_INTER && found == task->ninputs)
+            || (task->op == ZMERGE_DIFF && found == 1 && items[i].input == 0);
+        if (!keep) { continue; }
+
+        ZPair pair;
+        pair.score = items[i].score;
+        pair.name = items[i].name;
+        pair.len = items[i].len;
+        for (size_t k = i + 1; k < j; ++k) { pair.score = zaggregate(task->agg, pair.score, items[k].score); }
+        task->out.push_back(pair);
+    }
+}
+
+// Thread pool entry point
+static void merge_worker(void *arg) {
+    ZMergeTask *task = (ZMergeTask *)arg;
+    merge_partition(task);
+    latch_count_down(task->latch);
+}
+
+void zset_merge(ZSet *out, ZSet *const *inputs, const double *weights, size_t n,
+                ZMergeOp op, ZAggregate agg, TheadPool *pool) {
+    // Empty results known up front
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        size_t len = zset_len(inputs[i]);
+        if (len == 0 && (op == ZMERGE_INTER || (op == ZMERGE_DIFF && i == 0))) { return; }
+        total += len;
+    }
+
+    // Small inputs are merged by the caller alone
+    size_t parts = 1;
+    if (pool && total >= k_zset_merge_parallel_min) { parts = pool->threads.size() + 1; }
+
+    std::vector<ZMergeTask> tasks(parts);
+    Latch latch;
+    latch_init(&latch, parts - 1);
+    for (ZMergeTask &task : tasks) {
+        task.items.reserve(total / parts + total / parts / 8);
+        task.op = op;
+        task.agg = agg;
+        task.ninputs = n;
+        task.latch = &latch;
+    }
+
+    // Snapshot every input in sorted order, split by the name hash
+    for (size_t i = 0; i < n; ++i) {
+        ZIter iter;
+        for (bool ok = zset_seek_rank(inputs[i], &iter, 0); ok; ok = zset_iter_offset(inputs[i], &iter, +1)) {
+            ZMergeItem item;
+            // members with nodes carry their hash, packed ones are hashed here
+            item.hash = iter.node ? iter.node->hmap.hash_code : string_hash((uint8_t *)iter.name, iter.len);
+            item.name = iter.name;
+            item.len = (uint32_t)iter.len;
+            item.input = (uint32_t)i;
+            item.score = iter.score * weights[i];
+            if (isnan(item.score)) { item.score = 0; }  // inf * 0
+            tasks[item.hash % parts].items.push_back(item);
+        }
+    }
+
+    // Workers take all but the first partition, the caller merges that one meanwhile
+    for (size_t p = 1; p < parts; ++p) { thread_pool_queue(pool, &merge_worker, &tasks[p], WORK_PRIO_HIGH); }
+    merge_partition(&tasks[0]);
+    latch_wait(&latch);
+
+    // Names still point into the inputs, zset_load copies them
+    std::vector<ZPair> pairs;
+    size_t count = 0;
+    for (ZMergeTask &task : tasks) { count += task.out.size(); }
+    pairs.reserve(count);
+    for (ZMergeTask &task : tasks) { pairs.insert(pairs.end(), task.out.begin(), task.out.end()); }
+    zset_load(out, pairs);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// C stdlib
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t
+
+// local
+#include "sorted_set.h"             // ZSet
+#include "../core/thread_pool.h"    // TheadPool
+
+// Set operation of ZUNIONSTORE / ZINTERSTORE / ZDIFFSTORE
+enum ZMergeOp : uint8_t {
+    ZMERGE_UNION = 0,   // members of any input
+    ZMERGE_INTER = 1,   // members of every input
+    ZMERGE_DIFF  = 2,   // members of the first input only
+};
+
+// How the weighted scores of a member found in several inputs are combined
+enum ZAggregate : uint8_t {
+    ZAGG_SUM = 0,
+    ZAGG_MIN = 1,
+    ZAGG_MAX = 2,
+};
+
+/**
+ * Combine `n` input sets into the empty set `out`, each input score multiplied by its weight.
+ * Inputs are only read and must not change until this returns. Large inputs are split by
+ * member hash across the `pool` workers, each sort-merging its share, and `out` is bulk-built.
+ */
+void zset_merge(ZSet *out, ZSet *const *inputs, const double *weights, size_t n,
+                ZMergeOp op, ZAggregate agg, TheadPool *pool);
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "../src/storage/avl_tree.h"
+#include "../src/storage/btree.h"
+#include "../src/core/common.h"
+
+/**
+ * Throughput of the two sorted-set indexes: AVL tree (one node per member)
+ * vs. B+-tree (wide leaves of score/item arrays).
+ * Usage: bench_btree [members] (default 1,000,000)
+ */
+
+struct Data {
+    AVLNode node;
+    double score = 0;
+    uint32_t id = 0;
+};
+
+static double now_sec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (double)tv.tv_sec + (double)tv.tv_nsec / 1e9;
+}
+
+static bool data_less(const Data *lhs, double score, uint32_t id) {
+    return lhs->score != score ? lhs->score < score : lhs->id < id;
+}
+
+static int cmp_id(void *item, const void *key) {
+    uint32_t lhs = ((Data *)item)->id;
+    uint32_t rhs = ((const Data *)key)->id;
+    return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+static void avl_add(AVLNode **root, Data *data) {
+    AVLNode *parent = NULL;
+    AVLNode **from = root;
+    while (*from) {
+        parent = *from;
+        from = data_less(data, container_of(parent, Data, node)->score, container_of(parent, Data, node)->id)
+            ? &parent->left : &parent->right;
+    }
+    *from = &data->node;
+    data->node.parent = parent;
+    *root = avl_fix_tree(&data->node);
+}
+
+static AVLNode *avl_seek(AVLNode *root, double score, uint32_t id) {
+    AVLNode *found = NULL;
+    for (AVLNode *node = root; node; ) {
+        if (data_less(container_of(node, Data, node), score, id)) { node = node->right; }
+        else { found = node; node = node->left; }
+    }
+    return found;
+}
+
+static void report(const char *name, size_t ops, double secs) {
+    printf("  %-14s %10.2f Mops/s\n", name, (double)ops / secs / 1e6);
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    const size_t seeks = 1000000;
+    const size_t range_len = 100;
+    const size_t ranges = 20000;
+
+    std::vector<Data> data(n);
+    srand(1);
+    for (size_t i = 0; i < n; ++i) {
+        avl_init(&data[i].node);
+        data[i].score = (double)(rand() % (n + 1));
+        data[i].id = (uint32_t)i;
+    }
+    std::vector<size_t> probes(seeks);
+    for (size_t &p : probes) { p = (size_t)rand() % n; }
+
+    printf("members: %zu\n", n);
+    uint64_t sink = 0;
+
+    // AVL tree
+    printf("AVL tree\n");
+    AVLNode *root = NULL;
+    double t0 = now_sec();
+    for (size_t i = 0; i < n; ++i) { avl_add(&root, &data[i]); }
+    report("insert", n, now_sec() - t0);
+
+    t0 = now_sec();
+    for (size_t p : probes) { sink += (uintptr_t)avl_seek(root, data[p].score, data[p].id); }
+    report("seek", seeks, now_sec() - t0);
+
+    t0 = now_sec();
+    for (size_t r = 0; r < ranges; ++r) {
+        AVLNode *node = avl_seek(root, data[probes[r]].score, data[probes[r]].id);
+        for (size_t i = 0; i < range_len && node; ++i) {
+            sink += (uint64_t)container_of(node, Data, node)->score;
+            node = avl_offset(node, +1);
+        }
+    }
+    report("range (x100)", ranges * range_len, now_sec() - t0);
+
+    // B+-tree
+    printf("B+-tree\n");
+    BTree tree;
+    bt_init(&tree, &cmp_id);
+    t0 = now_sec();
+    for (size_t i = 0; i < n; ++i) { bt_insert(&tree, data[i].score, &data[i], &data[i]); }
+    report("insert", n, now_sec() - t0);
+
+    BIter iter;
+    t0 = now_sec();
+    for (size_t p : probes) {
+        bt_seek_greater_equal(&tree, data[p].score, &data[p], &iter);
+        sink += (uintptr_t)bt_iter_item(&iter);
+    }
+    report("seek", seeks, now_sec() - t0);
+
+    t0 = now_sec();
+    for (size_t r = 0; r < ranges; ++r) {
+        bool ok = bt_seek_greater_equal(&tree, data[probes[r]].score, &data[probes[r]], &iter);
+        for (size_t i = 0; i < range_len && ok; ++i) {
+            sink += (uint64_t)bt_iter_score(&iter);
+            ok = bt_iter_next(&iter);
+        }
+    }
+    report("range (x100)", ranges * range_len, now_sec() - t0);
+
+    bt_clear(&tree, NULL);
+    printf("(checksum %llu)\n", (unsigned long long)sink);
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include "../src/storage/avl_tree.h"
 #include <cstddef> // offsetof
 #include <set>     // std::multiset
+#include <vector>  // std::vector (test_build)
 
 
 #define container_of(ptr, type, member) \
@@ -163,6 +164,26 @@ static void test_remove(uint32_t sz) {
     }
 }
 
+static void test_build(uint32_t sz) {
+    Container c;
+    std::multiset<uint32_t> ref;
+    std::vector<AVLNode *> nodes;
+    for (uint32_t i = 0; i < sz; ++i) {
+        Data *data = new Data();
+        data->val = i / 2;  // some duplicates
+        nodes.push_back(&data->node);
+        ref.insert(data->val);
+    }
+    c.root = avl_build(nodes.data(), nodes.size());
+    container_verify(c, ref);
+
+    // The built tree keeps working under updates
+    add(c, sz / 3);
+    ref.insert(sz / 3);
+    container_verify(c, ref);
+    dispose(c);
+}
+
 int main() {
     Container c;
 
@@ -208,6 +229,7 @@ int main() {
         test_insert(i);
         test_insert_dup(i);
         test_remove(i);
+        test_build(i);
     }
 
     dispose(c);
@@ -0,0 +1,103 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../src/storage/bitmap_kernels.h"
+
+
+// Lengths around the 8-byte word, 32-byte popcnt/AVX2 block and 64-byte double block edges
+static const size_t k_lengths[] = {0, 1, 7, 8, 9, 31, 32, 33, 63, 64, 65, 95, 96, 97, 127, 128, 129, 1000};
+
+static uint64_t ref_count(const uint8_t *data, size_t len) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < len * 8; ++i) { total += (data[i / 8] >> (7 - i % 8)) & 1; }
+    return total;
+}
+
+static int64_t ref_pos(const uint8_t *data, size_t len, bool bit) {
+    for (size_t i = 0; i < len * 8; ++i) {
+        if (((data[i / 8] >> (7 - i % 8)) & 1) == bit) { return (int64_t)i; }
+    }
+    return -1;
+}
+
+static uint8_t ref_op(BitOp op, uint8_t a, uint8_t b) {
+    switch (op) {
+    case BITOP_AND: return a & b;
+    case BITOP_OR:  return a | b;
+    case BITOP_XOR: return a ^ b;
+    default:        return (uint8_t)~b;
+    }
+}
+
+// Random bytes, starting `skew` bytes into the allocation so the loads are unaligned too
+static uint8_t *rand_buf(std::vector<uint8_t> &store, size_t len, size_t skew) {
+    store.assign(len + skew + 1, 0);
+    for (uint8_t &byte : store) { byte = (uint8_t)rand(); }
+    return store.data() + skew;
+}
+
+static void test_count_op(const BitKernels &k, size_t len, size_t skew) {
+    std::vector<uint8_t> sa, sb, sd;
+    uint8_t *a = rand_buf(sa, len, skew), *b = rand_buf(sb, len, (skew + 3) % 8);
+    assert(k.count(a, len) == ref_count(a, len));
+
+    for (BitOp op : {BITOP_AND, BITOP_OR, BITOP_XOR, BITOP_NOT}) {
+        uint8_t *dst = rand_buf(sd, len, skew);
+        memcpy(dst, a, len);
+        uint8_t guard = dst[len];
+        k.op(op, dst, b, len);
+        for (size_t i = 0; i < len; ++i) { assert(dst[i] == ref_op(op, a[i], b[i])); }
+        assert(dst[len] == guard);  // nothing past the end
+    }
+}
+
+// A run of the other bit value, then the first match at `at` (none if at == len * 8)
+static void test_pos(const BitKernels &k, size_t len, size_t skew, bool bit, size_t at) {
+    std::vector<uint8_t> store;
+    uint8_t *data = rand_buf(store, len, skew);
+    memset(data, bit ? 0x00 : 0xff, len);
+    if (at < len * 8) {
+        data[at / 8] ^= (uint8_t)(0x80 >> (at % 8));
+        for (size_t i = at / 8 + 1; i < len; ++i) { data[i] = (uint8_t)rand(); }
+    }
+    assert(k.pos(data, len, bit) == ref_pos(data, len, bit));
+    assert(k.pos(data, len, bit) == (at < len * 8 ? (int64_t)at : -1));
+}
+
+int main() {
+    srand(1);
+    std::vector<BitKernels> sets = bitmap_kernel_sets();
+    assert(!sets.empty() && strcmp(sets.back().name, "scalar") == 0);
+    assert(strcmp(sets[0].name, bitmap_kernels()) == 0);
+
+    for (const BitKernels &k : sets) {
+        for (size_t len : k_lengths) {
+            for (size_t skew = 0; skew < 8; ++skew) {
+                test_count_op(k, len, skew);
+                for (bool bit : {false, true}) {
+                    test_pos(k, len, skew, bit, len * 8);   // no match
+                    for (size_t at : {(size_t)0, len * 4, len * 8 - 1}) {
+                        if (len > 0) { test_pos(k, len, skew, bit, at); }
+                    }
+                    if (len > 0) { test_pos(k, len, skew, bit, (size_t)rand() % (len * 8)); }
+                }
+            }
+        }
+    }
+
+    // Every build gives the same answers on the same large random buffer
+    std::vector<uint8_t> sa, sb;
+    size_t len = 4096 + 45;
+    uint8_t *a = rand_buf(sa, len, 5), *b = rand_buf(sb, len, 2);
+    for (const BitKernels &k : sets) {
+        assert(k.count(a, len) == sets.back().count(a, len));
+        std::vector<uint8_t> d1(a, a + len), d2(a, a + len);
+        k.op(BITOP_XOR, d1.data(), b, len);
+        sets.back().op(BITOP_XOR, d2.data(), b, len);
+        assert(d1 == d2);
+    }
+    printf("✅ Bitmap kernel tests passed.\n");
+    return 0;
+}
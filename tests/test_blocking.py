@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Test BZPOPMIN/BZPOPMAX: immediate pops, wake-ups in FIFO order and timeouts."""
+
+import socket
+import struct
+import time
+import sys
+
+def connect():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.connect(('127.0.0.1', 8080))
+    return sock
+
+def send_request(sock, *args):
+    """Send a request to the server."""
+    payload = struct.pack('<I', len(args))
+    for arg in args:
+        arg_bytes = str(arg).encode('utf-8')
+        payload += struct.pack('<I', len(arg_bytes))
+        payload += arg_bytes
+    frame = struct.pack('<I', len(payload)) + payload
+    sock.sendall(frame)
+
+def recv_exact(sock, n):
+    data = b''
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise EOFError("connection closed")
+        data += chunk
+    return data
+
+def parse(data, pos):
+    """Decode one serialized value: nil, error, string, int, double or array."""
+    tag = data[pos]
+    pos += 1
+    if tag == 0:
+        return None, pos
+    if tag == 1:
+        code, length = struct.unpack_from('<II', data, pos)
+        pos += 8
+        return ('error', code), pos + length
+    if tag == 2:
+        length = struct.unpack_from('<I', data, pos)[0]
+        pos += 4
+        return data[pos:pos + length].decode(), pos + length
+    if tag == 3:
+        return struct.unpack_from('<q', data, pos)[0], pos + 8
+    if tag == 4:
+        return struct.unpack_from('<d', data, pos)[0], pos + 8
+    if tag == 6:
+        count = struct.unpack_from('<I', data, pos)[0]
+        pos += 4
+        items = []
+        for _ in range(count):
+            item, pos = parse(data, pos)
+            items.append(item)
+        return items, pos
+    raise ValueError(f"unexpected tag {tag}")
+
+def recv_response(sock):
+    length = struct.unpack('<I', recv_exact(sock, 4))[0]
+    value, _ = parse(recv_exact(sock, length), 0)
+    return value
+
+def call(sock, *args):
+    send_request(sock, *args)
+    return recv_response(sock)
+
+def test_blocking():
+    ctl, first, second = connect(), connect(), connect()
+    call(ctl, 'del', 'jobs')
+    call(ctl, 'del', 'other')
+
+    # Members are popped right away, lowest or highest score first
+    assert call(ctl, 'zadd', 'jobs', 2, 'b', 1, 'a', 3, 'c') == 3
+    assert call(ctl, 'zpopmin', 'jobs') == ['a', 1.0]
+    assert call(ctl, 'bzpopmax', 'other', 'jobs', 0) == ['jobs', 'c', 3.0]
+    assert call(ctl, 'zpopmin', 'jobs', 5) == ['b', 2.0]
+
+    # Both park on the empty key, the first to block is served first
+    send_request(first, 'bzpopmin', 'other', 'jobs', 0)
+    time.sleep(0.05)
+    send_request(second, 'bzpopmin', 'jobs', 0)
+    send_request(second, 'ping')            # pipelined behind the blocked call
+    time.sleep(0.05)
+    assert call(ctl, 'zadd', 'jobs', 5, 'x') == 1
+    assert recv_response(first) == ['jobs', 'x', 5.0]
+    assert call(ctl, 'zadd', 'jobs', 7, 'y', 6, 'z') == 2
+    assert recv_response(second) == ['jobs', 'z', 6.0]
+    assert recv_response(second) == 'pong'
+    assert call(ctl, 'zpopmin', 'jobs') == ['y', 7.0]
+
+    # A timeout replies nil
+    start = time.time()
+    assert call(first, 'bzpopmin', 'jobs', 0.1) is None
+    assert time.time() - start >= 0.09
+
+    # Non-finite timeouts are refused, one past the clock's range waits like 0
+    assert call(first, 'bzpopmin', 'jobs', 'inf') == ('error', 4)
+    assert call(first, 'bzpopmin', 'jobs', 'nan') == ('error', 4)
+    send_request(first, 'bzpopmin', 'jobs', '1e300')
+    time.sleep(0.05)
+    assert call(ctl, 'zadd', 'jobs', 4, 'w') == 1
+    assert recv_response(first) == ['jobs', 'w', 4.0]
+
+    # A client that disconnects while parked leaves no waiter behind
+    send_request(second, 'bzpopmin', 'jobs', 0)
+    time.sleep(0.05)
+    second.close()
+    time.sleep(0.05)
+    assert call(ctl, 'zadd', 'jobs', 1, 'k') == 1
+    assert call(ctl, 'zscore', 'jobs', 'k') == 1.0
+
+    for sock in (ctl, first):
+        sock.close()
+    print("✅ Blocking pop test passed.")
+
+if __name__ == '__main__':
+    try:
+        test_blocking()
+    except Exception as e:
+        print(f"❌ Blocking pop test failed: {e!r}")
+        sys.exit(1)
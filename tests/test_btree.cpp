@@ -0,0 +1,188 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>     // std::set
+#include <utility> // std::pair
+#include <vector>
+#include "../src/storage/btree.h"
+
+
+struct Data {
+    double score = 0;
+    uint32_t id = 0;
+};
+
+typedef std::pair<double, uint32_t> Key;
+
+struct Container {
+    BTree tree;
+    std::set<Key> ref;
+    std::vector<Data *> items;  // indexed by id
+};
+
+static int cmp_id(void *item, const void *key) {
+    uint32_t lhs = ((Data *)item)->id;
+    uint32_t rhs = ((const Data *)key)->id;
+    return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+static void add(Container &c, double score, uint32_t id) {
+    Data *d = new Data();
+    d->score = score;
+    d->id = id;
+    bt_insert(&c.tree, score, d, d);
+    c.ref.insert(Key(score, id));
+    if (c.items.size() <= id) { c.items.resize(id + 1); }
+    c.items[id] = d;
+}
+
+static void del(Container &c, uint32_t id) {
+    Data *d = c.items[id];
+    void *found = bt_delete(&c.tree, d->score, d);
+    assert(found == d);
+    c.ref.erase(Key(d->score, d->id));
+    c.items[id] = NULL;
+    delete d;
+}
+
+// Check the per-child counts and minimums, returns the number of entries
+static uint64_t node_verify(Container &c, BNode *node, bool is_root) {
+    assert(node->n > 0 && node->n <= k_btree_order);
+    if (node->leaf) {
+        BLeaf *leaf = (BLeaf *)node;
+        for (uint32_t i = 0; i < node->n; ++i) {
+            assert(((Data *)leaf->item[i])->score == leaf->score[i]);
+        }
+        return node->n;
+    }
+
+    BInner *inner = (BInner *)node;
+    assert(is_root || node->n >= 2);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < node->n; ++i) {
+        uint64_t cnt = node_verify(c, inner->child[i], false);
+        assert(cnt == inner->cnt[i]);
+
+        // The separator is the exact minimum of the child
+        BNode *first = inner->child[i];
+        while (!first->leaf) { first = ((BInner *)first)->child[0]; }
+        assert(inner->item[i] == ((BLeaf *)first)->item[0]);
+        assert(inner->score[i] == ((BLeaf *)first)->score[0]);
+        total += cnt;
+    }
+    return total;
+}
+
+static void verify(Container &c) {
+    assert(c.tree.size == c.ref.size());
+    if (!c.tree.root) {
+        assert(c.ref.empty());
+        return;
+    }
+    assert(node_verify(c, c.tree.root, true) == c.ref.size());
+
+    // Forward scan through the leaf chain matches the reference order
+    BIter iter;
+    bool ok = bt_seek_rank(&c.tree, 0, &iter);
+    uint64_t rank = 0;
+    for (const Key &k : c.ref) {
+        assert(ok);
+        Data *d = (Data *)bt_iter_item(&iter);
+        assert(d->score == k.first && d->id == k.second);
+        assert(bt_rank(&c.tree, d->score, d) == rank);
+
+        BIter at;
+        assert(bt_seek_rank(&c.tree, rank, &at));
+        assert(bt_iter_item(&at) == d);
+
+        BIter ge;
+        assert(bt_seek_greater_equal(&c.tree, d->score, d, &ge));
+        assert(bt_iter_item(&ge) == d);
+
+        ok = bt_iter_next(&iter);
+        rank++;
+    }
+    assert(!ok);
+
+    // Backward scan
+    ok = bt_seek_rank(&c.tree, c.ref.size() - 1, &iter);
+    for (auto it = c.ref.rbegin(); it != c.ref.rend(); ++it) {
+        assert(ok);
+        assert(((Data *)bt_iter_item(&iter))->id == it->second);
+        ok = bt_iter_prev(&iter);
+    }
+    assert(!ok);
+
+    // Score-only bounds
+    for (double s = -1; s <= 101; s += 0.5) {
+        uint64_t below = 0, upto = 0;
+        for (const Key &k : c.ref) {
+            below += k.first < s;
+            upto += k.first <= s;
+        }
+        assert(bt_count_below(&c.tree, s, false) == below);
+        assert(bt_count_below(&c.tree, s, true) == upto);
+    }
+}
+
+static void dispose(Container &c) {
+    bt_clear(&c.tree, NULL);
+    for (Data *d : c.items) { delete d; }
+}
+
+static void test_random(uint32_t sz) {
+    Container c;
+    bt_init(&c.tree, &cmp_id);
+    for (uint32_t i = 0; i < sz; ++i) {
+        add(c, (double)(rand() % 100), i);  // plenty of equal scores
+    }
+    verify(c);
+
+    // Delete half in random order, then the rest
+    for (uint32_t i = 0; i < sz; ++i) {
+        uint32_t id = (uint32_t)rand() % sz;
+        if (c.items[id]) { del(c, id); }
+    }
+    verify(c);
+    for (uint32_t i = 0; i < sz; ++i) {
+        if (c.items[i]) { del(c, i); }
+    }
+    verify(c);
+    assert(c.tree.root == NULL);
+    dispose(c);
+}
+
+static void test_build(uint32_t sz) {
+    Container c;
+    bt_init(&c.tree, &cmp_id);
+
+    std::vector<double> scores;
+    std::vector<void *> items;
+    for (uint32_t i = 0; i < sz; ++i) {
+        Data *d = new Data();
+        d->score = (double)(i / 3);
+        d->id = i;
+        c.items.push_back(d);
+        c.ref.insert(Key(d->score, d->id));
+        scores.push_back(d->score);
+        items.push_back(d);
+    }
+    bt_build(&c.tree, scores.data(), items.data(), sz);
+    verify(c);
+
+    // The built tree keeps working under updates
+    for (uint32_t i = 0; i < sz; i += 2) { del(c, i); }
+    add(c, 0.5, sz);
+    verify(c);
+    dispose(c);
+}
+
+int main() {
+    srand(1);
+    for (uint32_t sz : {0u, 1u, 2u, 63u, 64u, 65u, 200u, 1000u, 5000u, 100000u}) {
+        test_random(sz);
+        test_build(sz);
+    }
+    printf("✅ B+-tree tests passed.\n");
+    return 0;
+}
@@ -39,8 +39,731 @@ array length: 2
 n2
 2
 array end
+$ zadd drain 1 a 2 b
+2
+$ zpopmax drain 5
+array length: 4
+b
+2
+a
+1
+array end
+$ hset drain f v
+1
+$ zadd board 10 a
+1
+$ zadd board 20 b
+1
+$ zadd board 30 c
+1
+$ zadd board 40 d
+1
+$ zrank board c
+2
+$ zrevrank board c
+1
+$ zrank board zz
+nil
+$ zcount board 20 30
+2
+$ zcount board (20 +inf
+2
+$ zcount board -inf (10
+0
+$ zrange board 1 2
+array length: 4
+b
+20
+c
+30
+array end
+$ zrevrange board 0 -3
+array length: 4
+d
+40
+c
+30
+array end
+$ zrange board 5 10
+array length: 0
+array end
+$ zadd multi 3 c 1 a 2 b 1 a
+3
+$ zadd multi nx 9 a 4 d
+1
+$ zadd multi xx 9 a 5 e
+0
+$ zadd multi gt 5 a 1 b
+0
+$ zadd multi incr 0.5 c
+3.5
+$ zadd multi nx incr 1 c
+nil
+$ zadd multi nx xx 1 a
+error 4: NX is incompatible with XX, GT and LT
+$ zrange multi 0 -1
+array length: 8
+b
+2
+c
+3.5
+d
+4
+a
+9
+array end
+$ zadd w1 1 a 2 b 3 c
+3
+$ zadd w2 10 b 20 c 30 d
+3
+$ zunionstore all 2 w1 w2 weights 2 1
+4
+$ zrange all 0 -1
+array length: 8
+a
+2
+b
+14
+c
+26
+d
+30
+array end
+$ zinterstore both 2 w1 w2 aggregate max
+2
+$ zrange both 0 -1
+array length: 4
+b
+10
+c
+20
+array end
+$ zdiffstore only 2 w1 w2
+1
+$ zrange only 0 -1
+array length: 2
+a
+1
+array end
+$ zinterstore only 2 w1 nokey
+0
+$ zscore only a
+nil
+$ zpttl w1 a
+-1
+$ zpttl w1 zz
+-2
+$ zpexpire w1 zz 1000
+0
+$ zpexpire w1 a -1
+1
+$ zpexpire w1 a x
+error 4: expect int
+$ set cnt 10
+nil
+$ incr cnt
+11
+$ incrby cnt -20
+-9
+$ decrby cnt 1
+-10
+$ get cnt
+-10
+$ incrbyfloat cnt 0.5
+-9.5
+$ incr cnt
+error 4: value is not an integer
+$ incr w1
+error 3: expect string
+$ get w1
+error 3: expect string
+$ hset user name ann age 31
+2
+$ hset user name bob
+0
+$ hget user name
+bob
+$ hmget user age nope
+array length: 2
+31
+nil
+array end
+$ hincrby user age 2
+33
+$ hgetall user
+array length: 4
+name
+bob
+age
+33
+array end
+$ hdel user name nope
+1
+$ hdel user age
+1
+$ hgetall user
+array length: 0
+array end
+$ hget w1 name
+error 3: expect hash
+$ rpush log b c d
+3
+$ lpush log a
+4
+$ lrange log 0 -1
+array length: 4
+a
+b
+c
+d
+array end
+$ ltrim log 1 -1
+nil
+$ lpop log
+b
+$ rpop log 5
+array length: 2
+d
+c
+array end
+$ llen log
+0
+$ lpop log
+nil
+$ lpush w1 x
+error 3: expect list
+$ sadd ids 30 10 20 10
+3
+$ smembers ids
+array length: 3
+10
+20
+30
+array end
+$ sismember ids 20
+1
+$ sismember ids 020
+0
+$ sadd odd 10 30 50 70000
+4
+$ sinter ids odd
+array length: 2
+10
+30
+array end
+$ sunion ids odd
+array length: 5
+10
+20
+30
+50
+70000
+array end
+$ sinter ids nosuchset
+array length: 0
+array end
+$ sadd odd tag
+1
+$ sinter odd ids
+array length: 2
+10
+30
+array end
+$ scard odd
+5
+$ srem ids 10 20 30 40
+3
+$ scard ids
+0
+$ sadd w1 x
+error 3: expect set
+$ setbit dau 7 1
+0
+$ setbit dau 7 1
+1
+$ setbit dau 14 1
+0
+$ getbit dau 14
+1
+$ getbit dau 1000
+0
+$ bitcount dau
+2
+$ bitcount dau 1 1
+1
+$ bitpos dau 1
+7
+$ bitpos dau 0 1
+8
+$ setbit dau2 14 1
+0
+$ bitop and both dau dau2
+2
+$ bitcount both
+1
+$ bitop or either dau dau2 missing
+2
+$ bitcount either
+2
+$ bitop not flipped dau
+2
+$ bitcount flipped
+14
+$ setbit dau 8 2
+error 4: bit is not an integer or out of range
+$ setbit w1 0 1
+error 3: expect string
+$ pfadd visitors a b c
+1
+$ pfadd visitors a b
+0
+$ pfcount visitors
+3
+$ pfadd visitors2 c d
+1
+$ pfcount visitors visitors2
+4
+$ pfmerge week visitors visitors2
+nil
+$ pfcount week
+4
+$ pfcount nosuchhll
+0
+$ pfadd dau x
+error 3: expect hyperloglog
+$ bf.reserve seen 0.001 1000
+nil
+$ bf.reserve seen 0.01 10
+error 4: item exists
+$ bf.add seen apple
+1
+$ bf.add seen apple
+0
+$ bf.exists seen apple
+1
+$ bf.exists seen pear
+0
+$ bf.madd seen pear plum apple
+array length: 3
+1
+1
+0
+array end
+$ bf.mexists seen plum kiwi
+array length: 2
+1
+0
+array end
+$ bf.exists nosuchfilter apple
+0
+$ bf.reserve f2 1.5 100
+error 4: error rate should be between 0 and 1
+$ bf.reserve f2 1e-15 1073741824
+error 4: filter too large
+$ bf.exists f2 x
+0
+$ bf.add dau x
+error 3: expect bloom filter
+$ topk.reserve hot 2
+nil
+$ topk.add hot a b a
+array length: 3
+nil
+nil
+nil
+array end
+$ topk.add hot c c c
+array length: 3
+nil
+b
+nil
+array end
+$ topk.list hot withcount
+array length: 4
+c
+3
+a
+2
+array end
+$ topk.query hot a b
+array length: 2
+1
+0
+array end
+$ topk.list hot WITHCOUNT
+array length: 4
+c
+3
+a
+2
+array end
+$ topk.list hot counts
+error 4: syntax error
+$ topk.list nosuchtopk
+array length: 0
+array end
+$ topk.reserve hot 5
+error 4: item exists
+$ topk.add dau x
+error 3: expect topk
+$ json.set doc $ {"name":"ann","visits":1,"tags":["a","b"],"addr":{"city":"Oslo"}}
+nil
+$ json.get doc $.addr.city
+"Oslo"
+$ json.get doc $.tags[-1]
+"b"
+$ json.set doc $.addr.zip "0150"
+nil
+$ json.set doc $.tags[0] {"k":[1,2.5,true,null]}
+nil
+$ json.numincrby doc $.visits 41
+42
+$ json.numincrby doc $.visits 0.5
+42.5
+$ json.get doc
+{"name":"ann","visits":42.5,"tags":[{"k":[1,2.5,true,null]},"b"],"addr":{"city":"Oslo","zip":"0150"}}
+$ json.set doc $.name "bob" nx
+0
+$ json.set doc $.nick "al" NX
+1
+$ json.get doc $.nick
+"al"
+$ json.set doc $.missing.x 1
+nil
+$ json.get doc $.missing
+nil
+$ json.numincrby doc $.name 1
+error 3: expect number
+$ json.set doc $ {"a":
+error 4: invalid json or too deep
+$ json.set newdoc $.a 1
+error 4: new documents must be set at the root
+$ json.get dau
+error 3: expect json
+$ xadd ev 1-1 page home
+1-1
+$ xadd ev 1-* page cart
+1-2
+$ xadd ev 5 page pay
+5-0
+$ xadd ev 3-0 page x
+error 4: the ID is equal or smaller than the last one
+$ xlen ev
+3
+$ xrevrange ev + - count 2
+array length: 2
+array length: 2
+5-0
+array length: 2
+page
+pay
+array end
+array end
+array length: 2
+1-2
+array length: 2
+page
+cart
+array end
+array end
+array end
+$ xrange ev (1-1 1
+array length: 1
+array length: 2
+1-2
+array length: 2
+page
+cart
+array end
+array end
+array end
+$ xtrim ev maxlen 1
+2
+$ xrange ev - +
+array length: 1
+array length: 2
+5-0
+array length: 2
+page
+pay
+array end
+array end
+array end
+$ xadd dau 9-9 a b
+error 3: expect stream
+$ geoadd sicily 13.361389 38.115556 palermo 15.087269 37.502669 catania
+2
+$ geoadd sicily 200 10 x
+error 4: invalid longitude,latitude pair
+$ geodist sicily palermo catania km
+166.274
+$ geopos sicily palermo nosuch
+array length: 2
+array length: 2
+13.3614
+38.1156
+array end
+nil
+array end
+$ geosearch sicily fromlonlat 15 37 byradius 100 km
+array length: 1
+catania
+array end
+$ geosearch sicily fromlonlat 15 37 byradius 200 km desc withdist
+array length: 2
+array length: 2
+palermo
+190.442
+array end
+array length: 2
+catania
+56.4413
+array end
+array end
+$ geosearch sicily frommember palermo bybox 400 400 km count 1
+array length: 1
+palermo
+array end
+$ geoadd ev 1 1 x
+error 3: expect zset
+$ ts.add cpu 1000 0.5
+1000
+$ ts.add cpu 2000 1.5
+2000
+$ ts.add cpu 3000 2.5
+3000
+$ ts.add cpu 61000 4
+61000
+$ ts.add cpu 3000 1
+error 4: timestamp must be after the last sample
+$ ts.range cpu 1500 3000
+array length: 2
+array length: 2
+2000
+1.5
+array end
+array length: 2
+3000
+2.5
+array end
+array end
+$ ts.range cpu - + aggregation avg 60000
+array length: 2
+array length: 2
+0
+1.5
+array end
+array length: 2
+60000
+4
+array end
+array end
+$ ts.info cpu
+array length: 4
+4
+1
+34
+0
+array end
+$ ts.add sicily 1 1
+error 3: expect time series
+$ append note hello
+5
+$ append note _world
+11
+$ getrange note -5 -1
+world
+$ setrange note 6 W
+11
+$ get note
+hello_World
+$ setrange pad 3 ab
+5
+$ strlen pad
+5
+$ strlen nosuch
+0
+$ append cpu x
+error 3: expect string
+$ set lock a nx
+1
+$ set lock b nx
+0
+$ set lock c get
+a
+$ set nolock x xx
+0
+$ get nolock
+nil
+$ set lock d xx px 100000
+1
+$ set lock e keepttl
+nil
+$ pexpiretime nolock
+-2
+$ set lock f
+nil
+$ pexpiretime lock
+-1
+$ getex lock px 100000
+f
+$ getex lock persist
+f
+$ pttl lock
+-1
+$ pexpireat lock 1
+1
+$ get lock
+nil
+$ set lock g ex 0
+error 4: invalid expire time
+$ set lock g nx xx
+error 4: syntax error
+$ set cpu x get
+error 3: expect string
+$ set note x get
+hello_World
+$ getdel note
+x
+$ getdel note
+nil
+$ gets nover
+nil
+$ cas nover 5 a
+0
+$ get nover
+nil
+$ cad nover 0
+0
+$ cas nover -1 a
+error 4: expect version
+$ cas cpu 0 a
+error 3: expect string
+$ gets cpu
+error 3: expect string
+$ ratelimit rl 2 1 60000
+array length: 3
+1
+1
+-1
+array end
+$ ratelimit rl 2 1 60000
+array length: 3
+1
+0
+-1
+array end
+$ ratelimit rl2 2 1 60000 3
+array length: 3
+0
+2
+-1
+array end
+$ ratelimit rl 0 1 60000
+error 4: expect positive values
+$ ratelimit cpu 2 1 60000
+error 3: expect rate limit
 '''
 
+# Lists across many 4 KB quicklist chunks: a chunk filled from one side and then pushed on
+# the other, so it re-centers its items; items of up to more than a chunk pushed at both ends;
+# pops that empty the head chunks; then trims and pops across chunk boundaries. The expected
+# replies come from a deque.
+def list_chunk_cases():
+    from collections import deque
+    ref, lines, n = deque(), [], [0]
+    sizes = [1, 40, 600, 1500, 5000]
+
+    def items(count, size=None):
+        out = []
+        for _ in range(count):
+            out.append(f'i{n[0]}-' + 'x' * (size or sizes[n[0] % len(sizes)]))
+            n[0] += 1
+        return out
+
+    def arr(vals):
+        return [f'array length: {len(vals)}', *vals, 'array end']
+
+    def push(cmd, vals):
+        for val in vals:
+            if cmd == 'lpush': ref.appendleft(val)
+            else: ref.append(val)
+        lines.extend([f'$ {cmd} qbig ' + ' '.join(vals), str(len(ref))])
+
+    def pop(cmd, count):
+        vals = [ref.popleft() if cmd == 'lpop' else ref.pop() for _ in range(min(count, len(ref)))]
+        lines.extend([f'$ {cmd} qbig {count}', *arr(vals)])
+
+    def check():
+        lines.extend(['$ llen qbig', str(len(ref)), '$ lrange qbig 0 -1', *arr(list(ref))])
+
+    push('rpush', items(6, 600))    # one chunk with its free bytes at the back
+    push('lpush', items(2, 40))     # no room at the front: the items move to the middle
+    push('rpush', items(2, 40))
+    check()
+    push('rpush', items(40))
+    push('lpush', items(40))
+    check()
+    lines.extend(['$ lrange qbig 13 57', *arr(list(ref)[13:58])])
+    lines.extend(['$ lrange qbig -30 -3', *arr(list(ref)[-30:-2])])
+    pop('lpop', 25)
+    push('rpush', items(12))
+    push('lpush', items(12))
+    check()
+    lines.extend(['$ ltrim qbig 9 -12', 'nil'])
+    ref = deque(list(ref)[9:-11])
+    check()
+    pop('rpop', 17)
+    pop('lpop', 9)
+    check()
+    pop('lpop', 1000)
+    lines.extend(['$ llen qbig', '0'])
+    return '\n'.join(lines) + '\n'
+
+CASES += list_chunk_cases()
+
+# A sorted set grown past k_zset_pack_max_len (64) members leaves the packed encoding for the
+# AVL tree, and so does a small one given a name over k_zset_pack_max_name (64) bytes; ranks,
+# ranges and scores read the same before and after, and after shrinking below the limit again
+def zset_pack_cases():
+    lines, ref = [], {}
+
+    def order():
+        return sorted(ref, key=lambda m: (ref[m], m))
+
+    def add(pairs):
+        fresh = sum(1 for _, m in pairs if m not in ref)
+        ref.update({m: sc for sc, m in pairs})
+        lines.extend(['$ zadd zpk ' + ' '.join(f'{sc:g} {m}' for sc, m in pairs), str(fresh)])
+
+    def check(members):
+        ranked = order()
+        for m in members:
+            lines.extend([f'$ zrank zpk {m}', str(ranked.index(m)), f'$ zscore zpk {m}', f'{ref[m]:g}'])
+        for start, stop in ((0, 2), (len(ranked) - 3, len(ranked) - 1)):
+            window = [x for m in ranked[start:stop + 1] for x in (m, f'{ref[m]:g}')]
+            lines.extend([f'$ zrange zpk {start} {stop}', f'array length: {len(window)}', *window, 'array end'])
+        lines.extend(['$ zcount zpk -inf +inf', str(len(ref))])
+
+    add([(i * 2, f'm{i:02d}') for i in range(64)])      # exactly at the limit: still packed
+    check(['m00', 'm31', 'm63'])
+    add([(61, 'm64')])                                   # the 65th member: AVL from here on
+    check(['m00', 'm30', 'm31', 'm63', 'm64'])
+    add([(-1, 'm63'), (200, 'm00')])                     # updates move members across the set
+    check(['m00', 'm63', 'm64'])
+    for i in range(10, 20):
+        lines.extend([f'$ zrem zpk m{i:02d}', '1'])
+        del ref[f'm{i:02d}']
+    check(['m00', 'm20', 'm63', 'm64'])                 # back under the limit, still right
+
+    long_name = 'n' * 65
+    lines.extend(['$ zadd zpl 1 a 3 c', '2', f'$ zadd zpl 2 {long_name}', '1',
+                  '$ zrange zpl 0 -1', 'array length: 6', 'a', '1', long_name, '2', 'c', '3', 'array end',
+                  f'$ zrank zpl {long_name}', '1', '$ zscore zpl c', '3'])
+    return '\n'.join(lines) + '\n'
+
+CASES += zset_pack_cases()
+
 # Parse commands and expected outputs
 cmds, outputs = [], []
 for x in CASES.splitlines():
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <vector>
 #include <map>
+#include <stdio.h>
 #include "../src/storage/heap.cpp"
 
 
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Test HyperLogLogs past the sparse limit: dense count accuracy, and PFMERGE/multi-key PFCOUNT
+over dense inputs matching one HLL that holds every element."""
+
+import socket
+import struct
+import sys
+
+def connect():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.connect(('127.0.0.1', 8080))
+    return sock
+
+def frame(*args):
+    """Encode one request frame."""
+    payload = struct.pack('<I', len(args))
+    for arg in args:
+        arg_bytes = str(arg).encode('utf-8')
+        payload += struct.pack('<I', len(arg_bytes))
+        payload += arg_bytes
+    return struct.pack('<I', len(payload)) + payload
+
+def send_request(sock, *args):
+    """Send a request to the server."""
+    sock.sendall(frame(*args))
+
+def recv_exact(sock, n):
+    data = b''
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise EOFError("connection closed")
+        data += chunk
+    return data
+
+def parse(data, pos):
+    """Decode one serialized value: nil, error, string, int, double or array."""
+    tag = data[pos]
+    pos += 1
+    if tag == 0:
+        return None, pos
+    if tag == 1:
+        code, length = struct.unpack_from('<II', data, pos)
+        pos += 8
+        return ('error', code), pos + length
+    if tag == 2:
+        length = struct.unpack_from('<I', data, pos)[0]
+        pos += 4
+        return data[pos:pos + length].decode(), pos + length
+    if tag == 3:
+        return struct.unpack_from('<q', data, pos)[0], pos + 8
+    if tag == 4:
+        return struct.unpack_from('<d', data, pos)[0], pos + 8
+    if tag == 6:
+        count = struct.unpack_from('<I', data, pos)[0]
+        pos += 4
+        items = []
+        for _ in range(count):
+            item, pos = parse(data, pos)
+            items.append(item)
+        return items, pos
+    raise ValueError(f"unexpected tag {tag}")
+
+def recv_response(sock):
+    length = struct.unpack('<I', recv_exact(sock, 4))[0]
+    value, _ = parse(recv_exact(sock, length), 0)
+    return value
+
+def call(sock, *args):
+    send_request(sock, *args)
+    return recv_response(sock)
+
+def pfadd_all(sock, key, elems, batch=10000):
+    for i in range(0, len(elems), batch):
+        call(sock, 'pfadd', key, *elems[i:i + batch])
+
+def test_hll():
+    sock = connect()
+    keys = ('hll:big', 'hll:a', 'hll:b', 'hll:c', 'hll:small', 'hll:all', 'hll:merged')
+    for key in keys:
+        call(sock, 'del', key)
+
+    # Far past the sparse limit: dense registers, most of them straddling a byte boundary
+    n = 100000
+    pfadd_all(sock, 'hll:big', [f'user:{i}' for i in range(n)])
+    count = call(sock, 'pfcount', 'hll:big')
+    assert abs(count - n) <= n * 0.02, count
+    assert call(sock, 'pfadd', 'hll:big', 'user:17') == 0   # already counted, no register moves
+
+    # Overlapping dense inputs plus a sparse one, against one HLL holding every element
+    parts = {
+        'hll:a': [f'item:{i}' for i in range(0, 40000)],
+        'hll:b': [f'item:{i}' for i in range(30000, 70000)],
+        'hll:c': [f'item:{i}' for i in range(60000, 100000)],
+        'hll:small': [f'item:{i}' for i in range(200000, 200100)],
+    }
+    for key, elems in parts.items():
+        pfadd_all(sock, key, elems)
+        pfadd_all(sock, 'hll:all', elems)
+    union = call(sock, 'pfcount', 'hll:all')
+    assert abs(union - 100100) <= 100100 * 0.02, union
+    assert call(sock, 'pfcount', *parts.keys()) == union
+
+    assert call(sock, 'pfmerge', 'hll:merged', *parts.keys()) is None
+    assert call(sock, 'pfcount', 'hll:merged') == union
+    # Merging into a dense destination that already holds some of them changes nothing
+    assert call(sock, 'pfmerge', 'hll:a', 'hll:b', 'hll:c', 'hll:small') is None
+    assert call(sock, 'pfcount', 'hll:a') == union
+
+    for key in keys:
+        call(sock, 'del', key)
+    sock.close()
+    print("✅ HyperLogLog test passed.")
+
+if __name__ == '__main__':
+    try:
+        test_hll()
+    except Exception as e:
+        print(f"❌ HyperLogLog test failed: {e!r}")
+        sys.exit(1)
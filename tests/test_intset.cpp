@@ -0,0 +1,252 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm> // std::set_intersection
+#include <iterator>  // std::back_inserter
+#include <set>       // std::set
+#include <vector>
+#include "../src/storage/intset.h"
+#include "../src/core/constants.h"
+
+
+// A random value that needs `width` bytes (2, 4 or 8)
+static int64_t rand_val(uint32_t width) {
+    int64_t val = 0;
+    if (width == 2) { val = rand() % 30000; }
+    else if (width == 4) { val = 40000 + rand() % 2000000000; }
+    else { val = ((int64_t)rand() << 32) + rand() + (1ll << 40); }
+    return rand() % 2 ? val : -val;
+}
+
+// A reference set of `n` values, `wide_every` of them (if not 0) 4 or 8 bytes wide
+static std::set<int64_t> rand_ref(size_t n, uint32_t width, uint32_t wide_every) {
+    std::set<int64_t> ref;
+    while (ref.size() < n) {
+        uint32_t w = wide_every && ref.size() % wide_every == 0 ? (rand() % 2 ? 4 : 8) : width;
+        ref.insert(rand_val(w));
+    }
+    return ref;
+}
+
+static void verify(const IntSet *set, const std::set<int64_t> &ref) {
+    assert(intset_len(set) == ref.size());
+    uint32_t i = 0;
+    for (int64_t val : ref) {
+        assert(intset_get(set, i) == val);
+        uint32_t pos = 0;
+        assert(intset_find(set, val, &pos) && pos == i);
+        i++;
+    }
+}
+
+static IntSet *build(const std::set<int64_t> &ref) {
+    IntSet *set = NULL;
+    for (int64_t val : ref) {
+        bool added = false;
+        set = intset_insert(set, val, &added);
+        assert(added);
+    }
+    verify(set, ref);
+    return set;
+}
+
+static std::vector<int64_t> ref_intersect(const std::set<int64_t> &a, const std::set<int64_t> &b) {
+    std::vector<int64_t> out;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+    return out;
+}
+
+// b shares about half of a's members, so both the matches and the misses are exercised
+static std::set<int64_t> overlapping(const std::set<int64_t> &a, size_t n, uint32_t width) {
+    std::set<int64_t> b;
+    for (int64_t val : a) {
+        if (b.size() < n / 2 && rand() % 2) { b.insert(val); }
+    }
+    while (b.size() < n) { b.insert(rand_val(width)); }
+    return b;
+}
+
+// Intersections of every kernel: vector (same width), scalar merge (mixed) and galloping (ratio)
+static void test_intersect(size_t na, size_t nb, uint32_t wa, uint32_t wb, uint32_t wide_every) {
+    std::set<int64_t> ra = rand_ref(na, wa, wide_every);
+    std::set<int64_t> rb = overlapping(ra, nb, wb);
+    IntSet *a = build(ra), *b = build(rb);
+
+    std::vector<int64_t> want = ref_intersect(ra, rb);
+    std::vector<int64_t> got;
+    intset_intersect(a, b, got);
+    assert(got == want);
+    got.clear();
+    intset_intersect(b, a, got);
+    assert(got == want);
+
+    std::vector<int64_t> vals(ra.begin(), ra.end());
+    intset_filter(vals, b);
+    assert(vals == want);
+
+    free(a);
+    free(b);
+}
+
+// Batched sorted merges match one insert at a time, including the widening steps
+static void test_add_sorted(size_t n, uint32_t batch) {
+    std::set<int64_t> ref;
+    IntSet *bulk = NULL, *single = NULL;
+    uint32_t width = 2;
+    while (ref.size() < n) {
+        std::set<int64_t> fresh;
+        while (fresh.size() < batch) {
+            int64_t val = rand_val(width);
+            if (!ref.count(val)) { fresh.insert(val); }
+        }
+        std::vector<int64_t> vals(fresh.begin(), fresh.end());
+        bulk = intset_add_sorted(bulk, vals.data(), vals.size());
+        for (int64_t val : vals) {
+            bool added = false;
+            single = intset_insert(single, val, &added);
+            assert(added);
+        }
+        ref.insert(fresh.begin(), fresh.end());
+        verify(bulk, ref);
+        verify(single, ref);
+        if (width < 8 && rand() % 3 == 0) { width *= 2; }
+    }
+    free(bulk);
+    free(single);
+}
+
+// Widening from 4 to 8 bytes at either end, then removing back down to empty
+static void test_upgrade() {
+    std::set<int64_t> ref = rand_ref(100, 4, 0);
+    IntSet *set = build(ref);
+    for (int64_t val : {(int64_t)1 << 40, -((int64_t)1 << 50), (int64_t)INT32_MAX + 1, (int64_t)INT32_MIN - 1}) {
+        bool added = false;
+        set = intset_insert(set, val, &added);
+        assert(added);
+        ref.insert(val);
+        verify(set, ref);
+    }
+    while (!ref.empty()) {
+        int64_t val = *ref.begin();
+        bool removed = false;
+        set = intset_remove(set, val, &removed);
+        assert(removed);
+        ref.erase(val);
+        verify(set, ref);
+    }
+    assert(set == NULL);
+}
+
+static void chain_verify(const IntChain *chain, const std::set<int64_t> &ref) {
+    assert(intchain_len(chain) == ref.size());
+    size_t total = 0;
+    for (size_t c = 0; c < chain->chunks.size(); ++c) {
+        const IntSet *chunk = chain->chunks[c];
+        assert(intset_len(chunk) > 0 && intset_len(chunk) <= k_set_intset_chunk_len);
+        if (c > 0) {
+            const IntSet *prev = chain->chunks[c - 1];
+            assert(intset_get(prev, intset_len(prev) - 1) < intset_get(chunk, 0));
+        }
+        total += intset_len(chunk);
+    }
+    assert(total == ref.size());
+
+    std::vector<int64_t> vals;
+    intchain_values(chain, vals);
+    assert(vals == std::vector<int64_t>(ref.begin(), ref.end()));
+}
+
+// Chains past several chunks, built one at a time or in sorted batches, then drained
+static void test_chain(size_t n, uint32_t batch) {
+    IntChain chain;
+    std::set<int64_t> ref;
+    while (ref.size() < n) {
+        std::set<int64_t> fresh;
+        while (fresh.size() < batch) {
+            int64_t val = rand_val(rand() % 8 ? 4 : 8);
+            if (!ref.count(val)) { fresh.insert(val); }
+        }
+        if (batch == 1) {
+            assert(intchain_insert(&chain, *fresh.begin()));
+            assert(!intchain_insert(&chain, *fresh.begin()));
+        }
+        else {
+            std::vector<int64_t> vals(fresh.begin(), fresh.end());
+            intchain_add_sorted(&chain, vals.data(), vals.size());
+        }
+        ref.insert(fresh.begin(), fresh.end());
+    }
+    chain_verify(&chain, ref);
+    for (int64_t val : ref) { assert(intchain_find(&chain, val)); }
+    for (int i = 0; i < 1000; ++i) {
+        int64_t val = rand_val(4);
+        assert(intchain_find(&chain, val) == (ref.count(val) > 0));
+    }
+    size_t chunks = chain.chunks.size();
+
+    // Removing most members folds the thin chunks together
+    std::vector<int64_t> order(ref.begin(), ref.end());
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i % 10 == 0) { continue; }
+        assert(intchain_remove(&chain, order[i]));
+        ref.erase(order[i]);
+    }
+    assert(!intchain_remove(&chain, order[1]));
+    chain_verify(&chain, ref);
+    assert(chain.chunks.size() < chunks);
+
+    intchain_clear(&chain);
+    assert(intchain_len(&chain) == 0 && chain.chunks.empty());
+}
+
+// Chain intersections of similar and very different sizes match the reference
+static void test_chain_intersect(size_t na, size_t nb) {
+    std::set<int64_t> ra = rand_ref(na, 4, 0);
+    std::set<int64_t> rb = overlapping(ra, nb, 4);
+    IntChain a, b;
+    std::vector<int64_t> va(ra.begin(), ra.end()), vb(rb.begin(), rb.end());
+    intchain_add_sorted(&a, va.data(), va.size());
+    intchain_add_sorted(&b, vb.data(), vb.size());
+    chain_verify(&a, ra);
+    chain_verify(&b, rb);
+
+    std::vector<int64_t> want = ref_intersect(ra, rb);
+    std::vector<int64_t> got;
+    intchain_intersect(&a, &b, got);
+    assert(got == want);
+    got.clear();
+    intchain_intersect(&b, &a, got);
+    assert(got == want);
+
+    intchain_filter(va, &b);
+    assert(va == want);
+
+    intchain_clear(&a);
+    intchain_clear(&b);
+}
+
+int main() {
+    srand(1);
+    for (uint32_t width : {2u, 4u, 8u}) {
+        for (size_t n : {1u, 7u, 8u, 9u, 64u, 1000u}) {
+            test_intersect(n, n, width, width, 0);      // same width: vector blocks
+            test_intersect(n, n + 3, width, width, 0);
+        }
+        test_intersect(20, 20 * 40, width, width, 0);   // over k_gallop_ratio: galloping
+        test_intersect(5000, 100, width, width, 0);
+    }
+    test_intersect(500, 500, 2, 4, 0);                  // mixed widths: scalar merge
+    test_intersect(500, 500, 4, 8, 0);
+    test_intersect(2000, 2000, 2, 2, 7);                // a few wide members in each
+    test_intersect(40, 4000, 2, 8, 0);
+
+    for (uint32_t batch : {1u, 16u, 100u}) { test_add_sorted(3000, batch); }
+    test_upgrade();
+
+    for (uint32_t batch : {1u, 1000u, 30000u}) { test_chain(100000, batch); }
+    test_chain_intersect(100000, 100000);
+    test_chain_intersect(1000, 200000);
+    test_chain_intersect(200000, 50);
+    printf("✅ Intset tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Test threaded I/O (server started with --io-threads): many connections pipelining at once
+keep their replies in request order, including frames split across writes and malformed ones."""
+
+import socket
+import struct
+import time
+import sys
+
+def connect():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.connect(('127.0.0.1', 8080))
+    return sock
+
+def frame(*args):
+    """Encode one request frame."""
+    payload = struct.pack('<I', len(args))
+    for arg in args:
+        arg_bytes = str(arg).encode('utf-8')
+        payload += struct.pack('<I', len(arg_bytes))
+        payload += arg_bytes
+    return struct.pack('<I', len(payload)) + payload
+
+def send_request(sock, *args):
+    """Send a request to the server."""
+    sock.sendall(frame(*args))
+
+def recv_exact(sock, n):
+    data = b''
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise EOFError("connection closed")
+        data += chunk
+    return data
+
+def parse(data, pos):
+    """Decode one serialized value: nil, error, string, int, double or array."""
+    tag = data[pos]
+    pos += 1
+    if tag == 0:
+        return None, pos
+    if tag == 1:
+        code, length = struct.unpack_from('<II', data, pos)
+        pos += 8
+        return ('error', code), pos + length
+    if tag == 2:
+        length = struct.unpack_from('<I', data, pos)[0]
+        pos += 4
+        return data[pos:pos + length].decode(), pos + length
+    if tag == 3:
+        return struct.unpack_from('<q', data, pos)[0], pos + 8
+    if tag == 4:
+        return struct.unpack_from('<d', data, pos)[0], pos + 8
+    if tag == 6:
+        count = struct.unpack_from('<I', data, pos)[0]
+        pos += 4
+        items = []
+        for _ in range(count):
+            item, pos = parse(data, pos)
+            items.append(item)
+        return items, pos
+    raise ValueError(f"unexpected tag {tag}")
+
+def recv_response(sock):
+    length = struct.unpack('<I', recv_exact(sock, 4))[0]
+    value, _ = parse(recv_exact(sock, length), 0)
+    return value
+
+def call(sock, *args):
+    send_request(sock, *args)
+    return recv_response(sock)
+
+def test_io_threads():
+    n_conns, n_reqs = 48, 200
+    socks = [connect() for _ in range(n_conns)]
+    ctl = connect()
+    call(ctl, 'del', 'io:hits')
+
+    # Every connection pipelines its whole batch, sent in odd-sized pieces so frames are split
+    expected = []
+    for c, sock in enumerate(socks):
+        data, want = b'', []
+        for r in range(n_reqs):
+            key = f'io:{c}:{r % 7}'
+            data += frame('set', key, f'{c}-{r}')
+            want.append(None)
+            data += frame('get', key)
+            want.append(f'{c}-{r}')
+            data += frame('incr', 'io:hits')
+            want.append(None)
+        # a malformed frame (argument longer than the payload) answers an error in its place
+        data += struct.pack('<I', 8) + struct.pack('<II', 1, 100)
+        want.append(('error', 4))
+        data += frame('get', f'io:{c}:0')
+        want.append(f'{c}-{(n_reqs - 1) // 7 * 7}')
+        expected.append((data, want))
+
+    for piece in range(0, max(len(d) for d, _ in expected), 997):
+        for sock, (data, _) in zip(socks, expected):
+            if piece < len(data):
+                sock.sendall(data[piece:piece + 997])
+
+    for c, (sock, (_, want)) in enumerate(zip(socks, expected)):
+        for i, value in enumerate(want):
+            got = recv_response(sock)
+            if value is not None:
+                assert got == value, f"conn {c} reply {i}: {got!r} != {value!r}"
+
+    # The increments from all connections ran one at a time
+    assert call(ctl, 'get', 'io:hits') == str(n_conns * n_reqs)
+
+    for sock in socks + [ctl]:
+        sock.close()
+    print("✅ I/O threads test passed.")
+
+if __name__ == '__main__':
+    try:
+        test_io_threads()
+    except Exception as e:
+        print(f"❌ I/O threads test failed: {e!r}")
+        sys.exit(1)
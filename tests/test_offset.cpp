@@ -58,6 +58,7 @@ static void test_case(uint32_t sz) {
     for (uint32_t i = 0; i < sz; ++i) {
         AVLNode *node = avl_offset(min, (int64_t)i);
         assert(container_of(node, Data, node)->val == i);
+        assert(avl_rank(node) == (int64_t)i);
 
         for (uint32_t j = 0; j < sz; ++j) {
             int64_t offset = (int64_t)j - (int64_t)i;
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+#include "core/thread_pool.h"
+
+
+static std::atomic<uint64_t> g_sum{0};
+
+static void add_work(void *arg) {
+    g_sum.fetch_add((uint64_t)(uintptr_t)arg);
+}
+
+// Fire-and-forget work from the submitting thread, more than a deque holds
+static void test_queue() {
+    TheadPool tp;
+    thread_pool_init(&tp, 4);
+    g_sum = 0;
+    uint64_t n = 20000, want = 0;
+    for (uint64_t i = 1; i <= n; ++i) {
+        thread_pool_queue(&tp, &add_work, (void *)(uintptr_t)i, (uint8_t)(i % WORK_PRIO_COUNT));
+        want += i;
+    }
+    thread_pool_stop(&tp);
+    assert(g_sum == want);
+}
+
+// Work that submits more work lands on the worker's own deque and is stolen by the others
+struct Spawn {
+    TheadPool *tp = NULL;
+    uint32_t depth = 0;
+};
+
+static void spawn_work(void *arg) {
+    Spawn *s = (Spawn *)arg;
+    g_sum.fetch_add(1);
+    if (s->depth > 0) {
+        for (int i = 0; i < 2; ++i) {
+            Spawn *kid = new Spawn();
+            kid->tp = s->tp;
+            kid->depth = s->depth - 1;
+            thread_pool_queue(s->tp, &spawn_work, kid);
+        }
+    }
+    delete s;
+}
+
+static void test_nested() {
+    TheadPool tp;
+    thread_pool_init(&tp, 3);
+    g_sum = 0;
+    Spawn *root = new Spawn();
+    root->tp = &tp;
+    root->depth = 14;
+    thread_pool_queue(&tp, &spawn_work, root);
+
+    // stop only after every level was spawned, a full tree has 2^15 - 1 nodes
+    while (g_sum.load() < (1u << 15) - 1) {}
+    thread_pool_stop(&tp);
+    assert(g_sum == (1u << 15) - 1);
+}
+
+// Results come back on the submitting thread through the eventfd
+struct Square {
+    Work work;
+    uint64_t in = 0;
+    uint64_t out = 0;
+    bool done = false;
+};
+
+static void square_work(void *arg) {
+    Square *sq = (Square *)arg;
+    sq->out = sq->in * sq->in;
+}
+
+static void square_done(void *arg) {
+    Square *sq = (Square *)arg;
+    assert(sq->out == sq->in * sq->in);
+    sq->done = true;
+}
+
+static void test_complete() {
+    TheadPool tp;
+    thread_pool_init(&tp, 4);
+    std::vector<Square> squares(5000);
+    for (size_t i = 0; i < squares.size(); ++i) {
+        Square &sq = squares[i];
+        sq.in = i;
+        sq.work.f = &square_work;
+        sq.work.done = &square_done;
+        sq.work.arg = &sq;
+        sq.work.prio = i % 2 ? WORK_PRIO_HIGH : WORK_PRIO_LOW;
+        thread_pool_submit(&tp, &sq.work);
+    }
+
+    size_t finished = 0;
+    while (finished < squares.size()) {
+        struct pollfd pfd = {tp.event_fd, POLLIN, 0};
+        int rv = poll(&pfd, 1, 1000);
+        assert(rv == 1);
+        finished += thread_pool_complete(&tp);
+    }
+    for (Square &sq : squares) { assert(sq.done); }
+    thread_pool_stop(&tp);
+}
+
+// Queued high priority work is taken before low priority work
+static std::atomic<bool> g_gate{false};
+static std::vector<int> g_order;
+
+static void gate_work(void *) {
+    while (!g_gate.load()) {}
+}
+
+static void order_work(void *arg) {
+    g_order.push_back((int)(uintptr_t)arg);
+}
+
+static void test_priority() {
+    TheadPool tp;
+    thread_pool_init(&tp, 1);
+    g_gate = false;
+    g_order.clear();
+    thread_pool_queue(&tp, &gate_work, NULL);
+    // let the worker pick up the gate before queueing the rest
+    while (tp.queued.load() != 0) {}
+    for (int i = 0; i < 10; ++i) { thread_pool_queue(&tp, &order_work, (void *)(uintptr_t)WORK_PRIO_LOW, WORK_PRIO_LOW); }
+    for (int i = 0; i < 10; ++i) { thread_pool_queue(&tp, &order_work, (void *)(uintptr_t)WORK_PRIO_HIGH, WORK_PRIO_HIGH); }
+    g_gate = true;
+    thread_pool_stop(&tp);
+
+    assert(g_order.size() == 20);
+    for (size_t i = 0; i < 20; ++i) { assert(g_order[i] == (i < 10 ? WORK_PRIO_HIGH : WORK_PRIO_LOW)); }
+}
+
+int main() {
+    for (int round = 0; round < 20; ++round) {
+        test_queue();
+        test_nested();
+        test_complete();
+        test_priority();
+    }
+    printf("✅ Thread pool tests passed.\n");
+    return 0;
+}
@@ -44,6 +44,28 @@ def main():
         raise SystemExit(f"Expected 0 or -2 after expiry, got {lines[0]}")
     expect(lines[1], "nil")
 
+    # Member deadlines inside a sorted set
+    out, err, rc = run_client(["del ttl_zset", "zadd ttl_zset 1 a 2 b 3 c",
+                               "zpexpire ttl_zset a 200", "zpexpire ttl_zset b 200", "zpttl ttl_zset c"])
+    lines = [l for l in out.splitlines() if l.strip()]
+    expect(lines[1], "3")
+    expect(lines[2], "1")
+    expect(lines[4], "-1")
+
+    # Expired members are gone from reads, the rest stays
+    time.sleep(0.4)
+    out, err, rc = run_client(["zcount ttl_zset -inf +inf", "zscore ttl_zset a", "zrank ttl_zset c"])
+    lines = [l for l in out.splitlines() if l.strip()]
+    expect(lines[0], "1")
+    expect(lines[1], "nil")
+    expect(lines[2], "0")
+
+    # The active sweep deletes a set emptied by expiry
+    out, err, rc = run_client(["zpexpire ttl_zset c 100"])
+    time.sleep(0.3)
+    out, err, rc = run_client(["pttl ttl_zset"])
+    expect(out, "-2")
+
     print("✅ TTL test passed.")
 
 if __name__ == "__main__":